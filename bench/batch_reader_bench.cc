@@ -0,0 +1,75 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <snap/collector/batch_reader.h>
+#include <snap/collector/procfs.h>
+
+#include "bench.h"
+
+using Plugin::BatchReader;
+using Plugin::FileReader;
+
+/**
+ * Reads 10k small files, each kept open, with a FileReader per file, and
+ * with BatchReader through pread and through io_uring.
+ */
+
+static const int kFiles = 10000;
+
+int main(int argc, char** argv) {
+  char tmpl[] = "/tmp/batch_reader_bench.XXXXXX";
+  std::string dir = mkdtemp(tmpl);
+  std::vector<std::string> paths;
+  for (int i = 0; i < kFiles; i++) {
+    paths.push_back(dir + "/cpu.stat." + std::to_string(i));
+    std::ofstream(paths.back()) << "usage_usec " << i * 1000 << "\n"
+                                << "user_usec " << i * 700 << "\n"
+                                << "system_usec " << i * 300 << "\n";
+  }
+
+  std::vector<std::unique_ptr<FileReader>> readers;
+  for (const std::string& path : paths) {
+    readers.emplace_back(new FileReader(path));
+  }
+  Bench::run("FileReader, 10k files", 20, kFiles, "files", [&](int) {
+    for (auto& reader : readers) reader->read();
+  });
+  readers.clear();
+
+  for (bool io_uring : {false, true}) {
+    BatchReader::Options opts;
+    opts.use_io_uring = io_uring;
+    BatchReader reader(opts);
+    for (const std::string& path : paths) reader.add(path);
+    if (io_uring && !reader.uses_io_uring()) {
+      std::printf("io_uring unavailable\n");
+      continue;
+    }
+    Bench::run(io_uring ? "BatchReader io_uring, 10k files" :
+                          "BatchReader pread, 10k files", 20, kFiles, "files",
+               [&](int) { reader.read_all(); });
+  }
+
+  for (const std::string& path : paths) unlink(path.c_str());
+  rmdir(dir.c_str());
+  return 0;
+}
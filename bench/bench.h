@@ -0,0 +1,42 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+namespace Bench {
+
+/**
+ * run calls fn(iteration) iterations times and prints the rate of items per
+ * second, where each call handles items_per_call items.
+ */
+template<typename F>
+double run(const std::string& name, int iterations, double items_per_call,
+           const char* unit, F fn) {
+  // one untimed call to warm up caches and buffers
+  fn(0);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 1; i <= iterations; i++) {
+    fn(i);
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  double rate = iterations * items_per_call / elapsed.count();
+  std::printf("%-40s %14.0f %s/sec\n", name.c_str(), rate, unit);
+  return rate;
+}
+
+}  // namespace Bench
@@ -0,0 +1,84 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <zlib.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <snap/metric.h>
+#include <snap/rpc/plugin.pb.h>
+
+#include "bench.h"
+
+using Plugin::Metric;
+
+/**
+ * Serializes metric replies of 10, 100 and 1000 namespace-heavy metrics and
+ * deflates them at zlib levels 1, 6 (what gRPC uses for deflate and gzip)
+ * and 9, reporting input bytes per second and the compressed size, to weigh
+ * the CPU spent against the bytes saved and pick Meta::compression_threshold.
+ */
+
+static const int kMetrics = 200000;
+
+static size_t deflate_into(const std::string& in, int level,
+                           std::vector<unsigned char>& out) {
+  z_stream zs = z_stream();
+  deflateInit(&zs, level);
+  out.resize(deflateBound(&zs, in.size()));
+  zs.next_in = (Bytef*)in.data();
+  zs.avail_in = uInt(in.size());
+  zs.next_out = out.data();
+  zs.avail_out = uInt(out.size());
+  deflate(&zs, Z_FINISH);
+  size_t n = zs.total_out;
+  deflateEnd(&zs);
+  return n;
+}
+
+int main(int argc, char** argv) {
+  const int batches[] = {10, 100, 1000};
+  const int levels[] = {1, 6, 9};
+  for (int batch : batches) {
+    rpc::MetricsReply reply;
+    for (int i = 0; i < batch; i++) {
+      Metric met({{"intel", "", ""}, {"procfs", "", ""}, {"disk", "", ""},
+                  {"sd" + std::to_string(i % 26), "", ""},
+                  {i % 2 ? "octets_read" : "octets_written", "", ""}},
+                 "B", "");
+      met.add_tag({"plugin_running_on", "node1.example.com"});
+      met.set_data(uint64_t(i) * 1000003);
+      met.set_timestamp();
+      *reply.add_metrics() = *met.get_rpc_metric_ptr();
+    }
+    std::string raw;
+    reply.SerializeToString(&raw);
+    int calls = kMetrics / batch;
+
+    std::string name = std::to_string(batch) + " metrics: ";
+    Bench::run(name + "serialize", calls, raw.size(), "bytes", [&](int) {
+      raw.clear();
+      reply.SerializeToString(&raw);
+    });
+    std::vector<unsigned char> out;
+    for (int level : levels) {
+      size_t n = 0;
+      Bench::run(name + "deflate " + std::to_string(level), calls, raw.size(),
+                 "bytes", [&](int) { n = deflate_into(raw, level, out); });
+      std::printf("%-40s %14zu -> %zu bytes\n", "", raw.size(), n);
+    }
+  }
+  return 0;
+}
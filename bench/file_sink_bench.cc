@@ -0,0 +1,126 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <snap/config.h>
+#include <snap/metric.h>
+#include <snap/publisher/file_sink.h>
+#include <snap/publisher/text_buffer.h>
+
+#include "bench.h"
+
+using std::chrono::system_clock;
+using Plugin::Config;
+using Plugin::FileSink;
+using Plugin::Metric;
+using Plugin::TextBuffer;
+
+/**
+ * Compares the pattern of examples/publisher/src/log.cc before FileSink (an
+ * ofstream opened per call, strftime and operator<< per metric) with the same
+ * line format written through FileSink.
+ */
+
+static const int kBatch = 1000;
+static const int kCalls = 200;
+
+static void publish_ofstream(std::vector<Metric>& metrics,
+                             const Config& config) {
+  std::ofstream outfile;
+  outfile.open(config.get_string("path"), std::ios::app);
+  for (Metric& met : metrics) {
+    std::time_t c_ts = system_clock::to_time_t(met.timestamp());
+    char str_time_b[50];
+    if (std::strftime(str_time_b, sizeof(str_time_b),
+                      "%F %T", std::gmtime(&c_ts))) {
+      outfile << str_time_b << " ";
+    }
+    for (Metric::NamespaceElement nse : met.ns()) {
+      outfile << "/" << nse.value;
+    }
+    outfile << " tags: [";
+    std::map<std::string, std::string> tags = met.tags();
+    int idx = 1;
+    for (auto it = tags.begin(); it != tags.end(); it++, idx++) {
+      outfile << it->first;
+      if (idx != int(tags.size())) outfile << ", ";
+    }
+    outfile << "] " << "data: " << met.get_float64_data() << "\n";
+  }
+}
+
+static void format_sink(std::vector<Metric>& metrics, TextBuffer& out) {
+  for (Metric& met : metrics) {
+    const rpc::Metric* rpc_met = met.get_rpc_metric_ptr();
+    out.append_utc_time(met.timestamp());
+    out.append(' ');
+    for (const rpc::NamespaceElement& nse : rpc_met->namespace_()) {
+      out.append('/');
+      out.append(nse.value());
+    }
+    out.append(" tags: [", 8);
+    bool first = true;
+    for (const auto& tag : rpc_met->tags()) {
+      if (!first) out.append(", ", 2);
+      out.append(tag.first);
+      first = false;
+    }
+    out.append("] data: ", 8);
+    out.append_double(met.get_float64_data());
+    out.append('\n');
+  }
+}
+
+int main(int argc, char** argv) {
+  char tmpl[] = "/tmp/file_sink_bench.XXXXXX";
+  close(mkstemp(tmpl));
+  rpc::ConfigMap map;
+  (*map.mutable_stringmap())["path"] = tmpl;
+  Config config(map);
+
+  std::vector<Metric> metrics;
+  metrics.reserve(kBatch);
+  for (int i = 0; i < kBatch; i++) {
+    metrics.emplace_back(Metric({{"intel", "", ""}, {"cpp", "", ""},
+                                 {"mock", "", ""}, {"host" + std::to_string(i % 50), "", ""},
+                                 {"load", "", ""}}, "", ""));
+    metrics.back().add_tag({"plugin_running_on", "node1"});
+    metrics.back().add_tag({"rack", "r" + std::to_string(i % 8)});
+    metrics.back().set_data(i * 0.37);
+    metrics.back().set_timestamp();
+  }
+
+  Bench::run("log: ofstream per call", kCalls, kBatch, "metrics",
+             [&](int) { publish_ofstream(metrics, config); });
+
+  FileSink::Options opts;
+  FileSink sink(opts);
+  Bench::run("log: FileSink", kCalls, kBatch, "metrics", [&](int) {
+    sink.write(config, "path", [&](TextBuffer& out) {
+      format_sink(metrics, out);
+    });
+  });
+  sink.flush();
+
+  unlink(tmpl);
+  return 0;
+}
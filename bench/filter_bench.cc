@@ -0,0 +1,76 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <regex>
+#include <string>
+#include <vector>
+
+#include <snap/metric.h>
+#include <snap/processor/filter.h>
+
+#include "bench.h"
+
+using Plugin::Metric;
+using Plugin::MetricFilter;
+
+/**
+ * Compares MetricFilter with matching a list of std::regex against the
+ * joined namespace, on 10000 procfs-like metrics and 20 rules.
+ */
+
+static const int kMetrics = 10000;
+
+int main(int argc, char** argv) {
+  const char* groups[] = {"cpu", "mem", "net", "disk", "load"};
+  std::vector<Metric> metrics;
+  for (int i = 0; i < kMetrics; i++) {
+    metrics.emplace_back(Metric({{"intel", "", ""}, {"procfs", "", ""},
+                                 {groups[i % 5], "", ""},
+                                 {"dev" + std::to_string(i % 64), "", ""},
+                                 {"stat" + std::to_string(i % 16), "", ""}},
+                                "", ""));
+  }
+
+  std::string rules;
+  std::vector<std::regex> regexes;
+  for (int i = 0; i < 20; i++) {
+    std::string group = groups[i % 5];
+    std::string stat = "stat" + std::to_string(i);
+    rules += "/intel/procfs/" + group + "/*/" + stat + ";";
+    regexes.emplace_back("^/intel/procfs/" + group + "/[^/]+/" + stat + "$");
+  }
+  MetricFilter filter(rules, "/intel/procfs/*/dev0/**");
+
+  volatile size_t sink = 0;
+  Bench::run("std::regex over joined ns", 20, kMetrics, "metrics", [&](int) {
+    for (const Metric& met : metrics) {
+      std::string path;
+      for (const Metric::NamespaceElement& nse : met.ns()) {
+        path += "/" + nse.value;
+      }
+      for (const std::regex& re : regexes) {
+        if (std::regex_match(path, re)) {
+          sink = sink + 1;
+          break;
+        }
+      }
+    }
+  });
+  Bench::run("MetricFilter::keep", 500, kMetrics, "metrics", [&](int) {
+    for (const Metric& met : metrics) {
+      sink = sink + filter.keep(*met.get_rpc_metric_ptr());
+    }
+  });
+  std::printf("  %zu automaton states for 21 rules\n", filter.states());
+  return 0;
+}
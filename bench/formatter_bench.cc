@@ -0,0 +1,70 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <snap/metric.h>
+#include <snap/publisher/formatter.h>
+#include <snap/publisher/text_buffer.h>
+
+#include "bench.h"
+
+using Plugin::Formatter;
+using Plugin::Metric;
+using Plugin::TextBuffer;
+
+/**
+ * Formats a 1000-metric batch with each Formatter into a reused TextBuffer
+ * and reports output bytes per second.
+ */
+
+static const int kBatch = 1000;
+static const int kCalls = 2000;
+
+int main(int argc, char** argv) {
+  std::vector<Metric> metrics;
+  metrics.reserve(kBatch);
+  for (int i = 0; i < kBatch; i++) {
+    metrics.emplace_back(Metric({{"intel", "", ""}, {"procfs", "", ""},
+                                 {"cpu" + std::to_string(i % 64), "", ""},
+                                 {"user_jiffies", "", ""}}, "", ""));
+    metrics.back().add_tag({"plugin_running_on", "node1.example.com"});
+    metrics.back().add_tag({"rack", "r" + std::to_string(i % 8)});
+    if (i % 2) {
+      metrics.back().set_data(i * 0.37);
+    } else {
+      metrics.back().set_data(uint64_t(i) * 1000003);
+    }
+    metrics.back().set_timestamp();
+  }
+
+  const std::pair<const char*, Formatter::Format> formats[] = {
+    {"format: influx", Formatter::Influx},
+    {"format: graphite", Formatter::Graphite},
+    {"format: opentsdb json", Formatter::OpenTSDB},
+    {"format: prometheus", Formatter::Prometheus},
+  };
+  for (const auto& f : formats) {
+    Formatter formatter(f.second);
+    TextBuffer out;
+    formatter.format(metrics, out);
+    size_t bytes = out.size();
+    Bench::run(f.first, kCalls, bytes, "bytes", [&](int) {
+      out.clear();
+      formatter.format(metrics, out);
+    });
+  }
+  return 0;
+}
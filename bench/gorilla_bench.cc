@@ -0,0 +1,91 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <snap/metric.h>
+#include <snap/publisher/gorilla.h>
+#include <snap/publisher/text_buffer.h>
+
+#include "bench.h"
+
+using std::chrono::seconds;
+using std::chrono::system_clock;
+using Plugin::GorillaDecoder;
+using Plugin::GorillaEncoder;
+using Plugin::Metric;
+using Plugin::TextBuffer;
+
+/**
+ * Encodes batches of 100 series x 100 points, as an archive sink would
+ * receive them from a CoalescingPublisher, and compares size and speed with
+ * the serialized rpc::Metrics.
+ */
+
+static const int kSeries = 100;
+static const int kPoints = 100;
+static const int kCalls = 100;
+
+int main(int argc, char** argv) {
+  std::vector<Metric> metrics;
+  metrics.reserve(kSeries * kPoints);
+  system_clock::time_point start = system_clock::now();
+  for (int p = 0; p < kPoints; p++) {
+    for (int s = 0; s < kSeries; s++) {
+      metrics.emplace_back(Metric({{"intel", "", ""}, {"procfs", "", ""},
+                                   {"cpu" + std::to_string(s), "", ""},
+                                   {"utilization", "", ""}}, "percent", ""));
+      metrics.back().add_tag({"plugin_running_on", "node1.example.com"});
+      if (s % 2) {
+        metrics.back().set_data(50 + (p * 7 + s) % 13 * 0.25);
+      } else {
+        metrics.back().set_data(uint64_t(1000000 + p * 4096 + s));
+      }
+      // a 10s interval with some scheduling jitter
+      metrics.back().set_timestamp(start + seconds(10 * p) +
+                                   std::chrono::microseconds((p * s) % 300));
+    }
+  }
+
+  rpc::PubProcArg arg;
+  for (const Metric& met : metrics) {
+    *arg.add_metrics() = *met.get_rpc_metric_ptr();
+  }
+  std::string raw;
+  Bench::run("serialize rpc::Metric", kCalls, metrics.size(), "metrics",
+             [&](int) {
+    raw.clear();
+    arg.SerializeToString(&raw);
+  });
+
+  GorillaEncoder enc;
+  TextBuffer out;
+  Bench::run("gorilla encode", kCalls, metrics.size(), "metrics", [&](int) {
+    out.clear();
+    enc.add(metrics);
+    enc.finish(out);
+  });
+
+  rpc::Metric met;
+  Bench::run("gorilla decode", kCalls, metrics.size(), "metrics", [&](int) {
+    GorillaDecoder dec(out.data(), out.size());
+    while (dec.next(&met)) {}
+  });
+
+  std::printf("%-40s %14zu bytes\n", "serialized size", raw.size());
+  std::printf("%-40s %14zu bytes (%.1fx smaller)\n", "gorilla size",
+              out.size(), double(raw.size()) / out.size());
+  return 0;
+}
@@ -0,0 +1,105 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <dirent.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <snap/collector/procfs.h>
+#include <snap/metric.h>
+
+#include "bench.h"
+
+using Plugin::Metric;
+using Plugin::PidStat;
+using Plugin::ProcessTable;
+
+/**
+ * Collects utime, stime, rss and thread count of every process, through
+ * ProcessTable and the std::ifstream and std::stringstream way, with 2000
+ * sleeping children started so there's something to read. The last run also
+ * builds the metrics.
+ */
+
+static std::vector<Metric> metrics;
+
+static void add(int pid, const char* name, int64_t value) {
+  metrics.emplace_back(Metric({{"intel", "", ""}, {"procfs", "", ""},
+                               {"pid", "", ""}, {name, "", ""}}, "", ""));
+  metrics.back().add_tag({"pid", std::to_string(pid)});
+  metrics.back().set_data(value);
+}
+
+int main(int argc, char** argv) {
+  // sleepers, so the table has a few thousand entries on an idle machine
+  std::vector<pid_t> children;
+  for (int i = 0; i < 2000; i++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      pause();
+      _exit(0);
+    }
+    if (pid > 0) children.push_back(pid);
+  }
+
+  ProcessTable table((ProcessTable::Options()));
+  size_t procs = table.scan().size();
+  std::printf("  %zu processes\n", procs);
+
+  Bench::run("ProcessTable scan", 50, procs, "processes", [&](int) {
+    for (const PidStat& stat : table.scan()) {
+      (void)stat.field(14);
+    }
+  });
+  Bench::run("std::ifstream + stringstream", 10, procs, "processes",
+             [&](int) {
+    DIR* dir = opendir("/proc");
+    while (struct dirent* ent = readdir(dir)) {
+      if (ent->d_name[0] < '0' || ent->d_name[0] > '9') continue;
+      std::ifstream in(std::string("/proc/") + ent->d_name + "/stat");
+      std::string line;
+      if (!std::getline(in, line)) continue;
+      std::stringstream ss(line.substr(line.rfind(')') + 2));
+      std::vector<std::string> fields;
+      std::string field;
+      while (ss >> field) fields.push_back(field);
+      (void)std::strtoll(fields[11].c_str(), nullptr, 10);
+    }
+    closedir(dir);
+  });
+
+  Bench::run("ProcessTable collect to metrics", 20, procs, "processes",
+             [&](int) {
+    metrics.clear();
+    for (const PidStat& stat : table.scan()) {
+      add(int(stat.pid()), "utime", stat.field(14));
+      add(int(stat.pid()), "stime", stat.field(15));
+      add(int(stat.pid()), "threads", stat.field(20));
+      add(int(stat.pid()), "rss", stat.field(24));
+    }
+  });
+
+  for (pid_t pid : children) {
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+  }
+  return 0;
+}
@@ -0,0 +1,77 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <snap/metric.h>
+#include <snap/processor/rate.h>
+
+#include "bench.h"
+
+using std::chrono::seconds;
+using std::chrono::system_clock;
+using Plugin::CounterRate;
+using Plugin::CounterTable;
+using Plugin::Metric;
+
+/**
+ * Measures CounterTable on 4M series, and CounterRate::update on 100k
+ * interface counters reporting every 10s.
+ */
+
+static const uint64_t kTableSeries = 1 << 22;
+static const int kSeries = 100000;
+
+int main(int argc, char** argv) {
+  CounterTable table(kTableSeries);
+  bool added;
+  Bench::run("table insert, 4M series", 1, kTableSeries, "series", [&](int) {
+    for (uint64_t k = 1; k <= kTableSeries; k++) {
+      table.insert(k * 0x9e3779b97f4a7c15ULL, &added)->value = k;
+    }
+  });
+  std::printf("  %zu series in %.1f MB, %.1f bytes per series\n",
+              table.size(), table.memory() / 1048576.0,
+              double(table.memory()) / table.size());
+  volatile uint64_t sink = 0;
+  Bench::run("table find, 4M series", 5, kTableSeries, "lookups", [&](int) {
+    for (uint64_t k = 1; k <= kTableSeries; k++) {
+      sink = sink + table.find(k * 0x9e3779b97f4a7c15ULL)->value;
+    }
+  });
+
+  std::vector<Metric> metrics;
+  metrics.reserve(kSeries);
+  for (int s = 0; s < kSeries; s++) {
+    metrics.emplace_back(Metric({{"intel", "", ""}, {"net", "", ""},
+                                 {"eth" + std::to_string(s), "", ""},
+                                 {"bytes_recv", "", ""}}, "B", ""));
+    metrics.back().add_tag({"plugin_running_on", "node1.example.com"});
+  }
+
+  CounterRate rate((CounterRate::Options()));
+  system_clock::time_point start = system_clock::time_point(seconds(0));
+  double r;
+  Bench::run("rate update, 100k series", 20, kSeries, "points", [&](int i) {
+    for (int s = 0; s < kSeries; s++) {
+      Metric& met = metrics[s];
+      met.set_timestamp(start + seconds(10 * i));
+      met.set_data(uint64_t(i) * 1500 * (s + 1));
+      rate.update(*met.get_rpc_metric_ptr(), &r);
+    }
+  });
+  return 0;
+}
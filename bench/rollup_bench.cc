@@ -0,0 +1,74 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <snap/metric.h>
+#include <snap/processor/rollup.h>
+
+#include "bench.h"
+
+using std::chrono::seconds;
+using std::chrono::system_clock;
+using Plugin::Metric;
+using Plugin::Rollup;
+
+/**
+ * Measures the aggregation kernels over a column, and Rollup::add on 1000
+ * series reporting every second into 60s windows.
+ */
+
+static const int kSeries = 1000;
+static const int kColumn = 1 << 20;
+
+int main(int argc, char** argv) {
+  std::vector<double> floats(kColumn);
+  std::vector<int64_t> ints(kColumn);
+  for (int64_t i = 0; i < kColumn; i++) {
+    floats[i] = (i * 7919 % 1000) * 0.5;
+    ints[i] = i * 7919 % 1000 - 500;
+  }
+  volatile double sink = 0;
+  Bench::run("aggregate float64 column", 200, kColumn, "points", [&](int) {
+    sink = sink + Plugin::aggregate(floats.data(), floats.size()).sum;
+  });
+  Bench::run("aggregate int64 column", 200, kColumn, "points", [&](int) {
+    sink = sink + Plugin::aggregate(ints.data(), ints.size()).sum;
+  });
+
+  std::vector<Metric> metrics;
+  metrics.reserve(kSeries);
+  for (int s = 0; s < kSeries; s++) {
+    metrics.emplace_back(Metric({{"intel", "", ""}, {"procfs", "", ""},
+                                 {"cpu" + std::to_string(s), "", ""},
+                                 {"utilization", "", ""}}, "percent", ""));
+    metrics.back().add_tag({"plugin_running_on", "node1.example.com"});
+    metrics.back().set_data(double(s % 100));
+  }
+
+  Rollup::Options opts;
+  opts.window = seconds(60);
+  Rollup rollup(opts);
+  std::vector<Metric> out;
+  system_clock::time_point start = system_clock::time_point(seconds(0));
+  Bench::run("rollup add, 60s windows", 600, kSeries, "points", [&](int i) {
+    out.clear();
+    for (Metric& met : metrics) {
+      met.set_timestamp(start + seconds(i));
+      rollup.add(*met.get_rpc_metric_ptr(), &out);
+    }
+  });
+  return 0;
+}
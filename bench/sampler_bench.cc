@@ -0,0 +1,72 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <snap/collector/sampler.h>
+#include <snap/metric.h>
+
+#include "bench.h"
+
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using Plugin::Metric;
+using Plugin::Sampler;
+
+/**
+ * Compares collecting 100 series whose probes take 100us each by calling
+ * the probes, as collect_metrics would without a sampler, against reading
+ * their summaries from a Sampler sampling every 10ms in the background.
+ */
+
+static const int kSeries = 100;
+
+static bool slow_probe(double* v) {
+  std::this_thread::sleep_for(microseconds(100));
+  *v = 1;
+  return true;
+}
+
+int main(int argc, char** argv) {
+  Sampler::Options opts;
+  opts.interval = milliseconds(10);
+  Sampler sampler(opts);
+  std::vector<Metric> metrics;
+  for (int s = 0; s < kSeries; s++) {
+    std::vector<Metric::NamespaceElement> ns = {
+        {"intel", "", ""}, {"dev" + std::to_string(s), "", ""},
+        {"latency", "", ""}};
+    sampler.add(ns, slow_probe);
+    ns.push_back({"avg", "", ""});
+    metrics.emplace_back(Metric(ns, "", ""));
+  }
+
+  Bench::run("probes in collect, 100 series", 5, kSeries, "metrics",
+             [&](int) {
+    double v;
+    for (Metric& met : metrics) {
+      slow_probe(&v);
+      met.set_data(v);
+    }
+  });
+
+  sampler.start();
+  Bench::run("sampler collect, 100 series", 1000, kSeries, "metrics",
+             [&](int) { sampler.collect(metrics); });
+  sampler.stop();
+  return 0;
+}
@@ -0,0 +1,82 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <snap/collector/shm_ring.h>
+#include <snap/collector/shm_ring_collector.h>
+
+#include "bench.h"
+
+using Plugin::ShmRing;
+using Plugin::ShmRingSlot;
+using Plugin::ShmRingWriter;
+
+/**
+ * Measures ShmRingWriter with one and four writer threads, writing bursts
+ * of 512k values into a ring of 1M slots that another thread drains, and
+ * then a single thread writing and draining in turn.
+ */
+
+static const int kWrites = 1 << 19;
+static const uint64_t kCapacity = 1 << 20;
+
+int main(int argc, char** argv) {
+  std::string name = "/snap_shm_ring_bench." + std::to_string(getpid());
+  ShmRing ring(name, kCapacity);
+  std::atomic<bool> done(false);
+  std::thread drainer([&] {
+    while (!done.load()) {
+      ring.drain([](const ShmRingSlot&) {}, 4096);
+    }
+  });
+
+  for (int threads : {1, 4}) {
+    uint64_t dropped = ring.dropped();
+    Bench::run("writes, " + std::to_string(threads) + " writers", 5,
+               kWrites, "values", [&](int) {
+      std::vector<std::thread> writers;
+      for (int t = 0; t < threads; t++) {
+        writers.emplace_back([&] {
+          ShmRingWriter writer;
+          writer.open(name);
+          for (int i = 0; i < kWrites / threads; i++) {
+            writer.counter("http_requests", 1);
+          }
+        });
+      }
+      for (std::thread& w : writers) w.join();
+    });
+    std::printf("  %.2f%% dropped\n", 100.0 * (ring.dropped() - dropped) /
+                (6.0 * kWrites));
+  }
+
+  done = true;
+  drainer.join();
+
+  ShmRingWriter writer;
+  writer.open(name);
+  Bench::run("write then drain, 1 thread", 5, kWrites, "values", [&](int) {
+    for (int i = 0; i < kWrites; i++) writer.counter("http_requests", 1);
+    ring.drain([](const ShmRingSlot&) {}, kWrites);
+  });
+  shm_unlink(name.c_str());
+  return 0;
+}
@@ -205,8 +205,8 @@ void Rando::collect_metrics(std::vector<Metric> &metrics) {
   }
 }
 
-int main() {
+int main(int argc, char** argv) {
   Meta meta(Type::Collector, "rando", 1);
   Rando plg = Rando();
-  start_collector(&plg, meta);
+  start_collector(argc, argv, &plg, meta);
 }
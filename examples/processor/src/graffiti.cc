@@ -13,6 +13,7 @@ limitations under the License.
 */
 #include "graffiti.h"
 
+#include <memory>
 #include <sstream>
 #include <string>
 #include <utility>
@@ -38,24 +39,26 @@ const ConfigPolicy Graffiti::get_config_policy() {
   return policy;
 }
 
+std::unique_ptr<GraffitiTags> Graffiti::prepare(const Config& config) {
+  std::unique_ptr<GraffitiTags> tags(new GraffitiTags());
+  tags->names = split_tags(config.get_string("tags"));
+  return tags;
+}
+
 void Graffiti::process_metrics(std::vector<Metric> &metrics,
-                               const Config& config) {
+                               const GraffitiTags& tags) {
   std::vector<Metric>::iterator mets_iter;
-  std::string tags_str = config.get_string("tags");
-
-  std::vector<std::string> tags = split_tags(tags_str);
-
   for (mets_iter = metrics.begin(); mets_iter != metrics.end(); mets_iter++) {
-    for (std::string tag : tags) {
+    for (const std::string& tag : tags.names) {
       mets_iter->add_tag(std::pair<std::string, std::string>(tag, "present"));
     }
   }
 }
 
-int main() {
+int main(int argc, char** argv) {
   Meta meta(Type::Processor, "graffiti", 1);
-  Graffiti plg = Graffiti();
-  start_processor(&plg, meta);
+  Graffiti plg;
+  start_processor(argc, argv, &plg, meta);
 }
 
 
@@ -13,15 +13,26 @@ limitations under the License.
 */
 #pragma once
 
+#include <memory>
+#include <string>
 #include <vector>
 
 #include <snap/config.h>
 #include <snap/metric.h>
 #include <snap/plugin.h>
+#include <snap/processor/prepared_processor.h>
 
-class Graffiti final : public Plugin::ProcessorInterface {
+/**
+ * The tags named in a task's "tags" config, split once per config.
+ */
+struct GraffitiTags {
+  std::vector<std::string> names;
+};
+
+class Graffiti final : public Plugin::PreparedProcessor<GraffitiTags> {
  public:
   const Plugin::ConfigPolicy get_config_policy();
+  std::unique_ptr<GraffitiTags> prepare(const Plugin::Config& config);
   void process_metrics(std::vector<Plugin::Metric> &metrics,
-                       const Plugin::Config& config);
+                       const GraffitiTags& tags);
 };
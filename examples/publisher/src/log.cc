@@ -13,27 +13,30 @@ limitations under the License.
 */
 #include "log.h"
 
-#include <chrono>
-#include <ctime>
-#include <fstream>
-#include <map>
+#include <algorithm>
 #include <string>
 #include <vector>
 
 #include <snap/config.h>
 #include <snap/plugin.h>
 #include <snap/metric.h>
-
-using std::chrono::system_clock;
-using std::chrono::duration_cast;
-using std::chrono::milliseconds;
+#include <snap/publisher/file_sink.h>
+#include <snap/publisher/text_buffer.h>
 
 using Plugin::Config;
 using Plugin::ConfigPolicy;
+using Plugin::FileSink;
 using Plugin::Metric;
 using Plugin::Meta;
+using Plugin::TextBuffer;
 using Plugin::Type;
 
+static bool less_ptr(const std::string* a, const std::string* b) {
+  return *a < *b;
+}
+
+Log::Log() : sink(FileSink::Options()) {}
+
 const ConfigPolicy Log::get_config_policy() {
   ConfigPolicy policy(Plugin::StringRule{
     "path",
@@ -44,79 +47,86 @@ const ConfigPolicy Log::get_config_policy() {
 
 /**
  * {ISO 8601 timestamp} {namespace} tags: [{tags}] data: {data}
+ *
+ * The file stays open between calls and is written out by the FileSink.
  */
 void Log::publish_metrics(std::vector<Metric> &metrics,
                           const Config& config) {
-  std::string path = config.get_string("path");
-  std::ofstream outfile;
-  outfile.open(path, std::ios::app);
+  sink.write(config, "path", [&](TextBuffer& out) {
+    format(metrics, out);
+  });
+}
 
-  std::vector<Metric>::iterator mets_iter;
+void Log::kill(const std::string& reason) {
+  sink.flush();
+}
+
+void Log::format(std::vector<Metric> &metrics, TextBuffer& out) {
+  // tag names, sorted per metric; reused to avoid allocating per metric
+  std::vector<const std::string*> tag_names;
+
+  for (Metric& met : metrics) {
+    const rpc::Metric* rpc_met = met.get_rpc_metric_ptr();
 
-  for (mets_iter = metrics.begin(); mets_iter != metrics.end(); mets_iter++) {
     // timestamp
-    system_clock::time_point ts = mets_iter->timestamp();
-    std::time_t c_ts = system_clock::to_time_t(ts);
-    char str_time_b[50];
-    if (std::strftime(str_time_b, sizeof(str_time_b),
-                      "%F %T", std::gmtime(&c_ts))) {
-      outfile << str_time_b << " ";
-    }
+    out.append_utc_time(met.timestamp());
+    out.append(' ');
 
     // namespace
-    for (Metric::NamespaceElement nse : mets_iter->ns()) {
-      outfile << "/" << nse.value;
+    for (const rpc::NamespaceElement& nse : rpc_met->namespace_()) {
+      out.append('/');
+      out.append(nse.value());
     }
 
     // tags
-    outfile << " tags: [";
-    std::map<std::string, std::string>::iterator tags_iter;
-    std::map<std::string, std::string> tags = mets_iter->tags();
-    int tags_size = tags.size();
-    int idx = 1;
-    for (tags_iter = tags.begin(); tags_iter != tags.end();
-         tags_iter++) {
-      outfile << tags_iter->first;
-      if (idx != tags_size) outfile << ", ";
-      idx++;
+    out.append(" tags: [", 8);
+    tag_names.clear();
+    for (const auto& tag : rpc_met->tags()) {
+      tag_names.push_back(&tag.first);
+    }
+    std::sort(tag_names.begin(), tag_names.end(), less_ptr);
+    for (size_t i = 0; i < tag_names.size(); i++) {
+      if (i > 0) out.append(", ", 2);
+      out.append(*tag_names[i]);
     }
 
     // data
-    outfile << "] " << "data: ";
-    switch (mets_iter->data_type()) {
+    out.append("] data: ", 8);
+    switch (met.data_type()) {
       case Metric::DataType::Float32:
-        outfile << mets_iter->get_float32_data() << "\n";
+        out.append_float(met.get_float32_data());
         break;
       case Metric::DataType::Float64:
-        outfile << mets_iter->get_float64_data() << "\n";
+        out.append_double(met.get_float64_data());
         break;
       case Metric::DataType::Int32:
-        outfile << mets_iter->get_int_data() << "\n";
+        out.append_int(met.get_int_data());
         break;
       case Metric::DataType::Int64:
-        outfile << mets_iter->get_int64_data() << "\n";
+        out.append_int(met.get_int64_data());
         break;
       case Metric::DataType::Uint32:
-        outfile << mets_iter->get_uint32_data() << "\n";
+        out.append_uint(met.get_uint32_data());
         break;
       case Metric::DataType::Uint64:
-        outfile << mets_iter->get_uint64_data() << "\n";
+        out.append_uint(met.get_uint64_data());
         break;
       case Metric::DataType::Bool:
-        outfile << mets_iter->get_bool_data() << "\n";
+        out.append(met.get_bool_data() ? '1' : '0');
         break;
       case Metric::DataType::String:
-        outfile << mets_iter->get_string_data() << "\n";
+        out.append(met.get_string_data());
         break;
       case Metric::DataType::NotSet:
-        outfile << "not set\n";
+        out.append("not set", 7);
         break;
     }
+    out.append('\n');
   }
 }
 
-int main() {
+int main(int argc, char** argv) {
   Meta meta(Type::Publisher, "log", 1);
-  Log plg = Log();
-  start_publisher(&plg, meta);
+  Log plg;
+  start_publisher(argc, argv, &plg, meta);
 }
@@ -13,15 +13,29 @@ limitations under the License.
 */
 #pragma once
 
+#include <string>
 #include <vector>
 
 #include <snap/config.h>
 #include <snap/metric.h>
 #include <snap/plugin.h>
+#include <snap/publisher/file_sink.h>
+#include <snap/publisher/text_buffer.h>
 
 class Log final : public Plugin::PublisherInterface {
  public:
+  Log();
   const Plugin::ConfigPolicy get_config_policy();
   void publish_metrics(std::vector<Plugin::Metric> &metrics,
                        const Plugin::Config& config);
+  void kill(const std::string& reason);
+
+  /**
+   * format appends one line per metric to out.
+   */
+  static void format(std::vector<Plugin::Metric> &metrics,
+                     Plugin::TextBuffer& out);
+
+ private:
+  Plugin::FileSink sink;
 };
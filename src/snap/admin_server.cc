@@ -0,0 +1,204 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/admin_server.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "snap/plugin.h"
+#include "snap/publisher/text_buffer.h"
+#include "snap/stats.h"
+
+using std::string;
+
+using Plugin::AdminServer;
+using Plugin::PluginException;
+using Plugin::Stats;
+using Plugin::TextBuffer;
+
+namespace {
+
+const size_t kMaxRequest = 8192;
+
+string error_text(const string& what) {
+  return "admin: " + what + ": " + std::strerror(errno);
+}
+
+bool write_all(int fd, const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+void respond(int fd, const char* status, const char* type,
+             const string& body) {
+  string head = string("HTTP/1.1 ") + status + "\r\nContent-Type: " + type +
+                "\r\nContent-Length: " + std::to_string(body.size()) +
+                "\r\nConnection: close\r\n\r\n";
+  if (write_all(fd, head.data(), head.size())) {
+    write_all(fd, body.data(), body.size());
+  }
+}
+
+}  // namespace
+
+AdminServer::AdminServer(const string& listen) :
+    listen_fd(-1), wake_fd(-1), tcp_port(0) {
+  if (listen.compare(0, 5, "unix:") == 0) {
+    unix_path = listen.substr(5);
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    if (unix_path.empty() || unix_path.size() >= sizeof(addr.sun_path)) {
+      throw PluginException("admin: bad unix socket path: " + unix_path);
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, unix_path.c_str(), unix_path.size());
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    // a stale socket from a previous run would fail the bind
+    struct stat st;
+    if (lstat(unix_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+      unlink(unix_path.c_str());
+    }
+    socklen_t len = sizeof(addr);
+    if (listen_fd < 0 ||
+        bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), len) != 0) {
+      string err = error_text("bind " + unix_path);
+      if (listen_fd >= 0) close(listen_fd);
+      throw PluginException(err);
+    }
+  } else {
+    size_t colon = listen.rfind(':');
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    char* end = nullptr;
+    long port = colon == string::npos ? -1 :
+                std::strtol(listen.c_str() + colon + 1, &end, 10);
+    if (port < 0 || port > 65535 || *end != '\0' ||
+        inet_pton(AF_INET, listen.substr(0, colon).c_str(),
+                  &addr.sin_addr) != 1) {
+      throw PluginException("admin: expected host:port or unix:path, got " +
+                            listen);
+    }
+    addr.sin_port = htons(uint16_t(port));
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int one = 1;
+    if (listen_fd >= 0) {
+      setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+    socklen_t len = sizeof(addr);
+    if (listen_fd < 0 ||
+        bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), len) != 0 ||
+        getsockname(listen_fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+      string err = error_text("bind " + listen);
+      if (listen_fd >= 0) close(listen_fd);
+      throw PluginException(err);
+    }
+    tcp_port = ntohs(addr.sin_port);
+  }
+
+  wake_fd = eventfd(0, EFD_CLOEXEC);
+  if (::listen(listen_fd, 16) != 0 || wake_fd < 0) {
+    string err = error_text("listen");
+    close(listen_fd);
+    if (wake_fd >= 0) close(wake_fd);
+    throw PluginException(err);
+  }
+  thread = std::thread(&AdminServer::serve, this);
+}
+
+AdminServer::~AdminServer() {
+  uint64_t one = 1;
+  ssize_t n = write(wake_fd, &one, sizeof(one));
+  (void)n;
+  thread.join();
+  close(listen_fd);
+  close(wake_fd);
+  if (!unix_path.empty()) unlink(unix_path.c_str());
+}
+
+void AdminServer::serve() {
+  pollfd fds[2] = {{listen_fd, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    if (fds[1].revents) return;
+    if (!fds[0].revents) continue;
+    int conn = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (conn < 0) continue;
+    handle(conn);
+    close(conn);
+  }
+}
+
+void AdminServer::handle(int conn) {
+  // a client that stalls can't hold the listener for long
+  timeval timeout = {1, 0};
+  setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(conn, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  string request;
+  char buf[1024];
+  while (request.find("\r\n\r\n") == string::npos &&
+         request.find("\n\n") == string::npos) {
+    if (request.size() >= kMaxRequest) {
+      respond(conn, "431 Request Header Fields Too Large", "text/plain",
+              "request too large\n");
+      return;
+    }
+    ssize_t n = recv(conn, buf, sizeof(buf), 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return;
+    request.append(buf, n);
+  }
+
+  string line = request.substr(0, request.find_first_of("\r\n"));
+  size_t sp1 = line.find(' ');
+  size_t sp2 = line.find(' ', sp1 + 1);
+  if (sp1 == string::npos || sp2 == string::npos) {
+    respond(conn, "400 Bad Request", "text/plain", "bad request\n");
+    return;
+  }
+  string method = line.substr(0, sp1);
+  string path = line.substr(sp1 + 1, sp2 - sp1 - 1);
+  path = path.substr(0, path.find('?'));
+  if (method != "GET") {
+    respond(conn, "405 Method Not Allowed", "text/plain", "use GET\n");
+  } else if (path == "/metrics") {
+    TextBuffer out;
+    Stats::write(out);
+    respond(conn, "200 OK", "text/plain; version=0.0.4; charset=utf-8",
+            out.str());
+  } else {
+    respond(conn, "404 Not Found", "text/plain", "see /metrics\n");
+  }
+}
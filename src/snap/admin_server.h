@@ -0,0 +1,59 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <string>
+#include <thread>
+
+namespace Plugin {
+
+/**
+ * AdminServer is a minimal HTTP listener serving Stats in the Prometheus
+ * text format at /metrics, so plugin internals can be scraped directly
+ * rather than through snapteld.
+ *
+ * It answers one request per connection, one connection at a time, on a
+ * thread of its own; scrapes never wait on the RPC path. It is meant for
+ * a local port or a unix socket, and has no authentication.
+ *
+ * GRPCExportImpl starts one when Meta::admin_listen, or the
+ * SNAP_PLUGIN_ADMIN environment variable, is set.
+ */
+class AdminServer final {
+ public:
+  /**
+   * listen is "host:port", with port 0 for any free port, or "unix:path".
+   * Failing to listen is thrown as PluginException.
+   */
+  explicit AdminServer(const std::string& listen);
+  ~AdminServer();
+
+  AdminServer(const AdminServer&) = delete;
+  AdminServer& operator=(const AdminServer&) = delete;
+
+  /** port returns the TCP port listened on, or 0 for a unix socket. */
+  int port() const { return tcp_port; }
+
+ private:
+  void serve();
+  void handle(int conn);
+
+  int listen_fd;
+  int wake_fd;
+  int tcp_port;
+  std::string unix_path;
+  std::thread thread;
+};
+
+}  // namespace Plugin
@@ -0,0 +1,91 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/collector/async_collector.h"
+
+#include <algorithm>
+#include <exception>
+#include <string>
+#include <utility>
+#include <vector>
+
+using std::chrono::system_clock;
+
+using Plugin::AsyncCollector;
+using Plugin::Metric;
+using Plugin::PluginException;
+
+AsyncCollector::AsyncCollector(std::chrono::milliseconds timeout,
+                               std::chrono::milliseconds margin) :
+    timeout(timeout), margin(margin) {}
+
+void AsyncCollector::collect_metrics(std::vector<Metric>& metrics) {
+  collect_metrics_by(metrics, system_clock::time_point::max());
+}
+
+std::string AsyncCollector::collect_metrics_by(
+    std::vector<Metric>& metrics, system_clock::time_point deadline) {
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    abandoned.erase(
+        std::remove_if(abandoned.begin(), abandoned.end(),
+            [](const std::future<std::vector<Metric>>& f) {
+              return f.wait_for(std::chrono::seconds(0)) ==
+                     std::future_status::ready;
+            }),
+        abandoned.end());
+  }
+
+  system_clock::time_point now = system_clock::now();
+  system_clock::time_point until = now + timeout;
+  // time_point::max() would overflow below
+  if (deadline < until + margin) {
+    until = deadline - margin;
+  }
+
+  std::vector<Group> groups = collect_async(metrics);
+  std::vector<Metric> collected;
+  std::string incomplete;
+  size_t completed = 0;
+  for (Group& group : groups) {
+    std::string error;
+    if (!group.metrics.valid()) {
+      error = "no result";
+    } else if (group.metrics.wait_until(until) != std::future_status::ready) {
+      error = "timed out";
+      std::lock_guard<std::mutex> lk(mtx);
+      abandoned.push_back(std::move(group.metrics));
+    } else {
+      try {
+        std::vector<Metric> got = group.metrics.get();
+        for (Metric& met : got) {
+          collected.emplace_back();
+          collected.back().swap(met);
+        }
+        completed++;
+      } catch (const std::exception& e) {
+        error = e.what();
+      }
+    }
+    if (!error.empty()) {
+      if (!incomplete.empty()) incomplete += "; ";
+      incomplete += group.name + ": " + error;
+    }
+  }
+
+  metrics.swap(collected);
+  if (!groups.empty() && completed == 0) {
+    throw PluginException(incomplete);
+  }
+  return incomplete;
+}
@@ -0,0 +1,106 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "snap/metric.h"
+#include "snap/plugin.h"
+
+namespace Plugin {
+
+/**
+ * AsyncCollector is a collector whose metrics arrive in groups that complete
+ * on their own, such as the metrics of each of many remote hosts, so that
+ * they can be collected concurrently and a slow group doesn't hold up the
+ * others.
+ *
+ * collect_async starts collecting the requested metrics and returns a future
+ * per group. The proxy then waits for them until the deadline of snapteld's
+ * request, less a margin for sending the reply, or at most timeout, and
+ * replies with the metrics of the groups that completed. Groups that failed
+ * or were not done in time are named in an extra string metric,
+ * <prefix>/collect/incomplete, which isn't listed among the metric types
+ * (see collect_metrics_by). The call only fails if no group completed.
+ *
+ * Futures given up on are kept until they complete, so the futures of
+ * std::async, whose destructors wait, don't block collection.
+ *
+ * E.g.:
+ *   class Bmcs final : public Plugin::AsyncCollector {
+ *    public:
+ *     std::vector<Group> collect_async(const std::vector<Metric>& metrics) {
+ *       std::vector<Group> groups;
+ *       for (const std::string& host : hosts) {
+ *         groups.push_back({host, std::async(std::launch::async, [=] {
+ *           return query(host, metrics);
+ *         })});
+ *       }
+ *       return groups;
+ *     }
+ *     ...
+ *   };
+ */
+class AsyncCollector : public CollectorInterface {
+ public:
+  struct Group {
+    /** names the group in errors */
+    std::string name;
+    std::future<std::vector<Metric>> metrics;
+  };
+
+  /**
+   * collect_async starts collecting metrics, returning a future for each
+   * group. Exceptions it throws fail the whole collection; those of a
+   * future only its group.
+   */
+  virtual std::vector<Group> collect_async(
+      const std::vector<Metric>& metrics) = 0;
+
+  /**
+   * collect_metrics waits up to timeout.
+   */
+  void collect_metrics(std::vector<Metric>& metrics) final;
+
+  /**
+   * collect_metrics_by throws PluginException, naming every group, if none
+   * completed.
+   */
+  std::string collect_metrics_by(
+      std::vector<Metric>& metrics,
+      std::chrono::system_clock::time_point deadline) final;
+
+ protected:
+  /**
+   * timeout bounds the wait when snapteld's deadline is further away, or
+   * unset; margin is kept from snapteld's deadline to send the reply.
+   */
+  explicit AsyncCollector(
+      std::chrono::milliseconds timeout = std::chrono::seconds(10),
+      std::chrono::milliseconds margin = std::chrono::milliseconds(50));
+
+ private:
+  std::chrono::milliseconds timeout;
+  std::chrono::milliseconds margin;
+
+  std::mutex mtx;
+  // futures of groups given up on, until they complete
+  std::vector<std::future<std::vector<Metric>>> abandoned;
+};
+
+}  // namespace Plugin
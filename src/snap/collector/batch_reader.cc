@@ -0,0 +1,287 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/collector/batch_reader.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using Plugin::BatchReader;
+using Plugin::Token;
+
+/**
+ * Ring is a bare io_uring: the submission and completion queues mapped from
+ * the kernel, driven with the raw system calls so that liburing isn't
+ * needed.
+ */
+struct BatchReader::Ring {
+  Ring() : fd(-1), sq_ptr(MAP_FAILED), cq_ptr(MAP_FAILED),
+           sqes(static_cast<io_uring_sqe*>(MAP_FAILED)) {}
+
+  ~Ring() {
+    if (sqes != MAP_FAILED) munmap(sqes, sqes_len);
+    if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr) munmap(cq_ptr, cq_len);
+    if (sq_ptr != MAP_FAILED) munmap(sq_ptr, sq_len);
+    if (fd >= 0) close(fd);
+  }
+
+  // returns false if io_uring isn't available
+  bool setup(unsigned depth) {
+    io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    fd = int(syscall(__NR_io_uring_setup, depth, &p));
+    if (fd < 0) return false;
+
+    sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) sq_len = cq_len = std::max(sq_len, cq_len);
+    sq_ptr = mmap(nullptr, sq_len, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED) return false;
+    cq_ptr = single ? sq_ptr :
+             mmap(nullptr, cq_len, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cq_ptr == MAP_FAILED) return false;
+    sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(
+        mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if (sqes == MAP_FAILED) return false;
+
+    char* sq = static_cast<char*>(sq_ptr);
+    sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    entries = p.sq_entries;
+    char* cq = static_cast<char*>(cq_ptr);
+    cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+    return true;
+  }
+
+  void queue_read(const File& file, uint64_t user_data) {
+    // only this thread moves the tail
+    unsigned tail = *sq_tail;
+    unsigned idx = tail & sq_mask;
+    io_uring_sqe* sqe = &sqes[idx];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = file.fd;
+    sqe->off = 0;
+    sqe->addr = reinterpret_cast<uint64_t>(&file.iov);
+    sqe->len = 1;
+    sqe->user_data = user_data;
+    sq_array[idx] = idx;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+  }
+
+  // submits queued reads and waits for at least one completion; returns
+  // the number submitted, or -errno
+  int enter(unsigned to_submit) {
+    int rc = int(syscall(__NR_io_uring_enter, fd, to_submit, 1,
+                         IORING_ENTER_GETEVENTS, nullptr, 0));
+    return rc < 0 ? -errno : rc;
+  }
+
+  int fd;
+  void* sq_ptr;
+  size_t sq_len;
+  void* cq_ptr;
+  size_t cq_len;
+  io_uring_sqe* sqes;
+  size_t sqes_len;
+  unsigned entries;
+  unsigned* sq_tail;
+  unsigned sq_mask;
+  unsigned* sq_array;
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned cq_mask;
+  io_uring_cqe* cqes;
+};
+
+BatchReader::Options::Options() :
+    use_io_uring(true), queue_depth(256), buffer_size(4096), max_open(256) {
+  struct rlimit lim;
+  if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur != RLIM_INFINITY) {
+    max_open = size_t(lim.rlim_cur / 2);
+  }
+}
+
+BatchReader::BatchReader(const Options& opts) : opts(opts), open_files(0) {
+  if (opts.use_io_uring) {
+    ring.reset(new Ring());
+    if (!ring->setup(std::max(1u, opts.queue_depth))) ring.reset();
+  }
+}
+
+BatchReader::~BatchReader() {
+  for (File& file : files) close_file(file);
+}
+
+size_t BatchReader::add(const std::string& path) {
+  files.push_back(File());
+  File& file = files.back();
+  file.path = path;
+  file.fd = -1;
+  file.owned = true;
+  file.buf.resize(std::max<size_t>(opts.buffer_size, 2));
+  file.len = 0;
+  file.error = 0;
+  if (open_files < opts.max_open && open_file(file)) open_files++;
+  return files.size() - 1;
+}
+
+size_t BatchReader::add_fd(int fd) {
+  size_t i = add("");
+  files[i].fd = fd;
+  files[i].owned = false;
+  return i;
+}
+
+bool BatchReader::open_file(File& file) {
+  file.fd = open(file.path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (file.fd < 0) {
+    file.error = errno;
+    return false;
+  }
+  return true;
+}
+
+void BatchReader::close_file(File& file) {
+  if (file.owned && file.fd >= 0) close(file.fd);
+  file.fd = -1;
+}
+
+Token BatchReader::contents(size_t i) const {
+  const File& file = files[i];
+  if (file.error) return Token();
+  return Token(file.buf.data(), file.len);
+}
+
+void BatchReader::complete(File& file, int64_t res) {
+  if (res < 0) {
+    file.error = int(-res);
+    file.len = 0;
+    return;
+  }
+  file.len = size_t(res);
+  // a full buffer may mean there's more
+  while (file.len == file.buf.size() - 1) {
+    file.buf.resize(file.buf.size() * 2);
+    ssize_t n = pread(file.fd, &file.buf[file.len],
+                      file.buf.size() - 1 - file.len, file.len);
+    if (n < 0) {
+      file.error = errno;
+      file.len = 0;
+      return;
+    }
+    if (n == 0) break;
+    file.len += n;
+  }
+  file.buf[file.len] = '\0';
+}
+
+void BatchReader::read_pread(File& file) {
+  ssize_t n = pread(file.fd, file.buf.data(), file.buf.size() - 1, 0);
+  complete(file, n < 0 ? -errno : n);
+}
+
+size_t BatchReader::read_all() {
+  // files beyond max_open are open only while they're read
+  std::vector<size_t> reopened;
+  for (size_t i = 0; i < files.size(); i++) {
+    File& file = files[i];
+    file.error = 0;
+    file.len = 0;
+    if (file.fd < 0) {
+      if (!open_file(file)) continue;
+      if (open_files < opts.max_open) {
+        open_files++;
+      } else {
+        reopened.push_back(i);
+      }
+    }
+    file.iov.iov_base = file.buf.data();
+    file.iov.iov_len = file.buf.size() - 1;
+  }
+
+  if (ring) {
+    read_ring();
+  } else {
+    for (File& file : files) {
+      if (file.fd >= 0) read_pread(file);
+    }
+  }
+
+  for (size_t i : reopened) close_file(files[i]);
+  size_t ok = 0;
+  for (const File& file : files) {
+    if (file.error == 0) ok++;
+  }
+  return ok;
+}
+
+void BatchReader::read_ring() {
+  std::vector<bool> done(files.size(), false);
+  size_t next = 0;
+  unsigned queued = 0;
+  unsigned in_flight = 0;
+  for (;;) {
+    while (next < files.size() && queued + in_flight < ring->entries) {
+      if (files[next].fd >= 0) {
+        ring->queue_read(files[next], next);
+        queued++;
+      }
+      next++;
+    }
+    if (queued + in_flight == 0) break;
+
+    int rc = ring->enter(queued);
+    if (rc < 0 && rc != -EINTR && rc != -EAGAIN && rc != -EBUSY) {
+      // the ring is unusable: read the rest with pread from now on
+      ring.reset();
+      for (size_t i = 0; i < files.size(); i++) {
+        if (!done[i] && files[i].fd >= 0) read_pread(files[i]);
+      }
+      return;
+    }
+    if (rc > 0) {
+      queued -= rc;
+      in_flight += rc;
+    }
+
+    unsigned head = *ring->cq_head;
+    unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+      const io_uring_cqe& cqe = ring->cqes[head & ring->cq_mask];
+      complete(files[cqe.user_data], cqe.res);
+      done[cqe.user_data] = true;
+      in_flight--;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+  }
+}
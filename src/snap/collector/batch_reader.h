@@ -0,0 +1,129 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <sys/uio.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "snap/collector/procfs.h"
+
+namespace Plugin {
+
+/**
+ * BatchReader reads many small files, such as per-cgroup or per-process
+ * stat files, once per collection.
+ *
+ * With io_uring (Linux 5.1 and later, unless disabled) every read of a
+ * batch is submitted at once and the kernel completes them with a few
+ * system calls in all; otherwise, or with use_io_uring false, each file is
+ * read with pread in turn. Files are read from offset 0 into buffers that
+ * are reused and grown as needed, so procfs and sysfs files read fresh each
+ * time.
+ *
+ * Files are opened when added and kept open, up to max_open of them;
+ * beyond that they're opened and closed by every read.
+ *
+ * E.g.:
+ *   Plugin::BatchReader reader((Plugin::BatchReader::Options()));
+ *   for (const std::string& cg : cgroups) reader.add(cg + "/cpu.stat");
+ *   ...
+ *   reader.read_all();
+ *   for (size_t i = 0; i < reader.size(); i++) {
+ *     Plugin::KeyValueParser kv(reader.contents(i), ' ');
+ *     ...
+ *   }
+ */
+class BatchReader final {
+ public:
+  struct Options {
+    Options();
+
+    bool use_io_uring;
+    /** reads in flight at once */
+    unsigned queue_depth;
+    /** initial buffer size per file */
+    size_t buffer_size;
+    size_t max_open;
+  };
+
+  explicit BatchReader(const Options& opts);
+  ~BatchReader();
+
+  BatchReader(const BatchReader&) = delete;
+  BatchReader& operator=(const BatchReader&) = delete;
+
+  /**
+   * add adds the file at path, returning its index.
+   */
+  size_t add(const std::string& path);
+
+  /**
+   * add_fd adds an open file the caller owns and keeps open while it's
+   * read, returning its index.
+   */
+  size_t add_fd(int fd);
+
+  size_t size() const { return files.size(); }
+
+  /**
+   * read_all reads every file, returning how many were read.
+   */
+  size_t read_all();
+
+  /**
+   * contents returns what the last read_all read from file i, NUL
+   * terminated, or an empty token if it failed.
+   */
+  Token contents(size_t i) const;
+
+  /**
+   * error returns the errno the last read of file i failed with, or 0.
+   */
+  int error(size_t i) const { return files[i].error; }
+
+  /**
+   * uses_io_uring tells whether reads go through io_uring.
+   */
+  bool uses_io_uring() const { return ring != nullptr; }
+
+ private:
+  struct File {
+    std::string path;
+    int fd;
+    bool owned;
+    std::vector<char> buf;
+    size_t len;
+    int error;
+    iovec iov;
+  };
+  struct Ring;
+
+  Options opts;
+  std::vector<File> files;
+  size_t open_files;
+  std::unique_ptr<Ring> ring;
+
+  bool open_file(File& file);
+  void close_file(File& file);
+  // finishes a read that returned res bytes or -errno
+  void complete(File& file, int64_t res);
+  void read_pread(File& file);
+  void read_ring();
+};
+
+}  // namespace Plugin
@@ -0,0 +1,288 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/collector/procfs.h"
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using Plugin::FileReader;
+using Plugin::KeyValueParser;
+using Plugin::PidStat;
+using Plugin::ProcessTable;
+using Plugin::TableParser;
+using Plugin::Token;
+
+static const size_t kInitialBuffer = 4096;
+
+static bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+bool Token::operator==(const char* str) const {
+  size_t n = std::strlen(str);
+  return n == size && std::memcmp(data, str, n) == 0;
+}
+
+bool Token::to_uint64(uint64_t* value) const {
+  if (size == 0) return false;
+  uint64_t v = 0;
+  for (size_t i = 0; i < size; i++) {
+    unsigned digit = unsigned(data[i]) - '0';
+    if (digit > 9) return false;
+    v = v * 10 + digit;
+  }
+  *value = v;
+  return true;
+}
+
+bool Token::to_int64(int64_t* value) const {
+  uint64_t v;
+  if (size > 1 && data[0] == '-') {
+    if (!Token(data + 1, size - 1).to_uint64(&v)) return false;
+    *value = -int64_t(v);
+    return true;
+  }
+  if (!to_uint64(&v)) return false;
+  *value = int64_t(v);
+  return true;
+}
+
+bool Token::to_double(double* value) const {
+  if (size == 0) return false;
+  // strtod needs a terminated string; numbers are short
+  char tmp[64];
+  if (size >= sizeof(tmp)) return false;
+  std::memcpy(tmp, data, size);
+  tmp[size] = '\0';
+  char* end;
+  double v = std::strtod(tmp, &end);
+  if (end != tmp + size) return false;
+  *value = v;
+  return true;
+}
+
+FileReader::FileReader(const std::string& path, bool keep_open) :
+                       file(path), keep_open(keep_open), fd(-1),
+                       buf(kInitialBuffer), len(0) {
+  buf[0] = '\0';
+}
+
+FileReader::~FileReader() {
+  if (fd >= 0) close(fd);
+}
+
+bool FileReader::read() {
+  len = 0;
+  buf[0] = '\0';
+  bool was_open = fd >= 0;
+  if (!was_open) {
+    fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+  }
+  bool ok = read_fd();
+  if (!ok && was_open) {
+    // the file may have been replaced, e.g. by a new process reusing a pid
+    close(fd);
+    fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    ok = fd >= 0 && read_fd();
+  }
+  if (fd >= 0 && (!ok || !keep_open)) {
+    close(fd);
+    fd = -1;
+  }
+  return ok;
+}
+
+bool FileReader::read_fd() {
+  len = 0;
+  for (;;) {
+    // keep a byte for the terminator
+    if (len + 1 == buf.size()) buf.resize(buf.size() * 2);
+    ssize_t n = pread(fd, buf.data() + len, buf.size() - len - 1, off_t(len));
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      len = 0;
+      buf[0] = '\0';
+      return false;
+    }
+    // seq_files return a page or so per read however much follows, so
+    // only an empty read is the end of the file
+    if (n == 0) break;
+    len += size_t(n);
+  }
+  buf[len] = '\0';
+  return true;
+}
+
+KeyValueParser::KeyValueParser(Token text, char sep) :
+                               pos(text.data), end(text.data + text.size),
+                               sep(sep) {}
+
+bool KeyValueParser::next(Token* key, Token* value) {
+  while (pos < end) {
+    const char* line = pos;
+    const char* eol = static_cast<const char*>(
+        std::memchr(pos, '\n', size_t(end - pos)));
+    if (eol == nullptr) eol = end;
+    pos = eol < end ? eol + 1 : end;
+
+    while (line < eol && is_space(*line)) line++;
+    const char* s = static_cast<const char*>(
+        std::memchr(line, sep, size_t(eol - line)));
+    if (s == nullptr || s == line) continue;
+    const char* key_end = s;
+    while (key_end > line && is_space(key_end[-1])) key_end--;
+
+    const char* v = s + 1;
+    while (v < eol && is_space(*v)) v++;
+    const char* v_end = v;
+    while (v_end < eol && !is_space(*v_end)) v_end++;
+
+    *key = Token(line, size_t(key_end - line));
+    *value = Token(v, size_t(v_end - v));
+    return true;
+  }
+  return false;
+}
+
+TableParser::TableParser(Token text) : pos(text.data),
+                                       end(text.data + text.size),
+                                       row_end(nullptr) {}
+
+bool TableParser::next_row() {
+  if (row_end != nullptr) {
+    pos = row_end < end ? row_end + 1 : end;
+  }
+  if (pos >= end) return false;
+  row_end = static_cast<const char*>(
+      std::memchr(pos, '\n', size_t(end - pos)));
+  if (row_end == nullptr) row_end = end;
+  return true;
+}
+
+bool TableParser::next_field(Token* field) {
+  if (row_end == nullptr) return false;
+  while (pos < row_end && is_space(*pos)) pos++;
+  if (pos == row_end) return false;
+  const char* start = pos;
+  while (pos < row_end && !is_space(*pos)) pos++;
+  *field = Token(start, size_t(pos - start));
+  return true;
+}
+
+size_t TableParser::fields(Token* out, size_t max) {
+  size_t n = 0;
+  while (n < max && next_field(&out[n])) n++;
+  return n;
+}
+
+bool PidStat::parse(Token text) {
+  const char* end = text.data + text.size;
+  const char* open = static_cast<const char*>(
+      std::memchr(text.data, '(', text.size));
+  const char* close = nullptr;
+  for (const char* p = end; p > text.data; p--) {
+    if (p[-1] == ')') {
+      close = p - 1;
+      break;
+    }
+  }
+  if (open == nullptr || close == nullptr || close < open) return false;
+
+  int64_t pid;
+  Token pid_token(text.data, size_t(open - text.data));
+  while (!pid_token.empty() && is_space(pid_token.data[pid_token.size - 1])) {
+    pid_token.size--;
+  }
+  if (!pid_token.to_int64(&pid)) return false;
+  fields[1] = pid;
+  comm = Token(open + 1, size_t(close - open - 1));
+  fields[2] = 0;
+
+  TableParser rest(Token(close + 1, size_t(end - close - 1)));
+  rest.next_row();
+  Token field;
+  if (!rest.next_field(&field) || field.size != 1) return false;
+  state = field.data[0];
+  fields[3] = 0;
+  count = 3;
+  while (count < kMaxFields && rest.next_field(&field)) {
+    if (!field.to_int64(&fields[count + 1])) return false;
+    count++;
+  }
+  return true;
+}
+
+ProcessTable::Options::Options() : root("/proc"), max_open(256) {
+  struct rlimit lim;
+  if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur != RLIM_INFINITY) {
+    max_open = size_t(lim.rlim_cur / 2);
+  }
+}
+
+ProcessTable::ProcessTable(const Options& opts) :
+                           opts(opts), dir(nullptr), open(0),
+                           generation(0) {}
+
+ProcessTable::~ProcessTable() {
+  if (dir != nullptr) closedir(dir);
+}
+
+const std::vector<PidStat>& ProcessTable::scan() {
+  stats.clear();
+  generation++;
+  if (dir == nullptr) {
+    dir = opendir(opts.root.c_str());
+    if (dir == nullptr) return stats;
+  } else {
+    rewinddir(dir);
+  }
+
+  while (struct dirent* ent = readdir(dir)) {
+    uint64_t pid;
+    if (!Token(ent->d_name, std::strlen(ent->d_name)).to_uint64(&pid)) {
+      continue;
+    }
+    Entry& e = procs[int(pid)];
+    if (!e.reader) {
+      bool keep = open < opts.max_open;
+      e.reader.reset(new FileReader(
+          opts.root + "/" + ent->d_name + "/stat", keep));
+      if (keep) open++;
+    }
+    e.seen = generation;
+    stats.emplace_back();
+    if (!e.reader->read() || !stats.back().parse(e.reader->contents())) {
+      stats.pop_back();
+    }
+  }
+
+  // forget the processes that exited
+  for (auto it = procs.begin(); it != procs.end();) {
+    if (it->second.seen != generation) {
+      if (it->second.reader->keeps_open()) open--;
+      it = procs.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return stats;
+}
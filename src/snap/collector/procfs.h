@@ -0,0 +1,218 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <dirent.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Plugin {
+
+/**
+ * Token is a view of bytes in a buffer owned by someone else, typically a
+ * FileReader; it's valid until that buffer is read into again.
+ */
+struct Token {
+  Token() : data(nullptr), size(0) {}
+  Token(const char* data, size_t size) : data(data), size(size) {}
+
+  bool empty() const { return size == 0; }
+  bool operator==(const char* str) const;
+  bool operator!=(const char* str) const { return !(*this == str); }
+  std::string str() const { return std::string(data, size); }
+
+  /**
+   * The to_ functions parse the whole token as a decimal number, returning
+   * false if it isn't one.
+   */
+  bool to_uint64(uint64_t* value) const;
+  bool to_int64(int64_t* value) const;
+  bool to_double(double* value) const;
+
+  const char* data;
+  size_t size;
+};
+
+/**
+ * FileReader reads a whole file with pread into a buffer it reuses, keeping
+ * the file open between reads, which suits procfs and sysfs files: their
+ * contents are regenerated by each read from offset 0.
+ *
+ * With keep_open false the file is opened and closed by every read, for
+ * callers that bound the number of open files.
+ */
+class FileReader final {
+ public:
+  explicit FileReader(const std::string& path, bool keep_open = true);
+  ~FileReader();
+
+  FileReader(const FileReader&) = delete;
+  FileReader& operator=(const FileReader&) = delete;
+
+  /**
+   * read reads the file again, returning false if it can't be opened or
+   * read, e.g. because the process it describes exited.
+   */
+  bool read();
+
+  /**
+   * contents returns what the last read returned. The buffer is NUL
+   * terminated.
+   */
+  Token contents() const { return Token(buf.data(), len); }
+
+  const std::string& path() const { return file; }
+
+  bool keeps_open() const { return keep_open; }
+
+ private:
+  std::string file;
+  bool keep_open;
+  int fd;
+  std::vector<char> buf;
+  size_t len;
+
+  bool read_fd();
+};
+
+/**
+ * KeyValueParser walks "key<sep> value" lines, as in /proc/meminfo
+ * ("MemTotal:  16318672 kB", sep ':') and /proc/vmstat ("nr_free_pages
+ * 123", sep ' '). Keys and values are trimmed; the value is the first
+ * whitespace-separated field after the separator.
+ */
+class KeyValueParser final {
+ public:
+  explicit KeyValueParser(Token text, char sep = ':');
+
+  /**
+   * next returns the next pair, skipping lines without sep, and false at
+   * the end.
+   */
+  bool next(Token* key, Token* value);
+
+ private:
+  const char* pos;
+  const char* end;
+  char sep;
+};
+
+/**
+ * TableParser walks whitespace-separated tables, as in /proc/net/dev or
+ * /proc/diskstats, row by row and field by field.
+ */
+class TableParser final {
+ public:
+  explicit TableParser(Token text);
+
+  /**
+   * next_row moves to the next line, returning false at the end.
+   */
+  bool next_row();
+
+  /**
+   * next_field returns the next field of the row, and false at its end.
+   */
+  bool next_field(Token* field);
+
+  /**
+   * fields splits the rest of the row into up to max fields, returning how
+   * many it found.
+   */
+  size_t fields(Token* out, size_t max);
+
+ private:
+  const char* pos;
+  const char* end;
+  const char* row_end;
+};
+
+/**
+ * PidStat holds the fields of /proc/[pid]/stat, numbered as in proc(5):
+ * field(1) is the pid, field(14) utime, field(24) rss, and so on. comm is
+ * taken from between the first '(' and the last ')', so a command holding
+ * spaces or parentheses parses correctly.
+ */
+struct PidStat {
+  static const int kMaxFields = 52;
+
+  /**
+   * parse fills the fields from text, returning false if it isn't a
+   * /proc/[pid]/stat line.
+   */
+  bool parse(Token text);
+
+  /**
+   * field returns field n, or 0 if the kernel didn't report it.
+   */
+  int64_t field(int n) const {
+    return n >= 1 && n <= count ? fields[n] : 0;
+  }
+
+  int64_t pid() const { return fields[1]; }
+
+  Token comm;
+  char state;
+  int count;
+  // 1-based; fields[2] and fields[3] (comm and state) are unused
+  int64_t fields[kMaxFields + 1];
+};
+
+/**
+ * ProcessTable reads /proc/[pid]/stat of every process, keeping a
+ * FileReader per process across scans, so a steady process table is read
+ * without opening files or allocating. At most max_open readers keep their
+ * file open, by default half the open file limit; the rest reopen it on
+ * each scan.
+ */
+class ProcessTable final {
+ public:
+  struct Options {
+    Options();
+
+    std::string root;
+    size_t max_open;
+  };
+
+  explicit ProcessTable(const Options& opts);
+  ~ProcessTable();
+
+  ProcessTable(const ProcessTable&) = delete;
+  ProcessTable& operator=(const ProcessTable&) = delete;
+
+  /**
+   * scan reads the stat of every process. The result, and the comm tokens
+   * in it, are valid until the next scan.
+   */
+  const std::vector<PidStat>& scan();
+
+ private:
+  struct Entry {
+    std::unique_ptr<FileReader> reader;
+    uint64_t seen;
+  };
+
+  Options opts;
+  DIR* dir;
+  std::unordered_map<int, Entry> procs;
+  size_t open;
+  uint64_t generation;
+  std::vector<PidStat> stats;
+};
+
+}  // namespace Plugin
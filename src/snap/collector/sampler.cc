@@ -0,0 +1,253 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/collector/sampler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "snap/plugin.h"
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+using std::chrono::system_clock;
+
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::Sampler;
+
+static const char* const kStats[] = {"last", "min", "max", "avg", "count"};
+
+static std::string join_ns(const rpc::Metric& met, int n) {
+  std::string key;
+  for (int i = 0; i < n; i++) {
+    key += '/';
+    key += met.namespace_(i).value();
+  }
+  return key;
+}
+
+struct Sampler::Series {
+  struct Slot {
+    // the index of the sample held, or kWriting while it's replaced
+    std::atomic<uint64_t> seq;
+    std::atomic<int64_t> ts;
+    std::atomic<uint64_t> bits;
+  };
+
+  static const uint64_t kWriting = std::numeric_limits<uint64_t>::max();
+
+  Series(const std::vector<Metric::NamespaceElement>& ns, const Probe& probe,
+         const std::string& unit, size_t capacity) :
+      ns(ns), unit(unit), probe(probe), capacity(capacity),
+      slots(new Slot[capacity]), head(0), cursor(0), has_last(false),
+      last(0), last_ts(0) {
+    for (size_t i = 0; i < capacity; i++) {
+      slots[i].seq.store(kWriting, std::memory_order_relaxed);
+    }
+  }
+
+  // writer side, the timer thread
+  void push(int64_t ts, double value) {
+    uint64_t i = head.load(std::memory_order_relaxed);
+    Slot& slot = slots[i % capacity];
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    slot.seq.store(kWriting, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.ts.store(ts, std::memory_order_relaxed);
+    slot.bits.store(bits, std::memory_order_relaxed);
+    slot.seq.store(i, std::memory_order_release);
+    head.store(i + 1, std::memory_order_release);
+  }
+
+  // reader side, under collect_mtx: summarizes the samples since the
+  // previous call
+  void summarize() {
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t begin = std::max(cursor, end > capacity ? end - capacity : 0);
+    count = 0;
+    min = std::numeric_limits<double>::infinity();
+    max = -std::numeric_limits<double>::infinity();
+    double sum = 0;
+    for (uint64_t i = begin; i < end; i++) {
+      const Slot& slot = slots[i % capacity];
+      uint64_t seq = slot.seq.load(std::memory_order_acquire);
+      int64_t ts = slot.ts.load(std::memory_order_relaxed);
+      uint64_t bits = slot.bits.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq != i || slot.seq.load(std::memory_order_relaxed) != i) {
+        // overwritten by a newer sample while being read
+        continue;
+      }
+      double value;
+      std::memcpy(&value, &bits, sizeof(value));
+      count++;
+      sum += value;
+      min = std::min(min, value);
+      max = std::max(max, value);
+      has_last = true;
+      last = value;
+      last_ts = ts;
+    }
+    cursor = end;
+    avg = count ? sum / count : last;
+    if (count == 0) {
+      min = last;
+      max = last;
+    }
+  }
+
+  std::vector<Metric::NamespaceElement> ns;
+  std::string unit;
+  Probe probe;
+  size_t capacity;
+  std::unique_ptr<Slot[]> slots;
+  // the number of samples pushed
+  std::atomic<uint64_t> head;
+
+  uint64_t cursor;
+  bool has_last;
+  double last;
+  int64_t last_ts;
+  uint64_t count;
+  double min;
+  double max;
+  double avg;
+};
+
+Sampler::Options::Options() : interval(milliseconds(100)), capacity(1024) {}
+
+Sampler::Sampler(const Options& opts) : opts(opts), running(false) {}
+
+Sampler::~Sampler() {
+  stop();
+}
+
+void Sampler::add(const std::vector<Metric::NamespaceElement>& ns,
+                  const Probe& probe, const std::string& unit) {
+  std::lock_guard<std::mutex> lk(timer_mtx);
+  if (running) {
+    throw PluginException("cannot add probes to a running Sampler");
+  }
+  series.emplace_back(new Series(ns, probe, unit,
+                                 std::max<size_t>(opts.capacity, 1)));
+  std::string key;
+  for (const Metric::NamespaceElement& nse : ns) key += "/" + nse.value;
+  by_ns[key] = series.back().get();
+}
+
+void Sampler::start() {
+  std::lock_guard<std::mutex> lk(timer_mtx);
+  if (running) return;
+  running = true;
+  timer = std::thread(&Sampler::run_timer, this);
+}
+
+void Sampler::stop() {
+  {
+    std::lock_guard<std::mutex> lk(timer_mtx);
+    running = false;
+  }
+  timer_cv.notify_all();
+  if (timer.joinable()) {
+    timer.join();
+  }
+}
+
+void Sampler::sample() {
+  int64_t now = duration_cast<nanoseconds>(
+      system_clock::now().time_since_epoch()).count();
+  for (const std::unique_ptr<Series>& s : series) {
+    double value;
+    try {
+      if (!s->probe(&value)) continue;
+    } catch (const std::exception&) {
+      continue;
+    }
+    s->push(now, value);
+  }
+}
+
+void Sampler::run_timer() {
+  steady_clock::time_point next = steady_clock::now();
+  std::unique_lock<std::mutex> lk(timer_mtx);
+  while (running) {
+    lk.unlock();
+    sample();
+    lk.lock();
+
+    next += opts.interval;
+    steady_clock::time_point now = steady_clock::now();
+    if (next < now) {
+      // the probes overran; skip the ticks missed rather than bunch them
+      next = now;
+    }
+    timer_cv.wait_until(lk, next, [this] { return !running; });
+  }
+}
+
+std::vector<Metric> Sampler::metric_types() const {
+  std::vector<Metric> types;
+  for (const std::unique_ptr<Series>& s : series) {
+    for (const char* stat : kStats) {
+      std::vector<Metric::NamespaceElement> ns = s->ns;
+      ns.push_back({stat, "", ""});
+      types.emplace_back(Metric(ns, s->unit, ""));
+    }
+  }
+  return types;
+}
+
+void Sampler::collect(std::vector<Metric>& metrics) {
+  std::lock_guard<std::mutex> lk(collect_mtx);
+  // each series is summarized once per collect, however many of its
+  // statistics are asked for
+  std::vector<Series*> summarized;
+  for (Metric& met : metrics) {
+    const rpc::Metric& rpc_met = *met.get_rpc_metric_ptr();
+    int n = rpc_met.namespace__size();
+    if (n < 2) continue;
+    auto it = by_ns.find(join_ns(rpc_met, n - 1));
+    if (it == by_ns.end()) continue;
+    Series* s = it->second;
+    if (std::find(summarized.begin(), summarized.end(), s) ==
+        summarized.end()) {
+      s->summarize();
+      summarized.push_back(s);
+    }
+    if (!s->has_last) continue;
+
+    const std::string& stat = rpc_met.namespace_(n - 1).value();
+    if (stat == "last") {
+      met.set_data(s->last);
+    } else if (stat == "min") {
+      met.set_data(s->min);
+    } else if (stat == "max") {
+      met.set_data(s->max);
+    } else if (stat == "avg") {
+      met.set_data(s->avg);
+    } else if (stat == "count") {
+      met.set_data(s->count);
+    } else {
+      continue;
+    }
+    met.set_timestamp(system_clock::time_point(
+        duration_cast<system_clock::duration>(nanoseconds(s->last_ts))));
+  }
+}
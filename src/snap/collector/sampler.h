@@ -0,0 +1,124 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "snap/metric.h"
+
+namespace Plugin {
+
+/**
+ * Sampler runs probes on its own timer thread, more often than snapteld
+ * polls, and keeps their samples in a ring buffer per series, so
+ * collect_metrics only has to summarize what was sampled since the previous
+ * collection, however slow the probes are.
+ *
+ * The timer thread is the only writer of the rings and never waits for
+ * readers: each slot carries a sequence number, written around the sample
+ * like a seqlock, so a reader tells a slot being overwritten from a
+ * complete one and skips it. Samples older than capacity ticks are lost.
+ *
+ * Each series with namespace ns offers the metrics ns/last, ns/min, ns/max
+ * and ns/avg (float64) and ns/count (uint64), over the samples since the
+ * previous collect; with no new samples, all but count repeat the last
+ * sample.
+ *
+ * E.g.:
+ *   sampler.add({{"intel", "", ""}, {"queue", "", ""}, {"depth", "", ""}},
+ *               [&](double* v) { *v = queue.depth(); return true; });
+ *   sampler.start();
+ *   ...
+ *   void collect_metrics(std::vector<Metric>& metrics) {
+ *     sampler.collect(metrics);
+ *   }
+ */
+class Sampler final {
+ public:
+  struct Options {
+    Options();
+
+    std::chrono::milliseconds interval;
+    /** samples kept per series */
+    size_t capacity;
+  };
+
+  /**
+   * A probe sets value and returns true, or returns false to skip the tick.
+   */
+  typedef std::function<bool(double* value)> Probe;
+
+  explicit Sampler(const Options& opts);
+  ~Sampler();
+
+  Sampler(const Sampler&) = delete;
+  Sampler& operator=(const Sampler&) = delete;
+
+  /**
+   * add registers a probe for the series ns. Probes can only be added
+   * before start, or PluginException is thrown.
+   */
+  void add(const std::vector<Metric::NamespaceElement>& ns, const Probe& probe,
+           const std::string& unit = "");
+
+  void start();
+  void stop();
+
+  /**
+   * sample runs every probe once, as the timer thread does each interval.
+   * It must not be called while the thread runs.
+   */
+  void sample();
+
+  /**
+   * metric_types returns the metrics the series offer, for
+   * get_metric_types.
+   */
+  std::vector<Metric> metric_types() const;
+
+  /**
+   * collect sets the data and timestamp of each requested metric that names
+   * a series and statistic; others are left as they are.
+   */
+  void collect(std::vector<Metric>& metrics);
+
+ private:
+  struct Series;
+
+  Options opts;
+  std::vector<std::unique_ptr<Series>> series;
+  std::unordered_map<std::string, Series*> by_ns;
+
+  // guards the summaries, which collect computes
+  std::mutex collect_mtx;
+
+  std::mutex timer_mtx;
+  std::condition_variable timer_cv;
+  bool running;
+  std::thread timer;
+
+  void run_timer();
+};
+
+}  // namespace Plugin
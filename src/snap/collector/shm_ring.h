@@ -0,0 +1,193 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace Plugin {
+
+/**
+ * The shared-memory ring lets local applications hand gauges and counters to
+ * a collector (see ShmRingCollector) with a few stores per value instead of a
+ * round trip over a socket.
+ *
+ * The collector creates the ring as a POSIX shared memory object; any number
+ * of producer processes or threads write to it through ShmRingWriter, which
+ * only needs this header. Writers claim a slot with one compare-and-swap and
+ * never wait for each other or for the collector: when the ring is full the
+ * value is dropped and counted instead.
+ *
+ * Layout: a ShmRingHeader, then capacity ShmRingSlots. A slot's seq is its
+ * position in the stream when free, position + 1 once written, and becomes
+ * free again for position + capacity when the collector has read it.
+ */
+static const uint32_t kShmRingMagic = 0x534e5052;  // "SNPR"
+static const uint32_t kShmRingVersion = 1;
+static const size_t kShmRingNameMax = 46;
+
+enum ShmRingKind : uint8_t {
+  /** the latest value is kept */
+  kShmGauge = 0,
+  /** values are added to a running total */
+  kShmCounter = 1,
+};
+
+struct ShmRingHeader {
+  // set last, once the slots are ready
+  std::atomic<uint32_t> magic;
+  uint32_t version;
+  uint64_t capacity;
+  // the next position to claim
+  alignas(64) std::atomic<uint64_t> head;
+  // values dropped by writers
+  alignas(64) std::atomic<uint64_t> dropped;
+  // the next position to read; only the collector uses it
+  alignas(64) uint64_t tail;
+};
+
+struct alignas(64) ShmRingSlot {
+  std::atomic<uint64_t> seq;
+  double value;
+  uint8_t kind;
+  uint8_t name_len;
+  char name[kShmRingNameMax];
+};
+
+static_assert(sizeof(ShmRingSlot) == 64, "ShmRingSlot must fill a cache line");
+
+/**
+ * shm_ring_size returns the size of a ring of capacity slots.
+ */
+inline size_t shm_ring_size(uint64_t capacity) {
+  return sizeof(ShmRingHeader) + capacity * sizeof(ShmRingSlot);
+}
+
+/**
+ * ShmRingWriter writes to a ring created by a collector. It does not throw;
+ * every call reports failure as false.
+ *
+ * E.g.:
+ *   Plugin::ShmRingWriter ring;
+ *   ring.open("/snap_ingest");
+ *   ...
+ *   ring.counter("http_requests", 1);
+ *   ring.gauge("queue_depth", queue.size());
+ *
+ * Names are at most kShmRingNameMax bytes and become the last namespace
+ * element of the metric. A writer may be shared by threads once open.
+ */
+class ShmRingWriter final {
+ public:
+  ShmRingWriter() : header(nullptr), slots(nullptr), size(0) {}
+  ~ShmRingWriter() { close(); }
+
+  ShmRingWriter(const ShmRingWriter&) = delete;
+  ShmRingWriter& operator=(const ShmRingWriter&) = delete;
+
+  /**
+   * open maps the ring named name, returning false if it doesn't exist yet
+   * or wasn't made by a compatible collector.
+   */
+  bool open(const std::string& name) {
+    close();
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) return false;
+    struct stat st;
+    void* addr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(ShmRingHeader)) {
+      addr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                  0);
+    }
+    ::close(fd);
+    if (addr == MAP_FAILED) return false;
+    ShmRingHeader* hdr = static_cast<ShmRingHeader*>(addr);
+    if (hdr->magic.load(std::memory_order_acquire) != kShmRingMagic ||
+        hdr->version != kShmRingVersion ||
+        shm_ring_size(hdr->capacity) != size_t(st.st_size)) {
+      munmap(addr, st.st_size);
+      return false;
+    }
+    header = hdr;
+    slots = reinterpret_cast<ShmRingSlot*>(hdr + 1);
+    size = st.st_size;
+    return true;
+  }
+
+  void close() {
+    if (header) munmap(header, size);
+    header = nullptr;
+    slots = nullptr;
+    size = 0;
+  }
+
+  bool is_open() const { return header != nullptr; }
+
+  bool gauge(const char* name, double value) {
+    return write(kShmGauge, name, value);
+  }
+
+  bool counter(const char* name, double delta) {
+    return write(kShmCounter, name, delta);
+  }
+
+ private:
+  ShmRingHeader* header;
+  ShmRingSlot* slots;
+  size_t size;
+
+  bool write(ShmRingKind kind, const char* name, double value) {
+    if (!header) return false;
+    size_t len = std::strlen(name);
+    if (len == 0 || len > kShmRingNameMax) {
+      header->dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    const uint64_t mask = header->capacity - 1;
+    uint64_t pos = header->head.load(std::memory_order_relaxed);
+    ShmRingSlot* slot;
+    for (;;) {
+      slot = &slots[pos & mask];
+      uint64_t seq = slot->seq.load(std::memory_order_acquire);
+      int64_t diff = int64_t(seq - pos);
+      if (diff == 0) {
+        if (header->head.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // not read yet since the last lap: full
+        header->dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      } else {
+        pos = header->head.load(std::memory_order_relaxed);
+      }
+    }
+    slot->value = value;
+    slot->kind = kind;
+    slot->name_len = uint8_t(len);
+    std::memcpy(slot->name, name, len);
+    slot->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+};
+
+}  // namespace Plugin
@@ -0,0 +1,225 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/collector/shm_ring_collector.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using Plugin::ConfigPolicy;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::ShmRing;
+using Plugin::ShmRingCollector;
+
+static uint64_t round_up_pow2(uint64_t n) {
+  uint64_t p = 1;
+  while (p < n) p <<= 1;
+  return p;
+}
+
+ShmRing::ShmRing(const std::string& name, uint64_t capacity,
+                 unsigned stall_drains) : stall_drains(stall_drains),
+                                          stalled_for(0), skipped(0) {
+  capacity = round_up_pow2(capacity < 2 ? 2 : capacity);
+  size = shm_ring_size(capacity);
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0660);
+  if (fd < 0) {
+    throw PluginException("shm_open " + name + ": " + std::strerror(errno));
+  }
+  struct stat st;
+  bool reuse = false;
+  if (fstat(fd, &st) == 0 && size_t(st.st_size) == size) {
+    void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr != MAP_FAILED) {
+      ShmRingHeader* hdr = static_cast<ShmRingHeader*>(addr);
+      reuse = hdr->magic.load(std::memory_order_acquire) == kShmRingMagic &&
+              hdr->version == kShmRingVersion && hdr->capacity == capacity;
+      if (reuse) {
+        header = hdr;
+      } else {
+        munmap(addr, size);
+      }
+    }
+  }
+
+  if (!reuse) {
+    // a fresh object, so producers mapping the old one can't see it change
+    // size under them
+    close(fd);
+    shm_unlink(name.c_str());
+    fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0660);
+    if (fd < 0) {
+      throw PluginException("shm_open " + name + ": " + std::strerror(errno));
+    }
+    void* addr = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+      addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (addr == MAP_FAILED) {
+      int err = errno;
+      close(fd);
+      throw PluginException("mapping " + name + ": " + std::strerror(err));
+    }
+    header = static_cast<ShmRingHeader*>(addr);
+    header->version = kShmRingVersion;
+    header->capacity = capacity;
+    header->head.store(0, std::memory_order_relaxed);
+    header->dropped.store(0, std::memory_order_relaxed);
+    header->tail = 0;
+    ShmRingSlot* s = reinterpret_cast<ShmRingSlot*>(header + 1);
+    for (uint64_t i = 0; i < capacity; i++) {
+      s[i].seq.store(i, std::memory_order_relaxed);
+    }
+    header->magic.store(kShmRingMagic, std::memory_order_release);
+  }
+  close(fd);
+  slots = reinterpret_cast<ShmRingSlot*>(header + 1);
+  stalled_at = header->tail;
+}
+
+ShmRing::~ShmRing() {
+  munmap(header, size);
+}
+
+bool ShmRing::abandon(uint64_t pos) {
+  if (pos != stalled_at) {
+    stalled_at = pos;
+    stalled_for = 0;
+  }
+  if (stall_drains == 0 || ++stalled_for <= stall_drains) return false;
+  stalled_for = 0;
+  skipped++;
+  return true;
+}
+
+ShmRingCollector::Options::Options() :
+    name("/snap_ingest"), capacity(1 << 16),
+    prefix({{"intel", "", ""}, {"ingest", "", ""}}), max_series(10000),
+    stall_drains(3) {}
+
+ShmRingCollector::ShmRingCollector(const Options& opts) :
+    opts(opts), ring(opts.name, opts.capacity, opts.stall_drains),
+    overflow(0) {}
+
+const ConfigPolicy ShmRingCollector::get_config_policy() {
+  return ConfigPolicy();
+}
+
+std::vector<Metric> ShmRingCollector::get_metric_types(Config cfg) {
+  std::vector<Metric::NamespaceElement> ns = opts.prefix;
+  ns.push_back({"*", "name", "name written by the producer"});
+  std::vector<Metric> types;
+  types.emplace_back(Metric(ns, "",
+                            "gauge or counter written by a local producer"));
+  ns.back() = {"ring", "", ""};
+  ns.push_back({"dropped", "", ""});
+  types.emplace_back(Metric(ns, "", "values dropped before collection"));
+  ns.back() = {"abandoned", "", ""};
+  types.emplace_back(Metric(ns, "",
+                            "slots skipped as left unwritten by a producer"));
+  return types;
+}
+
+void ShmRingCollector::drain() {
+  ring.drain([this](const ShmRingSlot& slot) {
+    // producers may write anything, including a length past the array
+    name.assign(slot.name, std::min<size_t>(slot.name_len, kShmRingNameMax));
+    auto it = series.find(name);
+    if (it == series.end()) {
+      if (series.size() >= opts.max_series) {
+        overflow++;
+        return;
+      }
+      it = series.insert({name, Series{ShmRingKind(slot.kind), 0}}).first;
+      order.push_back(&*it);
+    }
+    if (slot.kind == kShmCounter) {
+      it->second.value += slot.value;
+    } else {
+      it->second.value = slot.value;
+    }
+  }, ring.capacity());
+}
+
+bool ShmRingCollector::has_prefix(const rpc::Metric& met) const {
+  if (size_t(met.namespace__size()) <= opts.prefix.size()) return false;
+  for (size_t i = 0; i < opts.prefix.size(); i++) {
+    if (met.namespace_(i).value() != opts.prefix[i].value) return false;
+  }
+  return true;
+}
+
+void ShmRingCollector::collect_metrics(std::vector<Metric>& metrics) {
+  std::lock_guard<std::mutex> lk(mtx);
+  drain();
+
+  const int depth = opts.prefix.size();
+  const size_t requested = metrics.size();
+  // requests that got no data: unknown names, and the "*" requests which
+  // are replaced by one metric per name
+  std::vector<bool> drop(requested, true);
+  rpc::Metric scratch;
+  for (size_t i = 0; i < requested; i++) {
+    const rpc::Metric& req = *metrics[i].get_rpc_metric_ptr();
+    if (!has_prefix(req)) continue;
+    const int n = req.namespace__size();
+    if (n == depth + 2 && req.namespace_(depth).value() == "ring") {
+      const std::string& stat = req.namespace_(depth + 1).value();
+      if (stat == "dropped") {
+        metrics[i].set_data(uint64_t(ring.dropped() + overflow));
+      } else if (stat == "abandoned") {
+        metrics[i].set_data(uint64_t(ring.abandoned()));
+      } else {
+        continue;
+      }
+      metrics[i].set_timestamp();
+      drop[i] = false;
+      continue;
+    }
+    if (n != depth + 1) continue;
+
+    const std::string& want = req.namespace_(depth).value();
+    if (want != "*") {
+      auto it = series.find(want);
+      if (it == series.end()) continue;
+      metrics[i].set_data(it->second.value);
+      metrics[i].set_timestamp();
+      drop[i] = false;
+      continue;
+    }
+    scratch = req;
+    for (const std::pair<const std::string, Series>* s : order) {
+      scratch.mutable_namespace_(depth)->set_value(s->first);
+      metrics.emplace_back(Metric(&scratch));
+      metrics.back().set_data(s->second.value);
+      metrics.back().set_timestamp();
+    }
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < metrics.size(); i++) {
+    if (i < requested && drop[i]) continue;
+    if (kept != i) metrics[kept].swap(metrics[i]);
+    kept++;
+  }
+  while (metrics.size() > kept) metrics.pop_back();
+}
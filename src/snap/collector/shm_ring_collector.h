@@ -0,0 +1,180 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "snap/collector/shm_ring.h"
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+
+namespace Plugin {
+
+/**
+ * ShmRing is the collector's end of a shared-memory ring (see shm_ring.h).
+ *
+ * It creates the shared memory object, or reuses one left by an earlier run
+ * with the same capacity so that producers which already opened it keep
+ * working. An incompatible object is replaced; producers still holding the
+ * old one must open the ring again.
+ *
+ * The object is not removed on destruction, so the plugin can restart
+ * without producers losing the ring.
+ *
+ * A producer that dies between claiming a slot and finishing its write
+ * leaves the slot claimed for good, and nothing after it could be read. So
+ * once the same slot has stopped stall_drains drains in a row it is taken
+ * as abandoned: it is skipped, freed and counted (see abandoned). A
+ * producer that was only stalled that long loses its value, or has it read
+ * in place of a later one on the next lap; the ring stays usable either
+ * way.
+ */
+class ShmRing final {
+ public:
+  /**
+   * capacity is rounded up to a power of two. stall_drains of 0 never skips
+   * a claimed slot. Failures are thrown as PluginException.
+   */
+  ShmRing(const std::string& name, uint64_t capacity,
+          unsigned stall_drains = 3);
+  ~ShmRing();
+
+  ShmRing(const ShmRing&) = delete;
+  ShmRing& operator=(const ShmRing&) = delete;
+
+  /**
+   * drain calls fn(slot) for up to max written slots in order, and returns
+   * how many it read. It stops at a slot a producer has claimed but not
+   * finished writing, which is read by a later drain unless it is found
+   * abandoned.
+   */
+  template<typename F>
+  size_t drain(F fn, size_t max) {
+    const uint64_t mask = header->capacity - 1;
+    uint64_t tail = header->tail;
+    size_t n = 0;
+    while (n < max) {
+      ShmRingSlot& slot = slots[tail & mask];
+      if (slot.seq.load(std::memory_order_acquire) == tail + 1) {
+        fn(const_cast<const ShmRingSlot&>(slot));
+        n++;
+      } else if (header->head.load(std::memory_order_relaxed) == tail ||
+                 !abandon(tail)) {
+        // empty, or claimed and still being written
+        break;
+      }
+      slot.seq.store(tail + header->capacity, std::memory_order_release);
+      tail++;
+    }
+    header->tail = tail;
+    return n;
+  }
+
+  uint64_t capacity() const { return header->capacity; }
+
+  /**
+   * dropped returns the number of values producers dropped.
+   */
+  uint64_t dropped() const {
+    return header->dropped.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * abandoned returns the number of claimed slots skipped since this ring
+   * was opened.
+   */
+  uint64_t abandoned() const { return skipped; }
+
+ private:
+  ShmRingHeader* header;
+  ShmRingSlot* slots;
+  size_t size;
+  unsigned stall_drains;
+  // the position drains last stopped at, and how many did in a row
+  uint64_t stalled_at;
+  unsigned stalled_for;
+  uint64_t skipped;
+
+  /**
+   * abandon records that a drain stopped at the claimed slot of pos, and
+   * returns whether the slot should now be skipped.
+   */
+  bool abandon(uint64_t pos);
+};
+
+/**
+ * ShmRingCollector collects what local producers write to a ShmRing.
+ *
+ * Each collect drains the ring, keeping the latest value of each gauge and
+ * the running total of each counter, and reports every name seen so far as
+ * prefix/<name> (float64). The name element is dynamic, so a task can ask
+ * for every name with "*" or for single names. prefix/ring/dropped (uint64)
+ * counts the values lost to a full ring, to bad names, or to max_series;
+ * prefix/ring/abandoned (uint64) the slots skipped as left half-written by
+ * a producer that died (see ShmRing).
+ *
+ * E.g.:
+ *   Plugin::ShmRingCollector plg((Plugin::ShmRingCollector::Options()));
+ *   Plugin::start_collector(&plg, meta);
+ */
+class ShmRingCollector final : public CollectorInterface {
+ public:
+  struct Options {
+    Options();
+
+    /** the shared memory object, as given to shm_open */
+    std::string name;
+    uint64_t capacity;
+    std::vector<Metric::NamespaceElement> prefix;
+    /** names seen beyond this many are dropped */
+    size_t max_series;
+    /**
+     * collects a slot may hold up the ring while claimed but unwritten
+     * before it is skipped; 0 never skips
+     */
+    unsigned stall_drains;
+  };
+
+  explicit ShmRingCollector(const Options& opts);
+
+  const ConfigPolicy get_config_policy();
+  std::vector<Metric> get_metric_types(Config cfg);
+  void collect_metrics(std::vector<Metric>& metrics);
+
+ private:
+  struct Series {
+    ShmRingKind kind;
+    double value;
+  };
+
+  Options opts;
+  std::mutex mtx;
+  ShmRing ring;
+  std::unordered_map<std::string, Series> series;
+  // names in the order they were first seen
+  std::vector<const std::pair<const std::string, Series>*> order;
+  uint64_t overflow;
+  std::string name;
+
+  void drain();
+  bool has_prefix(const rpc::Metric& met) const;
+};
+
+}  // namespace Plugin
@@ -0,0 +1,532 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/collector/statsd.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "snap/hash.h"
+
+using Plugin::ConfigPolicy;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::StatsdCollector;
+using Plugin::StatsdLine;
+using Plugin::StatsdParser;
+using Plugin::Token;
+using Plugin::fnv1a;
+using Plugin::kFnvOffset;
+using Plugin::splitmix64;
+
+// larger datagrams are truncated and counted as errors
+static const size_t kMaxDatagram = 8192;
+
+StatsdParser::StatsdParser(const char* data, size_t len) :
+    pos(data), end(data + len), n_errors(0) {}
+
+bool StatsdParser::next(StatsdLine* line) {
+  while (pos < end) {
+    const char* eol = static_cast<const char*>(
+        std::memchr(pos, '\n', end - pos));
+    if (!eol) eol = end;
+    const char* p = pos;
+    const char* e = eol;
+    pos = eol + 1;
+    if (e > p && e[-1] == '\r') e--;
+    if (e == p) continue;
+    if (parse(p, e, line)) return true;
+    n_errors++;
+  }
+  return false;
+}
+
+bool StatsdParser::parse(const char* p, const char* e, StatsdLine* line) {
+  const char* colon = static_cast<const char*>(std::memchr(p, ':', e - p));
+  if (!colon || colon == p) return false;
+  // '|' ends the name in series keys
+  if (std::memchr(p, '|', colon - p)) return false;
+  const char* bar = static_cast<const char*>(
+      std::memchr(colon + 1, '|', e - colon - 1));
+  if (!bar) return false;
+  line->name = Token(p, colon - p);
+  Token value(colon + 1, bar - colon - 1);
+
+  // the type, then optional fields, each after a '|'
+  const char* field = bar + 1;
+  const char* field_end = static_cast<const char*>(
+      std::memchr(field, '|', e - field));
+  if (!field_end) field_end = e;
+  Token type(field, field_end - field);
+  if (type == "c") {
+    line->type = StatsdLine::Counter;
+  } else if (type == "g") {
+    line->type = StatsdLine::Gauge;
+  } else if (type == "ms" || type == "h") {
+    line->type = StatsdLine::Timer;
+  } else {
+    return false;
+  }
+
+  line->rate = 1;
+  line->tags = Token();
+  while (field_end < e) {
+    field = field_end + 1;
+    field_end = static_cast<const char*>(std::memchr(field, '|', e - field));
+    if (!field_end) field_end = e;
+    if (field == field_end) continue;
+    if (*field == '@') {
+      if (!Token(field + 1, field_end - field - 1).to_double(&line->rate) ||
+          !(line->rate > 0 && line->rate <= 1)) {
+        return false;
+      }
+    } else if (*field == '#') {
+      line->tags = Token(field + 1, field_end - field - 1);
+    }
+    // other fields, such as DogStatsD's container id, are ignored
+  }
+
+  if (!value.to_double(&line->value)) return false;
+  line->relative = line->type == StatsdLine::Gauge &&
+                   (value.data[0] == '+' || value.data[0] == '-');
+  return true;
+}
+
+namespace {
+
+// Series keys are the type, the name, '|' and the raw tags; names can't
+// hold a '|'.
+uint64_t key_hash(const StatsdLine& line) {
+  char type = line.type;
+  uint64_t h = fnv1a(kFnvOffset, &type, 1);
+  h = fnv1a(h, line.name.data, line.name.size);
+  h = fnv1a(h, "|", 1);
+  return splitmix64(fnv1a(h, line.tags.data, line.tags.size));
+}
+
+bool key_equals(const std::string& key, const StatsdLine& line) {
+  return key.size() == 2 + line.name.size + line.tags.size &&
+         key[0] == line.type &&
+         std::memcmp(&key[1], line.name.data, line.name.size) == 0 &&
+         key[1 + line.name.size] == '|' &&
+         std::memcmp(&key[2 + line.name.size], line.tags.data,
+                     line.tags.size) == 0;
+}
+
+}  // namespace
+
+struct StatsdCollector::Shard {
+  struct Entry {
+    uint64_t hash;
+    std::string key;
+    bool dirty;
+    // a gauge set, rather than only adjusted, since the last merge
+    bool gauge_set;
+    double value;
+    double count;
+    double min;
+    double max;
+  };
+
+  explicit Shard(size_t max_series) :
+      fd(-1), max_series(max_series), index(256, 0), packets(0), errors(0) {}
+
+  ~Shard() {
+    if (fd >= 0) close(fd);
+  }
+
+  // under mtx
+  void add_packet(const char* data, size_t len) {
+    StatsdParser parser(data, len);
+    StatsdLine line;
+    while (parser.next(&line)) {
+      Entry* e = find(line);
+      if (!e) {
+        errors.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      e->dirty = true;
+      switch (line.type) {
+        case StatsdLine::Counter:
+          e->value += line.value / line.rate;
+          break;
+        case StatsdLine::Gauge:
+          if (line.relative) {
+            e->value += line.value;
+          } else {
+            e->value = line.value;
+            e->gauge_set = true;
+          }
+          break;
+        case StatsdLine::Timer:
+          // a sampled value stands for 1 / rate values
+          e->count += 1 / line.rate;
+          e->value += line.value / line.rate;
+          e->min = std::min(e->min, line.value);
+          e->max = std::max(e->max, line.value);
+          break;
+      }
+    }
+    if (parser.errors()) {
+      errors.fetch_add(parser.errors(), std::memory_order_relaxed);
+    }
+  }
+
+  // finds the entry for the series of line, adding it if there's room
+  Entry* find(const StatsdLine& line) {
+    uint64_t h = key_hash(line);
+    size_t mask = index.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+      uint32_t slot = index[i];
+      if (slot == 0) break;
+      Entry& e = entries[slot - 1];
+      if (e.hash == h && key_equals(e.key, line)) return &e;
+    }
+    if (entries.size() >= max_series) return nullptr;
+
+    entries.push_back(Entry());
+    Entry& e = entries.back();
+    e.hash = h;
+    e.key.reserve(2 + line.name.size + line.tags.size);
+    e.key += char(line.type);
+    e.key.append(line.name.data, line.name.size);
+    e.key += '|';
+    e.key.append(line.tags.data, line.tags.size);
+    reset(e);
+    if (entries.size() * 4 > index.size() * 3) {
+      grow();
+    } else {
+      insert(h, entries.size());
+    }
+    return &e;
+  }
+
+  void insert(uint64_t h, uint32_t slot) {
+    size_t mask = index.size() - 1;
+    size_t i = h & mask;
+    while (index[i] != 0) i = (i + 1) & mask;
+    index[i] = slot;
+  }
+
+  void grow() {
+    index.assign(index.size() * 2, 0);
+    for (size_t i = 0; i < entries.size(); i++) {
+      insert(entries[i].hash, i + 1);
+    }
+  }
+
+  static void reset(Entry& e) {
+    e.dirty = false;
+    e.gauge_set = false;
+    e.value = 0;
+    e.count = 0;
+    e.min = std::numeric_limits<double>::infinity();
+    e.max = -std::numeric_limits<double>::infinity();
+  }
+
+  int fd;
+  size_t max_series;
+  std::mutex mtx;
+  std::vector<Entry> entries;
+  // open addressing over entries: 0 is empty, otherwise an entry index + 1
+  std::vector<uint32_t> index;
+  std::atomic<uint64_t> packets;
+  std::atomic<uint64_t> errors;
+};
+
+struct StatsdCollector::Series {
+  double value;
+  double count;
+  double min;
+  double max;
+};
+
+StatsdCollector::Options::Options() :
+    address("0.0.0.0"), port(8125),
+    threads(std::max(1, std::min(4, int(std::thread::hardware_concurrency())))),
+    batch(64), rcvbuf(4 << 20),
+    prefix({{"intel", "", ""}, {"statsd", "", ""}}), max_series(100000) {}
+
+static int open_socket(const StatsdCollector::Options& opts, int port,
+                       int* bound_port) {
+  sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, opts.address.c_str(), &addr.sin_addr) != 1) {
+    throw PluginException("invalid StatsD address " + opts.address);
+  }
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    throw PluginException(std::string("socket: ") + std::strerror(errno));
+  }
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &opts.rcvbuf, sizeof(opts.rcvbuf));
+  // receivers wake up this often to see if they should stop
+  timeval timeout = {0, 100000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  socklen_t len = sizeof(addr);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+    int err = errno;
+    close(fd);
+    throw PluginException("binding " + opts.address + ":" +
+                          std::to_string(port) + ": " + std::strerror(err));
+  }
+  *bound_port = ntohs(addr.sin_port);
+  return fd;
+}
+
+StatsdCollector::StatsdCollector(const Options& opts) :
+    opts(opts), bound_port(opts.port), stopping(false) {
+  int threads = std::max(1, opts.threads);
+  for (int i = 0; i < threads; i++) {
+    shards.emplace_back(new Shard(opts.max_series));
+    // the first socket fixes the port when asked for any
+    shards.back()->fd = open_socket(opts, bound_port, &bound_port);
+  }
+  for (const std::unique_ptr<Shard>& shard : shards) {
+    receivers.emplace_back(&StatsdCollector::run_receiver, this, shard.get());
+  }
+}
+
+StatsdCollector::~StatsdCollector() {
+  stopping = true;
+  for (std::thread& t : receivers) t.join();
+}
+
+void StatsdCollector::run_receiver(Shard* shard) {
+  const int batch = std::max(1, opts.batch);
+  std::vector<char> buf(batch * kMaxDatagram);
+  std::vector<iovec> iov(batch);
+  std::vector<mmsghdr> msgs(batch);
+  std::memset(msgs.data(), 0, batch * sizeof(mmsghdr));
+  for (int i = 0; i < batch; i++) {
+    iov[i].iov_base = &buf[i * kMaxDatagram];
+    iov[i].iov_len = kMaxDatagram;
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  while (!stopping.load(std::memory_order_relaxed)) {
+    // waits for one datagram, then takes whatever else is queued
+    int n = recvmmsg(shard->fd, msgs.data(), batch, MSG_WAITFORONE, nullptr);
+    if (n <= 0) continue;
+    std::lock_guard<std::mutex> lk(shard->mtx);
+    for (int i = 0; i < n; i++) {
+      if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+        shard->errors.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      shard->add_packet(static_cast<const char*>(iov[i].iov_base),
+                        msgs[i].msg_len);
+    }
+    shard->packets.fetch_add(n, std::memory_order_relaxed);
+  }
+}
+
+void StatsdCollector::add_packet(const char* data, size_t len) {
+  Shard* shard = shards[0].get();
+  std::lock_guard<std::mutex> lk(shard->mtx);
+  shard->add_packet(data, len);
+  shard->packets.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t StatsdCollector::packets() const {
+  uint64_t n = 0;
+  for (const std::unique_ptr<Shard>& shard : shards) {
+    n += shard->packets.load(std::memory_order_relaxed);
+  }
+  return n;
+}
+
+uint64_t StatsdCollector::errors() const {
+  uint64_t n = 0;
+  for (const std::unique_ptr<Shard>& shard : shards) {
+    n += shard->errors.load(std::memory_order_relaxed);
+  }
+  return n;
+}
+
+const ConfigPolicy StatsdCollector::get_config_policy() {
+  return ConfigPolicy();
+}
+
+std::vector<Metric> StatsdCollector::get_metric_types(Config cfg) {
+  std::vector<Metric> types;
+  std::vector<Metric::NamespaceElement> ns = opts.prefix;
+  ns.push_back({"counter", "", ""});
+  ns.push_back({"*", "name", "StatsD metric name"});
+  types.emplace_back(Metric(ns, "", "StatsD counter, per collect"));
+  ns[ns.size() - 2] = {"gauge", "", ""};
+  types.emplace_back(Metric(ns, "", "StatsD gauge"));
+  ns[ns.size() - 2] = {"timer", "", ""};
+  for (const char* stat : {"count", "min", "max", "avg"}) {
+    ns.push_back({stat, "", ""});
+    types.emplace_back(Metric(ns, "", std::string("StatsD timer ") + stat +
+                                      ", per collect"));
+    ns.pop_back();
+  }
+  return types;
+}
+
+void StatsdCollector::merge() {
+  // counters and timers report what arrived since the last collect
+  for (std::pair<const std::string, Series>* s : order) {
+    if (s->first[0] == StatsdLine::Gauge) continue;
+    s->second.value = 0;
+    s->second.count = 0;
+    s->second.min = std::numeric_limits<double>::infinity();
+    s->second.max = -std::numeric_limits<double>::infinity();
+  }
+
+  for (const std::unique_ptr<Shard>& shard : shards) {
+    std::lock_guard<std::mutex> lk(shard->mtx);
+    for (Shard::Entry& e : shard->entries) {
+      if (!e.dirty) continue;
+      auto it = series.find(e.key);
+      if (it == series.end()) {
+        it = series.insert({e.key, Series{0, 0,
+            std::numeric_limits<double>::infinity(),
+            -std::numeric_limits<double>::infinity()}}).first;
+        order.push_back(&*it);
+      }
+      Series& s = it->second;
+      if (e.gauge_set) {
+        s.value = e.value;
+      } else {
+        s.value += e.value;
+      }
+      s.count += e.count;
+      s.min = std::min(s.min, e.min);
+      s.max = std::max(s.max, e.max);
+      Shard::reset(e);
+    }
+  }
+}
+
+void StatsdCollector::report(const std::pair<const std::string, Series>& s,
+                             const rpc::Metric& req, size_t depth,
+                             std::vector<Metric>& out) {
+  const std::string& key = s.first;
+  size_t bar = key.find('|');
+  const Series& v = s.second;
+
+  rpc::Metric scratch = req;
+  scratch.mutable_namespace_(depth + 1)->set_value(key.substr(1, bar - 1));
+  // DogStatsD tags: "key:value,key"
+  size_t pos = bar + 1;
+  while (pos < key.size()) {
+    size_t comma = key.find(',', pos);
+    if (comma == std::string::npos) comma = key.size();
+    size_t colon = key.find(':', pos);
+    if (comma > pos) {
+      if (colon < comma) {
+        (*scratch.mutable_tags())[key.substr(pos, colon - pos)] =
+            key.substr(colon + 1, comma - colon - 1);
+      } else {
+        (*scratch.mutable_tags())[key.substr(pos, comma - pos)] = "";
+      }
+    }
+    pos = comma + 1;
+  }
+
+  out.emplace_back(Metric(&scratch));
+  Metric& met = out.back();
+  if (key[0] != StatsdLine::Timer) {
+    met.set_data(v.value);
+  } else {
+    const std::string& stat = req.namespace_(depth + 2).value();
+    if (stat == "count") {
+      met.set_data(uint64_t(v.count + 0.5));
+    } else if (stat == "min") {
+      met.set_data(v.min);
+    } else if (stat == "max") {
+      met.set_data(v.max);
+    } else {
+      met.set_data(v.value / v.count);
+    }
+  }
+  met.set_timestamp();
+}
+
+void StatsdCollector::collect_metrics(std::vector<Metric>& metrics) {
+  std::lock_guard<std::mutex> lk(mtx);
+  merge();
+
+  const size_t depth = opts.prefix.size();
+  const size_t requested = metrics.size();
+  rpc::Metric req;
+  for (size_t i = 0; i < requested; i++) {
+    // a copy, as metrics grows below
+    req = *metrics[i].get_rpc_metric_ptr();
+    size_t n = req.namespace__size();
+    if (n < depth + 2) continue;
+    bool match = true;
+    for (size_t j = 0; j < depth && match; j++) {
+      match = req.namespace_(j).value() == opts.prefix[j].value;
+    }
+    if (!match) continue;
+
+    const std::string& kind = req.namespace_(depth).value();
+    char type;
+    if (kind == "counter") {
+      type = StatsdLine::Counter;
+    } else if (kind == "gauge") {
+      type = StatsdLine::Gauge;
+    } else if (kind == "timer") {
+      type = StatsdLine::Timer;
+    } else {
+      continue;
+    }
+    if (n != depth + (type == StatsdLine::Timer ? 3 : 2)) continue;
+    bool timer_count = type == StatsdLine::Timer &&
+                       req.namespace_(depth + 2).value() == "count";
+    if (type == StatsdLine::Timer && !timer_count) {
+      const std::string& stat = req.namespace_(depth + 2).value();
+      if (stat != "min" && stat != "max" && stat != "avg") continue;
+    }
+
+    const std::string& name = req.namespace_(depth + 1).value();
+    for (const std::pair<const std::string, Series>* s : order) {
+      const std::string& key = s->first;
+      if (key[0] != type) continue;
+      if (name != "*" && (key.compare(1, name.size(), name) != 0 ||
+                          key[1 + name.size()] != '|')) {
+        continue;
+      }
+      // min, max and avg of no samples are left out
+      if (type == StatsdLine::Timer && !timer_count && s->second.count == 0) {
+        continue;
+      }
+      report(*s, req, depth, metrics);
+    }
+  }
+
+  // the requests themselves are replaced by what they matched
+  for (size_t i = requested; i < metrics.size(); i++) {
+    metrics[i - requested].swap(metrics[i]);
+  }
+  for (size_t i = 0; i < requested; i++) metrics.pop_back();
+}
@@ -0,0 +1,170 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "snap/collector/procfs.h"
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+
+namespace Plugin {
+
+/**
+ * StatsdLine is one parsed StatsD line,
+ *   <name>:<value>|<type>[|@<sample rate>][|#<tags>]
+ * where type is c (counter), g (gauge), ms or h (timer), and tags are
+ * DogStatsD's "key:value,key" list. The tokens point into the datagram.
+ */
+struct StatsdLine {
+  enum Type : char {
+    Counter = 'c',
+    Gauge = 'g',
+    Timer = 'm',
+  };
+
+  Token name;
+  Type type;
+  double value;
+  /** a gauge value with a sign adjusts the gauge instead of setting it */
+  bool relative;
+  double rate;
+  Token tags;
+};
+
+/**
+ * StatsdParser splits a datagram into StatsdLines without allocating.
+ * Malformed lines, and sets, are skipped and counted.
+ */
+class StatsdParser final {
+ public:
+  StatsdParser(const char* data, size_t len);
+
+  /**
+   * next parses the next good line into line, returning false at the end.
+   */
+  bool next(StatsdLine* line);
+
+  size_t errors() const { return n_errors; }
+
+ private:
+  const char* pos;
+  const char* end;
+  size_t n_errors;
+
+  bool parse(const char* p, const char* e, StatsdLine* line);
+};
+
+/**
+ * StatsdCollector is a StatsD server: it listens on a UDP port and reports
+ * what it received as metrics.
+ *
+ * Each of its receiver threads has its own socket on the port
+ * (SO_REUSEPORT, so the kernel spreads datagrams over them), reads batches
+ * of datagrams with one recvmmsg call, and aggregates them into its own
+ * shard, whose lock only collect_metrics ever contends for. Series are
+ * found without allocating; only a new series allocates.
+ *
+ * collect_metrics merges the shards, then reports
+ *   prefix/counter/<name>               (float64) sum since the last collect,
+ *                                       scaled by sample rates
+ *   prefix/gauge/<name>                 (float64) current value
+ *   prefix/timer/<name>/count           (uint64)  samples since the last
+ *                                       collect, scaled by sample rates
+ *   prefix/timer/<name>/{min,max,avg}   (float64) of those samples
+ * with a metric per series for each "*" name requested, and the DogStatsD
+ * tags as metric tags. Relative gauge updates received by different threads
+ * in one interval are applied in no particular order.
+ *
+ * E.g.:
+ *   Plugin::StatsdCollector plg((Plugin::StatsdCollector::Options()));
+ *   Plugin::start_collector(&plg, meta);
+ */
+class StatsdCollector final : public CollectorInterface {
+ public:
+  struct Options {
+    Options();
+
+    /** address to listen on, e.g. "0.0.0.0" */
+    std::string address;
+    /** 0 picks a free port, see port() */
+    int port;
+    int threads;
+    /** datagrams read per recvmmsg */
+    int batch;
+    /** socket receive buffer, in bytes */
+    int rcvbuf;
+    std::vector<Metric::NamespaceElement> prefix;
+    /** series per receiver thread; lines for new series beyond it are
+     * dropped */
+    size_t max_series;
+  };
+
+  /**
+   * The receivers start listening at once. Failing to bind is thrown as
+   * PluginException.
+   */
+  explicit StatsdCollector(const Options& opts);
+  ~StatsdCollector();
+
+  StatsdCollector(const StatsdCollector&) = delete;
+  StatsdCollector& operator=(const StatsdCollector&) = delete;
+
+  const ConfigPolicy get_config_policy();
+  std::vector<Metric> get_metric_types(Config cfg);
+  void collect_metrics(std::vector<Metric>& metrics);
+
+  /**
+   * add_packet aggregates a datagram as though a receiver had read it.
+   */
+  void add_packet(const char* data, size_t len);
+
+  int port() const { return bound_port; }
+
+  /** datagrams received */
+  uint64_t packets() const;
+  /** lines skipped as malformed or for exceeding max_series */
+  uint64_t errors() const;
+
+ private:
+  struct Shard;
+  struct Series;
+
+  Options opts;
+  int bound_port;
+  std::vector<std::unique_ptr<Shard>> shards;
+  std::vector<std::thread> receivers;
+  std::atomic<bool> stopping;
+
+  std::mutex mtx;
+  std::unordered_map<std::string, Series> series;
+  // series in the order they were first seen
+  std::vector<std::pair<const std::string, Series>*> order;
+
+  void run_receiver(Shard* shard);
+  void merge();
+  void report(const std::pair<const std::string, Series>& s,
+              const rpc::Metric& req, size_t depth, std::vector<Metric>& out);
+};
+
+}  // namespace Plugin
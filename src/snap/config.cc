@@ -13,15 +13,20 @@ limitations under the License.
 */
 #include "snap/config.h"
 
+#include <cstdint>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#include "snap/hash.h"
+
 using Plugin::Config;
 using Plugin::ConfigPolicy;
 using Plugin::StringRule;
+using Plugin::splitmix64;
 
 static const std::string build_key(const std::vector<std::string>&);
+static uint64_t hash_bytes(uint64_t seed, const void* data, size_t len);
 
 ConfigPolicy::ConfigPolicy() {}
 ConfigPolicy::~ConfigPolicy() {}
@@ -76,6 +81,43 @@ std::string Config::get_string(const std::string& key) const {
   return str_map.at(key);
 }
 
+uint64_t Config::fingerprint() const {
+  // Each entry is hashed on its own and the results are summed, which makes
+  // the fingerprint independent of the (unspecified) map iteration order.
+  uint64_t fp = 0;
+  for (const auto& kv : rpc_map.intmap()) {
+    uint64_t h = hash_bytes(1, kv.first.data(), kv.first.size());
+    int64_t v = kv.second;
+    fp += splitmix64(hash_bytes(h, &v, sizeof(v)));
+  }
+  for (const auto& kv : rpc_map.stringmap()) {
+    uint64_t h = hash_bytes(2, kv.first.data(), kv.first.size());
+    fp += splitmix64(hash_bytes(h, kv.second.data(), kv.second.size()));
+  }
+  for (const auto& kv : rpc_map.floatmap()) {
+    uint64_t h = hash_bytes(3, kv.first.data(), kv.first.size());
+    double v = kv.second;
+    fp += splitmix64(hash_bytes(h, &v, sizeof(v)));
+  }
+  for (const auto& kv : rpc_map.boolmap()) {
+    uint64_t h = hash_bytes(4, kv.first.data(), kv.first.size());
+    char v = kv.second ? 1 : 0;
+    fp += splitmix64(hash_bytes(h, &v, sizeof(v)));
+  }
+  return fp;
+}
+
+const rpc::ConfigMap& Config::get_rpc_config_map() const {
+  return rpc_map;
+}
+
+/**
+ * hash_bytes hashes one key or value, its FNV offset varied by seed.
+ */
+static uint64_t hash_bytes(uint64_t seed, const void* data, size_t len) {
+  return Plugin::fnv1a_sized(Plugin::kFnvOffset ^ seed, data, len);
+}
+
 static const std::string build_key(const std::vector<std::string>& ns) {
   std::stringstream ss;
   int i = 1;
@@ -13,6 +13,7 @@ limitations under the License.
 */
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -156,6 +157,16 @@ class Config {
   int get_int(const std::string& key) const;
   std::string get_string(const std::string& key) const;
 
+  /**
+   * fingerprint returns a hash of every key and value in this config.
+   * Configs with the same contents have the same fingerprint regardless of
+   * the order snapteld serialized them in, so it can be used as a cache key
+   * for state derived from a task's config.
+   */
+  uint64_t fingerprint() const;
+
+  const rpc::ConfigMap& get_rpc_config_map() const;
+
  private:
   const rpc::ConfigMap& rpc_map;
 };
@@ -0,0 +1,442 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/diagnostics.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#include <grpc++/grpc++.h>
+
+#include <json.hpp>
+
+#include "snap/metric.h"
+#include "snap/proxy/collector_proxy.h"
+#include "snap/proxy/plugin_proxy.h"
+#include "snap/proxy/processor_proxy.h"
+#include "snap/proxy/publisher_proxy.h"
+#include "snap/publisher/formatter.h"
+#include "snap/publisher/text_buffer.h"
+
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+using std::string;
+
+using google::protobuf::RepeatedPtrField;
+
+using json = nlohmann::json;
+
+using Plugin::Diagnostics;
+using Plugin::Formatter;
+using Plugin::Meta;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::PluginInterface;
+using Plugin::TextBuffer;
+
+namespace {
+
+// installed by libsnap_allocs, if linked
+Diagnostics::AllocCounter* alloc_counter = nullptr;
+
+// counts allocations while diagnostics run
+class CountAllocs final {
+ public:
+  CountAllocs() : counter(alloc_counter), start(0) {
+    if (!counter) return;
+    start = counter->count.load(std::memory_order_relaxed);
+    counter->enabled.store(true, std::memory_order_relaxed);
+  }
+  ~CountAllocs() {
+    if (counter) counter->enabled.store(false, std::memory_order_relaxed);
+  }
+
+  bool counting() const { return counter != nullptr; }
+
+  uint64_t count() const {
+    return counter ? counter->count.load(std::memory_order_relaxed) - start
+                   : 0;
+  }
+
+ private:
+  Diagnostics::AllocCounter* counter;
+  uint64_t start;
+};
+
+const char* type_name(Plugin::Type type) {
+  switch (type) {
+    case Plugin::Collector:
+      return "collector";
+    case Plugin::Processor:
+      return "processor";
+    case Plugin::Publisher:
+      return "publisher";
+  }
+  return "unknown";
+}
+
+int parse_count(const char* flag, const char* value) {
+  char* end;
+  long n = std::strtol(value, &end, 10);
+  if (*end != '\0' || n < 1 || n > 1000000000) {
+    throw PluginException(string(flag) + " takes a positive number, got " +
+                          value);
+  }
+  return int(n);
+}
+
+string ns_string(const rpc::Metric& met) {
+  string ns;
+  for (const rpc::NamespaceElement& nse : met.namespace_()) {
+    if (!ns.empty()) ns += '/';
+    ns += nse.value();
+  }
+  return ns;
+}
+
+}  // namespace
+
+Diagnostics::AllocCounter* Diagnostics::set_alloc_counter(
+    AllocCounter* counter) {
+  AllocCounter* previous = alloc_counter;
+  alloc_counter = counter;
+  return previous;
+}
+
+Diagnostics::Options::Options() : enabled(false), rounds(1), batch(10) {}
+
+Diagnostics::Options Diagnostics::parse(int argc, char** argv) {
+  Options opts;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--diagnose") == 0) opts.enabled = true;
+  }
+  if (!opts.enabled) return opts;
+
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    if (std::strcmp(arg, "--diagnose") == 0) continue;
+    bool has_value = i + 1 < argc;
+    if (std::strcmp(arg, "--config") == 0 && has_value) {
+      opts.config = argv[++i];
+    } else if (std::strcmp(arg, "--rounds") == 0 && has_value) {
+      opts.rounds = parse_count(arg, argv[++i]);
+    } else if (std::strcmp(arg, "--batch") == 0 && has_value) {
+      opts.batch = parse_count(arg, argv[++i]);
+    } else {
+      throw PluginException(string("unknown or incomplete argument: ") + arg +
+                            "\nusage: --diagnose [--config JSON] "
+                            "[--rounds N] [--batch N]");
+    }
+  }
+  return opts;
+}
+
+Diagnostics::Diagnostics(const Options& opts, std::ostream& out) :
+    opts(opts), out(out) {}
+
+bool Diagnostics::run(PluginInterface* plugin, const Meta& meta) {
+  phases.clear();
+  out << "Plugin: " << meta.name << " (" << type_name(meta.type)
+      << "), version " << meta.version << "\n";
+
+  Proxy::PluginImpl proxy(plugin);
+  rpc::Empty empty;
+  rpc::GetConfigPolicyReply policy;
+  string err = measure("get_config_policy", &policy,
+      [&](rpc::GetConfigPolicyReply* reply) {
+    return proxy.GetConfigPolicy(nullptr, &empty, reply);
+  });
+  if (!err.empty()) return failed("get_config_policy", err);
+  print_policy(policy);
+
+  rpc::ConfigMap config;
+  try {
+    config = make_config(policy);
+  } catch (std::exception& e) {
+    return failed("--config", e.what());
+  }
+
+  bool ok = false;
+  switch (plugin->GetType()) {
+    case Plugin::Collector:
+      ok = run_collector(plugin->IsCollector(), config);
+      break;
+    case Plugin::Processor:
+      ok = run_processor(plugin->IsProcessor(), config);
+      break;
+    case Plugin::Publisher:
+      ok = run_publisher(plugin->IsPublisher(), config);
+      break;
+  }
+  if (ok) print_phases();
+  return ok;
+}
+
+template <typename Reply, typename Call>
+string Diagnostics::measure(const string& name, Reply* first, Call call) {
+  CountAllocs allocs;
+  Phase phase = {name, 0, nanoseconds(0), nanoseconds(0), 0,
+                 allocs.counting(), 0};
+  for (int i = 0; i < opts.rounds; i++) {
+    Reply reply;
+    Reply* target = i == 0 ? first : &reply;
+    grpc::Status status;
+    steady_clock::time_point start = steady_clock::now();
+    try {
+      status = call(target);
+    } catch (std::exception& e) {
+      return e.what();
+    }
+    nanoseconds took = duration_cast<nanoseconds>(steady_clock::now() - start);
+    if (!status.ok()) return status.error_message();
+    phase.rounds++;
+    phase.total += took;
+    if (took > phase.max) phase.max = took;
+    phase.reply_bytes = target->ByteSize();
+  }
+  phase.allocs = allocs.count();
+  phases.push_back(phase);
+  return "";
+}
+
+bool Diagnostics::run_collector(CollectorInterface* collector,
+                                const rpc::ConfigMap& config) {
+  Proxy::CollectorImpl proxy(collector);
+
+  rpc::GetMetricTypesArg types_arg;
+  *types_arg.mutable_config() = config;
+  rpc::MetricsReply types;
+  string err = measure("get_metric_types", &types,
+      [&](rpc::MetricsReply* reply) {
+    return proxy.GetMetricTypes(nullptr, &types_arg, reply);
+  });
+  if (!err.empty()) return failed("get_metric_types", err);
+  print_metrics("Metric types", types.metrics());
+
+  // snapteld requests every advertised metric, with the task's config
+  rpc::MetricsArg collect_arg;
+  for (const rpc::Metric& met : types.metrics()) {
+    rpc::Metric* req = collect_arg.add_metrics();
+    *req = met;
+    *req->mutable_config() = config;
+  }
+  rpc::MetricsReply collected;
+  err = measure("collect_metrics", &collected, [&](rpc::MetricsReply* reply) {
+    return proxy.CollectMetrics(nullptr, &collect_arg, reply);
+  });
+  if (!err.empty()) return failed("collect_metrics", err);
+  print_metrics("Collected metrics", collected.metrics());
+  return true;
+}
+
+bool Diagnostics::run_processor(ProcessorInterface* processor,
+                                const rpc::ConfigMap& config) {
+  Proxy::ProcessorImpl proxy(processor);
+  rpc::PubProcArg arg;
+  synthetic_batch(config, &arg);
+  rpc::MetricsReply processed;
+  string err = measure("process_metrics", &processed,
+      [&](rpc::MetricsReply* reply) {
+    return proxy.Process(nullptr, &arg, reply);
+  });
+  if (!err.empty()) return failed("process_metrics", err);
+  print_metrics("Processed metrics", processed.metrics());
+  return true;
+}
+
+bool Diagnostics::run_publisher(PublisherInterface* publisher,
+                                const rpc::ConfigMap& config) {
+  Proxy::PublisherImpl proxy(publisher);
+  rpc::PubProcArg arg;
+  synthetic_batch(config, &arg);
+  rpc::ErrReply published;
+  string err = measure("publish_metrics", &published,
+      [&](rpc::ErrReply* reply) {
+    return proxy.Publish(nullptr, &arg, reply);
+  });
+  if (!err.empty()) return failed("publish_metrics", err);
+  print_metrics("Published metrics", arg.metrics());
+  return true;
+}
+
+/**
+ * Starts from the defaults in the policy and applies the JSON object given
+ * with --config over them, filing each value by its JSON type.
+ */
+rpc::ConfigMap Diagnostics::make_config(
+    const rpc::GetConfigPolicyReply& policy) {
+  rpc::ConfigMap config;
+  for (const auto& pol : policy.bool_policy()) {
+    for (const auto& rule : pol.second.rules()) {
+      if (rule.second.has_default()) {
+        (*config.mutable_boolmap())[rule.first] = rule.second.default_();
+      }
+    }
+  }
+  for (const auto& pol : policy.float_policy()) {
+    for (const auto& rule : pol.second.rules()) {
+      if (rule.second.has_default()) {
+        (*config.mutable_floatmap())[rule.first] = rule.second.default_();
+      }
+    }
+  }
+  for (const auto& pol : policy.integer_policy()) {
+    for (const auto& rule : pol.second.rules()) {
+      if (rule.second.has_default()) {
+        (*config.mutable_intmap())[rule.first] = rule.second.default_();
+      }
+    }
+  }
+  for (const auto& pol : policy.string_policy()) {
+    for (const auto& rule : pol.second.rules()) {
+      if (rule.second.has_default()) {
+        (*config.mutable_stringmap())[rule.first] = rule.second.default_();
+      }
+    }
+  }
+
+  if (opts.config.empty()) return config;
+  json j = json::parse(opts.config);
+  if (!j.is_object()) {
+    throw PluginException("config must be a JSON object");
+  }
+  for (json::iterator it = j.begin(); it != j.end(); ++it) {
+    const json& v = it.value();
+    if (v.is_boolean()) {
+      (*config.mutable_boolmap())[it.key()] = v.get<bool>();
+    } else if (v.is_number_integer()) {
+      (*config.mutable_intmap())[it.key()] = v.get<int64_t>();
+    } else if (v.is_number()) {
+      (*config.mutable_floatmap())[it.key()] = v.get<double>();
+    } else if (v.is_string()) {
+      (*config.mutable_stringmap())[it.key()] = v.get<string>();
+    } else {
+      throw PluginException("unsupported value for config key " + it.key());
+    }
+  }
+  return config;
+}
+
+void Diagnostics::synthetic_batch(const rpc::ConfigMap& config,
+                                  rpc::PubProcArg* arg) {
+  *arg->mutable_config() = config;
+  for (int i = 0; i < opts.batch; i++) {
+    Metric met({{"intel", "", ""}, {"diagnostics", "", ""},
+                {"metric" + std::to_string(i), "", ""}}, "", "");
+    met.add_tag({"source", "diagnostics"});
+    met.set_data(i * 0.5);
+    met.set_timestamp();
+    *arg->add_metrics() = *met.get_rpc_metric_ptr();
+  }
+}
+
+void Diagnostics::print_policy(const rpc::GetConfigPolicyReply& policy) {
+  out << "\nConfig policy:\n";
+  size_t rules = 0;
+  for (const auto& pol : policy.bool_policy()) {
+    for (const auto& rule : pol.second.rules()) {
+      out << "  bool    " << pol.first << " " << rule.first;
+      if (rule.second.has_default()) {
+        out << " default " << (rule.second.default_() ? "true" : "false");
+      }
+      out << (rule.second.required() ? " required\n" : "\n");
+      rules++;
+    }
+  }
+  for (const auto& pol : policy.float_policy()) {
+    for (const auto& rule : pol.second.rules()) {
+      out << "  float   " << pol.first << " " << rule.first;
+      if (rule.second.has_default()) {
+        out << " default " << rule.second.default_();
+      }
+      if (rule.second.has_min()) out << " min " << rule.second.minimum();
+      if (rule.second.has_max()) out << " max " << rule.second.maximum();
+      out << (rule.second.required() ? " required\n" : "\n");
+      rules++;
+    }
+  }
+  for (const auto& pol : policy.integer_policy()) {
+    for (const auto& rule : pol.second.rules()) {
+      out << "  integer " << pol.first << " " << rule.first;
+      if (rule.second.has_default()) {
+        out << " default " << rule.second.default_();
+      }
+      if (rule.second.has_min()) out << " min " << rule.second.minimum();
+      if (rule.second.has_max()) out << " max " << rule.second.maximum();
+      out << (rule.second.required() ? " required\n" : "\n");
+      rules++;
+    }
+  }
+  for (const auto& pol : policy.string_policy()) {
+    for (const auto& rule : pol.second.rules()) {
+      out << "  string  " << pol.first << " " << rule.first;
+      if (rule.second.has_default()) {
+        out << " default \"" << rule.second.default_() << "\"";
+      }
+      out << (rule.second.required() ? " required\n" : "\n");
+      rules++;
+    }
+  }
+  if (rules == 0) out << "  (none)\n";
+}
+
+void Diagnostics::print_metrics(const string& title,
+                                const RepeatedPtrField<rpc::Metric>& metrics) {
+  out << "\n" << title << " (" << metrics.size() << "):\n";
+  Formatter formatter(Formatter::Influx);
+  TextBuffer line;
+  for (const rpc::Metric& met : metrics) {
+    line.clear();
+    RepeatedPtrField<rpc::Metric> one;
+    *one.Add() = met;
+    // metrics without data, e.g. metric types, are printed by name
+    if (formatter.format(one, line) == 0) {
+      out << "  " << ns_string(met) << "\n";
+    } else {
+      out << "  " << line.str();
+    }
+  }
+}
+
+void Diagnostics::print_phases() {
+  out << "\n" << std::left << std::setw(20) << "Phase" << std::right
+      << std::setw(8) << "rounds" << std::setw(12) << "avg ms"
+      << std::setw(12) << "max ms" << std::setw(14) << "allocs/round"
+      << std::setw(13) << "reply bytes" << "\n";
+  for (const Phase& phase : phases) {
+    double avg_ms = phase.total.count() / 1e6 / phase.rounds;
+    out << std::left << std::setw(20) << phase.name << std::right
+        << std::setw(8) << phase.rounds << std::fixed << std::setprecision(3)
+        << std::setw(12) << avg_ms << std::setw(12) << phase.max.count() / 1e6
+        << std::setprecision(1) << std::setw(14);
+    if (phase.allocs_counted) {
+      out << double(phase.allocs) / phase.rounds;
+    } else {
+      out << "n/a";
+    }
+    out << std::setw(13) << phase.reply_bytes << "\n";
+    out.unsetf(std::ios::fixed);
+  }
+}
+
+bool Diagnostics::failed(const string& phase, const string& error) {
+  out << "\n" << phase << " failed: " << error << "\n";
+  return false;
+}
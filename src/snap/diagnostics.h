@@ -0,0 +1,138 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "snap/plugin.h"
+#include "snap/rpc/plugin.pb.h"
+
+namespace Plugin {
+
+/**
+ * Diagnostics runs a plugin standalone, without snapteld, and reports what
+ * it returns and what each call costs.
+ *
+ * It drives the plugin through the same gRPC service implementations
+ * snapteld talks to, minus the network: get_config_policy, then
+ * get_metric_types and collect_metrics for collectors, or process_metrics
+ * or publish_metrics on a synthetic batch for processors and publishers.
+ * The config given on the command line is merged over the policy defaults
+ * and sent along as snapteld would.
+ *
+ * Each phase is reported with its wall time, the number of allocations
+ * made through operator new in the whole process while it ran, and the
+ * size of the reply snapteld would receive. Counting allocations takes
+ * replacing the global operator new, which libsnap leaves alone; plugins
+ * that want the counts link libsnap_allocs as well (-lsnap_allocs, ahead
+ * of -lsnap), and get "n/a" otherwise. With it linked, the replaced
+ * operator new costs a single relaxed load outside diagnostics.
+ *
+ * It is enabled by passing --diagnose to a plugin started with the argc,
+ * argv overloads of start_collector and its siblings:
+ *   ./rando --diagnose --config '{"password": "secret"}' --rounds 100
+ */
+class Diagnostics final {
+ public:
+  struct Options {
+    Options();
+
+    /** enabled is set by --diagnose */
+    bool enabled;
+    /** config is the JSON object given with --config, e.g. {"key": 1} */
+    std::string config;
+    /** rounds is how many times each call is timed (--rounds) */
+    int rounds;
+    /** batch is the size of the synthetic batch (--batch) */
+    int batch;
+  };
+
+  /**
+   * parse reads the options from the command line. Arguments are ignored
+   * unless --diagnose is among them; then unknown or malformed ones are
+   * thrown as PluginException.
+   */
+  static Options parse(int argc, char** argv);
+
+  Diagnostics(const Options& opts, std::ostream& out = std::cout);
+
+  /**
+   * run drives the plugin and writes the report. It returns false if a
+   * call failed; the error is in the report.
+   */
+  bool run(PluginInterface* plugin, const Meta& meta);
+
+  /**
+   * AllocCounter is what libsnap_allocs counts allocations into while
+   * enabled is set.
+   */
+  struct AllocCounter {
+    std::atomic<bool> enabled;
+    std::atomic<uint64_t> count;
+  };
+
+  /**
+   * set_alloc_counter is called by libsnap_allocs as it's loaded. It
+   * returns the counter it replaces; nullptr stops counting.
+   */
+  static AllocCounter* set_alloc_counter(AllocCounter* counter);
+
+ private:
+  struct Phase {
+    std::string name;
+    int rounds;
+    std::chrono::nanoseconds total;
+    std::chrono::nanoseconds max;
+    // allocs is only meaningful if allocs_counted
+    uint64_t allocs;
+    bool allocs_counted;
+    size_t reply_bytes;
+  };
+
+  /**
+   * measure times opts.rounds calls of call(reply), each with a fresh
+   * reply, and keeps the first reply in first. It stops at the first call
+   * that fails, returning its error.
+   */
+  template <typename Reply, typename Call>
+  std::string measure(const std::string& name, Reply* first, Call call);
+
+  bool run_collector(CollectorInterface* collector,
+                     const rpc::ConfigMap& config);
+  bool run_processor(ProcessorInterface* processor,
+                     const rpc::ConfigMap& config);
+  bool run_publisher(PublisherInterface* publisher,
+                     const rpc::ConfigMap& config);
+
+  rpc::ConfigMap make_config(const rpc::GetConfigPolicyReply& policy);
+  void synthetic_batch(const rpc::ConfigMap& config, rpc::PubProcArg* arg);
+
+  void print_policy(const rpc::GetConfigPolicyReply& policy);
+  void print_metrics(
+      const std::string& title,
+      const google::protobuf::RepeatedPtrField<rpc::Metric>& metrics);
+  void print_phases();
+  bool failed(const std::string& phase, const std::string& error);
+
+  Options opts;
+  std::ostream& out;
+  std::vector<Phase> phases;
+};
+
+}  // namespace Plugin
@@ -0,0 +1,82 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+// Replaces the global operator new and delete to count allocations for
+// Diagnostics. Built as libsnap_allocs, which only plugins that link it
+// explicitly get; see diagnostics.h.
+#include <cstdlib>
+#include <new>
+
+#include "snap/diagnostics.h"
+
+using Plugin::Diagnostics;
+
+namespace {
+
+// zero-initialized, so usable by allocations made before main
+Diagnostics::AllocCounter counter;
+
+void* counted_alloc(size_t size, bool nothrow) {
+  if (counter.enabled.load(std::memory_order_relaxed)) {
+    counter.count.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (size == 0) size = 1;
+  for (;;) {
+    void* p = std::malloc(size);
+    if (p) return p;
+    std::new_handler handler = std::get_new_handler();
+    if (!handler) {
+      if (nothrow) return nullptr;
+      throw std::bad_alloc();
+    }
+    handler();
+  }
+}
+
+struct Install {
+  Install() { Diagnostics::set_alloc_counter(&counter); }
+} install;
+
+}  // namespace
+
+void* operator new(size_t size) {
+  return counted_alloc(size, false);
+}
+
+void* operator new[](size_t size) {
+  return counted_alloc(size, false);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return counted_alloc(size, true);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return counted_alloc(size, true);
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  std::free(p);
+}
@@ -0,0 +1,339 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/event_loop.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include "snap/plugin.h"
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
+using Plugin::EventLoop;
+using Plugin::PluginException;
+
+static const int kMaxEvents = 16;
+
+static bool would_block(int err) {
+  return err == EAGAIN || err == EWOULDBLOCK || err == EINTR;
+}
+
+EventLoop::Options::Options() : threads(2) {}
+
+EventLoop::EventLoop(const Options& opts) :
+    epoll_fd(epoll_create1(EPOLL_CLOEXEC)),
+    wake_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+    timer_fd(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+    stopping(false), next_timer(0) {
+  if (epoll_fd < 0 || wake_fd < 0 || timer_fd < 0) {
+    int err = errno;
+    if (epoll_fd >= 0) close(epoll_fd);
+    if (wake_fd >= 0) close(wake_fd);
+    if (timer_fd >= 0) close(timer_fd);
+    throw PluginException(std::string("creating event loop: ") +
+                          std::strerror(err));
+  }
+  for (int fd : {wake_fd, timer_fd}) {
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.fd = fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+  }
+  for (int i = 0; i < std::max(1, opts.threads); i++) {
+    threads.emplace_back(&EventLoop::run, this);
+  }
+}
+
+EventLoop::~EventLoop() {
+  stopping = true;
+  uint64_t one = 1;
+  ::write(wake_fd, &one, sizeof(one));
+  for (std::thread& t : threads) t.join();
+  close(epoll_fd);
+  close(wake_fd);
+  close(timer_fd);
+}
+
+void EventLoop::run() {
+  epoll_event events[kMaxEvents];
+  for (;;) {
+    int n = epoll_wait(epoll_fd, events, kMaxEvents, -1);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    for (int i = 0; i < n; i++) {
+      int fd = events[i].data.fd;
+      if (fd == wake_fd) {
+        if (stopping) {
+          // leave the wakeup pending for the next thread
+          rearm(wake_fd);
+          return;
+        }
+        on_wake();
+      } else if (fd == timer_fd) {
+        on_timer();
+      } else {
+        on_fd(fd, events[i].events);
+      }
+    }
+  }
+}
+
+void EventLoop::call(const Task& task) {
+  try {
+    task();
+  } catch (const std::exception&) {
+    // nowhere to report it
+  }
+}
+
+void EventLoop::rearm(int fd) {
+  epoll_event ev;
+  ev.events = EPOLLIN | EPOLLONESHOT;
+  ev.data.fd = fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void EventLoop::post(const Task& task) {
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    posted.push_back(task);
+  }
+  uint64_t one = 1;
+  ::write(wake_fd, &one, sizeof(one));
+}
+
+void EventLoop::on_wake() {
+  uint64_t count;
+  ::read(wake_fd, &count, sizeof(count));
+  std::deque<Task> tasks;
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    tasks.swap(posted);
+    rearm(wake_fd);
+  }
+  for (const Task& task : tasks) call(task);
+}
+
+uint64_t EventLoop::after(milliseconds delay, const Task& task) {
+  std::lock_guard<std::mutex> lk(mtx);
+  uint64_t id = ++next_timer;
+  steady_clock::time_point when = steady_clock::now() + delay;
+  timers[TimerKey(when, id)] = task;
+  timer_ids[id] = when;
+  if (timers.begin()->first.second == id) {
+    arm_timer();
+  }
+  return id;
+}
+
+bool EventLoop::cancel(uint64_t timer) {
+  std::lock_guard<std::mutex> lk(mtx);
+  auto it = timer_ids.find(timer);
+  if (it == timer_ids.end()) return false;
+  timers.erase(TimerKey(it->second, timer));
+  timer_ids.erase(it);
+  return true;
+}
+
+void EventLoop::arm_timer() {
+  itimerspec spec;
+  std::memset(&spec, 0, sizeof(spec));
+  if (!timers.empty()) {
+    int64_t ns = duration_cast<nanoseconds>(
+        timers.begin()->first.first - steady_clock::now()).count();
+    // a zero time would disarm the timer
+    if (ns < 1) ns = 1;
+    spec.it_value.tv_sec = ns / 1000000000;
+    spec.it_value.tv_nsec = ns % 1000000000;
+  }
+  timerfd_settime(timer_fd, 0, &spec, nullptr);
+}
+
+void EventLoop::on_timer() {
+  uint64_t expirations;
+  ::read(timer_fd, &expirations, sizeof(expirations));
+  std::vector<Task> due;
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    steady_clock::time_point now = steady_clock::now();
+    while (!timers.empty() && timers.begin()->first.first <= now) {
+      due.push_back(timers.begin()->second);
+      timer_ids.erase(timers.begin()->first.second);
+      timers.erase(timers.begin());
+    }
+    arm_timer();
+    rearm(timer_fd);
+  }
+  for (const Task& task : due) call(task);
+}
+
+void EventLoop::when_readable(int fd, const Done& done) {
+  watch(fd, false, done);
+}
+
+void EventLoop::when_writable(int fd, const Done& done) {
+  watch(fd, true, done);
+}
+
+int EventLoop::arm(int fd, Watch& w) {
+  epoll_event ev;
+  ev.events = EPOLLONESHOT;
+  if (w.on_read) ev.events |= EPOLLIN;
+  if (w.on_write) ev.events |= EPOLLOUT;
+  ev.data.fd = fd;
+  int rc = epoll_ctl(epoll_fd, w.added ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd,
+                     &ev);
+  // closing an fd takes it out of the epoll set, so one added before may be
+  // a new file under a reused number
+  if (rc < 0 && w.added && errno == ENOENT) {
+    rc = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+  }
+  w.added = rc == 0;
+  return rc == 0 ? 0 : errno;
+}
+
+void EventLoop::watch(int fd, bool write, const Done& done) {
+  int err;
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    Watch& w = watches[fd];
+    Done& pending = write ? w.on_write : w.on_read;
+    if (pending) {
+      throw PluginException("fd " + std::to_string(fd) + " already has a " +
+                            (write ? "write" : "read") + " pending");
+    }
+    pending = done;
+    err = arm(fd, w);
+    if (err == 0) return;
+    pending = nullptr;
+    if (!w.on_read && !w.on_write) watches.erase(fd);
+  }
+  // regular files can't be polled, but never block either
+  post([done, err] { done(err == EPERM ? 0 : err); });
+}
+
+void EventLoop::forget(int fd) {
+  std::lock_guard<std::mutex> lk(mtx);
+  auto it = watches.find(fd);
+  if (it == watches.end()) return;
+  if (it->second.added) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+  watches.erase(it);
+}
+
+void EventLoop::on_fd(int fd, uint32_t events) {
+  Done on_read;
+  Done on_write;
+  // the other direction, if it can't be armed again
+  Done lost;
+  int err = 0;
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    auto it = watches.find(fd);
+    if (it == watches.end()) return;
+    Watch& w = it->second;
+    bool failed = events & (EPOLLERR | EPOLLHUP);
+    if ((events & EPOLLIN) || failed) on_read.swap(w.on_read);
+    if ((events & EPOLLOUT) || failed) on_write.swap(w.on_write);
+    if (w.on_read || w.on_write) err = arm(fd, w);
+    if (err) {
+      lost.swap(w.on_read ? w.on_read : w.on_write);
+      watches.erase(it);
+    }
+  }
+  // the operations find out about errors themselves
+  if (on_read) call([&] { on_read(0); });
+  if (on_write) call([&] { on_write(0); });
+  if (lost) call([&] { lost(err); });
+}
+
+void EventLoop::read(int fd, char* buf, size_t len, const ReadDone& done) {
+  when_readable(fd, [this, fd, buf, len, done](int err) {
+    if (err) return done(0, err);
+    ssize_t n = ::read(fd, buf, len);
+    if (n < 0 && would_block(errno)) {
+      read(fd, buf, len, done);
+    } else {
+      done(n < 0 ? 0 : size_t(n), n < 0 ? errno : 0);
+    }
+  });
+}
+
+void EventLoop::write(int fd, const char* data, size_t len,
+                      const Done& done) {
+  when_writable(fd, [this, fd, data, len, done](int err) {
+    if (err) return done(err);
+    // send, where it works, so a closed peer is an error rather than
+    // SIGPIPE
+    ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == ENOTSOCK) n = ::write(fd, data, len);
+    if (n < 0 && !would_block(errno)) {
+      done(errno);
+    } else if (n < 0) {
+      write(fd, data, len, done);
+    } else if (size_t(n) < len) {
+      write(fd, data + n, len - n, done);
+    } else {
+      done(0);
+    }
+  });
+}
+
+void EventLoop::connect(int fd, const sockaddr* addr, socklen_t addr_len,
+                        const Done& done) {
+  if (::connect(fd, addr, addr_len) == 0) {
+    post([done] { done(0); });
+    return;
+  }
+  if (errno != EINPROGRESS) {
+    int err = errno;
+    post([done, err] { done(err); });
+    return;
+  }
+  when_writable(fd, [fd, done](int err) {
+    if (err) return done(err);
+    int so_error = 0;
+    socklen_t len = sizeof(so_error);
+    getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_error, &len);
+    done(so_error);
+  });
+}
+
+void EventLoop::read_file(const std::string& path, const FileDone& done) {
+  post([path, done] {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return done("", errno);
+    std::string contents;
+    char buf[4096];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0) contents.append(buf, n);
+    int err = n < 0 ? errno : 0;
+    close(fd);
+    done(err ? std::string() : contents, err);
+  });
+}
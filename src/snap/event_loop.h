@@ -0,0 +1,179 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Plugin {
+
+/**
+ * EventLoop runs callbacks for timers and non-blocking file descriptors on
+ * a few threads sharing one epoll set, so a plugin can keep thousands of
+ * reads, writes and connects in flight without a thread for each.
+ *
+ * Every operation takes a callback, run on one of the loop's threads once
+ * the operation completes; callbacks must not block, and exceptions they
+ * throw are dropped. A collector typically starts its operations from
+ * AsyncCollector::collect_async and fulfils a std::promise per group from
+ * the last callback.
+ *
+ * File descriptors must be in non-blocking mode, and only one read and one
+ * write may be pending on each. Call forget before closing one that has
+ * operations pending.
+ *
+ * E.g.:
+ *   Plugin::EventLoop loop((Plugin::EventLoop::Options()));
+ *   auto done = std::make_shared<std::promise<std::vector<Metric>>>();
+ *   loop.connect(fd, addr, len, [=, &loop](int err) {
+ *     if (err) return done->set_exception(...);
+ *     loop.write(fd, query.data(), query.size(), [=, &loop](int err) {
+ *       loop.read(fd, buf, sizeof(buf), [=](size_t n, int err) {
+ *         done->set_value(parse(buf, n));
+ *       });
+ *     });
+ *   });
+ *   return {{host, done->get_future()}};
+ */
+class EventLoop final {
+ public:
+  struct Options {
+    Options();
+
+    int threads;
+  };
+
+  typedef std::function<void()> Task;
+  /** Done gets 0, or the errno the operation failed with. */
+  typedef std::function<void(int err)> Done;
+  /** ReadDone gets the bytes read, 0 at end of file, or an errno. */
+  typedef std::function<void(size_t n, int err)> ReadDone;
+  typedef std::function<void(std::string contents, int err)> FileDone;
+
+  /**
+   * The threads start at once. Failing to create the epoll set is thrown
+   * as PluginException.
+   */
+  explicit EventLoop(const Options& opts);
+
+  /**
+   * The destructor stops the threads; pending callbacks are dropped.
+   */
+  ~EventLoop();
+
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  /**
+   * post runs task on a loop thread as soon as one is free.
+   */
+  void post(const Task& task);
+
+  /**
+   * after runs task once delay has passed, and returns an id to cancel it
+   * with.
+   */
+  uint64_t after(std::chrono::milliseconds delay, const Task& task);
+
+  /**
+   * cancel drops a timer that hasn't run yet, returning whether it did.
+   */
+  bool cancel(uint64_t timer);
+
+  /**
+   * when_readable and when_writable call done once fd is ready, or has
+   * failed or hung up.
+   */
+  void when_readable(int fd, const Done& done);
+  void when_writable(int fd, const Done& done);
+
+  /**
+   * forget drops the callbacks pending on fd.
+   */
+  void forget(int fd);
+
+  /**
+   * read reads up to len bytes into buf, which must stay valid until done
+   * is called.
+   */
+  void read(int fd, char* buf, size_t len, const ReadDone& done);
+
+  /**
+   * write writes all len bytes of data, which must stay valid until done is
+   * called.
+   */
+  void write(int fd, const char* data, size_t len, const Done& done);
+
+  /**
+   * connect connects the non-blocking socket fd to addr.
+   */
+  void connect(int fd, const sockaddr* addr, socklen_t addr_len,
+               const Done& done);
+
+  /**
+   * read_file reads a whole file. Regular files can't be polled, so it's
+   * read on a loop thread; keep it for small files such as those of procfs
+   * and sysfs.
+   */
+  void read_file(const std::string& path, const FileDone& done);
+
+ private:
+  struct Watch {
+    Done on_read;
+    Done on_write;
+    bool added;
+  };
+
+  typedef std::pair<std::chrono::steady_clock::time_point, uint64_t> TimerKey;
+
+  int epoll_fd;
+  int wake_fd;
+  int timer_fd;
+  std::atomic<bool> stopping;
+  std::vector<std::thread> threads;
+
+  std::mutex mtx;
+  std::unordered_map<int, Watch> watches;
+  std::deque<Task> posted;
+  std::map<TimerKey, Task> timers;
+  std::unordered_map<uint64_t, std::chrono::steady_clock::time_point>
+      timer_ids;
+  uint64_t next_timer;
+
+  void run();
+  void watch(int fd, bool write, const Done& done);
+  // under mtx; returns 0 or the errno of epoll_ctl
+  int arm(int fd, Watch& w);
+  void arm_timer();
+  void rearm(int fd);
+  void on_wake();
+  void on_timer();
+  void on_fd(int fd, uint32_t events);
+  static void call(const Task& task);
+};
+
+}  // namespace Plugin
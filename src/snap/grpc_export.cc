@@ -16,6 +16,7 @@ limitations under the License.
 #include "snap/grpc_export_impl.h"
 
 #include <chrono>
+#include <cstdlib>
 #include <future>
 #include <iostream>
 #include <memory>
@@ -31,6 +32,7 @@ limitations under the License.
 #include "snap/proxy/collector_proxy.h"
 #include "snap/proxy/processor_proxy.h"
 #include "snap/proxy/publisher_proxy.h"
+#include "snap/trace.h"
 
 using std::cout;
 using std::endl;
@@ -61,68 +63,110 @@ Plugin::GRPCExportImpl* Plugin::GRPCExporter::implement() {
 future<void> Plugin::GRPCExportImpl::DoExport(shared_ptr<PluginInterface> plugin, const Meta *meta) {
   this->plugin = std::move(plugin);
   this->meta = meta;
+  Trace::start_from_env();
   doConfigure();
   doRegister();
+  doAdmin();
   doAdvertise();
   auto self = this->shared_from_this();
   return std::async(std::launch::deferred, [=](){ self->doJoin(); });
 }
 
 void Plugin::GRPCExportImpl::doConfigure() {
+  Span span("configure", "export");
   string server_address = "127.0.0.1:0";
 
-  switch (plugin->GetType()) {
-    case Plugin::Collector:
-      this->service.reset(new Proxy::CollectorImpl(plugin->IsCollector()));
-      break;
-    case Plugin::Processor:
-      this->service.reset(new Proxy::ProcessorImpl(plugin->IsProcessor()));
-      break;
-    case Plugin::Publisher:
-      this->service.reset(new Proxy::PublisherImpl(plugin->IsPublisher()));
-      break;
-  }
+  this->service.reset(new_plugin_service(plugin.get(), *meta));
   builder.reset(new grpc::ServerBuilder());
+  limit_message_sizes(*builder, meta->max_receive_message_size,
+                      meta->max_send_message_size);
   builder->AddListeningPort(server_address, grpc::InsecureServerCredentials(),
                            &this->port);
 
 }
 
 void Plugin::GRPCExportImpl::doRegister() {
+  Span span("register", "export");
   builder->RegisterService(service.get());
   this->server = std::move(builder->BuildAndStart());
 }
 
 void Plugin::GRPCExportImpl::doAdvertise() {
+  Span span("advertise", "export");
   std::stringstream ss;
   ss << "127.0.0.1:" << port;
+  cout << advertisement(*meta, ss.str()) << endl;
+}
+
+void Plugin::GRPCExportImpl::doAdmin() {
+  admin = start_admin(meta->admin_listen);
+}
+
+void Plugin::GRPCExportImpl::doJoin() {
+  server->Wait();
+}
+
+unique_ptr<Plugin::AdminServer> Plugin::start_admin(const string& listen) {
+  const char* env = std::getenv("SNAP_PLUGIN_ADMIN");
+  string address = env != nullptr && *env != '\0' ? env : listen;
+  if (address.empty()) return nullptr;
+  try {
+    return unique_ptr<AdminServer>(new AdminServer(address));
+  } catch (PluginException& e) {
+    // stdout is reserved for the advertisement read by snapteld
+    std::cerr << e.what() << endl;
+    return nullptr;
+  }
+}
+
+grpc::Service* Plugin::new_plugin_service(PluginInterface* plugin,
+                                          const Meta& meta) {
+  Proxy::ReplyCompression compression(meta);
+  switch (plugin->GetType()) {
+    case Plugin::Collector:
+      return new Proxy::CollectorImpl(plugin->IsCollector(), compression);
+    case Plugin::Processor:
+      return new Proxy::ProcessorImpl(plugin->IsProcessor(), compression);
+    case Plugin::Publisher:
+      return new Proxy::PublisherImpl(plugin->IsPublisher());
+  }
+  return nullptr;
+}
+
+void Plugin::limit_message_sizes(grpc::ServerBuilder& builder,
+                                 int max_receive, int max_send) {
+  if (max_receive != 0) {
+    builder.SetMaxReceiveMessageSize(max_receive);
+  }
+  if (max_send != 0) {
+    builder.SetMaxSendMessageSize(max_send);
+  }
+}
+
+string Plugin::advertisement(const Meta& meta, const string& listen_address) {
   json j = {
       {"Meta", {
-                   {"Type", meta->type},
-                   {"Name", meta->name},
-                   {"Version", meta->version},
-                   {"RPCType", meta->rpc_type},
+                   {"Type", meta.type},
+                   {"Name", meta.name},
+                   {"Version", meta.version},
+                   {"RPCType", meta.rpc_type},
                    {"RPCVersion", RPC_VERSION},
-                   {"ConcurrencyCount", meta->concurrency_count},
-                   {"Exclusive", meta->exclusive},
+                   {"ConcurrencyCount", meta.concurrency_count},
+                   {"Exclusive", meta.exclusive},
 
                    // The gRPC client in Snap does not use the `Unsecure` metadata key at
                    // this time, as it is used for payload encryption.  With gRPC, encryption
                    // is done via its transport, and this will be updated once support for
                    // that feature lands in snapteld.
                    {"Unsecure", true},
-                   {"CacheTTL", meta->cache_ttl.count()},
-                   {"RoutingStrategy", meta->strategy}
+                   {"CacheTTL", meta.cache_ttl.count()},
+                   {"RoutingStrategy", meta.strategy}
                }},
-      {"ListenAddress", ss.str()},
-      {"Type", meta->type},
+      {"ListenAddress", listen_address},
+      {"Type", meta.type},
       {"State", 0},
       {"ErrMessage", ""},
-      {"Version", meta->version},
+      {"Version", meta.version},
   };
-  cout << j << endl;
-}
-
-void Plugin::GRPCExportImpl::doJoin() {
-  server->Wait();
+  return j.dump();
 }
@@ -21,6 +21,7 @@ limitations under the License.
 
 #include <grpc++/grpc++.h>
 
+#include "snap/admin_server.h"
 #include "snap/config.h"
 #include "snap/metric.h"
 
@@ -44,14 +45,43 @@ protected:
   std::unique_ptr<grpc::Service> service;
   std::unique_ptr<grpc::ServerBuilder> builder;
   std::unique_ptr<grpc::Server> server;
+  std::unique_ptr<AdminServer> admin;
 
   /* steps of the export procedure */
   void doConfigure();
   void doRegister();
   void doAdvertise();
+  void doAdmin();
 
   /* blocking method - waits for the server to finish. */
   void doJoin();
 };
 
+/**
+ * start_admin starts an AdminServer on listen, unless SNAP_PLUGIN_ADMIN
+ * names another address, or neither is set. The plugin runs on without
+ * one if it fails to start; the error is logged to stderr.
+ */
+std::unique_ptr<AdminServer> start_admin(const std::string& listen);
+
+/**
+ * new_plugin_service returns a new gRPC service dispatching to plugin,
+ * according to its type, compressing replies as meta asks. The caller owns
+ * the service.
+ */
+grpc::Service* new_plugin_service(PluginInterface* plugin, const Meta& meta);
+
+/**
+ * limit_message_sizes applies Meta-style message size bounds to builder;
+ * 0 keeps gRPC's default, -1 lifts the bound.
+ */
+void limit_message_sizes(grpc::ServerBuilder& builder, int max_receive,
+                         int max_send);
+
+/**
+ * advertisement returns the JSON line announcing the plugin described by
+ * meta, listening on listen_address, to snapteld.
+ */
+std::string advertisement(const Meta& meta, const std::string& listen_address);
+
 }
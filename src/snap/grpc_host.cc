@@ -0,0 +1,174 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/grpc_host.h"
+#include "snap/grpc_export_impl.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "snap/rpc/plugin.grpc.pb.h"
+#include "snap/trace.h"
+
+using std::string;
+using std::vector;
+
+using Plugin::GRPCHost;
+using Plugin::Meta;
+using Plugin::PluginException;
+using Plugin::PluginInterface;
+
+namespace {
+
+// host:port, with IPv6 literals in brackets
+string host_port(const string& address, int port) {
+  if (address.find(':') != string::npos) {
+    return "[" + address + "]:" + std::to_string(port);
+  }
+  return address + ":" + std::to_string(port);
+}
+
+}  // namespace
+
+GRPCHost::Options::Options() :
+    address("127.0.0.1"), base_port(0), max_pollers(0),
+    max_receive_message_size(0), max_send_message_size(0) {}
+
+GRPCHost::GRPCHost(const Options& opts) : opts(opts) {}
+
+GRPCHost::~GRPCHost() {
+  shutdown();
+}
+
+void GRPCHost::add(PluginInterface* plugin, const Meta& meta) {
+  if (server) {
+    throw PluginException("plugins can't be added to a started host");
+  }
+  Hosted hosted = {plugin, meta, 0, nullptr};
+  plugins.push_back(std::move(hosted));
+}
+
+void GRPCHost::start(std::ostream& out) {
+  if (server) {
+    throw PluginException("host is already started");
+  }
+  if (plugins.empty()) {
+    throw PluginException("no plugins to host");
+  }
+  Trace::start_from_env();
+  Span span("start", "export");
+  vector<int> ports = opts.base_port ? vector<int>() : pick_ports();
+  vector<int> selected(plugins.size(), 0);
+
+  grpc::ServerBuilder builder;
+  if (opts.max_pollers > 0) {
+    builder.SetSyncServerOption(
+        grpc::ServerBuilder::SyncServerOption::MAX_POLLERS, opts.max_pollers);
+  }
+  limit_message_sizes(builder, opts.max_receive_message_size,
+                      opts.max_send_message_size);
+  for (size_t i = 0; i < plugins.size(); i++) {
+    Hosted& hosted = plugins[i];
+    hosted.port = opts.base_port ? opts.base_port + int(i) : ports[i];
+    string addr = host_port(opts.address, hosted.port);
+    hosted.service.reset(new_plugin_service(hosted.plugin, hosted.meta));
+    builder.AddListeningPort(addr, grpc::InsecureServerCredentials(),
+                             &selected[i]);
+    // calls are routed by the authority the client dialed, so each plugin
+    // only answers on its own port
+    builder.RegisterService(addr, hosted.service.get());
+  }
+  server = builder.BuildAndStart();
+  if (!server) {
+    throw PluginException("failed to start gRPC server on " + opts.address);
+  }
+  for (size_t i = 0; i < plugins.size(); i++) {
+    if (selected[i] != plugins[i].port) {
+      shutdown();
+      throw PluginException("failed to listen on " +
+                            host_port(opts.address, plugins[i].port));
+    }
+  }
+
+  admin = start_admin(opts.admin_listen);
+
+  for (const Hosted& hosted : plugins) {
+    out << advertisement(hosted.meta, host_port(opts.address, hosted.port))
+        << std::endl;
+  }
+}
+
+void GRPCHost::shutdown() {
+  if (server) server->Shutdown();
+}
+
+void GRPCHost::wait() {
+  if (server) server->Wait();
+}
+
+/**
+ * Binds a socket to port 0 for every plugin and keeps them all open until
+ * the last is bound, so the kernel hands out distinct free ports. They are
+ * closed before the server binds them again.
+ */
+vector<int> GRPCHost::pick_ports() {
+  sockaddr_storage addr;
+  std::memset(&addr, 0, sizeof(addr));
+  socklen_t len;
+  sockaddr_in* in4 = reinterpret_cast<sockaddr_in*>(&addr);
+  sockaddr_in6* in6 = reinterpret_cast<sockaddr_in6*>(&addr);
+  if (inet_pton(AF_INET, opts.address.c_str(), &in4->sin_addr) == 1) {
+    in4->sin_family = AF_INET;
+    len = sizeof(*in4);
+  } else if (inet_pton(AF_INET6, opts.address.c_str(), &in6->sin6_addr) == 1) {
+    in6->sin6_family = AF_INET6;
+    len = sizeof(*in6);
+  } else {
+    throw PluginException("not an IP address: " + opts.address);
+  }
+
+  vector<int> fds;
+  vector<int> ports;
+  string err;
+  for (size_t i = 0; i < plugins.size() && err.empty(); i++) {
+    int fd = socket(addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      err = std::strerror(errno);
+      break;
+    }
+    fds.push_back(fd);
+    sockaddr_storage bound;
+    socklen_t bound_len = sizeof(bound);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), len) != 0 ||
+        getsockname(fd, reinterpret_cast<sockaddr*>(&bound), &bound_len) != 0) {
+      err = std::strerror(errno);
+      break;
+    }
+    ports.push_back(ntohs(bound.ss_family == AF_INET ?
+        reinterpret_cast<sockaddr_in*>(&bound)->sin_port :
+        reinterpret_cast<sockaddr_in6*>(&bound)->sin6_port));
+  }
+  for (int fd : fds) close(fd);
+  if (!err.empty()) {
+    throw PluginException("failed to pick a port on " + opts.address + ": " +
+                          err);
+  }
+  return ports;
+}
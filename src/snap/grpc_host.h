@@ -0,0 +1,123 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <grpc++/grpc++.h>
+
+#include "snap/admin_server.h"
+#include "snap/plugin.h"
+
+namespace Plugin {
+
+/**
+ * GRPCHost serves several plugins from one process and one gRPC server, so
+ * they share its worker threads, completion queues and allocators instead
+ * of each starting its own.
+ *
+ * Every plugin gets its own listening port and is advertised to snapteld
+ * on its own line, as if started alone. The server routes each call by the
+ * authority the client connected to ("address:port"), so clients must dial
+ * the advertised address as is; that is what snapteld does.
+ *
+ * E.g.:
+ *   Plugin::GRPCHost host((Plugin::GRPCHost::Options()));
+ *   host.add(&cpu, Plugin::Meta(Plugin::Collector, "cpu", 1));
+ *   host.add(&disk, Plugin::Meta(Plugin::Collector, "disk", 1));
+ *   host.start();
+ *   host.wait();
+ */
+class GRPCHost final {
+ public:
+  struct Options {
+    Options();
+
+    /** address to listen on and advertise; "127.0.0.1" by default */
+    std::string address;
+    /**
+     * base_port, when non-zero, puts the plugins on consecutive ports
+     * starting there; by default free ports are picked.
+     */
+    int base_port;
+    /**
+     * max_pollers caps the threads polling for calls across all plugins;
+     * 0 keeps gRPC's default.
+     */
+    int max_pollers;
+    /**
+     * admin_listen starts an AdminServer for the whole process, as
+     * Meta::admin_listen does for a single plugin; off by default.
+     */
+    std::string admin_listen;
+    /**
+     * max_receive_message_size and max_send_message_size bound messages
+     * for all plugins, as the Meta fields of the same name do for a single
+     * plugin; those fields are ignored here. Compression is still set per
+     * plugin by its Meta.
+     */
+    int max_receive_message_size;
+    int max_send_message_size;
+  };
+
+  explicit GRPCHost(const Options& opts);
+  ~GRPCHost();
+
+  GRPCHost(const GRPCHost&) = delete;
+  GRPCHost& operator=(const GRPCHost&) = delete;
+
+  /**
+   * add registers a plugin, which is not owned and must outlive the host.
+   * Plugins can't be added once the host is started.
+   */
+  void add(PluginInterface* plugin, const Meta& meta);
+
+  /**
+   * start listens on a port per plugin, starts the server and writes an
+   * advertisement line per plugin to out, in the order the plugins were
+   * added. Failing to listen is thrown as PluginException.
+   */
+  void start(std::ostream& out = std::cout);
+
+  size_t size() const { return plugins.size(); }
+
+  /** port returns the port of the i-th plugin added, once started. */
+  int port(size_t i) const { return plugins[i].port; }
+
+  /** shutdown stops the server; calls in flight are cancelled. */
+  void shutdown();
+
+  /** wait blocks until the server is shut down. */
+  void wait();
+
+ private:
+  struct Hosted {
+    PluginInterface* plugin;
+    Meta meta;
+    int port;
+    std::unique_ptr<grpc::Service> service;
+  };
+
+  std::vector<int> pick_ports();
+
+  Options opts;
+  std::vector<Hosted> plugins;
+  std::unique_ptr<grpc::Server> server;
+  std::unique_ptr<AdminServer> admin;
+};
+
+}  // namespace Plugin
@@ -0,0 +1,66 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Plugin {
+
+/**
+ * The hashes behind config fingerprints, series ids and other in-memory
+ * keys. They are not stable across releases and must not be persisted.
+ * This header is internal to the library and not installed.
+ */
+
+static const uint64_t kFnvOffset = 14695981039346656037ULL;
+static const uint64_t kFnvPrime = 1099511628211ULL;
+
+/**
+ * fnv1a continues the FNV-1a hash h over len bytes; start from kFnvOffset.
+ */
+inline uint64_t fnv1a(uint64_t h, const void* data, size_t len) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= kFnvPrime;
+  }
+  return h;
+}
+
+/**
+ * fnv1a_sized is fnv1a followed by the length, so that hashing fields one
+ * after the other tells ("ab", "c") from ("a", "bc").
+ */
+inline uint64_t fnv1a_sized(uint64_t h, const void* data, size_t len) {
+  h = fnv1a(h, data, len);
+  h ^= len;
+  h *= kFnvPrime;
+  return h;
+}
+
+/**
+ * splitmix64 is the splitmix64 finalizer. FNV output is weak in its top
+ * bits and when summed; this spreads it over all 64.
+ */
+inline uint64_t splitmix64(uint64_t h) {
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+}  // namespace Plugin
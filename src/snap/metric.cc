@@ -14,6 +14,7 @@ limitations under the License.
 #include "snap/metric.h"
 
 #include <ratio>
+#include <utility>
 
 #include <google/protobuf/repeated_field.h>
 
@@ -31,15 +32,13 @@ using Plugin::Metric;
 
 Metric::Metric() : delete_metric_ptr(true),
                    rpc_metric_ptr(new rpc::Metric),
-                   type(DataType::NotSet),
-                   config(Config(rpc_metric_ptr->config())) {}
+                   type(DataType::NotSet) {}
 
 Metric::Metric(std::vector<Metric::NamespaceElement> ns, std::string unit,
                std::string description) :
                  delete_metric_ptr(true),
                  type(DataType::NotSet),
-                 rpc_metric_ptr(new rpc::Metric),
-                 config(Config(rpc_metric_ptr->config())) {
+                 rpc_metric_ptr(new rpc::Metric) {
   rpc_metric_ptr->set_unit(unit);
   rpc_metric_ptr->set_description(description);
   set_ns(ns);
@@ -48,11 +47,9 @@ Metric::Metric(std::vector<Metric::NamespaceElement> ns, std::string unit,
 Metric::Metric(rpc::Metric* metric) :
                  rpc_metric_ptr(metric),
                  type(DataType::NotSet),
-                 delete_metric_ptr(false),
-                 config(Config(rpc_metric_ptr->config())) {}
+                 delete_metric_ptr(false) {}
 
-Metric::Metric(const Metric& from) : delete_metric_ptr(true),
-                                     config(from.config) {
+Metric::Metric(const Metric& from) : delete_metric_ptr(true) {
   rpc_metric_ptr = new rpc::Metric;
   *rpc_metric_ptr = *from.rpc_metric_ptr;
 }
@@ -63,6 +60,14 @@ Metric::~Metric() {
   }
 }
 
+void Metric::swap(Metric& other) {
+  std::swap(rpc_metric_ptr, other.rpc_metric_ptr);
+  std::swap(delete_metric_ptr, other.delete_metric_ptr);
+  std::swap(type, other.type);
+  memo_ns.swap(other.memo_ns);
+  memo_tags.swap(other.memo_tags);
+}
+
 void Metric::set_ns(std::vector<Metric::NamespaceElement> ns) {
   memo_ns.clear();
   rpc_metric_ptr->clear_namespace_();
@@ -113,11 +118,16 @@ std::vector<int> Metric::dynamic_ns_elements() const {
 
 void Metric::add_tag(std::pair<std::string, std::string> pair) {
   // invalidate memoized tags.
-  std::map<std::string, std::string> memo_tags;
+  memo_tags.clear();
   Map<std::string, std::string>* rpc_tags = rpc_metric_ptr->mutable_tags();
   (*rpc_tags)[pair.first] = pair.second;
 }
 
+Map<std::string, std::string>* Metric::mutable_tags() {
+  memo_tags.clear();
+  return rpc_metric_ptr->mutable_tags();
+}
+
 const std::map<std::string, std::string>& Metric::tags() const {
   if (memo_tags.size() != 0) {
     return memo_tags;
@@ -241,7 +251,7 @@ const std::string& Metric::get_string_data() const {
 }
 
 Plugin::Config Metric::get_config() const {
-  return config;
+  return Config(rpc_metric_ptr->config());
 }
 
 const rpc::Metric* Metric::get_rpc_metric_ptr() const {
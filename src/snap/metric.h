@@ -90,6 +90,12 @@ class Metric final {
 
   ~Metric();
 
+  /**
+   * swap exchanges the contents of two metrics without copying them, e.g. to
+   * compact a std::vector<Metric> in place.
+   */
+  void swap(Metric& other);
+
   /**
    * ns returns the metric's namespace.
    * If there is a memoized copy, that is returned. Else the namespace is
@@ -126,6 +132,14 @@ class Metric final {
    */
   void add_tag(std::pair<std::string, std::string>);
 
+  /**
+   * mutable_tags returns the tags in the metric's `rpc::Metric` ptr, to edit
+   * them in place.
+   * It also invalidates the memoization cache of the tags.
+   * @see memo_tags_ptr
+   */
+  google::protobuf::Map<std::string, std::string>* mutable_tags();
+
   /**
    * timestamp returns the metric's collection timestamp.
    */
@@ -183,7 +197,6 @@ class Metric final {
 
  private:
   rpc::Metric* rpc_metric_ptr;
-  Config config;
 
   void inline set_ts(std::chrono::system_clock::time_point tp);
   void inline set_last_advert_tm(std::chrono::system_clock::time_point tp);
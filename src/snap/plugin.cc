@@ -12,10 +12,12 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 #include "snap/plugin.h"
+#include "snap/diagnostics.h"
 #include "snap/grpc_export.h"
 #include "snap/lib_setup_impl.h"
 
 #include <chrono>
+#include <cstdlib>
 #include <functional>
 #include <sstream>
 #include <string>
@@ -38,6 +40,9 @@ using grpc::Server;
 using grpc::ServerBuilder;
 
 static void start_plugin(Plugin::PluginInterface* plugin, const Plugin::Meta& meta);
+static void start_plugin(int argc, char** argv,
+                         Plugin::PluginInterface* plugin,
+                         const Plugin::Meta& meta);
 
 function<unique_ptr<Plugin::PluginExporter, function<void(Plugin::PluginExporter*)>>()> Plugin::LibSetup::exporter_provider = []{ return std::unique_ptr<PluginExporter>(new GRPCExporter()); };
 
@@ -52,7 +57,12 @@ Plugin::Meta::Meta(Type type, std::string name, int version) :
                      concurrency_count(5),
                      exclusive(false),
                      cache_ttl(std::chrono::milliseconds(500)),
-                     strategy(Strategy::LRU) {}
+                     strategy(Strategy::LRU),
+                     max_receive_message_size(0),
+                     max_send_message_size(0),
+                     compression(NoCompression),
+                     compression_level(CompressNone),
+                     compression_threshold(1024) {}
 
 Plugin::CollectorInterface* Plugin::PluginInterface::IsCollector() {
   return nullptr;
@@ -66,6 +76,8 @@ Plugin::PublisherInterface* Plugin::PluginInterface::IsPublisher() {
   return nullptr;
 }
 
+void Plugin::PluginInterface::kill(const std::string& reason) {}
+
 Plugin::Type Plugin::CollectorInterface::GetType() const {
   return Collector;
 }
@@ -74,6 +86,13 @@ Plugin::CollectorInterface* Plugin::CollectorInterface::IsCollector() {
   return this;
 }
 
+std::string Plugin::CollectorInterface::collect_metrics_by(
+    std::vector<Metric> &metrics,
+    std::chrono::system_clock::time_point deadline) {
+  collect_metrics(metrics);
+  return "";
+}
+
 Plugin::Type Plugin::ProcessorInterface::GetType() const {
   return Processor;
 }
@@ -105,6 +124,24 @@ void Plugin::start_publisher(PublisherInterface* publisher,
   start_plugin(publisher, meta);
 }
 
+void Plugin::start_collector(int argc, char** argv,
+                             CollectorInterface* collector,
+                             const Meta& meta) {
+  start_plugin(argc, argv, collector, meta);
+}
+
+void Plugin::start_processor(int argc, char** argv,
+                             ProcessorInterface* processor,
+                             const Meta& meta) {
+  start_plugin(argc, argv, processor, meta);
+}
+
+void Plugin::start_publisher(int argc, char** argv,
+                             PublisherInterface* publisher,
+                             const Meta& meta) {
+  start_plugin(argc, argv, publisher, meta);
+}
+
 static void start_plugin(Plugin::PluginInterface* plugin, const Plugin::Meta& meta) {
   auto exporter = Plugin::LibSetup::exporter_provider();
   // disable deleting the plugin instance
@@ -112,3 +149,17 @@ static void start_plugin(Plugin::PluginInterface* plugin, const Plugin::Meta& me
   auto completion = exporter->ExportPlugin(plugin_ptr, &meta);
   completion.get();
 }
+
+static void start_plugin(int argc, char** argv,
+                         Plugin::PluginInterface* plugin,
+                         const Plugin::Meta& meta) {
+  Plugin::Diagnostics::Options opts = Plugin::Diagnostics::parse(argc, argv);
+  if (!opts.enabled) {
+    start_plugin(plugin, meta);
+    return;
+  }
+  if (!Plugin::Diagnostics(opts).run(plugin, meta)) {
+    // so scripts running --diagnose see the failure
+    std::exit(1);
+  }
+}
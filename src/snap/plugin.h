@@ -72,6 +72,26 @@ enum Strategy {
   ConfigBased
 };
 
+/**
+ * Compression is the algorithm gRPC replies are compressed with.
+ */
+enum Compression {
+  NoCompression,
+  Deflate,
+  Gzip
+};
+
+/**
+ * CompressionLevel lets gRPC pick the algorithm for replies among those the
+ * caller accepts, trading CPU for bytes as the level rises.
+ */
+enum CompressionLevel {
+  CompressNone,
+  CompressLow,
+  CompressMedium,
+  CompressHigh
+};
+
 /**
  * Meta is the metadata about the plugin.
  */
@@ -116,6 +136,41 @@ struct Meta final {
    * Strategy overwrites the default value of (LRU).
    */
   Strategy strategy;
+
+  /**
+   * admin_listen, when set, starts an AdminServer serving the plugin's RPC
+   * and memory stats for Prometheus, on "host:port" or "unix:path". The
+   * SNAP_PLUGIN_ADMIN environment variable overrides it. Off by default.
+   */
+  std::string admin_listen;
+
+  /**
+   * max_receive_message_size and max_send_message_size bound the gRPC
+   * messages the plugin takes and returns, in bytes. 0 keeps gRPC's defaults
+   * (4MB received, unbounded sent); -1 lifts the bound.
+   */
+  int max_receive_message_size;
+  int max_send_message_size;
+
+  /**
+   * compression is the algorithm metric replies are compressed with, when
+   * snapteld accepts it. Off by default: metric payloads repeat their
+   * namespaces and compress well, but it costs CPU on both ends.
+   */
+  Compression compression;
+
+  /**
+   * compression_level, when set, overrides compression and lets gRPC pick
+   * an algorithm snapteld accepts.
+   */
+  CompressionLevel compression_level;
+
+  /**
+   * compression_threshold is the serialized size, in bytes, below which
+   * replies are sent uncompressed, as compressing them saves little.
+   * Defaults to 1024.
+   */
+  size_t compression_threshold;
 };
 
 /**
@@ -142,6 +197,13 @@ public:
   virtual PublisherInterface* IsPublisher();
 
   virtual const ConfigPolicy get_config_policy() = 0;
+
+  /**
+   * kill is called when snapteld asks the plugin to stop. Plugins holding
+   * buffered data or open resources may override it to flush them; the
+   * default does nothing.
+   */
+  virtual void kill(const std::string& reason);
 protected:
   PluginInterface() = default;
 
@@ -198,6 +260,21 @@ public:
    */
   virtual void collect_metrics(std::vector<Metric> &metrics) = 0;
 
+  /**
+   * collect_metrics_by is what the plugin proxy calls, with the deadline of
+   * snapteld's request (or time_point::max() if it has none). It returns an
+   * empty string, or a description of the metrics it couldn't collect in
+   * time when it returns partial results (see AsyncCollector); the proxy
+   * sends that as a string metric, <prefix>/collect/incomplete, where
+   * prefix is the namespace the requested metrics share.
+   * That metric is only ever sent in collect replies, never listed by
+   * get_metric_types, so tasks can't ask for it; snapteld passes it on to
+   * the task's processors and publishers with the collected metrics.
+   * The default ignores the deadline and calls collect_metrics.
+   */
+  virtual std::string collect_metrics_by(
+      std::vector<Metric> &metrics,
+      std::chrono::system_clock::time_point deadline);
 };
 
 /**
@@ -241,4 +318,18 @@ void start_collector(CollectorInterface* plg, const Meta& meta);
 void start_processor(ProcessorInterface* plg, const Meta& meta);
 void start_publisher(PublisherInterface* plg, const Meta& meta);
 
+/**
+ * These take the command line of the plugin as well. Given --diagnose,
+ * they run the plugin standalone instead, print what it returns and how
+ * long each call took, and return, or exit with status 1 if a call failed;
+ * see Diagnostics for the other flags. Otherwise the arguments are ignored
+ * and the plugin is exported as above.
+ */
+void start_collector(int argc, char** argv, CollectorInterface* plg,
+                     const Meta& meta);
+void start_processor(int argc, char** argv, ProcessorInterface* plg,
+                     const Meta& meta);
+void start_publisher(int argc, char** argv, PublisherInterface* plg,
+                     const Meta& meta);
+
 };  // namespace Plugin
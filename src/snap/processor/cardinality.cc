@@ -0,0 +1,404 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/processor/cardinality.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "snap/hash.h"
+#include "snap/plugin.h"
+#include "snap/processor/series.h"
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using std::chrono::seconds;
+using std::chrono::system_clock;
+
+using Plugin::CardinalityGuardProcessor;
+using Plugin::CardinalityTask;
+using Plugin::Config;
+using Plugin::ConfigPolicy;
+using Plugin::HyperLogLog;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::SlidingCardinality;
+using Plugin::splitmix64;
+
+static const int64_t kNanosPerSec = 1000000000;
+static const int kSlices = 4;
+
+HyperLogLog::HyperLogLog(int precision) : precision(precision) {
+  if (precision < 4 || precision > 16) {
+    throw PluginException("HyperLogLog precision must be in [4, 16]");
+  }
+  registers.assign(size_t(1) << precision, 0);
+}
+
+void HyperLogLog::add(uint64_t hash) {
+  // the register index comes from the top bits, which FNV-style hashes
+  // don't spread well
+  uint64_t h = splitmix64(hash);
+  size_t index = size_t(h >> (64 - precision));
+  uint64_t rest = h << precision;
+  uint8_t rank = rest == 0 ? uint8_t(64 - precision + 1) :
+                             uint8_t(__builtin_clzll(rest) + 1);
+  if (rank > registers[index]) registers[index] = rank;
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+  if (other.precision != precision) {
+    throw PluginException("cannot merge HyperLogLogs of different precision");
+  }
+  for (size_t i = 0; i < registers.size(); i++) {
+    registers[i] = std::max(registers[i], other.registers[i]);
+  }
+}
+
+double HyperLogLog::estimate() const {
+  return estimate(registers.data(), registers.size());
+}
+
+void HyperLogLog::clear() {
+  std::fill(registers.begin(), registers.end(), 0);
+}
+
+double HyperLogLog::estimate(const uint8_t* registers, size_t m) {
+  double sum = 0;
+  size_t zeros = 0;
+  for (size_t i = 0; i < m; i++) {
+    sum += std::ldexp(1.0, -registers[i]);
+    if (registers[i] == 0) zeros++;
+  }
+  double alpha;
+  switch (m) {
+    case 16: alpha = 0.673; break;
+    case 32: alpha = 0.697; break;
+    case 64: alpha = 0.709; break;
+    default: alpha = 0.7213 / (1 + 1.079 / m); break;
+  }
+  double e = alpha * m * m / sum;
+  // linear counting does better while many registers are empty; with
+  // 64-bit hashes no large range correction is needed
+  if (e <= 2.5 * m && zeros > 0) {
+    e = m * std::log(double(m) / zeros);
+  }
+  return e;
+}
+
+SlidingCardinality::SlidingCardinality(int precision, seconds window,
+                                       int slices) :
+    slice_ns(std::max<int64_t>(1, duration_cast<nanoseconds>(
+        window).count() / slices)),
+    ring(slices, HyperLogLog(precision)),
+    newest(std::numeric_limits<int64_t>::min()),
+    merged(size_t(1) << precision) {}
+
+void SlidingCardinality::add(uint64_t hash, int64_t ts) {
+  int64_t slice = ts / slice_ns;
+  int64_t n = int64_t(ring.size());
+  if (newest == std::numeric_limits<int64_t>::min()) {
+    newest = slice;
+  } else if (slice > newest) {
+    // clear the slices time moved past, the oldest of the ring
+    for (int64_t k = 1; k <= std::min(slice - newest, n); k++) {
+      ring[(newest + k) % n].clear();
+    }
+    newest = slice;
+  } else if (slice <= newest - n) {
+    return;
+  }
+  ring[slice % n].add(hash);
+}
+
+double SlidingCardinality::estimate() const {
+  merged = ring[0].data();
+  for (size_t s = 1; s < ring.size(); s++) {
+    const std::vector<uint8_t>& regs = ring[s].data();
+    for (size_t i = 0; i < merged.size(); i++) {
+      merged[i] = std::max(merged[i], regs[i]);
+    }
+  }
+  return HyperLogLog::estimate(merged.data(), merged.size());
+}
+
+size_t SlidingCardinality::memory() const {
+  return (ring.size() + 1) * merged.size();
+}
+
+struct CardinalityTask::Group {
+  Group(const std::vector<std::string>& prefix, int precision,
+        seconds window) : prefix(prefix),
+                          series(precision, window, kSlices),
+                          touched(false), over(false),
+                          alerted(std::numeric_limits<int64_t>::min()) {}
+
+  std::vector<std::string> prefix;
+  SlidingCardinality series;
+  // distinct values per tag key
+  std::unordered_map<std::string, std::unique_ptr<SlidingCardinality>> tags;
+  bool touched;
+  bool over;
+  std::string culprit;
+  // the slice an alert was last emitted in
+  int64_t alerted;
+};
+
+CardinalityTask::CardinalityTask() : precision(12), window(seconds(600)),
+                                     budget(10000), action(Aggregate),
+                                     max_tag_keys(32), fingerprint(0) {}
+
+struct CardinalityGuardProcessor::Groups {
+  std::vector<std::unique_ptr<CardinalityTask::Group>> groups;
+};
+
+CardinalityGuardProcessor::CardinalityGuardProcessor(milliseconds idle) :
+    groups(idle) {}
+
+CardinalityGuardProcessor::~CardinalityGuardProcessor() {}
+
+const ConfigPolicy CardinalityGuardProcessor::get_config_policy() {
+  ConfigPolicy policy(Plugin::StringRule{"prefixes", {"", false}});
+  policy.add_rule({""}, Plugin::IntRule{"budget", {10000, false}});
+  policy.add_rule({""}, Plugin::IntRule{"window", {600, false}});
+  policy.add_rule({""}, Plugin::StringRule{"action", {"aggregate", false}});
+  policy.add_rule({""}, Plugin::IntRule{"precision", {12, false}});
+  policy.add_rule({""}, Plugin::IntRule{"max_tag_keys", {32, false}});
+  return policy;
+}
+
+std::unique_ptr<CardinalityTask> CardinalityGuardProcessor::prepare(
+    const Config& config) {
+  const rpc::ConfigMap& map = config.get_rpc_config_map();
+  std::unique_ptr<CardinalityTask> task(new CardinalityTask());
+  if (map.intmap().count("budget")) {
+    task->budget = config.get_int("budget");
+  }
+  if (map.intmap().count("window")) {
+    task->window = seconds(config.get_int("window"));
+  }
+  if (task->budget <= 0 || task->window.count() <= 0) {
+    throw PluginException("budget and window must be positive");
+  }
+  if (map.stringmap().count("action")) {
+    std::string action = config.get_string("action");
+    if (action == "drop") {
+      task->action = CardinalityTask::Drop;
+    } else if (action != "aggregate") {
+      throw PluginException("action must be aggregate or drop: " + action);
+    }
+  }
+  if (map.intmap().count("precision")) {
+    task->precision = config.get_int("precision");
+    // checked now, as sketches are only built for the first batch
+    HyperLogLog check(task->precision);
+  }
+  if (map.intmap().count("max_tag_keys")) {
+    int max_tag_keys = config.get_int("max_tag_keys");
+    if (max_tag_keys < 0) {
+      throw PluginException("max_tag_keys must not be negative");
+    }
+    task->max_tag_keys = size_t(max_tag_keys);
+  }
+
+  std::string prefixes;
+  if (map.stringmap().count("prefixes")) {
+    prefixes = config.get_string("prefixes");
+  }
+  std::stringstream ss(prefixes);
+  std::string prefix;
+  while (std::getline(ss, prefix, ';')) {
+    size_t begin = prefix.find_first_not_of(" \t\n");
+    if (begin == std::string::npos) continue;
+    size_t end = prefix.find_last_not_of(" \t\n");
+    task->prefixes.push_back(split_ns(prefix.substr(begin,
+                                                    end - begin + 1)));
+  }
+  if (task->prefixes.empty()) task->prefixes.emplace_back();
+  task->fingerprint = config.fingerprint();
+  return task;
+}
+
+/**
+ * Returns the tag key of g with the most distinct values, or "" if none has
+ * more than one.
+ */
+static std::string find_culprit(const CardinalityTask::Group& g) {
+  std::string culprit;
+  double most = 1.5;
+  for (const auto& tag : g.tags) {
+    double estimate = tag.second->estimate();
+    if (estimate > most) {
+      most = estimate;
+      culprit = tag.first;
+    }
+  }
+  return culprit;
+}
+
+/**
+ * Adds the data of met to into, both of the same series, and keeps the newer
+ * timestamp. Data that can't be summed, or of another type, is replaced.
+ */
+static void merge_into(rpc::Metric* into, const rpc::Metric& met) {
+  if (into->data_case() != met.data_case()) {
+    *into = met;
+    return;
+  }
+  switch (met.data_case()) {
+    case rpc::Metric::kFloat64Data:
+      into->set_float64_data(into->float64_data() + met.float64_data());
+      break;
+    case rpc::Metric::kFloat32Data:
+      into->set_float32_data(into->float32_data() + met.float32_data());
+      break;
+    case rpc::Metric::kInt64Data:
+      into->set_int64_data(into->int64_data() + met.int64_data());
+      break;
+    case rpc::Metric::kInt32Data:
+      into->set_int32_data(into->int32_data() + met.int32_data());
+      break;
+    case rpc::Metric::kUint64Data:
+      into->set_uint64_data(into->uint64_data() + met.uint64_data());
+      break;
+    case rpc::Metric::kUint32Data:
+      into->set_uint32_data(into->uint32_data() + met.uint32_data());
+      break;
+    default:
+      *into = met;
+      return;
+  }
+  const rpc::Time& a = into->timestamp();
+  const rpc::Time& b = met.timestamp();
+  if (b.sec() > a.sec() || (b.sec() == a.sec() && b.nsec() > a.nsec())) {
+    *into->mutable_timestamp() = b;
+  }
+}
+
+void CardinalityGuardProcessor::process_metrics(std::vector<Metric> &metrics,
+                                                const CardinalityTask& task) {
+  groups.with(task.fingerprint, [&]() {
+    std::unique_ptr<Groups> state(new Groups());
+    for (const auto& prefix : task.prefixes) {
+      state->groups.emplace_back(new CardinalityTask::Group(
+          prefix, task.precision, task.window));
+    }
+    return state;
+  }, [&](Groups& state) {
+    std::vector<CardinalityTask::Group*> group_of(metrics.size(), nullptr);
+    int64_t newest = 0;
+
+    for (size_t i = 0; i < metrics.size(); i++) {
+      const rpc::Metric& met = *metrics[i].get_rpc_metric_ptr();
+      CardinalityTask::Group* g = nullptr;
+      for (const auto& group : state.groups) {
+        if (has_ns_prefix(met, group->prefix)) {
+          g = group.get();
+          break;
+        }
+      }
+      if (g == nullptr) continue;
+      group_of[i] = g;
+      g->touched = true;
+
+      int64_t ts = met.timestamp().sec() * kNanosPerSec +
+                   met.timestamp().nsec();
+      newest = std::max(newest, ts);
+      g->series.add(series_id(met), ts);
+      for (const auto& tag : met.tags()) {
+        auto it = g->tags.find(tag.first);
+        if (it == g->tags.end()) {
+          if (g->tags.size() >= task.max_tag_keys) continue;
+          it = g->tags.emplace(tag.first, std::unique_ptr<SlidingCardinality>(
+              new SlidingCardinality(task.precision, task.window,
+                                     kSlices))).first;
+        }
+        it->second->add(std::hash<std::string>()(tag.second), ts);
+      }
+    }
+
+    std::vector<Metric> alerts;
+    int64_t slice = newest / (duration_cast<nanoseconds>(task.window).count() /
+                              kSlices);
+    for (const auto& group : state.groups) {
+      CardinalityTask::Group& g = *group;
+      if (!g.touched) continue;
+      g.touched = false;
+
+      double estimate = g.series.estimate();
+      if (estimate <= task.budget) {
+        g.over = false;
+        g.culprit.clear();
+        continue;
+      }
+      if (!g.over || g.culprit.empty()) {
+        g.over = true;
+        g.culprit = find_culprit(g);
+      }
+      if (slice == g.alerted) continue;
+      g.alerted = slice;
+
+      std::vector<Metric::NamespaceElement> ns;
+      for (const std::string& elem : g.prefix) ns.push_back({elem, "", ""});
+      ns.push_back({"cardinality", "", ""});
+      alerts.emplace_back(Metric(ns, "", "distinct series over budget"));
+      if (!g.culprit.empty()) alerts.back().add_tag({"tag", g.culprit});
+      alerts.back().add_tag({"action",
+          task.action == CardinalityTask::Drop ? "drop" : "aggregate"});
+      alerts.back().set_data(std::round(estimate));
+      alerts.back().set_timestamp(system_clock::time_point(
+          duration_cast<system_clock::duration>(nanoseconds(newest))));
+    }
+
+    // metrics without the culprit, by the slot they go to
+    std::vector<std::pair<size_t, rpc::Metric>> collapsed;
+    std::unordered_map<uint64_t, size_t> collapsed_at;
+    size_t kept = 0;
+    rpc::Metric scratch;
+    for (size_t i = 0; i < metrics.size(); i++) {
+      CardinalityTask::Group* g = group_of[i];
+      const rpc::Metric& met = *metrics[i].get_rpc_metric_ptr();
+      if (g != nullptr && g->over && !g->culprit.empty() &&
+          met.tags().count(g->culprit)) {
+        if (task.action == CardinalityTask::Drop) continue;
+        scratch = met;
+        scratch.mutable_tags()->erase(g->culprit);
+        auto at = collapsed_at.emplace(series_id(scratch), collapsed.size());
+        if (!at.second) {
+          merge_into(&collapsed[at.first->second].second, scratch);
+          continue;
+        }
+        collapsed.emplace_back(kept, scratch);
+      } else if (kept != i) {
+        metrics[kept].swap(metrics[i]);
+      }
+      kept++;
+    }
+    for (auto& c : collapsed) {
+      // copied explicitly, as a wrapper of c.second mustn't be kept
+      Metric wrapper(&c.second);
+      Metric owned(wrapper);
+      metrics[c.first].swap(owned);
+    }
+    while (metrics.size() > kept) metrics.pop_back();
+    for (const Metric& alert : alerts) metrics.push_back(alert);
+  });
+}
@@ -0,0 +1,173 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/processor/prepared_processor.h"
+#include "snap/rpc/plugin.pb.h"
+
+namespace Plugin {
+
+/**
+ * HyperLogLog estimates the number of distinct 64-bit hashes added, in
+ * 2^precision one-byte registers, with a standard error of about
+ * 1.04 / sqrt(2^precision): 1.6% at the default precision of 12, in 4KB.
+ * (Flajolet et al., "HyperLogLog: the analysis of a near-optimal
+ * cardinality estimation algorithm", 2007.)
+ */
+class HyperLogLog final {
+ public:
+  /**
+   * precision must be in [4, 16], or PluginException is thrown.
+   */
+  explicit HyperLogLog(int precision = 12);
+
+  /**
+   * add counts hash, which should be well mixed; series_id and std::hash
+   * values are mixed again here.
+   */
+  void add(uint64_t hash);
+
+  /**
+   * merge makes this count the union of both; both must have the same
+   * precision.
+   */
+  void merge(const HyperLogLog& other);
+
+  double estimate() const;
+
+  void clear();
+
+  size_t memory() const { return registers.size(); }
+
+  /**
+   * estimate returns the estimate for registers, e.g. the merge of several
+   * sketches of the same precision.
+   */
+  static double estimate(const uint8_t* registers, size_t m);
+
+  const std::vector<uint8_t>& data() const { return registers; }
+
+ private:
+  int precision;
+  std::vector<uint8_t> registers;
+};
+
+/**
+ * SlidingCardinality estimates the distinct hashes added over the last
+ * window, as a ring of HyperLogLogs each covering window / slices; the
+ * oldest is cleared as time moves into a new slice. Time is taken from the
+ * timestamps passed to add, so memory is fixed at slices sketches.
+ */
+class SlidingCardinality final {
+ public:
+  SlidingCardinality(int precision, std::chrono::seconds window, int slices);
+
+  /**
+   * add counts hash at ts, in nanoseconds since the epoch; hashes older than
+   * the window are ignored.
+   */
+  void add(uint64_t hash, int64_t ts);
+
+  double estimate() const;
+
+  size_t memory() const;
+
+ private:
+  int64_t slice_ns;
+  std::vector<HyperLogLog> ring;
+  // the number of the newest slice, counted from the epoch
+  int64_t newest;
+  mutable std::vector<uint8_t> merged;
+};
+
+/**
+ * The prepared state of a CardinalityGuardProcessor task.
+ */
+struct CardinalityTask {
+  struct Group;
+
+  CardinalityTask();
+
+  enum Action {Drop, Aggregate};
+
+  int precision;
+  std::chrono::seconds window;
+  double budget;
+  Action action;
+  size_t max_tag_keys;
+  // the guarded prefixes, in order; one empty prefix if none was given
+  std::vector<std::vector<std::string>> prefixes;
+  // the config fingerprint, which keys the task's sketches
+  uint64_t fingerprint;
+};
+
+/**
+ * CardinalityGuardProcessor estimates the distinct series under namespace
+ * prefixes, and the distinct values of each of their tag keys, over a
+ * sliding window. When a prefix goes over budget, the tag key with the most
+ * distinct values is taken as the culprit: metrics carrying it are dropped,
+ * or have it removed, until the prefix is back within budget. Removing it
+ * aggregates the metrics of a batch that now fall in the same series into
+ * one: numbers are summed under the newest timestamp, other data keeps the
+ * last value. An alert metric is emitted once per window / 4 while over
+ * budget, under the prefix plus "cardinality", with tags "tag" and "action"
+ * and the estimate as data.
+ *
+ * Task config values:
+ *   prefixes:     namespace prefixes guarded separately, separated by ';',
+ *                 e.g. "/intel/app;/intel/web"; a metric counts towards the
+ *                 first it matches. Everything as one group if empty (the
+ *                 default)
+ *   budget:       the distinct series allowed per prefix, 10000 by default
+ *   window:       seconds, 600 by default
+ *   action:       "aggregate" (the default) or "drop"
+ *   precision:    the HyperLogLog precision, 12 by default
+ *   max_tag_keys: tag keys tracked per prefix, 32 by default; later keys
+ *                 are not considered as culprits
+ * Memory is fixed at prefixes * (1 + max_tag_keys) * 5 * 2^precision bytes
+ * per task: each tracker keeps four slices and a merge buffer. Sketches are
+ * kept per config in a TaskStore (see there).
+ */
+class CardinalityGuardProcessor final :
+    public PreparedProcessor<CardinalityTask> {
+ public:
+  using PreparedProcessor<CardinalityTask>::process_metrics;
+
+  explicit CardinalityGuardProcessor(
+      std::chrono::milliseconds idle = std::chrono::hours(1));
+  ~CardinalityGuardProcessor();
+
+  const ConfigPolicy get_config_policy();
+
+  std::unique_ptr<CardinalityTask> prepare(const Config& config);
+
+  void process_metrics(std::vector<Metric> &metrics,
+                       const CardinalityTask& task);
+
+ private:
+  struct Groups;
+
+  TaskStore<Groups> groups;
+};
+
+}  // namespace Plugin
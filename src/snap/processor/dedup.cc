@@ -0,0 +1,222 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/processor/dedup.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "snap/plugin.h"
+#include "snap/processor/series.h"
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using std::chrono::seconds;
+using std::chrono::system_clock;
+
+using Plugin::ChangeFilter;
+using Plugin::Config;
+using Plugin::ConfigPolicy;
+using Plugin::DedupProcessor;
+using Plugin::DedupTask;
+using Plugin::Metric;
+using Plugin::PluginException;
+
+static const int64_t kNanosPerSec = 1000000000;
+
+static uint64_t double_bits(double d) {
+  uint64_t bits;
+  std::memcpy(&bits, &d, sizeof(bits));
+  return bits;
+}
+
+static double bits_double(uint64_t bits) {
+  double d;
+  std::memcpy(&d, &bits, sizeof(d));
+  return d;
+}
+
+static uint64_t fingerprint(const rpc::Metric& met) {
+  switch (met.data_case()) {
+    case rpc::Metric::kFloat32Data:
+      return double_bits(met.float32_data());
+    case rpc::Metric::kFloat64Data:
+      return double_bits(met.float64_data());
+    case rpc::Metric::kInt32Data:
+      return uint64_t(int64_t(met.int32_data()));
+    case rpc::Metric::kInt64Data:
+      return uint64_t(met.int64_data());
+    case rpc::Metric::kUint32Data:
+      return met.uint32_data();
+    case rpc::Metric::kUint64Data:
+      return met.uint64_data();
+    case rpc::Metric::kBoolData:
+      return met.bool_data();
+    case rpc::Metric::kStringData:
+      return std::hash<std::string>()(met.string_data());
+    case rpc::Metric::kBytesData:
+      return std::hash<std::string>()(met.bytes_data());
+    default:
+      return 0;
+  }
+}
+
+ChangeFilter::Options::Options() : keepalive(10), tolerance(0),
+                                   relative_tolerance(0),
+                                   stale_after(seconds(600)) {}
+
+ChangeFilter::ChangeFilter(const Options& opts) :
+                           opts(opts),
+                           stale_ns(duration_cast<nanoseconds>(
+                               opts.stale_after).count()),
+                           last_evict(std::numeric_limits<int64_t>::min()) {}
+
+bool ChangeFilter::pass(const rpc::Metric& met) {
+  uint64_t fp = fingerprint(met);
+  int64_t ts = met.timestamp().sec() * kNanosPerSec + met.timestamp().nsec();
+  uint64_t id = series_id(met);
+  auto it = last.find(id);
+  if (it == last.end()) {
+    last.emplace(id, Series{fp, ts, 0, int32_t(met.data_case())});
+    return true;
+  }
+
+  Series& s = it->second;
+  s.seen = ts;
+  bool unchanged = s.data_case == int32_t(met.data_case()) &&
+                   s.fingerprint == fp;
+  if (!unchanged && s.data_case == int32_t(met.data_case()) &&
+      (met.data_case() == rpc::Metric::kFloat64Data ||
+       met.data_case() == rpc::Metric::kFloat32Data)) {
+    double prev = bits_double(s.fingerprint);
+    double cur = bits_double(fp);
+    double band = std::max(opts.tolerance,
+                           opts.relative_tolerance * std::fabs(prev));
+    unchanged = std::fabs(cur - prev) <= band;
+  }
+  if (unchanged && (opts.keepalive == 0 ||
+                    s.suppressed + 1 < opts.keepalive)) {
+    s.suppressed++;
+    return false;
+  }
+  s.fingerprint = fp;
+  s.suppressed = 0;
+  s.data_case = int32_t(met.data_case());
+  return true;
+}
+
+size_t ChangeFilter::evict(system_clock::time_point now) {
+  int64_t now_ns = duration_cast<nanoseconds>(now.time_since_epoch()).count();
+  if (last_evict != std::numeric_limits<int64_t>::min() &&
+      now_ns - last_evict < stale_ns) {
+    return 0;
+  }
+  last_evict = now_ns;
+  size_t removed = 0;
+  for (auto it = last.begin(); it != last.end();) {
+    if (it->second.seen < now_ns - stale_ns) {
+      it = last.erase(it);
+      removed++;
+    } else {
+      ++it;
+    }
+  }
+  return removed;
+}
+
+const ConfigPolicy DedupProcessor::get_config_policy() {
+  ConfigPolicy policy(Plugin::StringRule{"match", {"", false}});
+  policy.add_rule({""}, Plugin::IntRule{"keepalive", {10, false}});
+  policy.add_rule({""}, Plugin::StringRule{"tolerance", {"0", false}});
+  policy.add_rule({""}, Plugin::StringRule{"relative_tolerance",
+                                           {"0", false}});
+  policy.add_rule({""}, Plugin::IntRule{"stale_after", {600, false}});
+  return policy;
+}
+
+/**
+ * parse_tolerance reads a tolerance config value, rejecting anything that
+ * isn't entirely a number.
+ */
+static double parse_tolerance(const std::string& value) {
+  char* end;
+  double tolerance = std::strtod(value.c_str(), &end);
+  if (value.empty() || *end != '\0') {
+    throw PluginException("bad tolerance: " + value);
+  }
+  return tolerance;
+}
+
+DedupProcessor::DedupProcessor(milliseconds idle) : filters(idle) {}
+
+std::unique_ptr<DedupTask> DedupProcessor::prepare(const Config& config) {
+  const rpc::ConfigMap& map = config.get_rpc_config_map();
+  std::unique_ptr<DedupTask> task(new DedupTask());
+  ChangeFilter::Options& opts = task->opts;
+  if (map.stringmap().count("match")) {
+    task->match = split_ns(config.get_string("match"));
+  }
+  if (map.intmap().count("keepalive")) {
+    int keepalive = config.get_int("keepalive");
+    if (keepalive < 0) {
+      throw PluginException("keepalive must not be negative");
+    }
+    opts.keepalive = uint32_t(keepalive);
+  }
+  if (map.stringmap().count("tolerance")) {
+    opts.tolerance = parse_tolerance(config.get_string("tolerance"));
+  }
+  if (map.stringmap().count("relative_tolerance")) {
+    opts.relative_tolerance = parse_tolerance(
+        config.get_string("relative_tolerance"));
+  }
+  if (!(opts.tolerance >= 0) || !(opts.relative_tolerance >= 0)) {
+    throw PluginException("tolerances must not be negative");
+  }
+  if (map.intmap().count("stale_after")) {
+    opts.stale_after = seconds(config.get_int("stale_after"));
+  }
+  task->fingerprint = config.fingerprint();
+  return task;
+}
+
+void DedupProcessor::process_metrics(std::vector<Metric> &metrics,
+                                     const DedupTask& task) {
+  system_clock::time_point newest;
+  size_t kept = 0;
+
+  filters.with(task.fingerprint, [&]() {
+    return std::unique_ptr<ChangeFilter>(new ChangeFilter(task.opts));
+  }, [&](ChangeFilter& filter) {
+    for (size_t i = 0; i < metrics.size(); i++) {
+      const rpc::Metric& met = *metrics[i].get_rpc_metric_ptr();
+      if (has_ns_prefix(met, task.match)) {
+        newest = std::max(newest, metrics[i].timestamp());
+        if (!filter.pass(met)) continue;
+      }
+      if (kept != i) metrics[kept].swap(metrics[i]);
+      kept++;
+    }
+    if (newest != system_clock::time_point()) {
+      filter.evict(newest);
+    }
+  });
+  while (metrics.size() > kept) metrics.pop_back();
+}
@@ -0,0 +1,126 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/processor/prepared_processor.h"
+#include "snap/rpc/plugin.pb.h"
+
+namespace Plugin {
+
+/**
+ * ChangeFilter passes the samples of a series whose value changed since the
+ * last one it passed, and every keepalive-th sample regardless, so readers
+ * can tell a quiet series from a dead one.
+ *
+ * Each series keeps a 64-bit fingerprint of its last passed value: the bits
+ * of numbers, a hash of strings. Floats within tolerance, or within
+ * relative_tolerance of the last passed value, count as unchanged; comparing
+ * to the last passed value rather than the last seen one keeps slow drift
+ * from going unreported.
+ */
+class ChangeFilter final {
+ public:
+  struct Options {
+    Options();
+
+    /** pass at least every keepalive-th sample; 0 for never */
+    uint32_t keepalive;
+    double tolerance;
+    double relative_tolerance;
+    /** series not seen for this long are dropped by evict */
+    std::chrono::seconds stale_after;
+  };
+
+  explicit ChangeFilter(const Options& opts);
+
+  /**
+   * pass records met and tells whether to keep it.
+   */
+  bool pass(const rpc::Metric& met);
+
+  /**
+   * evict drops the series whose last sample is older than stale_after
+   * before now; it only scans once every stale_after.
+   */
+  size_t evict(std::chrono::system_clock::time_point now);
+
+  size_t series() const { return last.size(); }
+
+ private:
+  struct Series {
+    uint64_t fingerprint;
+    int64_t seen;
+    uint32_t suppressed;
+    int32_t data_case;
+  };
+
+  Options opts;
+  int64_t stale_ns;
+  int64_t last_evict;
+  std::unordered_map<uint64_t, Series> last;
+};
+
+/**
+ * The prepared state of a DedupProcessor task.
+ */
+struct DedupTask {
+  std::vector<std::string> match;
+  ChangeFilter::Options opts;
+  // the config fingerprint, which keys the task's last values
+  uint64_t fingerprint;
+};
+
+/**
+ * DedupProcessor drops samples that repeat the last value of their series,
+ * using the task config values
+ *   match:              the namespace prefix to deduplicate, e.g.
+ *                       "/intel/inventory"; all metrics if empty (the
+ *                       default)
+ *   keepalive:          pass at least every keepalive-th sample of a series,
+ *                       10 by default; 0 for never
+ *   tolerance:          the absolute change below which floats count as
+ *                       unchanged, "0" by default
+ *   relative_tolerance: the same relative to the last passed value, "0" by
+ *                       default
+ *   stale_after:        seconds after which a series that stopped reporting
+ *                       is forgotten, 600 by default
+ * Last values are kept per config in a TaskStore (see there).
+ */
+class DedupProcessor final : public PreparedProcessor<DedupTask> {
+ public:
+  using PreparedProcessor<DedupTask>::process_metrics;
+
+  explicit DedupProcessor(
+      std::chrono::milliseconds idle = std::chrono::hours(1));
+
+  const ConfigPolicy get_config_policy();
+
+  std::unique_ptr<DedupTask> prepare(const Config& config);
+
+  void process_metrics(std::vector<Metric> &metrics, const DedupTask& task);
+
+ private:
+  TaskStore<ChangeFilter> filters;
+};
+
+}  // namespace Plugin
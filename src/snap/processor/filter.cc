@@ -0,0 +1,354 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/processor/filter.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "snap/plugin.h"
+
+using Plugin::Config;
+using Plugin::ConfigPolicy;
+using Plugin::FilterProcessor;
+using Plugin::Metric;
+using Plugin::MetricFilter;
+using Plugin::PluginException;
+
+namespace {
+
+// Pattern elements are symbol ids, or one of these.
+const uint32_t kAnyElem = 0xffffffff;
+const uint32_t kAnyDepthElem = 0xfffffffe;
+// The symbol of namespace elements no rule names.
+const uint32_t kOtherSym = 0;
+
+const size_t kMaxStates = 4096;
+
+// A set of positions in the patterns, each rule << 32 | element index,
+// sorted.
+typedef std::vector<uint64_t> ItemSet;
+
+std::string trim(const std::string& str) {
+  size_t begin = str.find_first_not_of(" \t\r");
+  if (begin == std::string::npos) return "";
+  size_t end = str.find_last_not_of(" \t\r");
+  return str.substr(begin, end - begin + 1);
+}
+
+std::vector<std::string> split(const std::string& str, const char* seps) {
+  std::vector<std::string> parts;
+  size_t begin = 0;
+  for (;;) {
+    size_t end = str.find_first_of(seps, begin);
+    parts.push_back(str.substr(begin, end - begin));
+    if (end == std::string::npos) return parts;
+    begin = end + 1;
+  }
+}
+
+/**
+ * Adds the positions reachable from set by letting "**" match nothing, then
+ * sorts it.
+ */
+void close(const std::vector<std::vector<uint32_t>>& patterns, ItemSet* set) {
+  for (size_t i = 0; i < set->size(); i++) {
+    uint64_t item = (*set)[i];
+    const std::vector<uint32_t>& pat = patterns[item >> 32];
+    uint32_t pos = uint32_t(item);
+    if (pos < pat.size() && pat[pos] == kAnyDepthElem) {
+      set->push_back(item + 1);
+    }
+  }
+  std::sort(set->begin(), set->end());
+  set->erase(std::unique(set->begin(), set->end()), set->end());
+}
+
+/**
+ * Returns the positions reached from set on an element with symbol sym.
+ */
+ItemSet step(const std::vector<std::vector<uint32_t>>& patterns,
+             const ItemSet& set, uint32_t sym) {
+  ItemSet next;
+  for (uint64_t item : set) {
+    const std::vector<uint32_t>& pat = patterns[item >> 32];
+    uint32_t pos = uint32_t(item);
+    if (pos >= pat.size()) continue;
+    if (pat[pos] == kAnyDepthElem) {
+      next.push_back(item);
+    } else if (pat[pos] == kAnyElem ||
+               (sym != kOtherSym && pat[pos] == sym)) {
+      next.push_back(item + 1);
+    }
+  }
+  close(patterns, &next);
+  return next;
+}
+
+}  // namespace
+
+MetricFilter::MetricFilter(const std::string& include,
+                           const std::string& exclude) : has_include(false) {
+  std::vector<std::vector<uint32_t>> patterns;
+  add_rules(include, false, &patterns);
+  add_rules(exclude, true, &patterns);
+  compile(patterns);
+}
+
+void MetricFilter::add_rules(const std::string& text, bool exclude,
+                             std::vector<std::vector<uint32_t>>* patterns) {
+  for (const std::string& part : split(text, ";\n")) {
+    std::string rule = trim(part);
+    if (rule.empty()) continue;
+
+    Rule r{exclude, uint32_t(preds.size()), 0};
+    size_t brace = rule.find('{');
+    if (brace != std::string::npos) {
+      if (rule.back() != '}') {
+        throw PluginException("filter rule \"" + rule +
+                              "\": expected '}' at the end");
+      }
+      std::string body = rule.substr(brace + 1, rule.size() - brace - 2);
+      for (const std::string& p : split(body, ",")) {
+        std::string pred = trim(p);
+        TagPredicate tp;
+        size_t eq = pred.find('=');
+        if (!pred.empty() && pred[0] == '!') {
+          tp.key = pred.substr(1);
+          tp.op = TagPredicate::kAbsent;
+        } else if (eq == std::string::npos) {
+          tp.key = pred;
+          tp.op = TagPredicate::kPresent;
+        } else if (eq > 0 && pred[eq - 1] == '!') {
+          tp.key = trim(pred.substr(0, eq - 1));
+          tp.value = trim(pred.substr(eq + 1));
+          tp.op = TagPredicate::kNotEquals;
+        } else {
+          tp.key = trim(pred.substr(0, eq));
+          tp.value = trim(pred.substr(eq + 1));
+          tp.op = TagPredicate::kEquals;
+        }
+        if (tp.key.empty()) {
+          throw PluginException("filter rule \"" + rule +
+                                "\": empty tag key");
+        }
+        preds.push_back(tp);
+      }
+    }
+    r.pred_end = uint32_t(preds.size());
+
+    std::string ns = trim(rule.substr(0, brace));
+    if (!ns.empty() && ns[0] == '/') ns.erase(0, 1);
+    if (ns.empty()) {
+      throw PluginException("filter rule \"" + rule + "\": empty namespace");
+    }
+    std::vector<uint32_t> pattern;
+    for (const std::string& elem : split(ns, "/")) {
+      if (elem.empty()) {
+        throw PluginException("filter rule \"" + rule +
+                              "\": empty namespace element");
+      }
+      if (elem == "*") {
+        pattern.push_back(kAnyElem);
+      } else if (elem == "**") {
+        pattern.push_back(kAnyDepthElem);
+      } else {
+        // symbols start at 1, after kOtherSym
+        uint32_t sym = uint32_t(symbols.size()) + 1;
+        pattern.push_back(symbols.emplace(elem, sym).first->second);
+      }
+    }
+    rules.push_back(r);
+    patterns->push_back(pattern);
+    if (!exclude) has_include = true;
+  }
+}
+
+void MetricFilter::compile(const std::vector<std::vector<uint32_t>>& patterns) {
+  std::map<ItemSet, int32_t> ids;
+  std::vector<ItemSet> sets;
+
+  ItemSet start;
+  for (size_t r = 0; r < patterns.size(); r++) {
+    start.push_back(uint64_t(r) << 32);
+  }
+  close(patterns, &start);
+  ids[start] = 0;
+  sets.push_back(start);
+
+  // the empty set is the dead state, -1
+  auto intern = [&](const ItemSet& set) -> int32_t {
+    if (set.empty()) return -1;
+    auto it = ids.find(set);
+    if (it != ids.end()) return it->second;
+    if (sets.size() >= kMaxStates) {
+      throw PluginException("filter rules need more than " +
+                            std::to_string(kMaxStates) + " states");
+    }
+    int32_t id = int32_t(sets.size());
+    ids[set] = id;
+    sets.push_back(set);
+    return id;
+  };
+
+  // sets grows as new states are found; each is expanded once, in order, so
+  // nodes[n] and its edges are appended while expanding sets[n]
+  for (size_t n = 0; n < sets.size(); n++) {
+    const ItemSet set = sets[n];
+    Node node;
+    node.other = intern(step(patterns, set, kOtherSym));
+
+    std::vector<uint32_t> syms;
+    for (uint64_t item : set) {
+      const std::vector<uint32_t>& pat = patterns[item >> 32];
+      uint32_t pos = uint32_t(item);
+      if (pos < pat.size() && pat[pos] != kAnyElem &&
+          pat[pos] != kAnyDepthElem) {
+        syms.push_back(pat[pos]);
+      }
+    }
+    std::sort(syms.begin(), syms.end());
+    syms.erase(std::unique(syms.begin(), syms.end()), syms.end());
+    node.edge_begin = uint32_t(edges.size());
+    for (uint32_t sym : syms) {
+      int32_t next = intern(step(patterns, set, sym));
+      if (next != node.other) edges.emplace_back(sym, next);
+    }
+    node.edge_end = uint32_t(edges.size());
+
+    bool any_include = false;
+    bool include_plain = false;
+    bool exclude_plain = false;
+    bool exclude_tags = false;
+    node.accept_begin = uint32_t(accepts.size());
+    for (uint64_t item : set) {
+      uint32_t r = uint32_t(item >> 32);
+      if (uint32_t(item) != patterns[r].size()) continue;
+      accepts.push_back(r);
+      bool plain = rules[r].pred_begin == rules[r].pred_end;
+      if (rules[r].exclude) {
+        exclude_plain = exclude_plain || plain;
+        exclude_tags = exclude_tags || !plain;
+      } else {
+        any_include = true;
+        include_plain = include_plain || plain;
+      }
+    }
+    node.accept_end = uint32_t(accepts.size());
+
+    bool included = !has_include || include_plain;
+    if (exclude_plain || (!included && !any_include)) {
+      node.verdict = kDrop;
+    } else if (included && !exclude_tags) {
+      node.verdict = kKeep;
+    } else {
+      node.verdict = kCheckTags;
+    }
+    nodes.push_back(node);
+  }
+}
+
+bool MetricFilter::tags_match(const Rule& rule, const rpc::Metric& met) const {
+  for (uint32_t i = rule.pred_begin; i < rule.pred_end; i++) {
+    const TagPredicate& pred = preds[i];
+    auto it = met.tags().find(pred.key);
+    bool found = it != met.tags().end();
+    switch (pred.op) {
+      case TagPredicate::kEquals:
+        if (!found || it->second != pred.value) return false;
+        break;
+      case TagPredicate::kNotEquals:
+        if (found && it->second == pred.value) return false;
+        break;
+      case TagPredicate::kPresent:
+        if (!found) return false;
+        break;
+      case TagPredicate::kAbsent:
+        if (found) return false;
+        break;
+    }
+  }
+  return true;
+}
+
+bool MetricFilter::keep(const rpc::Metric& met) const {
+  int32_t state = 0;
+  for (const rpc::NamespaceElement& nse : met.namespace_()) {
+    const Node& node = nodes[state];
+    int32_t next = node.other;
+    if (node.edge_begin != node.edge_end) {
+      auto sym = symbols.find(nse.value());
+      if (sym != symbols.end()) {
+        auto begin = edges.begin() + node.edge_begin;
+        auto end = edges.begin() + node.edge_end;
+        // targets are at least -1, so this is the first edge for sym
+        auto edge = std::lower_bound(begin, end,
+                                     std::make_pair(sym->second, -1));
+        if (edge != end && edge->first == sym->second) next = edge->second;
+      }
+    }
+    if (next < 0) {
+      // no rule can match any more
+      return !has_include;
+    }
+    state = next;
+  }
+
+  const Node& node = nodes[state];
+  if (node.verdict != kCheckTags) {
+    return node.verdict == kKeep;
+  }
+  bool included = !has_include;
+  for (uint32_t i = node.accept_begin; i < node.accept_end; i++) {
+    const Rule& rule = rules[accepts[i]];
+    if (rule.exclude) {
+      if (tags_match(rule, met)) return false;
+    } else if (!included) {
+      included = tags_match(rule, met);
+    }
+  }
+  return included;
+}
+
+void MetricFilter::apply(std::vector<Metric>& metrics) const {
+  size_t kept = 0;
+  for (size_t i = 0; i < metrics.size(); i++) {
+    if (!keep(*metrics[i].get_rpc_metric_ptr())) continue;
+    if (kept != i) metrics[kept].swap(metrics[i]);
+    kept++;
+  }
+  // pop_back, as Metric can't be assigned for erase
+  while (metrics.size() > kept) metrics.pop_back();
+}
+
+const ConfigPolicy FilterProcessor::get_config_policy() {
+  ConfigPolicy policy(Plugin::StringRule{"include", {"", false}});
+  policy.add_rule({""}, Plugin::StringRule{"exclude", {"", false}});
+  return policy;
+}
+
+std::unique_ptr<MetricFilter> FilterProcessor::prepare(const Config& config) {
+  const rpc::ConfigMap& map = config.get_rpc_config_map();
+  std::string include;
+  std::string exclude;
+  if (map.stringmap().count("include")) include = config.get_string("include");
+  if (map.stringmap().count("exclude")) exclude = config.get_string("exclude");
+  return std::unique_ptr<MetricFilter>(new MetricFilter(include, exclude));
+}
+
+void FilterProcessor::process_metrics(std::vector<Metric> &metrics,
+                                      const MetricFilter& filter) {
+  filter.apply(metrics);
+}
@@ -0,0 +1,138 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/processor/prepared_processor.h"
+#include "snap/rpc/plugin.pb.h"
+
+namespace Plugin {
+
+/**
+ * MetricFilter decides which metrics to keep from include and exclude rule
+ * sets, compiled once into a deterministic automaton over namespace elements.
+ *
+ * Rules are separated by ';' or newlines. A rule is a namespace glob,
+ * elements separated by '/', where "*" matches any one element and "**"
+ * any number of them, optionally followed by tag predicates in braces.
+ * key=value and key!=value compare a tag's value, key requires the tag and
+ * !key requires its absence. For instance, the elements intel, net and "**"
+ * followed by {host=node1,rack!=r2,env,!debug} keep every metric under
+ * /intel/net from node1, outside rack r2, with an env tag and no debug tag.
+ *
+ * A metric is kept if it matches an include rule, or there are none, and
+ * matches no exclude rule. Deciding costs one symbol lookup and one
+ * transition per namespace element; tags are only looked at when a rule
+ * with predicates matched the namespace.
+ */
+class MetricFilter final {
+ public:
+  /**
+   * Throws PluginException on malformed rules, or rules whose automaton
+   * grows beyond a few thousand states.
+   */
+  MetricFilter(const std::string& include, const std::string& exclude);
+
+  bool keep(const rpc::Metric& met) const;
+
+  /**
+   * apply removes the metrics not kept, preserving the order of the rest.
+   * The vector is compacted in place, without reallocating.
+   */
+  void apply(std::vector<Metric>& metrics) const;
+
+  /**
+   * states returns the number of automaton states.
+   */
+  size_t states() const { return nodes.size(); }
+
+ private:
+  // what a state says about a metric whose namespace ends there
+  enum Verdict : uint8_t {kKeep, kDrop, kCheckTags};
+
+  struct TagPredicate {
+    enum Op : uint8_t {kEquals, kNotEquals, kPresent, kAbsent};
+    std::string key;
+    std::string value;
+    Op op;
+  };
+
+  struct Rule {
+    bool exclude;
+    // the range of preds holding this rule's tag predicates
+    uint32_t pred_begin;
+    uint32_t pred_end;
+  };
+
+  struct Node {
+    // the range of edges leaving this state, sorted by symbol
+    uint32_t edge_begin;
+    uint32_t edge_end;
+    // the state for elements that aren't the symbol of an edge; -1 if none
+    int32_t other;
+    Verdict verdict;
+    // the range of accepts holding the rules matched by a namespace ending
+    // here, looked at for kCheckTags
+    uint32_t accept_begin;
+    uint32_t accept_end;
+  };
+
+  std::unordered_map<std::string, uint32_t> symbols;
+  std::vector<std::pair<uint32_t, int32_t>> edges;
+  std::vector<Node> nodes;
+  std::vector<uint32_t> accepts;
+  std::vector<Rule> rules;
+  std::vector<TagPredicate> preds;
+  bool has_include;
+
+  /**
+   * add_rules parses text into rules and their tag predicates, appending the
+   * namespace glob of each to patterns.
+   */
+  void add_rules(const std::string& text, bool exclude,
+                 std::vector<std::vector<uint32_t>>* patterns);
+
+  /**
+   * compile builds the automaton from the patterns by subset construction.
+   */
+  void compile(const std::vector<std::vector<uint32_t>>& patterns);
+
+  bool tags_match(const Rule& rule, const rpc::Metric& met) const;
+};
+
+/**
+ * FilterProcessor drops metrics by the task config values "include" and
+ * "exclude", each a MetricFilter rule set; both are empty by default.
+ */
+class FilterProcessor final : public PreparedProcessor<MetricFilter> {
+ public:
+  using PreparedProcessor<MetricFilter>::process_metrics;
+
+  const ConfigPolicy get_config_policy();
+
+  std::unique_ptr<MetricFilter> prepare(const Config& config);
+
+  void process_metrics(std::vector<Metric> &metrics,
+                       const MetricFilter& filter);
+};
+
+}  // namespace Plugin
@@ -0,0 +1,55 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/processor/prepared_processor.h"
+
+#include <memory>
+#include <mutex>
+
+using Plugin::Config;
+using Plugin::PreparedStateCache;
+
+PreparedStateCache::PreparedStateCache(size_t max_states) :
+                                       max_states(max_states) {}
+
+std::shared_ptr<const void> PreparedStateCache::get(
+    const Config& config, const PrepareFunc& prepare) {
+  uint64_t id = config.fingerprint();
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    auto it = states.find(id);
+    if (it != states.end()) {
+      return it->second;
+    }
+  }
+
+  std::shared_ptr<const void> state = prepare();
+
+  std::lock_guard<std::mutex> lk(mtx);
+  // another batch with the same config may have got here first
+  auto inserted = states.emplace(id, state);
+  if (!inserted.second) {
+    return inserted.first->second;
+  }
+  order.push_back(id);
+  while (order.size() > max_states) {
+    states.erase(order.front());
+    order.pop_front();
+  }
+  return state;
+}
+
+size_t PreparedStateCache::size() {
+  std::lock_guard<std::mutex> lk(mtx);
+  return states.size();
+}
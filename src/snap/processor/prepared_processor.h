@@ -0,0 +1,189 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+
+namespace Plugin {
+
+/**
+ * PreparedStateCache holds the state prepared for each config, keyed by
+ * config fingerprint. It backs PreparedProcessor and holds at most
+ * max_states states, dropping the oldest beyond that.
+ */
+class PreparedStateCache final {
+ public:
+  typedef std::function<std::shared_ptr<const void>()> PrepareFunc;
+
+  explicit PreparedStateCache(size_t max_states);
+
+  /**
+   * get returns the state cached for config, calling prepare to build it
+   * if there's none. prepare runs without the cache locked, so a slow one
+   * doesn't hold up batches of other configs; exceptions it throws are
+   * passed on and nothing is cached.
+   */
+  std::shared_ptr<const void> get(const Config& config,
+                                  const PrepareFunc& prepare);
+
+  size_t size();
+
+ private:
+  size_t max_states;
+  std::mutex mtx;
+  std::unordered_map<uint64_t, std::shared_ptr<const void>> states;
+  // fingerprints in the order they were cached
+  std::deque<uint64_t> order;
+};
+
+/**
+ * PreparedProcessor is a processor whose config is compiled once into a
+ * State, rather than parsed again on every batch.
+ *
+ * prepare is called the first time a config is seen; its result is cached
+ * by config fingerprint and handed to process_metrics for every batch with
+ * that config. Since the state is shared by concurrent batches, and dropped
+ * once more than max_states configs are seen, it's passed as const; state
+ * that changes from batch to batch belongs in a TaskStore.
+ *
+ * E.g.:
+ *   struct Tags {
+ *     std::vector<std::string> names;
+ *   };
+ *
+ *   class Graffiti final : public Plugin::PreparedProcessor<Tags> {
+ *    public:
+ *     std::unique_ptr<Tags> prepare(const Plugin::Config& config);
+ *     void process_metrics(std::vector<Plugin::Metric>& metrics,
+ *                          const Tags& tags);
+ *   };
+ */
+template<typename State>
+class PreparedProcessor : public ProcessorInterface {
+ public:
+  /**
+   * prepare compiles config into the state for its batches. It may throw
+   * PluginException for a config it can't use; the batch then fails and
+   * prepare is called again for the next one.
+   */
+  virtual std::unique_ptr<State> prepare(const Config& config) = 0;
+
+  virtual void process_metrics(std::vector<Metric> &metrics,
+                               const State& state) = 0;
+
+  void process_metrics(std::vector<Metric> &metrics,
+                       const Config& config) final {
+    std::shared_ptr<const void> state = cache.get(config, [&]() {
+      return std::shared_ptr<const void>(
+          std::shared_ptr<const State>(prepare(config)));
+    });
+    process_metrics(metrics, *static_cast<const State*>(state.get()));
+  }
+
+ protected:
+  /**
+   * max_states bounds the number of configs whose state is kept.
+   */
+  explicit PreparedProcessor(size_t max_states = 64) : cache(max_states) {}
+
+ private:
+  PreparedStateCache cache;
+};
+
+/**
+ * TaskStore keeps the state a processor carries from batch to batch, such
+ * as open windows or the last value of each series, for each task config.
+ * Unlike prepared state it is never dropped to make room for other configs:
+ * an entry lives until its config has seen no batch for idle, or until
+ * clear is called.
+ *
+ * Entries are keyed by config fingerprint, as plugins can't tell tasks apart
+ * otherwise. Under the default LRU strategy snapteld sends the batches of
+ * every task to the same plugin instance, so tasks with the same config
+ * share an entry; processors using a TaskStore should set Meta::strategy to
+ * Sticky, which gives each task an instance of its own.
+ */
+template<typename S>
+class TaskStore final {
+ public:
+  explicit TaskStore(std::chrono::milliseconds idle) : idle(idle) {}
+
+  TaskStore(const TaskStore&) = delete;
+  TaskStore& operator=(const TaskStore&) = delete;
+
+  /**
+   * with calls fn with the state kept under key, holding that state's lock,
+   * after building it with make if there's none. Batches with other keys
+   * are not held up. Entries idle for longer than idle are dropped on the
+   * way.
+   */
+  template<typename Make, typename Fn>
+  void with(uint64_t key, const Make& make, const Fn& fn) {
+    std::shared_ptr<Entry> entry;
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      std::chrono::steady_clock::time_point now =
+          std::chrono::steady_clock::now();
+      for (auto it = entries.begin(); it != entries.end();) {
+        if (now - it->second->used > idle) {
+          it = entries.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      std::shared_ptr<Entry>& e = entries[key];
+      if (!e) e = std::make_shared<Entry>();
+      e->used = now;
+      entry = e;
+    }
+    std::lock_guard<std::mutex> lk(entry->mtx);
+    if (!entry->state) entry->state = make();
+    fn(*entry->state);
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lk(mtx);
+    return entries.size();
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lk(mtx);
+    entries.clear();
+  }
+
+ private:
+  struct Entry {
+    std::mutex mtx;
+    std::unique_ptr<S> state;
+    // guarded by TaskStore::mtx
+    std::chrono::steady_clock::time_point used;
+  };
+
+  std::chrono::milliseconds idle;
+  std::mutex mtx;
+  std::unordered_map<uint64_t, std::shared_ptr<Entry>> entries;
+};
+
+}  // namespace Plugin
@@ -0,0 +1,319 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/processor/rate.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "snap/plugin.h"
+#include "snap/processor/series.h"
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using std::chrono::seconds;
+using std::chrono::system_clock;
+
+using Plugin::Config;
+using Plugin::ConfigPolicy;
+using Plugin::CounterRate;
+using Plugin::CounterTable;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::RateProcessor;
+using Plugin::RateTask;
+
+static const int64_t kNanosPerSec = 1000000000;
+static const size_t kInitialSlots = 1024;
+
+/**
+ * The splitmix64 finalizer, to spread series ids over the low bits used
+ * as the slot index.
+ */
+static size_t slot_of(uint64_t key) {
+  key ^= key >> 31;
+  key *= 0x7fb5d329728ea185ULL;
+  key ^= key >> 27;
+  return size_t(key);
+}
+
+CounterTable::CounterTable(size_t max_series) :
+                           max_series(max_series), count(0) {
+  slots.assign(kInitialSlots, Entry{0, 0, 0});
+  mask = slots.size() - 1;
+}
+
+CounterTable::Entry* CounterTable::find(uint64_t key) {
+  // 0 marks an empty slot
+  if (key == 0) key = 1;
+  for (size_t i = slot_of(key) & mask;; i = (i + 1) & mask) {
+    if (slots[i].key == key) return &slots[i];
+    if (slots[i].key == 0) return nullptr;
+  }
+}
+
+CounterTable::Entry* CounterTable::insert(uint64_t key, bool* added) {
+  if (key == 0) key = 1;
+  *added = false;
+  for (size_t i = slot_of(key) & mask;; i = (i + 1) & mask) {
+    if (slots[i].key == key) return &slots[i];
+    if (slots[i].key != 0) continue;
+
+    if (count >= max_series) {
+      return nullptr;
+    }
+    if ((count + 1) * 4 > slots.size() * 3) {
+      grow();
+      return insert(key, added);
+    }
+    slots[i] = Entry{key, 0, 0};
+    count++;
+    *added = true;
+    return &slots[i];
+  }
+}
+
+void CounterTable::grow() {
+  std::vector<Entry> old(slots.size() * 2, Entry{0, 0, 0});
+  old.swap(slots);
+  mask = slots.size() - 1;
+  for (const Entry& e : old) {
+    if (e.key == 0) continue;
+    size_t i = slot_of(e.key) & mask;
+    while (slots[i].key != 0) i = (i + 1) & mask;
+    slots[i] = e;
+  }
+}
+
+/**
+ * erase_slot empties slot i and moves back the entries after it that
+ * would no longer be reachable across the gap.
+ */
+void CounterTable::erase_slot(size_t i) {
+  size_t j = i;
+  for (;;) {
+    j = (j + 1) & mask;
+    if (slots[j].key == 0) break;
+    size_t home = slot_of(slots[j].key) & mask;
+    // move j into the gap at i unless its home lies cyclically in (i, j]
+    bool stays = i <= j ? (home > i && home <= j) : (home > i || home <= j);
+    if (!stays) {
+      slots[i] = slots[j];
+      i = j;
+    }
+  }
+  slots[i] = Entry{0, 0, 0};
+  count--;
+}
+
+size_t CounterTable::evict(int64_t older_than) {
+  size_t removed = 0;
+  for (size_t i = 0; i < slots.size();) {
+    if (slots[i].key != 0 && slots[i].ts < older_than) {
+      // an entry shifted back into i is looked at again
+      erase_slot(i);
+      removed++;
+    } else {
+      i++;
+    }
+  }
+  return removed;
+}
+
+CounterRate::Options::Options() : max_series(1 << 22),
+                                  stale_after(seconds(600)) {}
+
+CounterRate::CounterRate(const Options& opts) :
+                         opts(opts),
+                         stale_ns(duration_cast<nanoseconds>(
+                             opts.stale_after).count()),
+                         last_evict(std::numeric_limits<int64_t>::min()),
+                         series(opts.max_series) {}
+
+bool CounterRate::update(const rpc::Metric& met, double* rate) {
+  uint64_t value;
+  switch (met.data_case()) {
+    case rpc::Metric::kFloat64Data: {
+      double d = met.float64_data();
+      std::memcpy(&value, &d, sizeof(value));
+      break;
+    }
+    case rpc::Metric::kFloat32Data: {
+      double d = met.float32_data();
+      std::memcpy(&value, &d, sizeof(value));
+      break;
+    }
+    case rpc::Metric::kInt32Data:
+      value = uint64_t(int64_t(met.int32_data()));
+      break;
+    case rpc::Metric::kInt64Data:
+      value = uint64_t(met.int64_data());
+      break;
+    case rpc::Metric::kUint32Data:
+      value = met.uint32_data();
+      break;
+    case rpc::Metric::kUint64Data:
+      value = met.uint64_data();
+      break;
+    default:
+      return false;
+  }
+
+  int64_t ts = met.timestamp().sec() * kNanosPerSec + met.timestamp().nsec();
+  // a series whose data type changes starts over
+  uint64_t key = series_id(met) + uint64_t(met.data_case()) *
+                                  0x9e3779b97f4a7c15ULL;
+  bool added;
+  CounterTable::Entry* e = series.insert(key, &added);
+  if (e == nullptr) {
+    return false;
+  }
+  if (added) {
+    e->ts = ts;
+    e->value = value;
+    return false;
+  }
+  if (ts <= e->ts) {
+    return false;
+  }
+
+  double delta;
+  switch (met.data_case()) {
+    case rpc::Metric::kFloat64Data:
+    case rpc::Metric::kFloat32Data: {
+      double cur, prev;
+      std::memcpy(&cur, &value, sizeof(cur));
+      std::memcpy(&prev, &e->value, sizeof(prev));
+      delta = cur >= prev ? cur - prev : cur;
+      break;
+    }
+    case rpc::Metric::kInt32Data:
+    case rpc::Metric::kInt64Data: {
+      int64_t cur = int64_t(value);
+      int64_t prev = int64_t(e->value);
+      delta = cur >= prev ? double(uint64_t(cur) - uint64_t(prev)) :
+                            double(cur);
+      break;
+    }
+    case rpc::Metric::kUint32Data:
+      if (value >= e->value) {
+        delta = double(value - e->value);
+      } else if (e->value >= (uint64_t(1) << 31)) {
+        delta = double((value - e->value) & 0xffffffffULL);
+      } else {
+        delta = double(value);
+      }
+      break;
+    default:  // kUint64Data
+      if (value >= e->value) {
+        delta = double(value - e->value);
+      } else if (e->value >= (uint64_t(1) << 63)) {
+        delta = double(value - e->value);
+      } else {
+        delta = double(value);
+      }
+      break;
+  }
+  *rate = delta * kNanosPerSec / double(ts - e->ts);
+  e->ts = ts;
+  e->value = value;
+  return true;
+}
+
+size_t CounterRate::evict(system_clock::time_point now) {
+  int64_t now_ns = duration_cast<nanoseconds>(now.time_since_epoch()).count();
+  if (last_evict != std::numeric_limits<int64_t>::min() &&
+      now_ns - last_evict < stale_ns) {
+    return 0;
+  }
+  last_evict = now_ns;
+  return series.evict(now_ns - stale_ns);
+}
+
+RateProcessor::RateProcessor(milliseconds idle) : counters(idle) {}
+
+const ConfigPolicy RateProcessor::get_config_policy() {
+  ConfigPolicy policy(Plugin::StringRule{"match", {"", false}});
+  policy.add_rule({""}, Plugin::IntRule{"stale_after", {600, false}});
+  policy.add_rule({""}, Plugin::IntRule{"max_series", {1 << 22, false}});
+  return policy;
+}
+
+std::unique_ptr<RateTask> RateProcessor::prepare(const Config& config) {
+  const rpc::ConfigMap& map = config.get_rpc_config_map();
+  std::unique_ptr<RateTask> task(new RateTask());
+  CounterRate::Options& opts = task->opts;
+  if (map.stringmap().count("match")) {
+    task->match = split_ns(config.get_string("match"));
+  }
+  if (map.intmap().count("stale_after")) {
+    opts.stale_after = seconds(config.get_int("stale_after"));
+  }
+  if (map.intmap().count("max_series")) {
+    int max_series = config.get_int("max_series");
+    if (max_series <= 0) {
+      throw PluginException("max_series must be positive");
+    }
+    opts.max_series = size_t(max_series);
+  }
+  task->fingerprint = config.fingerprint();
+  return task;
+}
+
+void RateProcessor::process_metrics(std::vector<Metric> &metrics,
+                                    const RateTask& task) {
+  std::vector<Metric> out;
+  out.reserve(metrics.size());
+  system_clock::time_point newest;
+  rpc::Metric scratch;
+
+  counters.with(task.fingerprint, [&]() {
+    return std::unique_ptr<CounterRate>(new CounterRate(task.opts));
+  }, [&](CounterRate& counter) {
+    for (Metric& met : metrics) {
+      const rpc::Metric* rpc_met = met.get_rpc_metric_ptr();
+      if (!has_ns_prefix(*rpc_met, task.match)) {
+        out.emplace_back(met);
+        continue;
+      }
+      rpc::Metric::DataCase data = rpc_met->data_case();
+      if (data == rpc::Metric::kStringData ||
+          data == rpc::Metric::kBytesData ||
+          data == rpc::Metric::kBoolData ||
+          data == rpc::Metric::DATA_NOT_SET) {
+        out.emplace_back(met);
+        continue;
+      }
+      newest = std::max(newest, met.timestamp());
+      double rate;
+      if (!counter.update(*rpc_met, &rate)) {
+        continue;
+      }
+
+      scratch = *rpc_met;
+      scratch.add_namespace_()->set_value("rate");
+      scratch.set_unit(rpc_met->unit() + "/s");
+      scratch.set_float64_data(rate);
+      // deep-copies scratch
+      out.emplace_back(Metric(&scratch));
+    }
+    if (newest != system_clock::time_point()) {
+      counter.evict(newest);
+    }
+  });
+  metrics.swap(out);
+}
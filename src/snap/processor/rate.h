@@ -0,0 +1,166 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/processor/prepared_processor.h"
+#include "snap/rpc/plugin.pb.h"
+
+namespace Plugin {
+
+/**
+ * CounterTable maps series ids to the last sample of each series, in one
+ * open-addressing (linear probing) array of 24-byte entries.
+ *
+ * The array doubles as it fills, up to the power of two that holds
+ * max_series at a load factor of 3/4, so memory is bounded by max_series
+ * up front; once max_series series are held, new ones are refused.
+ * Removal shifts later entries back instead of leaving tombstones, so
+ * lookups stay short however many series come and go.
+ */
+class CounterTable final {
+ public:
+  struct Entry {
+    uint64_t key;
+    int64_t ts;
+    uint64_t value;
+  };
+
+  explicit CounterTable(size_t max_series);
+
+  /**
+   * find returns the entry for key, or nullptr if there's none.
+   */
+  Entry* find(uint64_t key);
+
+  /**
+   * insert returns the entry for key, adding one with ts and value zeroed if
+   * there's none; it returns nullptr if the table is full.
+   */
+  Entry* insert(uint64_t key, bool* added);
+
+  /**
+   * evict removes the entries with ts before older_than, returning how many
+   * were removed.
+   */
+  size_t evict(int64_t older_than);
+
+  size_t size() const { return count; }
+
+  /**
+   * memory returns the bytes allocated for entries.
+   */
+  size_t memory() const { return slots.size() * sizeof(Entry); }
+
+ private:
+  size_t max_series;
+  std::vector<Entry> slots;
+  size_t mask;
+  size_t count;
+
+  void grow();
+  void erase_slot(size_t i);
+};
+
+/**
+ * CounterRate turns samples of monotonic counters into per-second rates.
+ *
+ * A decrease of an unsigned 32 or 64-bit counter whose previous value was
+ * in the top half of its range is taken as a wraparound; any other
+ * decrease is taken as a counter reset, and the rate counts from zero.
+ */
+class CounterRate final {
+ public:
+  struct Options {
+    Options();
+
+    size_t max_series;
+    /** series not seen for this long are dropped by evict */
+    std::chrono::seconds stale_after;
+  };
+
+  explicit CounterRate(const Options& opts);
+
+  /**
+   * update records met as the latest sample of its series and sets rate to
+   * the per-second rate since the previous one. It returns false, with no
+   * rate, for the first sample of a series, for a sample not newer than the
+   * previous one, for non-numeric data, and when the table is full.
+   */
+  bool update(const rpc::Metric& met, double* rate);
+
+  /**
+   * evict drops the series whose last sample is older than stale_after
+   * before now; it only scans the table once every stale_after.
+   */
+  size_t evict(std::chrono::system_clock::time_point now);
+
+  const CounterTable& table() const { return series; }
+
+ private:
+  Options opts;
+  int64_t stale_ns;
+  int64_t last_evict;
+  CounterTable series;
+};
+
+/**
+ * The prepared state of a RateProcessor task.
+ */
+struct RateTask {
+  std::vector<std::string> match;
+  CounterRate::Options opts;
+  // the config fingerprint, which keys the task's counters
+  uint64_t fingerprint;
+};
+
+/**
+ * RateProcessor replaces counters with their per-second rates, using the
+ * task config values
+ *   match:       the namespace prefix of the counters, e.g. "/intel/net";
+ *                all numeric metrics if empty (the default)
+ *   stale_after: seconds after which a series that stopped reporting is
+ *                forgotten, 600 by default
+ *   max_series:  the most series tracked, 4194304 by default
+ * A rate is emitted as float64 under the counter's namespace plus "rate",
+ * with "/s" appended to the unit. The first sample of a series yields no
+ * rate and is dropped, as are new series once max_series are tracked;
+ * non-numeric and non-matching metrics pass through. Counters are kept per
+ * config in a TaskStore (see there).
+ */
+class RateProcessor final : public PreparedProcessor<RateTask> {
+ public:
+  using PreparedProcessor<RateTask>::process_metrics;
+
+  explicit RateProcessor(
+      std::chrono::milliseconds idle = std::chrono::hours(1));
+
+  const ConfigPolicy get_config_policy();
+
+  std::unique_ptr<RateTask> prepare(const Config& config);
+
+  void process_metrics(std::vector<Metric> &metrics, const RateTask& task);
+
+ private:
+  TaskStore<CounterRate> counters;
+};
+
+}  // namespace Plugin
@@ -0,0 +1,167 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/processor/rewrite.h"
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "snap/plugin.h"
+
+using google::protobuf::Map;
+
+using Plugin::Config;
+using Plugin::ConfigPolicy;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::RewriteProcessor;
+using Plugin::TagRewriter;
+
+static std::string trim(const std::string& str) {
+  size_t begin = str.find_first_not_of(" \t\r");
+  if (begin == std::string::npos) return "";
+  size_t end = str.find_last_not_of(" \t\r");
+  return str.substr(begin, end - begin + 1);
+}
+
+TagRewriter::TagRewriter(const std::string& rules) {
+  std::stringstream ss(rules);
+  std::string line;
+  while (std::getline(ss, line, '\n')) {
+    std::stringstream ls(line);
+    std::string part;
+    while (std::getline(ls, part, ';')) {
+      std::string rule = trim(part);
+      if (rule.empty()) continue;
+
+      size_t space = rule.find_first_of(" \t");
+      std::string verb = rule.substr(0, space);
+      std::string body = space == std::string::npos ? "" :
+                                                      trim(rule.substr(space));
+      Op op;
+      op.index = 0;
+      size_t eq = body.find('=');
+      if (verb == "drop") {
+        op.code = Op::kDrop;
+        op.key = body;
+      } else if (eq == std::string::npos) {
+        throw PluginException("rewrite rule \"" + rule + "\": expected '='");
+      } else {
+        op.key = trim(body.substr(0, eq));
+        op.arg = trim(body.substr(eq + 1));
+        if (verb == "set") {
+          op.code = Op::kSet;
+        } else if (verb == "default") {
+          op.code = Op::kDefault;
+        } else if (verb == "rename") {
+          op.code = Op::kRename;
+          if (op.arg.empty()) {
+            throw PluginException("rewrite rule \"" + rule +
+                                  "\": empty key");
+          }
+        } else if (verb == "copy") {
+          const std::string& arg = op.arg;
+          if (arg.size() > 2 && arg[0] == '[' && arg.back() == ']') {
+            op.code = Op::kCopyName;
+            op.arg = arg.substr(1, arg.size() - 2);
+          } else if (arg.size() > 4 && arg.compare(0, 3, "ns[") == 0 &&
+                     arg.back() == ']') {
+            char* end;
+            op.code = Op::kCopyIndex;
+            op.index = int(std::strtol(arg.c_str() + 3, &end, 10));
+            if (end != arg.c_str() + arg.size() - 1) {
+              throw PluginException("rewrite rule \"" + rule +
+                                    "\": bad namespace index");
+            }
+          } else {
+            throw PluginException("rewrite rule \"" + rule +
+                                  "\": expected ns[i] or [name]");
+          }
+        } else {
+          throw PluginException("rewrite rule \"" + rule +
+                                "\": unknown verb " + verb);
+        }
+      }
+      if (op.key.empty()) {
+        throw PluginException("rewrite rule \"" + rule + "\": empty key");
+      }
+      ops.push_back(op);
+    }
+  }
+}
+
+void TagRewriter::apply(Metric& met) const {
+  if (ops.empty()) return;
+  const rpc::Metric& rpc_met = *met.get_rpc_metric_ptr();
+  Map<std::string, std::string>* tags = met.mutable_tags();
+  for (const Op& op : ops) {
+    switch (op.code) {
+      case Op::kSet:
+        (*tags)[op.key] = op.arg;
+        break;
+      case Op::kDefault:
+        if (!tags->count(op.key)) (*tags)[op.key] = op.arg;
+        break;
+      case Op::kRename: {
+        auto it = tags->find(op.key);
+        if (it == tags->end()) break;
+        std::string value;
+        value.swap(it->second);
+        tags->erase(it);
+        (*tags)[op.arg].swap(value);
+        break;
+      }
+      case Op::kDrop:
+        tags->erase(op.key);
+        break;
+      case Op::kCopyIndex: {
+        int n = rpc_met.namespace__size();
+        int i = op.index < 0 ? n + op.index : op.index;
+        if (i >= 0 && i < n) (*tags)[op.key] = rpc_met.namespace_(i).value();
+        break;
+      }
+      case Op::kCopyName:
+        for (const rpc::NamespaceElement& nse : rpc_met.namespace_()) {
+          if (nse.name() == op.arg) {
+            (*tags)[op.key] = nse.value();
+            break;
+          }
+        }
+        break;
+    }
+  }
+}
+
+void TagRewriter::apply(std::vector<Metric>& metrics) const {
+  for (Metric& met : metrics) apply(met);
+}
+
+const ConfigPolicy RewriteProcessor::get_config_policy() {
+  return ConfigPolicy(Plugin::StringRule{"rules", {"", false}});
+}
+
+std::unique_ptr<TagRewriter> RewriteProcessor::prepare(const Config& config) {
+  std::string rules;
+  if (config.get_rpc_config_map().stringmap().count("rules")) {
+    rules = config.get_string("rules");
+  }
+  return std::unique_ptr<TagRewriter>(new TagRewriter(rules));
+}
+
+void RewriteProcessor::process_metrics(std::vector<Metric> &metrics,
+                                       const TagRewriter& rewriter) {
+  rewriter.apply(metrics);
+}
@@ -0,0 +1,83 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/processor/prepared_processor.h"
+#include "snap/rpc/plugin.pb.h"
+
+namespace Plugin {
+
+/**
+ * TagRewriter edits metric tags by a list of rules, compiled once into
+ * instructions that work on the rpc::Metric tag map in place.
+ *
+ * Rules are separated by ';' or newlines and run in order:
+ *   set key=value        sets the tag
+ *   default key=value    sets the tag if the metric doesn't have it
+ *   rename from=to       moves the tag's value to another key
+ *   drop key             removes the tag
+ *   copy key=ns[i]       sets the tag to namespace element i, counted from
+ *                        the end if negative
+ *   copy key=[name]      sets the tag to the dynamic namespace element named
+ *                        name, e.g. copy vm=[vm_id]
+ * A copy whose element doesn't exist leaves the tags as they are.
+ */
+class TagRewriter final {
+ public:
+  /**
+   * Throws PluginException on malformed rules.
+   */
+  explicit TagRewriter(const std::string& rules);
+
+  void apply(Metric& met) const;
+  void apply(std::vector<Metric>& metrics) const;
+
+  size_t size() const { return ops.size(); }
+
+ private:
+  struct Op {
+    enum Code {kSet, kDefault, kRename, kDrop, kCopyIndex, kCopyName};
+    Code code;
+    std::string key;
+    // the value to set, the key to rename to, or the element name
+    std::string arg;
+    int index;
+  };
+
+  std::vector<Op> ops;
+};
+
+/**
+ * RewriteProcessor applies the TagRewriter rules in the task config value
+ * "rules" to every metric.
+ */
+class RewriteProcessor final : public PreparedProcessor<TagRewriter> {
+ public:
+  using PreparedProcessor<TagRewriter>::process_metrics;
+
+  const ConfigPolicy get_config_policy();
+
+  std::unique_ptr<TagRewriter> prepare(const Config& config);
+
+  void process_metrics(std::vector<Metric> &metrics,
+                       const TagRewriter& rewriter);
+};
+
+}  // namespace Plugin
@@ -0,0 +1,314 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/processor/rollup.h"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "snap/plugin.h"
+#include "snap/processor/series.h"
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using std::chrono::system_clock;
+
+using Plugin::ColumnStats;
+using Plugin::Config;
+using Plugin::ConfigPolicy;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::Rollup;
+using Plugin::RollupProcessor;
+using Plugin::RollupTask;
+
+static const int64_t kNanosPerSec = 1000000000;
+
+ColumnStats<double> Plugin::aggregate(const double* values, size_t n) {
+  const double inf = std::numeric_limits<double>::infinity();
+  double mn[4] = {inf, inf, inf, inf};
+  double mx[4] = {-inf, -inf, -inf, -inf};
+  double sum[4] = {0, 0, 0, 0};
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    for (int l = 0; l < 4; l++) {
+      double v = values[i + l];
+      mn[l] = v < mn[l] ? v : mn[l];
+      mx[l] = v > mx[l] ? v : mx[l];
+      sum[l] += v;
+    }
+  }
+  for (; i < n; i++) {
+    double v = values[i];
+    mn[0] = v < mn[0] ? v : mn[0];
+    mx[0] = v > mx[0] ? v : mx[0];
+    sum[0] += v;
+  }
+  ColumnStats<double> stats;
+  stats.min = std::min(std::min(mn[0], mn[1]), std::min(mn[2], mn[3]));
+  stats.max = std::max(std::max(mx[0], mx[1]), std::max(mx[2], mx[3]));
+  stats.sum = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+  return stats;
+}
+
+ColumnStats<int64_t> Plugin::aggregate(const int64_t* values, size_t n) {
+  int64_t mn[4] = {values[0], values[0], values[0], values[0]};
+  int64_t mx[4] = {values[0], values[0], values[0], values[0]};
+  uint64_t sum[4] = {0, 0, 0, 0};
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    for (int l = 0; l < 4; l++) {
+      int64_t v = values[i + l];
+      mn[l] = v < mn[l] ? v : mn[l];
+      mx[l] = v > mx[l] ? v : mx[l];
+      sum[l] += uint64_t(v);
+    }
+  }
+  for (; i < n; i++) {
+    int64_t v = values[i];
+    mn[0] = v < mn[0] ? v : mn[0];
+    mx[0] = v > mx[0] ? v : mx[0];
+    sum[0] += uint64_t(v);
+  }
+  ColumnStats<int64_t> stats;
+  stats.min = std::min(std::min(mn[0], mn[1]), std::min(mn[2], mn[3]));
+  stats.max = std::max(std::max(mx[0], mx[1]), std::max(mx[2], mx[3]));
+  stats.sum = int64_t(sum[0] + sum[1] + sum[2] + sum[3]);
+  return stats;
+}
+
+Rollup::Options::Options() : window(milliseconds(60000)),
+                             aggregates(Min | Max | Avg | Count) {}
+
+/**
+ * window_ns converts a window to nanoseconds, and rejects those that aren't
+ * positive.
+ */
+static int64_t window_ns(milliseconds window) {
+  int64_t ns = duration_cast<nanoseconds>(window).count();
+  if (ns <= 0) {
+    throw PluginException("rollup window must be positive");
+  }
+  return ns;
+}
+
+Rollup::Rollup(const Options& opts) :
+               opts(opts),
+               windows(window_ns(opts.window), Columns()) {}
+
+Rollup::~Rollup() {}
+
+int Rollup::parse_aggregates(const std::string& names) {
+  static const struct {
+    const char* name;
+    Aggregate agg;
+  } kNames[] = {
+    {"min", Min}, {"max", Max}, {"sum", Sum}, {"count", Count}, {"avg", Avg},
+  };
+  int mask = 0;
+  std::stringstream ss(names);
+  std::string name;
+  while (std::getline(ss, name, ',')) {
+    if (name.empty()) continue;
+    bool found = false;
+    for (const auto& n : kNames) {
+      if (name == n.name) {
+        mask |= n.agg;
+        found = true;
+      }
+    }
+    if (!found) {
+      throw PluginException("unknown rollup aggregate: " + name);
+    }
+  }
+  return mask;
+}
+
+bool Rollup::add(const rpc::Metric& met, std::vector<Metric>* out) {
+  bool is_int;
+  double f = 0;
+  int64_t i = 0;
+  switch (met.data_case()) {
+    case rpc::Metric::kFloat64Data:
+      is_int = false;
+      f = met.float64_data();
+      break;
+    case rpc::Metric::kFloat32Data:
+      is_int = false;
+      f = met.float32_data();
+      break;
+    case rpc::Metric::kUint64Data:
+      is_int = false;
+      f = double(met.uint64_data());
+      break;
+    case rpc::Metric::kInt64Data:
+      is_int = true;
+      i = met.int64_data();
+      break;
+    case rpc::Metric::kInt32Data:
+      is_int = true;
+      i = met.int32_data();
+      break;
+    case rpc::Metric::kUint32Data:
+      is_int = true;
+      i = met.uint32_data();
+      break;
+    default:
+      return false;
+  }
+
+  // a series switching between float and integer data starts over
+  Columns* c = windows.add(
+      series_id(met) ^ uint64_t(is_int), met,
+      [&](const Windows<Columns>::Window& w) { close(w, out); });
+  if (c == nullptr) {
+    return true;
+  }
+  c->is_int = is_int;
+  if (is_int) {
+    c->ints.push_back(i);
+  } else {
+    c->floats.push_back(f);
+  }
+  return true;
+}
+
+void Rollup::flush(system_clock::time_point tp, std::vector<Metric>* out) {
+  windows.close_until(
+      duration_cast<nanoseconds>(tp.time_since_epoch()).count(),
+      [&](const Windows<Columns>::Window& w) { close(w, out); });
+}
+
+void Rollup::close(const Windows<Columns>::Window& w,
+                   std::vector<Metric>* out) {
+  size_t n = w.acc.count();
+  if (n == 0) {
+    return;
+  }
+  scratch.CopyFrom(w.tmpl);
+  scratch.mutable_timestamp()->set_sec(w.start / kNanosPerSec);
+  scratch.mutable_timestamp()->set_nsec(w.start % kNanosPerSec);
+  // named by emit
+  scratch.add_namespace_();
+
+  if (w.acc.is_int) {
+    ColumnStats<int64_t> stats = aggregate(w.acc.ints.data(), n);
+    if (opts.aggregates & Min) {
+      scratch.set_int64_data(stats.min);
+      emit("min", out);
+    }
+    if (opts.aggregates & Max) {
+      scratch.set_int64_data(stats.max);
+      emit("max", out);
+    }
+    if (opts.aggregates & Sum) {
+      scratch.set_int64_data(stats.sum);
+      emit("sum", out);
+    }
+    if (opts.aggregates & Avg) {
+      scratch.set_float64_data(double(stats.sum) / n);
+      emit("avg", out);
+    }
+  } else {
+    ColumnStats<double> stats = aggregate(w.acc.floats.data(), n);
+    if (opts.aggregates & Min) {
+      scratch.set_float64_data(stats.min);
+      emit("min", out);
+    }
+    if (opts.aggregates & Max) {
+      scratch.set_float64_data(stats.max);
+      emit("max", out);
+    }
+    if (opts.aggregates & Sum) {
+      scratch.set_float64_data(stats.sum);
+      emit("sum", out);
+    }
+    if (opts.aggregates & Avg) {
+      scratch.set_float64_data(stats.sum / n);
+      emit("avg", out);
+    }
+  }
+  if (opts.aggregates & Count) {
+    scratch.set_uint64_data(n);
+    emit("count", out);
+  }
+}
+
+/**
+ * emit appends scratch, its last namespace element named name, to out.
+ */
+void Rollup::emit(const char* name, std::vector<Metric>* out) {
+  int last = scratch.namespace__size() - 1;
+  scratch.mutable_namespace_(last)->set_value(name);
+  // the Metric copy constructor copies scratch into a Metric of its own
+  out->emplace_back(Metric(&scratch));
+}
+
+RollupProcessor::RollupProcessor(milliseconds idle) : windows(idle) {}
+
+const ConfigPolicy RollupProcessor::get_config_policy() {
+  ConfigPolicy policy(Plugin::IntRule{"window", {60, false}});
+  policy.add_rule({""}, Plugin::StringRule{"aggregates",
+                                           {"min,max,avg,count", false}});
+  return policy;
+}
+
+std::unique_ptr<RollupTask> RollupProcessor::prepare(const Config& config) {
+  const rpc::ConfigMap& map = config.get_rpc_config_map();
+  Rollup::Options opts;
+  if (map.intmap().count("window")) {
+    opts.window = milliseconds(int64_t(config.get_int("window")) * 1000);
+  }
+  if (map.stringmap().count("aggregates")) {
+    opts.aggregates = Rollup::parse_aggregates(
+        config.get_string("aggregates"));
+  }
+  // validates the options
+  Rollup check(opts);
+  std::unique_ptr<RollupTask> task(new RollupTask());
+  task->opts = opts;
+  task->fingerprint = config.fingerprint();
+  return task;
+}
+
+void RollupProcessor::process_metrics(std::vector<Metric> &metrics,
+                                      const RollupTask& task) {
+  std::vector<Metric> out;
+  out.reserve(metrics.size());
+  system_clock::time_point newest;
+
+  windows.with(task.fingerprint, [&]() {
+    return std::unique_ptr<Rollup>(new Rollup(task.opts));
+  }, [&](Rollup& rollup) {
+    for (Metric& met : metrics) {
+      const rpc::Metric* rpc_met = met.get_rpc_metric_ptr();
+      if (!rollup.add(*rpc_met, &out)) {
+        out.emplace_back(met);
+        continue;
+      }
+      system_clock::time_point ts = met.timestamp();
+      if (ts > newest) newest = ts;
+    }
+    if (newest != system_clock::time_point()) {
+      // active series close their windows in add; this only catches series
+      // that went quiet, so it can afford to leave a window of slack for
+      // points arriving out of order across batches
+      rollup.flush(newest - task.opts.window, &out);
+    }
+  });
+  metrics.swap(out);
+}
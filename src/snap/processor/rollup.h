@@ -0,0 +1,189 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/processor/prepared_processor.h"
+#include "snap/processor/windows.h"
+#include "snap/rpc/plugin.pb.h"
+
+namespace Plugin {
+
+/**
+ * The minimum, maximum and sum of a column of values.
+ */
+template<typename T>
+struct ColumnStats {
+  T min;
+  T max;
+  T sum;
+};
+
+/**
+ * aggregate computes the stats of n > 0 values. The loops keep four
+ * independent accumulators so the compiler can vectorize them; as a result
+ * float sums are added in a different order than a plain loop would.
+ * NaNs are skipped by min and max but propagate to the sum. Integer sums
+ * wrap on overflow.
+ */
+ColumnStats<double> aggregate(const double* values, size_t n);
+ColumnStats<int64_t> aggregate(const int64_t* values, size_t n);
+
+/**
+ * Rollup downsamples numeric series into fixed windows.
+ *
+ * Windows are aligned to multiples of window since the epoch. Points are
+ * appended to a per-series column (float64 for floats and uint64, int64 for
+ * the other integers) and aggregated when the window closes, which happens
+ * when a point of the series arrives for a later window, or when flush is
+ * called with a time at or past the end of the window. Each aggregate is
+ * emitted as a metric whose namespace is the series' namespace plus an
+ * element naming the aggregate ("min", "max", "sum", "count", "avg"),
+ * timestamped with the window start.
+ *
+ * Points that arrive for a window that was already emitted are dropped and
+ * counted as late.
+ */
+class Rollup final {
+ public:
+  enum Aggregate {
+    Min = 1,
+    Max = 2,
+    Sum = 4,
+    Count = 8,
+    Avg = 16,
+  };
+
+  struct Options {
+    Options();
+
+    std::chrono::milliseconds window;
+    /** Aggregate values or'ed together */
+    int aggregates;
+  };
+
+  explicit Rollup(const Options& opts);
+  ~Rollup();
+
+  Rollup(const Rollup&) = delete;
+  Rollup& operator=(const Rollup&) = delete;
+
+  /**
+   * parse_aggregates turns a comma separated list of aggregate names into
+   * an Aggregate mask, and throws PluginException for unknown names.
+   */
+  static int parse_aggregates(const std::string& names);
+
+  /**
+   * add folds met into its series. It returns false, ignoring met, if met
+   * doesn't hold numeric data. Rollups of a window it closes are appended
+   * to out.
+   */
+  bool add(const rpc::Metric& met, std::vector<Metric>* out);
+
+  /**
+   * flush closes every window that ends at or before tp, appending the
+   * rollups to out, and forgets the series that had them.
+   */
+  void flush(std::chrono::system_clock::time_point tp,
+             std::vector<Metric>* out);
+
+  const Options& options() const { return opts; }
+
+  /**
+   * series returns the number of series with an open window.
+   */
+  size_t series() const { return windows.size(); }
+
+  /**
+   * late returns the number of points dropped for arriving late.
+   */
+  uint64_t late() const { return windows.late(); }
+
+ private:
+  /**
+   * The points of a window, as float64 or int64 depending on the series.
+   */
+  struct Columns {
+    bool is_int;
+    std::vector<double> floats;
+    std::vector<int64_t> ints;
+
+    size_t count() const { return is_int ? ints.size() : floats.size(); }
+    void clear() {
+      floats.clear();
+      ints.clear();
+    }
+  };
+
+  Options opts;
+  Windows<Columns> windows;
+  // reused to build each emitted metric
+  rpc::Metric scratch;
+
+  void close(const Windows<Columns>::Window& w, std::vector<Metric>* out);
+  void emit(const char* name, std::vector<Metric>* out);
+};
+
+/**
+ * The prepared state of a RollupProcessor task.
+ */
+struct RollupTask {
+  Rollup::Options opts;
+  // the config fingerprint, which keys the task's windows
+  uint64_t fingerprint;
+};
+
+/**
+ * RollupProcessor replaces numeric metrics with their rollups, using the
+ * task config values
+ *   window:     the window length in seconds, 60 by default
+ *   aggregates: which aggregates to emit, "min,max,avg,count" by default
+ * Other metrics pass through unchanged.
+ *
+ * Windows are closed as points of later windows arrive; after each batch,
+ * windows that ended a full window before the batch's newest timestamp are
+ * closed as well, which emits the last window of series that stopped
+ * reporting. Open windows are kept per config in a TaskStore (see there).
+ */
+class RollupProcessor final : public PreparedProcessor<RollupTask> {
+ public:
+  using PreparedProcessor<RollupTask>::process_metrics;
+
+  explicit RollupProcessor(
+      std::chrono::milliseconds idle = std::chrono::hours(1));
+
+  const ConfigPolicy get_config_policy();
+
+  std::unique_ptr<RollupTask> prepare(const Config& config);
+
+  void process_metrics(std::vector<Metric> &metrics, const RollupTask& task);
+
+  /**
+   * tasks returns the number of configs with windows kept.
+   */
+  size_t tasks() { return windows.size(); }
+
+ private:
+  TaskStore<Rollup> windows;
+};
+
+}  // namespace Plugin
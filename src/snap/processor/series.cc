@@ -0,0 +1,66 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/processor/series.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "snap/hash.h"
+
+using Plugin::fnv1a_sized;
+using Plugin::kFnvOffset;
+using Plugin::splitmix64;
+
+/**
+ * Hashes str onto h, so that ("ab", "c") and ("a", "bc") differ.
+ */
+static uint64_t hash_string(uint64_t h, const std::string& str) {
+  return fnv1a_sized(h, str.data(), str.size());
+}
+
+uint64_t Plugin::series_id(const rpc::Metric& met) {
+  uint64_t ns = kFnvOffset;
+  for (const rpc::NamespaceElement& nse : met.namespace_()) {
+    ns = hash_string(ns, nse.value());
+  }
+  // tags are summed so that their (unspecified) map order doesn't matter
+  uint64_t tags = 0;
+  for (const auto& tag : met.tags()) {
+    tags += splitmix64(hash_string(hash_string(kFnvOffset, tag.first),
+                                   tag.second));
+  }
+  return splitmix64(ns ^ splitmix64(tags + 1));
+}
+
+std::vector<std::string> Plugin::split_ns(const std::string& ns) {
+  std::vector<std::string> elems;
+  std::stringstream ss(ns);
+  std::string elem;
+  while (std::getline(ss, elem, '/')) {
+    if (!elem.empty()) elems.push_back(elem);
+  }
+  return elems;
+}
+
+bool Plugin::has_ns_prefix(const rpc::Metric& met,
+                           const std::vector<std::string>& prefix) {
+  if (met.namespace__size() < int(prefix.size())) {
+    return false;
+  }
+  for (size_t i = 0; i < prefix.size(); i++) {
+    if (met.namespace_(int(i)).value() != prefix[i]) return false;
+  }
+  return true;
+}
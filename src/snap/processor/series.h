@@ -0,0 +1,44 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "snap/rpc/plugin.pb.h"
+
+namespace Plugin {
+
+/**
+ * series_id hashes what identifies the series met belongs to: its namespace
+ * values, in order, and its tags, in any order. Processors that keep state
+ * per series key it by series_id, and accept that two series colliding in
+ * 64 bits share state.
+ */
+uint64_t series_id(const rpc::Metric& met);
+
+/**
+ * split_ns splits a namespace written as "/intel/app/latency" into its
+ * elements.
+ */
+std::vector<std::string> split_ns(const std::string& ns);
+
+/**
+ * has_ns_prefix tells whether the namespace of met starts with prefix.
+ */
+bool has_ns_prefix(const rpc::Metric& met,
+                   const std::vector<std::string>& prefix);
+
+}  // namespace Plugin
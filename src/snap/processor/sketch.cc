@@ -0,0 +1,480 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/processor/sketch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "snap/plugin.h"
+#include "snap/processor/series.h"
+
+using std::chrono::system_clock;
+
+using Plugin::Config;
+using Plugin::ConfigPolicy;
+using Plugin::DDSketch;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::QuantileProcessor;
+using Plugin::QuantileTask;
+using Plugin::Windows;
+
+static const int64_t kNanosPerSec = 1000000000;
+static const char kSketchVersion = 1;
+
+static void put_varint(std::string* out, uint64_t value) {
+  while (value >= 0x80) {
+    out->push_back(char((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(char(value));
+}
+
+static void put_double(std::string* out, double value) {
+  char buf[sizeof(value)];
+  std::memcpy(buf, &value, sizeof(value));
+  out->append(buf, sizeof(buf));
+}
+
+namespace {
+
+/**
+ * Reads what serialize wrote, bounds-checked.
+ */
+class Reader {
+ public:
+  explicit Reader(const std::string& data) : data(data), pos(0) {}
+
+  uint64_t varint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64 && pos < data.size(); shift += 7) {
+      uint8_t byte = uint8_t(data[pos++]);
+      value |= uint64_t(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) return value;
+    }
+    throw PluginException("corrupt sketch");
+  }
+
+  double float64() {
+    double value;
+    if (data.size() - pos < sizeof(value)) {
+      throw PluginException("corrupt sketch");
+    }
+    std::memcpy(&value, data.data() + pos, sizeof(value));
+    pos += sizeof(value);
+    return value;
+  }
+
+  char byte() {
+    if (pos >= data.size()) {
+      throw PluginException("corrupt sketch");
+    }
+    return data[pos++];
+  }
+
+ private:
+  const std::string& data;
+  size_t pos;
+};
+
+}  // namespace
+
+DDSketch::Options::Options() : relative_accuracy(0.01), max_bins(2048) {}
+
+DDSketch::DDSketch(const Options& opts) : opts(opts) {
+  if (!(opts.relative_accuracy > 0 && opts.relative_accuracy < 1)) {
+    throw PluginException("sketch accuracy must be between 0 and 1");
+  }
+  if (opts.max_bins < 1) {
+    throw PluginException("sketch needs at least one bin");
+  }
+  gamma = (1 + opts.relative_accuracy) / (1 - opts.relative_accuracy);
+  log_gamma = std::log(gamma);
+  clear();
+}
+
+void DDSketch::clear() {
+  pos = Store();
+  neg = Store();
+  zeros = 0;
+  n = 0;
+  total = 0;
+  lo = std::numeric_limits<double>::infinity();
+  hi = -std::numeric_limits<double>::infinity();
+}
+
+int32_t DDSketch::index(double value) const {
+  return int32_t(std::ceil(std::log(value) / log_gamma));
+}
+
+/**
+ * The estimate for bin i, which holds (gamma^(i-1), gamma^i]; it is within
+ * relative_accuracy of both bounds.
+ */
+double DDSketch::value(int32_t i) const {
+  return 2 * std::pow(gamma, i) / (gamma + 1);
+}
+
+void DDSketch::add(double value) {
+  if (!std::isfinite(value)) {
+    return;
+  }
+  // magnitudes below this would all index far below the others; count them
+  // as zero
+  const double min_magnitude = 1e-300;
+  if (value > min_magnitude) {
+    pos.add(index(value), 1, opts.max_bins);
+  } else if (value < -min_magnitude) {
+    neg.add(index(-value), 1, opts.max_bins);
+  } else {
+    zeros++;
+  }
+  n++;
+  total += value;
+  lo = std::min(lo, value);
+  hi = std::max(hi, value);
+}
+
+void DDSketch::Store::add(int32_t index, uint64_t count, size_t max_bins) {
+  total += count;
+  if (bins.empty()) {
+    offset = index;
+    bins.push_back(0);
+  }
+  int64_t top = int64_t(offset) + int64_t(bins.size()) - 1;
+  if (index >= offset && index <= top) {
+    bins[index - offset] += count;
+    return;
+  }
+
+  int64_t new_lo = std::min<int64_t>(offset, index);
+  int64_t new_hi = std::max<int64_t>(top, index);
+  if (new_hi - new_lo + 1 > int64_t(max_bins)) {
+    // collapse the bins closest to zero into the lowest one kept
+    new_lo = new_hi - int64_t(max_bins) + 1;
+  }
+  if (new_lo == offset) {
+    bins.resize(new_hi - new_lo + 1);
+  } else {
+    std::vector<uint64_t> grown(new_hi - new_lo + 1);
+    for (size_t i = 0; i < bins.size(); i++) {
+      int64_t at = std::max<int64_t>(offset + int64_t(i), new_lo) - new_lo;
+      grown[at] += bins[i];
+    }
+    bins.swap(grown);
+    offset = int32_t(new_lo);
+  }
+  bins[std::max<int64_t>(index, new_lo) - new_lo] += count;
+}
+
+void DDSketch::merge(const DDSketch& other) {
+  if (other.opts.relative_accuracy != opts.relative_accuracy) {
+    throw PluginException("cannot merge sketches of different accuracy");
+  }
+  for (size_t i = 0; i < other.pos.bins.size(); i++) {
+    if (other.pos.bins[i]) {
+      pos.add(other.pos.offset + int32_t(i), other.pos.bins[i], opts.max_bins);
+    }
+  }
+  for (size_t i = 0; i < other.neg.bins.size(); i++) {
+    if (other.neg.bins[i]) {
+      neg.add(other.neg.offset + int32_t(i), other.neg.bins[i], opts.max_bins);
+    }
+  }
+  zeros += other.zeros;
+  n += other.n;
+  total += other.total;
+  lo = std::min(lo, other.lo);
+  hi = std::max(hi, other.hi);
+}
+
+double DDSketch::quantile(double q) const {
+  if (n == 0) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  if (q <= 0) return lo;
+  if (q >= 1) return hi;
+  double rank = q * (n - 1);
+  double result;
+  uint64_t seen = 0;
+  // negative values, most negative (highest index) first
+  for (size_t i = neg.bins.size(); i-- > 0;) {
+    seen += neg.bins[i];
+    if (seen > rank) {
+      result = -value(neg.offset + int32_t(i));
+      return std::min(std::max(result, lo), hi);
+    }
+  }
+  seen += zeros;
+  if (seen > rank) {
+    return 0;
+  }
+  for (size_t i = 0; i < pos.bins.size(); i++) {
+    seen += pos.bins[i];
+    if (seen > rank) {
+      result = value(pos.offset + int32_t(i));
+      return std::min(std::max(result, lo), hi);
+    }
+  }
+  return hi;
+}
+
+size_t DDSketch::memory() const {
+  return (pos.bins.capacity() + neg.bins.capacity()) * sizeof(uint64_t);
+}
+
+/**
+ * Layout: version | accuracy | max bins | zeros | sum | min | max |
+ * positive store | negative store, where a store is offset (zigzag) | bin
+ * count | counts. Integers are varints, doubles 8 bytes in host order.
+ */
+void DDSketch::serialize(std::string* out) const {
+  out->push_back(kSketchVersion);
+  put_double(out, opts.relative_accuracy);
+  put_varint(out, opts.max_bins);
+  put_varint(out, zeros);
+  put_double(out, total);
+  put_double(out, lo);
+  put_double(out, hi);
+  for (const Store* s : {&pos, &neg}) {
+    int64_t off = s->offset;
+    put_varint(out, (uint64_t(off) << 1) ^ uint64_t(off >> 63));
+    put_varint(out, s->bins.size());
+    for (uint64_t count : s->bins) put_varint(out, count);
+  }
+}
+
+DDSketch DDSketch::parse(const std::string& data) {
+  Reader in(data);
+  if (in.byte() != kSketchVersion) {
+    throw PluginException("unknown sketch version");
+  }
+  Options opts;
+  opts.relative_accuracy = in.float64();
+  opts.max_bins = in.varint();
+  DDSketch sketch(opts);
+  sketch.zeros = in.varint();
+  sketch.total = in.float64();
+  sketch.lo = in.float64();
+  sketch.hi = in.float64();
+  sketch.n = sketch.zeros;
+  for (Store* s : {&sketch.pos, &sketch.neg}) {
+    uint64_t zz = in.varint();
+    s->offset = int32_t(int64_t(zz >> 1) ^ -int64_t(zz & 1));
+    uint64_t size = in.varint();
+    if (size > opts.max_bins) {
+      throw PluginException("corrupt sketch");
+    }
+    s->bins.resize(size);
+    for (uint64_t& count : s->bins) {
+      count = in.varint();
+      s->total += count;
+    }
+    sketch.n += s->total;
+  }
+  return sketch;
+}
+
+QuantileTask::QuantileTask() : emit_sketch(false), window_ns(0),
+                               fingerprint(0) {}
+
+/**
+ * The metric name for quantile q: "p50" for 0.5, "p999" for 0.999.
+ */
+static std::string quantile_name(double q) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%g", q * 100);
+  std::string name = "p";
+  for (const char* c = buf; *c; c++) {
+    if (*c != '.') name.push_back(*c);
+  }
+  return name;
+}
+
+static std::vector<std::string> split(const std::string& str, char sep) {
+  std::vector<std::string> parts;
+  std::stringstream ss(str);
+  std::string part;
+  while (std::getline(ss, part, sep)) {
+    if (!part.empty()) parts.push_back(part);
+  }
+  return parts;
+}
+
+static bool numeric_value(const rpc::Metric& met, double* value) {
+  switch (met.data_case()) {
+    case rpc::Metric::kFloat64Data:
+      *value = met.float64_data();
+      return true;
+    case rpc::Metric::kFloat32Data:
+      *value = met.float32_data();
+      return true;
+    case rpc::Metric::kInt32Data:
+      *value = met.int32_data();
+      return true;
+    case rpc::Metric::kInt64Data:
+      *value = double(met.int64_data());
+      return true;
+    case rpc::Metric::kUint32Data:
+      *value = met.uint32_data();
+      return true;
+    case rpc::Metric::kUint64Data:
+      *value = double(met.uint64_data());
+      return true;
+    default:
+      return false;
+  }
+}
+
+static void emit(const QuantileTask& task,
+                 const Windows<DDSketch>::Window& w,
+                 rpc::Metric* scratch, std::vector<Metric>* out) {
+  const DDSketch& sketch = w.acc;
+  if (sketch.count() == 0) {
+    return;
+  }
+  scratch->CopyFrom(w.tmpl);
+  scratch->mutable_timestamp()->set_sec(w.start / kNanosPerSec);
+  scratch->mutable_timestamp()->set_nsec(w.start % kNanosPerSec);
+  rpc::NamespaceElement* name = scratch->add_namespace_();
+  if (task.emit_sketch) {
+    name->set_value("sketch");
+    sketch.serialize(scratch->mutable_bytes_data());
+    out->emplace_back(Metric(scratch));
+    return;
+  }
+  for (size_t i = 0; i < task.quantiles.size(); i++) {
+    name->set_value(task.names[i]);
+    scratch->set_float64_data(sketch.quantile(task.quantiles[i]));
+    // the Metric copy constructor copies scratch into a Metric of its own
+    out->emplace_back(Metric(scratch));
+  }
+}
+
+QuantileProcessor::QuantileProcessor(std::chrono::milliseconds idle) :
+                                     windows(idle) {}
+
+const ConfigPolicy QuantileProcessor::get_config_policy() {
+  ConfigPolicy policy(Plugin::StringRule{"match", {"", false}});
+  policy.add_rule({""}, Plugin::StringRule{"quantiles",
+                                           {"0.5,0.9,0.99,0.999", false}});
+  policy.add_rule({""}, Plugin::StringRule{"output", {"quantiles", false}});
+  policy.add_rule({""}, Plugin::IntRule{"window", {60, false}});
+  policy.add_rule({""}, Plugin::StringRule{"accuracy", {"0.01", false}});
+  policy.add_rule({""}, Plugin::IntRule{"max_bins", {2048, false}});
+  return policy;
+}
+
+std::unique_ptr<QuantileTask> QuantileProcessor::prepare(
+    const Config& config) {
+  const rpc::ConfigMap& map = config.get_rpc_config_map();
+  std::unique_ptr<QuantileTask> task(new QuantileTask());
+
+  if (map.stringmap().count("match")) {
+    task->match = split_ns(config.get_string("match"));
+  }
+  std::string quantiles = "0.5,0.9,0.99,0.999";
+  if (map.stringmap().count("quantiles")) {
+    quantiles = config.get_string("quantiles");
+  }
+  for (const std::string& q : split(quantiles, ',')) {
+    char* end;
+    double value = std::strtod(q.c_str(), &end);
+    if (*end != '\0' || !(value >= 0 && value <= 1)) {
+      throw PluginException("bad quantile: " + q);
+    }
+    task->quantiles.push_back(value);
+    task->names.push_back(quantile_name(value));
+  }
+
+  if (map.stringmap().count("output")) {
+    std::string output = config.get_string("output");
+    if (output == "sketch") {
+      task->emit_sketch = true;
+    } else if (output != "quantiles") {
+      throw PluginException("output must be quantiles or sketch: " + output);
+    }
+  }
+
+  int64_t window = 60;
+  if (map.intmap().count("window")) {
+    window = config.get_int("window");
+  }
+  if (window <= 0) {
+    throw PluginException("window must be positive");
+  }
+  task->window_ns = window * kNanosPerSec;
+
+  if (map.stringmap().count("accuracy")) {
+    std::string accuracy = config.get_string("accuracy");
+    char* end;
+    task->sketch.relative_accuracy = std::strtod(accuracy.c_str(), &end);
+    if (accuracy.empty() || *end != '\0') {
+      throw PluginException("bad accuracy: " + accuracy);
+    }
+  }
+  if (map.intmap().count("max_bins")) {
+    int bins = config.get_int("max_bins");
+    task->sketch.max_bins = bins > 0 ? size_t(bins) : 0;
+  }
+  // validates the sketch options
+  DDSketch check(task->sketch);
+  task->fingerprint = config.fingerprint();
+  return task;
+}
+
+void QuantileProcessor::process_metrics(std::vector<Metric> &metrics,
+                                        const QuantileTask& task) {
+  std::vector<Metric> out;
+  out.reserve(metrics.size());
+  rpc::Metric scratch;
+  int64_t newest = std::numeric_limits<int64_t>::min();
+
+  windows.with(task.fingerprint, [&]() {
+    return std::unique_ptr<Windows<DDSketch>>(
+        new Windows<DDSketch>(task.window_ns, DDSketch(task.sketch)));
+  }, [&](Windows<DDSketch>& open) {
+    auto close = [&](const Windows<DDSketch>::Window& w) {
+      emit(task, w, &scratch, &out);
+    };
+    for (Metric& met : metrics) {
+      const rpc::Metric& rpc_met = *met.get_rpc_metric_ptr();
+      double value;
+      if (!numeric_value(rpc_met, &value) ||
+          !has_ns_prefix(rpc_met, task.match)) {
+        out.emplace_back(met);
+        continue;
+      }
+      newest = std::max(newest, rpc_met.timestamp().sec() * kNanosPerSec +
+                                rpc_met.timestamp().nsec());
+      DDSketch* sketch = open.add(series_id(rpc_met), rpc_met, close);
+      if (sketch != nullptr) {
+        sketch->add(value);
+      }
+    }
+    // as in RollupProcessor, close the windows of series that went quiet,
+    // a window behind the newest point
+    if (newest != std::numeric_limits<int64_t>::min()) {
+      open.close_until(newest - task.window_ns, close);
+    }
+  });
+  metrics.swap(out);
+}
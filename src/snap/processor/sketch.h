@@ -0,0 +1,166 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/processor/prepared_processor.h"
+#include "snap/processor/windows.h"
+#include "snap/rpc/plugin.pb.h"
+
+namespace Plugin {
+
+/**
+ * DDSketch is a quantile sketch with relative error guarantees, after
+ * Masson, Rim and Lee, "DDSketch: A Fast and Fully-Mergeable Quantile
+ * Sketch with Relative-Error Guarantees" (VLDB 2019).
+ *
+ * Values are counted in logarithmically sized bins, so any quantile is
+ * returned within relative_accuracy of its true value. Inserting is constant
+ * time, and sketches with the same accuracy merge exactly. Each sign keeps
+ * at most max_bins bins; past that, the bins closest to zero are collapsed
+ * into one, which loses accuracy only for the quantiles of the smallest
+ * magnitudes.
+ */
+class DDSketch final {
+ public:
+  struct Options {
+    Options();
+
+    double relative_accuracy;
+    size_t max_bins;
+  };
+
+  explicit DDSketch(const Options& opts);
+
+  /**
+   * add counts value; NaN and infinities are ignored.
+   */
+  void add(double value);
+
+  /**
+   * merge adds the counts of other, which must have the same relative
+   * accuracy, or PluginException is thrown.
+   */
+  void merge(const DDSketch& other);
+
+  /**
+   * quantile returns the estimated value at q in [0, 1], or NaN if the
+   * sketch is empty. q = 0 and q = 1 return the exact min and max.
+   */
+  double quantile(double q) const;
+
+  uint64_t count() const { return n; }
+  double sum() const { return total; }
+  double min() const { return lo; }
+  double max() const { return hi; }
+
+  void clear();
+
+  /**
+   * serialize appends the sketch to out in a compact binary form that parse
+   * reads back.
+   */
+  void serialize(std::string* out) const;
+  static DDSketch parse(const std::string& data);
+
+  /**
+   * Bytes held by the bins, for bounding memory per series.
+   */
+  size_t memory() const;
+
+ private:
+  /**
+   * Store counts values by bin index, densely from offset on.
+   */
+  struct Store {
+    int32_t offset;
+    std::vector<uint64_t> bins;
+    uint64_t total;
+
+    Store() : offset(0), total(0) {}
+    void add(int32_t index, uint64_t count, size_t max_bins);
+  };
+
+  Options opts;
+  double gamma;
+  double log_gamma;
+  Store pos;
+  Store neg;
+  uint64_t zeros;
+  uint64_t n;
+  double total;
+  double lo;
+  double hi;
+
+  int32_t index(double value) const;
+  double value(int32_t index) const;
+};
+
+/**
+ * The prepared state of a QuantileProcessor task.
+ */
+struct QuantileTask {
+  QuantileTask();
+
+  std::vector<std::string> match;
+  std::vector<double> quantiles;
+  std::vector<std::string> names;
+  bool emit_sketch;
+  int64_t window_ns;
+  DDSketch::Options sketch;
+  // the config fingerprint, which keys the task's windows
+  uint64_t fingerprint;
+};
+
+/**
+ * QuantileProcessor replaces numeric metrics matching a namespace prefix
+ * with quantiles computed per series and window, using the task config
+ * values
+ *   match:      the namespace prefix, e.g. "/intel/app/latency"; all numeric
+ *               metrics if empty (the default)
+ *   quantiles:  the quantiles to emit, "0.5,0.9,0.99,0.999" by default
+ *   output:     "quantiles" (the default) to emit a float64 metric per
+ *               quantile, named by appending "p50", "p99", "p999" and so on
+ *               to the namespace; "sketch" to emit the serialized DDSketch
+ *               as bytes_data under "sketch", for merging downstream
+ *   window:     the window length in seconds, 60 by default
+ *   accuracy:   the relative accuracy, "0.01" by default
+ *   max_bins:   the bins kept per series and sign, 2048 by default
+ * Windows close, and are kept, the way RollupProcessor's are.
+ */
+class QuantileProcessor final : public PreparedProcessor<QuantileTask> {
+ public:
+  using PreparedProcessor<QuantileTask>::process_metrics;
+
+  explicit QuantileProcessor(
+      std::chrono::milliseconds idle = std::chrono::hours(1));
+
+  const ConfigPolicy get_config_policy();
+
+  std::unique_ptr<QuantileTask> prepare(const Config& config);
+
+  void process_metrics(std::vector<Metric> &metrics, const QuantileTask& task);
+
+ private:
+  TaskStore<Windows<DDSketch>> windows;
+};
+
+}  // namespace Plugin
@@ -0,0 +1,141 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+
+#include "snap/rpc/plugin.pb.h"
+
+namespace Plugin {
+
+/**
+ * Windows keeps the open window of each series for the windowed processors,
+ * with an Acc accumulating the points of each. Acc must be copyable and have
+ * clear(); a copy of the Acc given to the constructor starts each series.
+ *
+ * Windows are aligned to multiples of the window length since the epoch. A
+ * series' window closes when a point of the series arrives for a later
+ * window, or when close_until passes its end. Points that arrive for a
+ * window that was already closed are dropped and counted as late.
+ *
+ * Windows is not safe for concurrent use.
+ */
+template<typename Acc>
+class Windows final {
+ public:
+  struct Window {
+    explicit Window(const Acc& empty) : acc(empty) {}
+
+    // namespace, tags, unit and version of the series, without data
+    rpc::Metric tmpl;
+    int64_t start;
+    Acc acc;
+  };
+
+  Windows(int64_t window_ns, const Acc& empty) :
+          window_ns(window_ns), empty(empty),
+          closed_until(std::numeric_limits<int64_t>::min()),
+          next_end(std::numeric_limits<int64_t>::max()),
+          n_late(0) {}
+
+  Windows(const Windows&) = delete;
+  Windows& operator=(const Windows&) = delete;
+
+  /**
+   * add returns the accumulator of the window met's point belongs to, in
+   * the series keyed by key, or null if the point is late. If the point
+   * opens a later window, close is called with the series' current window
+   * first.
+   */
+  template<typename Close>
+  Acc* add(uint64_t key, const rpc::Metric& met, const Close& close) {
+    int64_t ts = met.timestamp().sec() * 1000000000 +
+                 met.timestamp().nsec();
+    int64_t start = ts - ((ts % window_ns) + window_ns) % window_ns;
+    if (start + window_ns <= closed_until) {
+      n_late++;
+      return nullptr;
+    }
+    std::unique_ptr<Window>& w = open[key];
+    if (!w) {
+      w.reset(new Window(empty));
+      w->tmpl.mutable_namespace_()->CopyFrom(met.namespace_());
+      *w->tmpl.mutable_tags() = met.tags();
+      w->tmpl.set_unit(met.unit());
+      w->tmpl.set_version(met.version());
+      w->start = start;
+    } else if (start < w->start) {
+      n_late++;
+      return nullptr;
+    } else if (start > w->start) {
+      close(*w);
+      w->acc.clear();
+      w->start = start;
+    }
+    next_end = std::min(next_end, start + window_ns);
+    return &w->acc;
+  }
+
+  /**
+   * close_until calls close with every window that ends at or before until
+   * and forgets their series. Points for those windows are late from then
+   * on.
+   */
+  template<typename Close>
+  void close_until(int64_t until, const Close& close) {
+    closed_until = std::max(closed_until, until);
+    if (until < next_end) {
+      return;
+    }
+    next_end = std::numeric_limits<int64_t>::max();
+    for (auto it = open.begin(); it != open.end();) {
+      int64_t end = it->second->start + window_ns;
+      if (end <= until) {
+        close(*it->second);
+        it = open.erase(it);
+      } else {
+        next_end = std::min(next_end, end);
+        ++it;
+      }
+    }
+  }
+
+  int64_t window() const { return window_ns; }
+
+  /**
+   * size returns the number of series with an open window.
+   */
+  size_t size() const { return open.size(); }
+
+  /**
+   * late returns the number of points dropped for arriving late.
+   */
+  uint64_t late() const { return n_late; }
+
+ private:
+  int64_t window_ns;
+  Acc empty;
+  std::unordered_map<uint64_t, std::unique_ptr<Window>> open;
+  // windows ending at or before this were closed
+  int64_t closed_until;
+  // the earliest end of an open window
+  int64_t next_end;
+  uint64_t n_late;
+};
+
+}  // namespace Plugin
@@ -15,11 +15,16 @@ limitations under the License.
 
 #include <grpc++/grpc++.h>
 
+#include <algorithm>
+#include <chrono>
+#include <string>
 #include<vector>
 
 #include "snap/rpc/plugin.pb.h"
 
 #include "snap/metric.h"
+#include "snap/stats.h"
+#include "snap/trace.h"
 
 using google::protobuf::RepeatedPtrField;
 
@@ -37,10 +42,46 @@ using rpc::MetricsArg;
 using rpc::MetricsReply;
 
 using Plugin::Metric;
+using Plugin::RpcCall;
+using Plugin::Span;
 using Plugin::Proxy::CollectorImpl;
 
-CollectorImpl::CollectorImpl(Plugin::CollectorInterface* plugin) :
-                             collector(plugin) {
+/**
+ * incomplete_metric reports what a collection left out as a string metric,
+ * <prefix>/collect/incomplete, where prefix is what the namespaces of req's
+ * metrics share short of their last element. snapteld takes a non-empty
+ * MetricsReply.error as a failed call, discarding the metrics sent with it.
+ */
+static Metric incomplete_metric(const MetricsArg& req,
+                                const std::string& incomplete) {
+  std::vector<Metric::NamespaceElement> ns;
+  if (req.metrics_size() > 0) {
+    const rpc::Metric& first = req.metrics(0);
+    int len = first.namespace__size() - 1;
+    for (const rpc::Metric& met : req.metrics()) {
+      len = std::min(len, met.namespace__size() - 1);
+      for (int i = 0; i < len; i++) {
+        if (met.namespace_(i).value() != first.namespace_(i).value()) {
+          len = i;
+        }
+      }
+    }
+    for (int i = 0; i < len; i++) {
+      if (first.namespace_(i).value() == "*") break;
+      ns.push_back({first.namespace_(i).value(), "", ""});
+    }
+  }
+  ns.push_back({"collect", "", ""});
+  ns.push_back({"incomplete", "", ""});
+  Metric met(ns, "", "what the collection could not include");
+  met.set_data(incomplete);
+  met.set_timestamp();
+  return met;
+}
+
+CollectorImpl::CollectorImpl(Plugin::CollectorInterface* plugin,
+                             const ReplyCompression& compression) :
+                             collector(plugin), compression(compression) {
   plugin_impl_ptr = new PluginImpl(plugin);
 }
 
@@ -51,21 +92,38 @@ CollectorImpl::~CollectorImpl() {
 Status CollectorImpl::CollectMetrics(ServerContext* context,
                                      const MetricsArg* req,
                                      MetricsReply* resp) {
+  RpcCall stats(Plugin::kCollectMetrics);
+  Span call("CollectMetrics", "proxy");
+  Span wrap("wrap", "proxy");
   std::vector<Metric> metrics;
   RepeatedPtrField<rpc::Metric> rpc_mets = req->metrics();
 
   for (int i = 0; i < rpc_mets.size(); i++) {
     metrics.emplace_back(rpc_mets.Mutable(i));
   }
+  wrap.end();
 
+  std::chrono::system_clock::time_point deadline =
+      context ? context->deadline() :
+      std::chrono::system_clock::time_point::max();
   try {
-   collector->collect_metrics(metrics);
+   Span callback("collect_metrics", "plugin");
+   std::string incomplete = collector->collect_metrics_by(metrics, deadline);
+   callback.end();
 
+   Span marshal("marshal", "proxy");
    for (Metric met : metrics) {
      *resp->add_metrics() = *met.get_rpc_metric_ptr();
    }
+   // partial results are sent along with what's missing
+   if (!incomplete.empty()) {
+     Metric annotation = incomplete_metric(*req, incomplete);
+     *resp->add_metrics() = *annotation.get_rpc_metric_ptr();
+   }
+   compression.apply(context, *resp);
    return Status::OK;
   } catch (PluginException &e) {
+   stats.failed();
    resp->set_error(e.what());
    return Status(StatusCode::UNKNOWN, e.what());
   }
@@ -74,18 +132,25 @@ Status CollectorImpl::CollectMetrics(ServerContext* context,
 Status CollectorImpl::GetMetricTypes(ServerContext* context,
                                      const GetMetricTypesArg* req,
                                      MetricsReply* resp) {
+  RpcCall stats(Plugin::kGetMetricTypes);
+  Span call("GetMetricTypes", "proxy");
   Plugin::Config cfg(req->config());
 
   try {
+   Span callback("get_metric_types", "plugin");
    std::vector<Metric> metrics = collector->get_metric_types(cfg);
+   callback.end();
 
+   Span marshal("marshal", "proxy");
    for (Metric met : metrics) {
      met.set_timestamp();
      met.set_last_advertised_time();
      *resp->add_metrics() = *met.get_rpc_metric_ptr();
    }
+   compression.apply(context, *resp);
    return Status::OK;
   } catch (PluginException &e) {
+   stats.failed();
    resp->set_error(e.what());
    return Status(StatusCode::UNKNOWN, e.what());
   }
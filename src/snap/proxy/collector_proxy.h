@@ -25,7 +25,8 @@ namespace Proxy {
 
 class CollectorImpl final : public rpc::Collector::Service {
  public:
-  explicit CollectorImpl(Plugin::CollectorInterface* plugin);
+  explicit CollectorImpl(Plugin::CollectorInterface* plugin,
+                  const ReplyCompression& compression = ReplyCompression());
 
   ~CollectorImpl();
 
@@ -50,6 +51,7 @@ class CollectorImpl final : public rpc::Collector::Service {
  private:
   Plugin::CollectorInterface* collector;
   PluginImpl* plugin_impl_ptr;
+  ReplyCompression compression;
 };
 
 }  // namespace Proxy
@@ -17,9 +17,13 @@ limitations under the License.
 
 #include "snap/rpc/plugin.pb.h"
 
+#include "snap/stats.h"
+#include "snap/trace.h"
+
 using grpc::Server;
 using grpc::ServerContext;
 using grpc::Status;
+using grpc::StatusCode;
 
 using rpc::Empty;
 using rpc::ErrReply;
@@ -27,6 +31,44 @@ using rpc::KillArg;
 using rpc::GetConfigPolicyReply;
 
 using Plugin::Proxy::PluginImpl;
+using Plugin::Proxy::ReplyCompression;
+using Plugin::RpcCall;
+using Plugin::Span;
+
+ReplyCompression::ReplyCompression() :
+    algorithm(GRPC_COMPRESS_NONE), level(GRPC_COMPRESS_LEVEL_NONE),
+    threshold(0) {}
+
+ReplyCompression::ReplyCompression(const Plugin::Meta& meta) :
+    algorithm(GRPC_COMPRESS_NONE), level(GRPC_COMPRESS_LEVEL_NONE),
+    threshold(meta.compression_threshold) {
+  switch (meta.compression) {
+    case Plugin::NoCompression: break;
+    case Plugin::Deflate: algorithm = GRPC_COMPRESS_DEFLATE; break;
+    case Plugin::Gzip: algorithm = GRPC_COMPRESS_GZIP; break;
+  }
+  switch (meta.compression_level) {
+    case Plugin::CompressNone: break;
+    case Plugin::CompressLow: level = GRPC_COMPRESS_LEVEL_LOW; break;
+    case Plugin::CompressMedium: level = GRPC_COMPRESS_LEVEL_MED; break;
+    case Plugin::CompressHigh: level = GRPC_COMPRESS_LEVEL_HIGH; break;
+  }
+}
+
+void ReplyCompression::apply(ServerContext* context,
+                             const google::protobuf::Message& reply) const {
+  if (context == nullptr ||
+      (algorithm == GRPC_COMPRESS_NONE && level == GRPC_COMPRESS_LEVEL_NONE)) {
+    return;
+  }
+  if (size_t(reply.ByteSize()) < threshold) {
+    context->set_compression_algorithm(GRPC_COMPRESS_NONE);
+  } else if (level != GRPC_COMPRESS_LEVEL_NONE) {
+    context->set_compression_level(level);
+  } else {
+    context->set_compression_algorithm(algorithm);
+  }
+}
 
 PluginImpl::PluginImpl(Plugin::PluginInterface* plugin) : plugin(plugin) {}
 
@@ -37,11 +79,28 @@ Status PluginImpl::Ping(ServerContext* context, const Empty* req,
 
 Status PluginImpl::Kill(ServerContext* context, const KillArg* req,
                         ErrReply* resp) {
-  return Status::OK;
+  RpcCall stats(Plugin::kKill);
+  Span call("Kill", "proxy");
+  try {
+    plugin->kill(req != nullptr ? req->reason() : "");
+    return Status::OK;
+  } catch (PluginException &e) {
+    stats.failed();
+    resp->set_error(e.what());
+    return Status(StatusCode::UNKNOWN, e.what());
+  }
 }
 
 Status PluginImpl::GetConfigPolicy(ServerContext* context, const Empty* req,
                                    GetConfigPolicyReply* resp) {
-  *resp = plugin->get_config_policy();
+  RpcCall stats(Plugin::kGetConfigPolicy);
+  Span call("GetConfigPolicy", "proxy");
+  try {
+    *resp = plugin->get_config_policy();
+  } catch (PluginException&) {
+    // reported by the caller
+    stats.failed();
+    throw;
+  }
   return Status::OK;
 }
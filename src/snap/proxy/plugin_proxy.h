@@ -22,6 +22,30 @@ limitations under the License.
 namespace Plugin {
 namespace Proxy {
 
+/**
+ * ReplyCompression sets how each metric reply is compressed, after the
+ * compression settings of the plugin's Meta. gRPC still sends a reply
+ * uncompressed when the caller doesn't accept the algorithm.
+ */
+class ReplyCompression final {
+ public:
+  /** The default leaves replies uncompressed. */
+  ReplyCompression();
+  explicit ReplyCompression(const Plugin::Meta& meta);
+
+  /**
+   * apply sets the compression of reply on context, which may be null
+   * when a proxy is called directly.
+   */
+  void apply(grpc::ServerContext* context,
+             const google::protobuf::Message& reply) const;
+
+ private:
+  grpc_compression_algorithm algorithm;
+  grpc_compression_level level;
+  size_t threshold;
+};
+
 class PluginImpl final {
  public:
   explicit PluginImpl(Plugin::PluginInterface* plugin);
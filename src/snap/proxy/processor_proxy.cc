@@ -19,6 +19,9 @@ limitations under the License.
 
 #include "snap/rpc/plugin.pb.h"
 
+#include "snap/stats.h"
+#include "snap/trace.h"
+
 using google::protobuf::RepeatedPtrField;
 
 using grpc::Server;
@@ -35,9 +38,12 @@ using rpc::Processor;
 using rpc::PubProcArg;
 
 using Plugin::Proxy::ProcessorImpl;
+using Plugin::RpcCall;
+using Plugin::Span;
 
-ProcessorImpl::ProcessorImpl(Plugin::ProcessorInterface* plugin) :
-                             processor(plugin) {
+ProcessorImpl::ProcessorImpl(Plugin::ProcessorInterface* plugin,
+                             const ReplyCompression& compression) :
+                             processor(plugin), compression(compression) {
   plugin_impl_ptr = new PluginImpl(plugin);
 }
 
@@ -47,6 +53,9 @@ ProcessorImpl::~ProcessorImpl() {
 
 Status ProcessorImpl::Process(ServerContext* context, const PubProcArg* req,
                               MetricsReply* resp) {
+  RpcCall stats(Plugin::kProcess);
+  Span call("Process", "proxy");
+  Span wrap("wrap", "proxy");
   std::vector<Metric> metrics;
   RepeatedPtrField<rpc::Metric> rpc_mets = req->metrics();
 
@@ -55,14 +64,20 @@ Status ProcessorImpl::Process(ServerContext* context, const PubProcArg* req,
   }
 
   Plugin::Config config(req->config());
+  wrap.end();
   try {
+   Span callback("process_metrics", "plugin");
    processor->process_metrics(metrics, config);
+   callback.end();
 
+   Span marshal("marshal", "proxy");
    for (Metric met : metrics) {
      *resp->add_metrics() = *met.get_rpc_metric_ptr();
    }
+   compression.apply(context, *resp);
    return Status::OK;
   } catch (PluginException &e) {
+   stats.failed();
    resp->set_error(e.what());
    return Status(StatusCode::UNKNOWN, e.what());
   }
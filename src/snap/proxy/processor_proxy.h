@@ -25,7 +25,8 @@ namespace Proxy {
 
 class ProcessorImpl final : public rpc::Processor::Service {
  public:
-  explicit ProcessorImpl(Plugin::ProcessorInterface* plugin);
+  explicit ProcessorImpl(Plugin::ProcessorInterface* plugin,
+                  const ReplyCompression& compression = ReplyCompression());
 
   ~ProcessorImpl();
 
@@ -46,6 +47,7 @@ class ProcessorImpl final : public rpc::Processor::Service {
  private:
   Plugin::ProcessorInterface* processor;
   PluginImpl* plugin_impl_ptr;
+  ReplyCompression compression;
 };
 
 }   // namespace Proxy
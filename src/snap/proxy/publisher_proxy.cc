@@ -19,6 +19,9 @@ limitations under the License.
 
 #include "snap/rpc/plugin.pb.h"
 
+#include "snap/stats.h"
+#include "snap/trace.h"
+
 using google::protobuf::RepeatedPtrField;
 
 using grpc::Server;
@@ -34,6 +37,8 @@ using rpc::Publisher;
 using rpc::PubProcArg;
 
 using Plugin::Proxy::PublisherImpl;
+using Plugin::RpcCall;
+using Plugin::Span;
 
 PublisherImpl::PublisherImpl(Plugin::PublisherInterface* plugin) :
                              publisher(plugin) {
@@ -46,6 +51,9 @@ PublisherImpl::~PublisherImpl() {
 
 Status PublisherImpl::Publish(ServerContext* context, const PubProcArg* req,
                               ErrReply* resp) {
+  RpcCall stats(Plugin::kPublish);
+  Span call("Publish", "proxy");
+  Span wrap("wrap", "proxy");
   std::vector<Metric> metrics;
   RepeatedPtrField<rpc::Metric> rpc_mets = req->metrics();
 
@@ -54,10 +62,13 @@ Status PublisherImpl::Publish(ServerContext* context, const PubProcArg* req,
   }
 
   Plugin::Config config(req->config());
+  wrap.end();
   try {
+   Span callback("publish_metrics", "plugin");
    publisher->publish_metrics(metrics, config);
    return Status::OK;
   } catch (PluginException &e) {
+   stats.failed();
    resp->set_error(e.what());
    return Status(StatusCode::UNKNOWN, e.what());
   }
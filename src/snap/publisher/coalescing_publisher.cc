@@ -0,0 +1,335 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/publisher/coalescing_publisher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "snap/rpc/plugin.pb.h"
+
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+using Plugin::CoalescingPublisher;
+using Plugin::Config;
+using Plugin::ConfigPolicy;
+using Plugin::Metric;
+using Plugin::PluginException;
+
+CoalescingPublisher::Limits::Limits() : max_metrics(1000),
+                                        max_bytes(1 << 20),
+                                        max_age(milliseconds(1000)),
+                                        max_attempts(5) {}
+
+CoalescingPublisher::Limits::Limits(size_t max_metrics, size_t max_bytes,
+                                    milliseconds max_age, int max_attempts) :
+                                      max_metrics(max_metrics),
+                                      max_bytes(max_bytes),
+                                      max_age(max_age),
+                                      max_attempts(max_attempts) {}
+
+CoalescingPublisher::CoalescingPublisher(PublisherInterface* sink,
+                                         const Limits& limits) :
+                                           sink(sink),
+                                           limits(limits),
+                                           buffered_count(0),
+                                           dropped_count(0),
+                                           draining(false),
+                                           stopping(false) {
+  if (limits.max_age.count() > 0) {
+    timer = std::thread(&CoalescingPublisher::run_timer, this);
+  }
+}
+
+CoalescingPublisher::~CoalescingPublisher() {
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    stopping = true;
+  }
+  timer_cv.notify_all();
+  if (timer.joinable()) {
+    timer.join();
+  }
+  try {
+    flush();
+  } catch (...) {
+    // nowhere left to report it
+  }
+}
+
+const ConfigPolicy CoalescingPublisher::get_config_policy() {
+  return sink->get_config_policy();
+}
+
+void CoalescingPublisher::publish_metrics(std::vector<Metric> &metrics,
+                                          const Config& config) {
+  std::unique_lock<std::mutex> lk(mtx);
+  if (!metrics.empty()) {
+    uint64_t key = config.fingerprint();
+    std::unique_ptr<Batch>& batch = batches[key];
+    if (!batch) {
+      batch.reset(new Batch);
+      batch->key = key;
+      batch->config = config.get_rpc_config_map();
+      batch->bytes = 0;
+      batch->deadline = steady_clock::now() + limits.max_age;
+      batch->attempts = 0;
+      timer_cv.notify_one();
+    }
+
+    batch->metrics.Reserve(batch->metrics.size() + metrics.size());
+    for (const Metric& met : metrics) {
+      const rpc::Metric* rpc_met = met.get_rpc_metric_ptr();
+      batch->bytes += rpc_met->ByteSize();
+      *batch->metrics.Add() = *rpc_met;
+    }
+    buffered_count += metrics.size();
+
+    if (is_full(*batch)) {
+      queue.push_back(std::move(batch));
+      batches.erase(key);
+      // a drain in progress picks the group up, in order
+      drain_locked(lk);
+    }
+  }
+  // the metrics above are buffered either way, so reporting an earlier
+  // failure doesn't lose them
+  rethrow_pending_locked();
+}
+
+void CoalescingPublisher::kill(const std::string& reason) {
+  std::exception_ptr err;
+  try {
+    flush();
+  } catch (...) {
+    err = std::current_exception();
+  }
+  sink->kill(reason);
+  if (err) {
+    std::rethrow_exception(err);
+  }
+}
+
+void CoalescingPublisher::flush() {
+  std::unique_lock<std::mutex> lk(mtx);
+  for (auto& kv : batches) {
+    queue.push_back(std::move(kv.second));
+  }
+  batches.clear();
+  drained_cv.wait(lk, [this] { return !draining; });
+  // rejected groups don't wait out their retry delay either
+  for (auto& batch : queue) {
+    batch->retry_at = steady_clock::time_point();
+  }
+  std::exception_ptr err = pending_error;
+  pending_error = nullptr;
+  try {
+    drain_locked(lk);
+  } catch (...) {
+    if (!err) err = std::current_exception();
+  }
+  if (err) {
+    std::rethrow_exception(err);
+  }
+}
+
+size_t CoalescingPublisher::buffered() const {
+  std::lock_guard<std::mutex> lk(mtx);
+  return buffered_count;
+}
+
+size_t CoalescingPublisher::dropped() const {
+  std::lock_guard<std::mutex> lk(mtx);
+  return dropped_count;
+}
+
+bool CoalescingPublisher::is_full(const Batch& batch) const {
+  if (limits.max_metrics > 0 &&
+      size_t(batch.metrics.size()) >= limits.max_metrics) {
+    return true;
+  }
+  return limits.max_bytes > 0 && batch.bytes >= limits.max_bytes;
+}
+
+/**
+ * next_due_locked returns the oldest queued group that may go to the sink
+ * now: its retry delay is over and no older group of its config, nor one of
+ * the configs in skip, is waiting.
+ */
+CoalescingPublisher::Queue::iterator CoalescingPublisher::next_due_locked(
+    steady_clock::time_point now, const std::set<uint64_t>& skip) {
+  std::set<uint64_t> waiting;
+  for (auto it = queue.begin(); it != queue.end(); ++it) {
+    uint64_t key = (*it)->key;
+    if (skip.count(key) || waiting.count(key)) {
+      continue;
+    }
+    if ((*it)->retry_at <= now) {
+      return it;
+    }
+    waiting.insert(key);
+  }
+  return queue.end();
+}
+
+/**
+ * next_retry_locked returns when the first of the groups at the head of
+ * their config may go to the sink, or time_point::max() if none is queued.
+ */
+steady_clock::time_point CoalescingPublisher::next_retry_locked() {
+  steady_clock::time_point next = steady_clock::time_point::max();
+  std::set<uint64_t> seen;
+  for (const auto& batch : queue) {
+    if (seen.insert(batch->key).second) {
+      next = std::min(next, batch->retry_at);
+    }
+  }
+  return next;
+}
+
+/**
+ * drain_locked publishes the queued groups that are due, oldest first,
+ * unless another thread is already draining. It is entered and left with lk
+ * held, and releases it around each call into the sink. A group the sink
+ * rejects goes back to the queue to wait out its retry delay, or is dropped
+ * with the rest of its config once it ran out of attempts; either way the
+ * drain moves on to the other configs and rethrows the first error at the
+ * end.
+ */
+void CoalescingPublisher::drain_locked(std::unique_lock<std::mutex>& lk) {
+  if (draining) {
+    return;
+  }
+  draining = true;
+  std::exception_ptr err;
+  // configs rejected during this drain
+  std::set<uint64_t> failed;
+  for (;;) {
+    steady_clock::time_point now = steady_clock::now();
+    Queue::iterator it = next_due_locked(now, failed);
+    if (it == queue.end()) {
+      break;
+    }
+    std::unique_ptr<Batch> batch = std::move(*it);
+    queue.erase(it);
+    lk.unlock();
+    std::exception_ptr rejected;
+    std::string reason;
+    try {
+      std::vector<Metric> metrics;
+      metrics.reserve(batch->metrics.size());
+      for (int i = 0; i < batch->metrics.size(); i++) {
+        metrics.emplace_back(batch->metrics.Mutable(i));
+      }
+      Config config(batch->config);
+      sink->publish_metrics(metrics, config);
+    } catch (const std::exception& e) {
+      rejected = std::current_exception();
+      reason = e.what();
+    } catch (...) {
+      rejected = std::current_exception();
+      reason = "unknown error";
+    }
+    lk.lock();
+    if (!rejected) {
+      buffered_count -= batch->metrics.size();
+      continue;
+    }
+
+    failed.insert(batch->key);
+    if (++batch->attempts < limits.max_attempts || limits.max_attempts <= 0) {
+      batch->retry_at = steady_clock::now() + limits.max_age;
+      // younger groups of its config are all behind it
+      queue.push_front(std::move(batch));
+      if (!err) err = rejected;
+      continue;
+    }
+
+    size_t lost = batch->metrics.size();
+    for (auto q = queue.begin(); q != queue.end();) {
+      if ((*q)->key == batch->key) {
+        lost += (*q)->metrics.size();
+        q = queue.erase(q);
+      } else {
+        ++q;
+      }
+    }
+    buffered_count -= lost;
+    dropped_count += lost;
+    if (!err) {
+      err = std::make_exception_ptr(PluginException(
+          "dropped " + std::to_string(lost) + " metrics after " +
+          std::to_string(batch->attempts) + " failed publishes: " + reason));
+    }
+  }
+  draining = false;
+  drained_cv.notify_all();
+  timer_cv.notify_one();
+  if (err) {
+    std::rethrow_exception(err);
+  }
+}
+
+void CoalescingPublisher::rethrow_pending_locked() {
+  if (pending_error) {
+    std::exception_ptr err = pending_error;
+    pending_error = nullptr;
+    std::rethrow_exception(err);
+  }
+}
+
+void CoalescingPublisher::run_timer() {
+  std::unique_lock<std::mutex> lk(mtx);
+  while (!stopping) {
+    steady_clock::time_point now = steady_clock::now();
+    steady_clock::time_point next = steady_clock::time_point::max();
+    size_t queued = queue.size();
+    for (auto it = batches.begin(); it != batches.end();) {
+      if (it->second->deadline <= now) {
+        queue.push_back(std::move(it->second));
+        it = batches.erase(it);
+      } else {
+        next = std::min(next, it->second->deadline);
+        ++it;
+      }
+    }
+
+    // new groups go out now; rejected ones wait out their retry delay
+    steady_clock::time_point retry = next_retry_locked();
+    bool due = queue.size() > queued || retry <= now;
+    if (due && !draining) {
+      try {
+        drain_locked(lk);
+      } catch (...) {
+        pending_error = std::current_exception();
+      }
+      continue;
+    }
+
+    if (!draining) {
+      next = std::min(next, retry);
+    }
+    if (next == steady_clock::time_point::max()) {
+      timer_cv.wait(lk);
+    } else {
+      timer_cv.wait_until(lk, next);
+    }
+  }
+}
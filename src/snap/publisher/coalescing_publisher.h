@@ -0,0 +1,166 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <google/protobuf/repeated_field.h>
+
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+
+namespace Plugin {
+
+/**
+ * CoalescingPublisher buffers metrics across Publish calls and hands them to
+ * the wrapped publisher in larger batches.
+ *
+ * Metrics are grouped by the fingerprint of the config they arrived with, so
+ * a sink only ever sees one config per publish_metrics call. A group is
+ * flushed when it holds max_metrics metrics, when its serialized size reaches
+ * max_bytes, or when its oldest metric is max_age old. Every group is flushed
+ * when snapteld kills the plugin.
+ *
+ * Flushed groups join a queue that one thread at a time drains into the
+ * sink, in order, without holding up publish_metrics callers while the sink
+ * is slow. A size-triggered flush drains on the calling thread unless
+ * another drain is running, so errors thrown by the sink propagate to
+ * snapteld as usual. Age-triggered flushes drain on a background thread; an
+ * error thrown there is reported by the next publish_metrics or kill call,
+ * after that call's metrics are buffered.
+ *
+ * A group the sink rejects is retried by the first drain at least max_age
+ * later, and holds back the younger groups of its config until then; groups
+ * of other configs keep going to the sink meanwhile. After max_attempts
+ * rejections it is dropped along with the groups of its config queued
+ * behind it, counted in dropped() and reported like a sink error. Wrap the
+ * sink in a SpoolingPublisher to keep rejected groups across restarts.
+ *
+ * E.g.:
+ *   MySink sink;
+ *   Plugin::CoalescingPublisher plg(&sink, {5000, 4 << 20,
+ *                                           std::chrono::seconds(10)});
+ *   Plugin::start_publisher(&plg, meta);
+ */
+class CoalescingPublisher final : public PublisherInterface {
+ public:
+  /**
+   * Limits that trigger a flush. A limit of zero disables that trigger.
+   * max_attempts is how often the sink may reject a group before it is
+   * dropped; zero retries it for as long as the plugin runs.
+   */
+  struct Limits {
+    Limits();
+    Limits(size_t max_metrics, size_t max_bytes,
+           std::chrono::milliseconds max_age, int max_attempts = 5);
+
+    size_t max_metrics;
+    size_t max_bytes;
+    std::chrono::milliseconds max_age;
+    int max_attempts;
+  };
+
+  /**
+   * The sink is not owned and must outlive the CoalescingPublisher.
+   */
+  CoalescingPublisher(PublisherInterface* sink, const Limits& limits);
+
+  /**
+   * Flushes whatever is still buffered; errors thrown by the sink at this
+   * point are dropped, along with the groups it rejected.
+   */
+  ~CoalescingPublisher();
+
+  CoalescingPublisher(const CoalescingPublisher&) = delete;
+  CoalescingPublisher& operator=(const CoalescingPublisher&) = delete;
+
+  const ConfigPolicy get_config_policy();
+
+  void publish_metrics(std::vector<Metric> &metrics, const Config& config);
+
+  void kill(const std::string& reason);
+
+  /**
+   * flush hands every buffered group to the sink immediately, and waits for
+   * any drain in progress to finish first.
+   */
+  void flush();
+
+  /**
+   * buffered returns the number of metrics not yet accepted by the sink.
+   */
+  size_t buffered() const;
+
+  /**
+   * dropped returns the number of metrics given up on after the sink
+   * rejected them max_attempts times.
+   */
+  size_t dropped() const;
+
+ private:
+  struct Batch {
+    uint64_t key;
+    rpc::ConfigMap config;
+    google::protobuf::RepeatedPtrField<rpc::Metric> metrics;
+    size_t bytes;
+    std::chrono::steady_clock::time_point deadline;
+    // rejections so far, and when the group may be retried
+    int attempts;
+    std::chrono::steady_clock::time_point retry_at;
+  };
+
+  typedef std::map<uint64_t, std::unique_ptr<Batch>> BatchMap;
+  typedef std::deque<std::unique_ptr<Batch>> Queue;
+
+  PublisherInterface* sink;
+  Limits limits;
+
+  // guards everything below except timer
+  mutable std::mutex mtx;
+  std::condition_variable timer_cv;
+  // signalled when a drain ends
+  std::condition_variable drained_cv;
+  BatchMap batches;
+  // groups detached from batches, oldest first, waiting for the sink
+  Queue queue;
+  size_t buffered_count;
+  size_t dropped_count;
+  // set while a thread is draining queue into the sink
+  bool draining;
+  std::exception_ptr pending_error;
+  bool stopping;
+  std::thread timer;
+
+  bool is_full(const Batch& batch) const;
+  Queue::iterator next_due_locked(std::chrono::steady_clock::time_point now,
+                                  const std::set<uint64_t>& skip);
+  std::chrono::steady_clock::time_point next_retry_locked();
+  void drain_locked(std::unique_lock<std::mutex>& lk);
+  void rethrow_pending_locked();
+  void run_timer();
+};
+
+}  // namespace Plugin
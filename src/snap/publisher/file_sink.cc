@@ -0,0 +1,208 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/publisher/file_sink.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "snap/plugin.h"
+
+using std::chrono::milliseconds;
+
+using Plugin::Config;
+using Plugin::FileSink;
+using Plugin::PluginException;
+
+static void throw_errno(const std::string& what, const std::string& path) {
+  throw PluginException(what + " " + path + ": " + std::strerror(errno));
+}
+
+FileSink::Options::Options() : buffer_bytes(1 << 20),
+                               sync_interval(milliseconds(1000)),
+                               sync(true) {}
+
+FileSink::FileSink(const Options& opts) : opts(opts), stopping(false) {
+  if (opts.sync_interval.count() > 0) {
+    timer = std::thread(&FileSink::run_timer, this);
+  }
+}
+
+FileSink::~FileSink() {
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    stopping = true;
+  }
+  timer_cv.notify_all();
+  if (timer.joinable()) {
+    timer.join();
+  }
+  for (auto& kv : files) {
+    File* file = kv.second.get();
+    try {
+      std::lock_guard<std::mutex> file_lk(file->mtx);
+      sync_file(file, true);
+    } catch (...) {
+      // nowhere left to report it
+    }
+    close(file->fd);
+  }
+}
+
+void FileSink::write(const Config& config, const std::string& key,
+                     const FormatFunc& fn) {
+  uint64_t id = config.fingerprint() ^
+                (std::hash<std::string>()(key) * 0x9e3779b97f4a7c15ULL);
+  File* file = nullptr;
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    auto it = by_config.find(id);
+    if (it != by_config.end()) {
+      file = it->second;
+    } else {
+      file = open_file(config.get_string(key));
+      by_config[id] = file;
+    }
+  }
+  write_file(file, fn);
+}
+
+void FileSink::write(const std::string& path, const FormatFunc& fn) {
+  File* file = nullptr;
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    file = open_file(path);
+  }
+  write_file(file, fn);
+}
+
+void FileSink::flush() {
+  std::vector<File*> snapshot;
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    for (auto& kv : files) snapshot.push_back(kv.second.get());
+  }
+  std::exception_ptr err;
+  for (File* file : snapshot) {
+    std::lock_guard<std::mutex> file_lk(file->mtx);
+    try {
+      if (file->error) {
+        std::exception_ptr pending = file->error;
+        file->error = nullptr;
+        std::rethrow_exception(pending);
+      }
+      sync_file(file, true);
+    } catch (...) {
+      if (!err) err = std::current_exception();
+    }
+  }
+  if (err) {
+    std::rethrow_exception(err);
+  }
+}
+
+/**
+ * open_file returns the file for path, opening it on first use. Called with
+ * mtx held.
+ */
+FileSink::File* FileSink::open_file(const std::string& path) {
+  std::unique_ptr<File>& file = files[path];
+  if (!file) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                  0644);
+    if (fd < 0) {
+      files.erase(path);
+      throw_errno("cannot open", path);
+    }
+    file.reset(new File());
+    file->path = path;
+    file->fd = fd;
+    file->dirty = false;
+    file->buffer.reserve(opts.buffer_bytes);
+  }
+  return file.get();
+}
+
+void FileSink::write_file(File* file, const FormatFunc& fn) {
+  std::lock_guard<std::mutex> file_lk(file->mtx);
+  if (file->error) {
+    std::exception_ptr err = file->error;
+    file->error = nullptr;
+    std::rethrow_exception(err);
+  }
+  fn(file->buffer);
+  if (file->buffer.size() >= opts.buffer_bytes) {
+    write_out(file);
+  }
+}
+
+/**
+ * write_out hands the file's buffer to the kernel. On error the buffered
+ * output is dropped, as it would be had the publish failed outright.
+ * Called with the file locked.
+ */
+void FileSink::write_out(File* file) {
+  const char* data = file->buffer.data();
+  size_t left = file->buffer.size();
+  while (left > 0) {
+    ssize_t n = ::write(file->fd, data, left);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      file->buffer.clear();
+      throw_errno("cannot write", file->path);
+    }
+    data += n;
+    left -= n;
+    file->dirty = true;
+  }
+  file->buffer.clear();
+}
+
+void FileSink::sync_file(File* file, bool sync) {
+  write_out(file);
+  if (sync && file->dirty) {
+    if (fdatasync(file->fd) != 0) {
+      throw_errno("cannot sync", file->path);
+    }
+    file->dirty = false;
+  }
+}
+
+void FileSink::run_timer() {
+  std::unique_lock<std::mutex> lk(mtx);
+  while (!stopping) {
+    timer_cv.wait_for(lk, opts.sync_interval);
+    if (stopping) {
+      break;
+    }
+    std::vector<File*> snapshot;
+    for (auto& kv : files) snapshot.push_back(kv.second.get());
+    lk.unlock();
+
+    for (File* file : snapshot) {
+      std::lock_guard<std::mutex> file_lk(file->mtx);
+      try {
+        sync_file(file, opts.sync);
+      } catch (...) {
+        file->error = std::current_exception();
+      }
+    }
+    lk.lock();
+  }
+}
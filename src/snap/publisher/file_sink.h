@@ -0,0 +1,118 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "snap/config.h"
+#include "snap/publisher/text_buffer.h"
+
+namespace Plugin {
+
+/**
+ * FileSink is the file output for publishers that write text to local files.
+ *
+ * Each path is opened once (O_APPEND) and kept open for the life of the sink;
+ * the file for a task is looked up by config fingerprint, so the config isn't
+ * parsed again on every publish. Output is formatted straight into a per-file
+ * buffer, which is written out once it holds buffer_bytes. Every
+ * sync_interval a background thread writes out what is buffered and
+ * fdatasyncs the files written since the last round, so one sync covers all
+ * the batches of that interval (group commit).
+ *
+ * Write errors hit on the publishing thread are thrown as PluginException;
+ * errors hit by the background thread are thrown by the next write to the
+ * same file.
+ */
+class FileSink final {
+ public:
+  struct Options {
+    Options();
+
+    /** buffered output per file that triggers a write */
+    size_t buffer_bytes;
+    /** interval of the background write-out and sync; zero disables it */
+    std::chrono::milliseconds sync_interval;
+    /** fdatasync files in the background round, not just write them out */
+    bool sync;
+  };
+
+  typedef std::function<void(TextBuffer& out)> FormatFunc;
+
+  explicit FileSink(const Options& opts);
+
+  /**
+   * Writes out and syncs everything still buffered; errors are dropped.
+   */
+  ~FileSink();
+
+  FileSink(const FileSink&) = delete;
+  FileSink& operator=(const FileSink&) = delete;
+
+  /**
+   * write calls fn to append to the buffer of the file named by the string
+   * config value under key. fn runs with the file locked, so concurrent
+   * writers to one file don't interleave.
+   */
+  void write(const Config& config, const std::string& key,
+             const FormatFunc& fn);
+
+  /**
+   * write appends to the buffer of the file at path.
+   */
+  void write(const std::string& path, const FormatFunc& fn);
+
+  /**
+   * flush writes out every buffer and fdatasyncs every file.
+   */
+  void flush();
+
+ private:
+  struct File {
+    std::string path;
+    int fd;
+    std::mutex mtx;
+    TextBuffer buffer;
+    // written since the last sync
+    bool dirty;
+    std::exception_ptr error;
+  };
+
+  Options opts;
+  // guards files, by_config and stopping
+  std::mutex mtx;
+  std::map<std::string, std::unique_ptr<File>> files;
+  std::unordered_map<uint64_t, File*> by_config;
+  std::condition_variable timer_cv;
+  bool stopping;
+  std::thread timer;
+
+  File* open_file(const std::string& path);
+  void write_file(File* file, const FormatFunc& fn);
+  void write_out(File* file);
+  void sync_file(File* file, bool sync);
+  void run_timer();
+};
+
+}  // namespace Plugin
@@ -0,0 +1,402 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/publisher/formatter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using google::protobuf::RepeatedPtrField;
+
+using Plugin::Formatter;
+using Plugin::Metric;
+using Plugin::TextBuffer;
+
+namespace {
+
+// What to do with a byte when writing it in a given position.
+enum Escape : unsigned char {
+  kCopy = 0,
+  kBackslash,   // prefix it with '\'
+  kUnderscore,  // replace it with '_'
+  kNewline,     // write "\n"
+};
+
+struct EscapeTable {
+  unsigned char action[256];
+};
+
+struct EscapeTables {
+  EscapeTable influx_name;
+  EscapeTable influx_tag;
+  EscapeTable influx_string;
+  EscapeTable graphite_path;
+  EscapeTable graphite_tag;
+  EscapeTable opentsdb;
+  EscapeTable prom_name;
+  EscapeTable prom_label;
+  EscapeTable prom_value;
+
+  EscapeTables() {
+    fill(influx_name, kCopy, ", ", kBackslash);
+    set(influx_name, "\n\r", kUnderscore);
+    fill(influx_tag, kCopy, ",= ", kBackslash);
+    set(influx_tag, "\n\r", kUnderscore);
+    fill(influx_string, kCopy, "\"\\", kBackslash);
+
+    fill(graphite_path, kCopy, " .;\t\n\r", kUnderscore);
+    fill(graphite_tag, kCopy, " ;!^=~\t\n\r", kUnderscore);
+
+    // OpenTSDB allows letters, digits, "-_./" and Unicode; none of those need
+    // escaping in JSON
+    fill_allowed(opentsdb, "-_./", true);
+    fill_allowed(prom_name, "_:", false);
+    fill_allowed(prom_label, "_", false);
+
+    fill(prom_value, kCopy, "\"\\", kBackslash);
+    set(prom_value, "\n", kNewline);
+  }
+
+  static void set(EscapeTable& t, const char* chars, Escape action) {
+    for (const char* c = chars; *c; c++) t.action[(unsigned char)*c] = action;
+  }
+
+  static void fill(EscapeTable& t, Escape base, const char* chars,
+                   Escape action) {
+    std::memset(t.action, base, sizeof(t.action));
+    set(t, chars, action);
+  }
+
+  static void fill_allowed(EscapeTable& t, const char* extra, bool high) {
+    for (int c = 0; c < 256; c++) {
+      bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                (c >= '0' && c <= '9') || (high && c >= 0x80);
+      t.action[c] = ok ? kCopy : kUnderscore;
+    }
+    set(t, extra, kCopy);
+  }
+};
+
+const EscapeTables& tables() {
+  static const EscapeTables t;
+  return t;
+}
+
+/**
+ * Appends str, escaped per table. Runs of bytes that need no escaping are
+ * appended in one go.
+ */
+void append_escaped(TextBuffer& out, const std::string& str,
+                    const EscapeTable& table) {
+  const char* p = str.data();
+  const char* end = p + str.size();
+  while (p < end) {
+    const char* run = p;
+    while (p < end && table.action[(unsigned char)*p] == kCopy) p++;
+    if (p > run) out.append(run, p - run);
+    if (p == end) break;
+    switch (table.action[(unsigned char)*p]) {
+      case kBackslash:
+        out.append('\\');
+        out.append(*p);
+        break;
+      case kUnderscore:
+        out.append('_');
+        break;
+      case kNewline:
+        out.append("\\n", 2);
+        break;
+    }
+    p++;
+  }
+}
+
+void append_ns(TextBuffer& out, const rpc::Metric& met, char sep,
+               const EscapeTable& table) {
+  bool first = true;
+  for (const rpc::NamespaceElement& nse : met.namespace_()) {
+    if (!first) out.append(sep);
+    append_escaped(out, nse.value(), table);
+    first = false;
+  }
+}
+
+bool less_key(const std::pair<const std::string*, const std::string*>& a,
+              const std::pair<const std::string*, const std::string*>& b) {
+  return *a.first < *b.first;
+}
+
+bool is_number(const rpc::Metric& met) {
+  switch (met.data_case()) {
+    case rpc::Metric::kFloat32Data:
+      return std::isfinite(met.float32_data());
+    case rpc::Metric::kFloat64Data:
+      return std::isfinite(met.float64_data());
+    case rpc::Metric::kInt32Data:
+    case rpc::Metric::kInt64Data:
+    case rpc::Metric::kUint32Data:
+    case rpc::Metric::kUint64Data:
+    case rpc::Metric::kBoolData:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * Appends numeric data; bools are written as 1 and 0.
+ */
+void append_number(TextBuffer& out, const rpc::Metric& met) {
+  switch (met.data_case()) {
+    case rpc::Metric::kFloat32Data:
+      out.append_float(met.float32_data());
+      break;
+    case rpc::Metric::kFloat64Data:
+      out.append_double(met.float64_data());
+      break;
+    case rpc::Metric::kInt32Data:
+      out.append_int(met.int32_data());
+      break;
+    case rpc::Metric::kInt64Data:
+      out.append_int(met.int64_data());
+      break;
+    case rpc::Metric::kUint32Data:
+      out.append_uint(met.uint32_data());
+      break;
+    case rpc::Metric::kUint64Data:
+      out.append_uint(met.uint64_data());
+      break;
+    case rpc::Metric::kBoolData:
+      out.append(met.bool_data() ? '1' : '0');
+      break;
+    default:
+      break;
+  }
+}
+
+bool has_tag(const rpc::Metric& met) {
+  for (const auto& tag : met.tags()) {
+    if (!tag.first.empty() && !tag.second.empty()) return true;
+  }
+  return false;
+}
+
+int64_t unix_ms(const rpc::Metric& met) {
+  return met.timestamp().sec() * 1000 + met.timestamp().nsec() / 1000000;
+}
+
+}  // namespace
+
+Formatter::Formatter(Format format) : fmt(format), first(true) {}
+
+size_t Formatter::format(const std::vector<Metric>& metrics, TextBuffer& out) {
+  size_t written = 0;
+  begin(out);
+  for (const Metric& met : metrics) {
+    if (format_one(*met.get_rpc_metric_ptr(), out)) written++;
+  }
+  end(out);
+  return written;
+}
+
+size_t Formatter::format(const RepeatedPtrField<rpc::Metric>& metrics,
+                         TextBuffer& out) {
+  size_t written = 0;
+  begin(out);
+  for (const rpc::Metric& met : metrics) {
+    if (format_one(met, out)) written++;
+  }
+  end(out);
+  return written;
+}
+
+void Formatter::begin(TextBuffer& out) {
+  if (fmt == OpenTSDB) {
+    out.append('[');
+    first = true;
+  }
+}
+
+void Formatter::end(TextBuffer& out) {
+  if (fmt == OpenTSDB) {
+    out.append(']');
+  }
+}
+
+bool Formatter::format_one(const rpc::Metric& met, TextBuffer& out) {
+  switch (fmt) {
+    case Influx:
+      if (met.data_case() != rpc::Metric::kStringData && !is_number(met)) {
+        return false;
+      }
+      influx(met, out);
+      return true;
+    case Graphite:
+      if (!is_number(met)) return false;
+      graphite(met, out);
+      return true;
+    case OpenTSDB:
+      if (!is_number(met) || !has_tag(met)) return false;
+      opentsdb(met, out);
+      return true;
+    case Prometheus:
+      if (met.data_case() == rpc::Metric::kStringData ||
+          met.data_case() == rpc::Metric::DATA_NOT_SET) {
+        return false;
+      }
+      prometheus(met, out);
+      return true;
+  }
+  return false;
+}
+
+void Formatter::sort_tags(const rpc::Metric& met) {
+  tags.clear();
+  for (const auto& tag : met.tags()) {
+    tags.emplace_back(&tag.first, &tag.second);
+  }
+  std::sort(tags.begin(), tags.end(), less_key);
+}
+
+void Formatter::influx(const rpc::Metric& met, TextBuffer& out) {
+  const EscapeTables& t = tables();
+  append_ns(out, met, '/', t.influx_name);
+  sort_tags(met);
+  for (const Tag& tag : tags) {
+    // empty tag values aren't allowed
+    if (tag.second->empty()) continue;
+    out.append(',');
+    append_escaped(out, *tag.first, t.influx_tag);
+    out.append('=');
+    append_escaped(out, *tag.second, t.influx_tag);
+  }
+
+  out.append(" value=", 7);
+  switch (met.data_case()) {
+    case rpc::Metric::kInt32Data:
+    case rpc::Metric::kInt64Data:
+    case rpc::Metric::kUint32Data:
+      append_number(out, met);
+      out.append('i');
+      break;
+    case rpc::Metric::kUint64Data:
+      append_number(out, met);
+      out.append('u');
+      break;
+    case rpc::Metric::kBoolData:
+      out.append(met.bool_data() ? "true" : "false",
+                 met.bool_data() ? 4 : 5);
+      break;
+    case rpc::Metric::kStringData:
+      out.append('"');
+      append_escaped(out, met.string_data(), t.influx_string);
+      out.append('"');
+      break;
+    default:
+      append_number(out, met);
+      break;
+  }
+
+  out.append(' ');
+  out.append_int(met.timestamp().sec() * 1000000000 + met.timestamp().nsec());
+  out.append('\n');
+}
+
+void Formatter::graphite(const rpc::Metric& met, TextBuffer& out) {
+  const EscapeTables& t = tables();
+  append_ns(out, met, '.', t.graphite_path);
+  sort_tags(met);
+  for (const Tag& tag : tags) {
+    if (tag.first->empty() || tag.second->empty()) continue;
+    out.append(';');
+    append_escaped(out, *tag.first, t.graphite_tag);
+    out.append('=');
+    append_escaped(out, *tag.second, t.graphite_tag);
+  }
+  out.append(' ');
+  append_number(out, met);
+  out.append(' ');
+  out.append_int(met.timestamp().sec());
+  out.append('\n');
+}
+
+void Formatter::opentsdb(const rpc::Metric& met, TextBuffer& out) {
+  const EscapeTables& t = tables();
+  if (!first) out.append(',');
+  first = false;
+
+  out.append("{\"metric\":\"", 11);
+  append_ns(out, met, '.', t.opentsdb);
+  out.append("\",\"timestamp\":", 14);
+  out.append_int(unix_ms(met));
+  out.append(",\"value\":", 9);
+  append_number(out, met);
+  out.append(",\"tags\":{", 9);
+  sort_tags(met);
+  bool first_tag = true;
+  for (const Tag& tag : tags) {
+    if (tag.first->empty() || tag.second->empty()) continue;
+    if (!first_tag) out.append(',');
+    first_tag = false;
+    out.append('"');
+    append_escaped(out, *tag.first, t.opentsdb);
+    out.append("\":\"", 3);
+    append_escaped(out, *tag.second, t.opentsdb);
+    out.append('"');
+  }
+  out.append("}}", 2);
+}
+
+void Formatter::prometheus(const rpc::Metric& met, TextBuffer& out) {
+  const EscapeTables& t = tables();
+  const RepeatedPtrField<rpc::NamespaceElement>& ns = met.namespace_();
+  // names can't start with a digit
+  if (ns.size() == 0 || ns.Get(0).value().empty() ||
+      (ns.Get(0).value()[0] >= '0' && ns.Get(0).value()[0] <= '9')) {
+    out.append('_');
+  }
+  append_ns(out, met, '_', t.prom_name);
+
+  sort_tags(met);
+  bool first_label = true;
+  for (const Tag& tag : tags) {
+    if (tag.first->empty()) continue;
+    out.append(first_label ? '{' : ',');
+    first_label = false;
+    if ((*tag.first)[0] >= '0' && (*tag.first)[0] <= '9') out.append('_');
+    append_escaped(out, *tag.first, t.prom_label);
+    out.append("=\"", 2);
+    append_escaped(out, *tag.second, t.prom_value);
+    out.append('"');
+  }
+  if (!first_label) out.append('}');
+
+  out.append(' ');
+  double value = met.data_case() == rpc::Metric::kFloat32Data ?
+                 met.float32_data() : met.float64_data();
+  bool is_float = met.data_case() == rpc::Metric::kFloat32Data ||
+                  met.data_case() == rpc::Metric::kFloat64Data;
+  if (is_float && std::isnan(value)) {
+    out.append("NaN", 3);
+  } else if (is_float && std::isinf(value)) {
+    out.append(value > 0 ? "+Inf" : "-Inf", 4);
+  } else {
+    append_number(out, met);
+  }
+  out.append(' ');
+  out.append_int(unix_ms(met));
+  out.append('\n');
+}
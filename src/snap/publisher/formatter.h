@@ -0,0 +1,101 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "snap/metric.h"
+#include "snap/publisher/text_buffer.h"
+#include "snap/rpc/plugin.pb.h"
+
+namespace Plugin {
+
+/**
+ * Formatter renders metrics in the line protocol of a time series database.
+ *
+ * Names are built from the namespace element values; tags are written sorted
+ * by key. Characters a protocol can't carry are escaped, or replaced with '_'
+ * where it has no escaping. Metrics a protocol can't represent (strings
+ * outside Influx, NaN and infinities outside Prometheus, unset data) are
+ * skipped.
+ *
+ * A Formatter keeps its scratch space between calls, so it doesn't allocate
+ * per metric; it is not safe for concurrent use.
+ */
+class Formatter final {
+ public:
+  enum Format {
+    /**
+     * Influx line protocol:
+     * `<ns joined by '/'>,<tags> value=<data> <unix ns>`.
+     * Signed and 32-bit unsigned integers get the 'i' suffix, uint64 the 'u'
+     * suffix (InfluxDB 1.4 and later).
+     */
+    Influx,
+    /**
+     * Graphite plaintext with 1.1 tags:
+     * `<ns joined by '.'>;<key>=<value>... <data> <unix s>`.
+     */
+    Graphite,
+    /**
+     * A JSON array for the OpenTSDB /api/put endpoint, with the namespace
+     * joined by '.' as the metric name and the timestamp in milliseconds.
+     * OpenTSDB rejects a whole batch when one point has no tags, so metrics
+     * without a non-empty tag are skipped.
+     */
+    OpenTSDB,
+    /**
+     * Prometheus text exposition format, untyped:
+     * `<ns joined by '_'>{<labels>} <data> <unix ms>`.
+     */
+    Prometheus,
+  };
+
+  explicit Formatter(Format format);
+
+  /**
+   * format appends metrics to out, and returns how many were written; the
+   * rest were skipped.
+   */
+  size_t format(const std::vector<Metric>& metrics, TextBuffer& out);
+
+  /**
+   * format appends a batch of rpc metrics, as buffered by
+   * CoalescingPublisher, to out.
+   */
+  size_t format(const google::protobuf::RepeatedPtrField<rpc::Metric>& metrics,
+                TextBuffer& out);
+
+ private:
+  typedef std::pair<const std::string*, const std::string*> Tag;
+
+  Format fmt;
+  // tags of the current metric, sorted by key
+  std::vector<Tag> tags;
+  // OpenTSDB: nothing written yet, so no separating comma is due
+  bool first;
+
+  void begin(TextBuffer& out);
+  void end(TextBuffer& out);
+  bool format_one(const rpc::Metric& met, TextBuffer& out);
+  void sort_tags(const rpc::Metric& met);
+  void influx(const rpc::Metric& met, TextBuffer& out);
+  void graphite(const rpc::Metric& met, TextBuffer& out);
+  void opentsdb(const rpc::Metric& met, TextBuffer& out);
+  void prometheus(const rpc::Metric& met, TextBuffer& out);
+};
+
+}  // namespace Plugin
@@ -0,0 +1,614 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/publisher/gorilla.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+using Plugin::Config;
+using Plugin::ConfigPolicy;
+using Plugin::FileSink;
+using Plugin::GorillaDecoder;
+using Plugin::GorillaEncoder;
+using Plugin::GorillaPublisher;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::TextBuffer;
+
+static const char kMagic[4] = {'S', 'G', 'B', '1'};
+static const int64_t kNanosPerSec = 1000000000;
+
+namespace {
+
+/**
+ * BitWriter appends bits, most significant first, to a string.
+ */
+class BitWriter {
+ public:
+  explicit BitWriter(std::string* buf) : buf(buf), used(0) {}
+
+  void write(uint64_t value, int nbits) {
+    while (nbits > 0) {
+      if (used == 0) buf->push_back(0);
+      int room = 8 - used;
+      int take = nbits < room ? nbits : room;
+      unsigned bits = unsigned(value >> (nbits - take)) & ((1u << take) - 1);
+      buf->back() = char(uint8_t(buf->back()) | (bits << (room - take)));
+      used = (used + take) & 7;
+      nbits -= take;
+    }
+  }
+
+  void write_varint(uint64_t value) {
+    while (value >= 0x80) {
+      write((value & 0x7f) | 0x80, 8);
+      value >>= 7;
+    }
+    write(value, 8);
+  }
+
+ private:
+  std::string* buf;
+  // bits used in the last byte, 0 if it is full
+  int used;
+};
+
+/**
+ * BitReader reads what BitWriter wrote.
+ */
+class BitReader {
+ public:
+  BitReader() : data(nullptr), nbits(0), pos(0) {}
+  BitReader(const char* data, size_t len) :
+            data(reinterpret_cast<const uint8_t*>(data)), nbits(len * 8),
+            pos(0) {}
+
+  uint64_t read(int n) {
+    if (nbits - pos < size_t(n)) {
+      throw PluginException("corrupt gorilla block: payload too short");
+    }
+    uint64_t value = 0;
+    while (n > 0) {
+      int off = int(pos & 7);
+      int room = 8 - off;
+      int take = n < room ? n : room;
+      unsigned bits = (data[pos >> 3] >> (room - take)) & ((1u << take) - 1);
+      value = (value << take) | bits;
+      pos += take;
+      n -= take;
+    }
+    return value;
+  }
+
+  bool read_bit() { return read(1) != 0; }
+
+  uint64_t read_varint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      uint64_t byte = read(8);
+      value |= (byte & 0x7f) << shift;
+      if (!(byte & 0x80)) return value;
+    }
+    throw PluginException("corrupt gorilla block: bad varint");
+  }
+
+ private:
+  const uint8_t* data;
+  size_t nbits;
+  size_t pos;
+};
+
+uint64_t zigzag(uint64_t v) {
+  return (v << 1) ^ uint64_t(int64_t(v) >> 63);
+}
+
+uint64_t unzigzag(uint64_t v) {
+  return (v >> 1) ^ (0 - (v & 1));
+}
+
+void put_varint(std::string& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(char((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(char(value));
+}
+
+void put_string(std::string& out, const std::string& str) {
+  put_varint(out, str.size());
+  out.append(str);
+}
+
+/**
+ * Reads the byte-aligned parts of a block, bounds-checked.
+ */
+class ByteReader {
+ public:
+  ByteReader(const char* data, size_t len) : data(data), len(len), pos(0) {}
+
+  uint64_t varint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (pos >= len) break;
+      uint8_t byte = uint8_t(data[pos++]);
+      value |= uint64_t(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) return value;
+    }
+    throw PluginException("corrupt gorilla block: bad varint");
+  }
+
+  const char* bytes(size_t n) {
+    if (len - pos < n) {
+      throw PluginException("corrupt gorilla block: truncated");
+    }
+    const char* p = data + pos;
+    pos += n;
+    return p;
+  }
+
+  void read_string(std::string* out) {
+    size_t n = varint();
+    out->assign(bytes(n), n);
+  }
+
+ private:
+  const char* data;
+  size_t len;
+  size_t pos;
+};
+
+bool is_float(int data_case) {
+  return data_case == rpc::Metric::kFloat32Data ||
+         data_case == rpc::Metric::kFloat64Data;
+}
+
+bool is_int(int data_case) {
+  return data_case == rpc::Metric::kInt32Data ||
+         data_case == rpc::Metric::kInt64Data ||
+         data_case == rpc::Metric::kUint32Data ||
+         data_case == rpc::Metric::kUint64Data;
+}
+
+bool is_bytes(int data_case) {
+  return data_case == rpc::Metric::kStringData ||
+         data_case == rpc::Metric::kBytesData;
+}
+
+uint64_t double_bits(double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+double bits_double(uint64_t bits) {
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/**
+ * The data of met as 64 bits: floats as the bits of the double, integers
+ * sign- or zero-extended.
+ */
+uint64_t value_bits(const rpc::Metric& met) {
+  switch (met.data_case()) {
+    case rpc::Metric::kFloat32Data:
+      return double_bits(met.float32_data());
+    case rpc::Metric::kFloat64Data:
+      return double_bits(met.float64_data());
+    case rpc::Metric::kInt32Data:
+      return uint64_t(int64_t(met.int32_data()));
+    case rpc::Metric::kInt64Data:
+      return uint64_t(met.int64_data());
+    case rpc::Metric::kUint32Data:
+      return met.uint32_data();
+    case rpc::Metric::kUint64Data:
+      return met.uint64_data();
+    case rpc::Metric::kBoolData:
+      return met.bool_data();
+    default:
+      return 0;
+  }
+}
+
+void set_value_bits(rpc::Metric* met, int data_case, uint64_t bits) {
+  switch (data_case) {
+    case rpc::Metric::kFloat32Data:
+      met->set_float32_data(float(bits_double(bits)));
+      break;
+    case rpc::Metric::kFloat64Data:
+      met->set_float64_data(bits_double(bits));
+      break;
+    case rpc::Metric::kInt32Data:
+      met->set_int32_data(int32_t(bits));
+      break;
+    case rpc::Metric::kInt64Data:
+      met->set_int64_data(int64_t(bits));
+      break;
+    case rpc::Metric::kUint32Data:
+      met->set_uint32_data(uint32_t(bits));
+      break;
+    case rpc::Metric::kUint64Data:
+      met->set_uint64_data(bits);
+      break;
+    case rpc::Metric::kBoolData:
+      met->set_bool_data(bits != 0);
+      break;
+  }
+}
+
+int64_t unix_nanos(const rpc::Metric& met) {
+  return int64_t(uint64_t(met.timestamp().sec()) * kNanosPerSec +
+                 uint64_t(met.timestamp().nsec()));
+}
+
+bool less_key(const std::pair<const std::string*, const std::string*>& a,
+              const std::pair<const std::string*, const std::string*>& b) {
+  return *a.first < *b.first;
+}
+
+}  // namespace
+
+/**
+ * The state of one series while its block is being built.
+ */
+struct GorillaEncoder::Series {
+  Series() : data_case(0), count(0), writer(&payload) {}
+
+  std::string header;
+  int data_case;
+  size_t count;
+  std::string payload;
+  BitWriter writer;
+  int64_t prev_ts;
+  int64_t prev_delta;
+  uint64_t prev_value;
+  // the meaningful-bit window of the last XORed float, leading < 0 if none
+  int leading;
+  int trailing;
+
+  void add(const rpc::Metric& met) {
+    int64_t ts = unix_nanos(met);
+    uint64_t value = value_bits(met);
+    if (count == 0) {
+      writer.write(uint64_t(ts), 64);
+      prev_delta = 0;
+      leading = -1;
+      if (is_float(data_case)) {
+        writer.write(value, 64);
+      } else if (is_int(data_case)) {
+        writer.write_varint(zigzag(value));
+      }
+    } else {
+      int64_t delta = int64_t(uint64_t(ts) - uint64_t(prev_ts));
+      write_dod(int64_t(uint64_t(delta) - uint64_t(prev_delta)));
+      prev_delta = delta;
+      if (is_float(data_case)) {
+        write_xor(value ^ prev_value);
+      } else if (is_int(data_case)) {
+        writer.write_varint(zigzag(value - prev_value));
+      }
+    }
+    if (data_case == rpc::Metric::kBoolData) {
+      writer.write(value, 1);
+    } else if (is_bytes(data_case)) {
+      const std::string& str = data_case == rpc::Metric::kStringData ?
+                               met.string_data() : met.bytes_data();
+      writer.write_varint(str.size());
+      for (char c : str) writer.write(uint8_t(c), 8);
+    }
+    prev_ts = ts;
+    prev_value = value;
+    count++;
+  }
+
+  void write_dod(int64_t dod) {
+    if (dod == 0) {
+      writer.write(0, 1);
+    } else if (dod >= -63 && dod <= 64) {
+      writer.write(0x2, 2);
+      writer.write(uint64_t(dod + 63), 7);
+    } else if (dod >= -255 && dod <= 256) {
+      writer.write(0x6, 3);
+      writer.write(uint64_t(dod + 255), 9);
+    } else if (dod >= -2047 && dod <= 2048) {
+      writer.write(0xe, 4);
+      writer.write(uint64_t(dod + 2047), 12);
+    } else if (dod >= -2147483647LL && dod <= 2147483648LL) {
+      writer.write(0x1e, 5);
+      writer.write(uint64_t(dod + 2147483647LL), 32);
+    } else {
+      writer.write(0x1f, 5);
+      writer.write(uint64_t(dod), 64);
+    }
+  }
+
+  void write_xor(uint64_t x) {
+    if (x == 0) {
+      writer.write(0, 1);
+      return;
+    }
+    int lead = __builtin_clzll(x);
+    int trail = __builtin_ctzll(x);
+    // the leading count has 5 bits
+    if (lead > 31) lead = 31;
+    if (leading >= 0 && lead >= leading && trail >= trailing) {
+      writer.write(0x2, 2);
+      writer.write(x >> trailing, 64 - leading - trailing);
+      return;
+    }
+    int meaningful = 64 - lead - trail;
+    writer.write(0x3, 2);
+    writer.write(uint64_t(lead), 5);
+    // 64 meaningful bits don't fit in 6 bits and are written as 0
+    writer.write(uint64_t(meaningful & 63), 6);
+    writer.write(x >> trail, meaningful);
+    leading = lead;
+    trailing = trail;
+  }
+};
+
+GorillaEncoder::GorillaEncoder() : n_points(0) {}
+
+GorillaEncoder::~GorillaEncoder() {}
+
+void GorillaEncoder::add(const rpc::Metric& met) {
+  key.clear();
+  put_varint(key, met.namespace__size());
+  for (const rpc::NamespaceElement& nse : met.namespace_()) {
+    put_string(key, nse.value());
+    put_string(key, nse.name());
+  }
+  tags.clear();
+  for (const auto& tag : met.tags()) {
+    tags.emplace_back(&tag.first, &tag.second);
+  }
+  std::sort(tags.begin(), tags.end(), less_key);
+  put_varint(key, tags.size());
+  for (const auto& tag : tags) {
+    put_string(key, *tag.first);
+    put_string(key, *tag.second);
+  }
+  put_string(key, met.unit());
+  put_varint(key, zigzag(uint64_t(met.version())));
+  key.push_back(char(met.data_case()));
+
+  std::unique_ptr<Series>& s = series[key];
+  if (!s) {
+    s.reset(new Series());
+    s->header = key;
+    s->data_case = met.data_case();
+  }
+  if (s->count == 0) {
+    order.push_back(s.get());
+  }
+  s->add(met);
+  n_points++;
+}
+
+void GorillaEncoder::add(const std::vector<Metric>& metrics) {
+  for (const Metric& met : metrics) {
+    add(*met.get_rpc_metric_ptr());
+  }
+}
+
+void GorillaEncoder::finish(TextBuffer& out) {
+  body.clear();
+  put_varint(body, order.size());
+  for (Series* s : order) {
+    body.append(s->header);
+    put_varint(body, s->count);
+    put_varint(body, s->payload.size());
+    body.append(s->payload);
+  }
+
+  char len[4];
+  uint32_t n = uint32_t(body.size());
+  for (int i = 0; i < 4; i++) len[i] = char(n >> (8 * i));
+  out.append(kMagic, sizeof(kMagic));
+  out.append(len, sizeof(len));
+  out.append(body);
+
+  // series that went quiet aren't carried over to the next block
+  series.clear();
+  order.clear();
+  n_points = 0;
+}
+
+/**
+ * Where the decoder is: the current block, series and point.
+ */
+struct GorillaDecoder::State {
+  State() : block(nullptr, 0), series_left(0), points_left(0), count(0) {}
+
+  ByteReader block;
+  size_t series_left;
+  rpc::Metric tmpl;
+  int data_case;
+  size_t points_left;
+  size_t count;
+  BitReader bits;
+  int64_t prev_ts;
+  int64_t prev_delta;
+  uint64_t prev_value;
+  int leading;
+  int trailing;
+  std::string str;
+
+  void read_series() {
+    tmpl.Clear();
+    size_t n_ns = block.varint();
+    for (size_t i = 0; i < n_ns; i++) {
+      rpc::NamespaceElement* nse = tmpl.add_namespace_();
+      block.read_string(nse->mutable_value());
+      block.read_string(nse->mutable_name());
+    }
+    size_t n_tags = block.varint();
+    for (size_t i = 0; i < n_tags; i++) {
+      block.read_string(&str);
+      block.read_string(&(*tmpl.mutable_tags())[str]);
+    }
+    block.read_string(tmpl.mutable_unit());
+    tmpl.set_version(int64_t(unzigzag(block.varint())));
+    data_case = uint8_t(*block.bytes(1));
+    if (data_case != rpc::Metric::DATA_NOT_SET && !is_float(data_case) &&
+        !is_int(data_case) && !is_bytes(data_case) &&
+        data_case != rpc::Metric::kBoolData) {
+      throw PluginException("corrupt gorilla block: unknown data type");
+    }
+    points_left = block.varint();
+    size_t payload_len = block.varint();
+    bits = BitReader(block.bytes(payload_len), payload_len);
+    count = 0;
+  }
+
+  void read_point(rpc::Metric* met) {
+    uint64_t value = 0;
+    int64_t ts;
+    if (count == 0) {
+      ts = int64_t(bits.read(64));
+      prev_delta = 0;
+      leading = -1;
+      if (is_float(data_case)) {
+        value = bits.read(64);
+      } else if (is_int(data_case)) {
+        value = unzigzag(bits.read_varint());
+      }
+    } else {
+      int64_t delta = int64_t(uint64_t(prev_delta) + uint64_t(read_dod()));
+      ts = int64_t(uint64_t(prev_ts) + uint64_t(delta));
+      prev_delta = delta;
+      if (is_float(data_case)) {
+        value = prev_value ^ read_xor();
+      } else if (is_int(data_case)) {
+        value = prev_value + unzigzag(bits.read_varint());
+      }
+    }
+    if (data_case == rpc::Metric::kBoolData) {
+      value = bits.read(1);
+    }
+
+    met->CopyFrom(tmpl);
+    int64_t sec = ts / kNanosPerSec;
+    int64_t nsec = ts % kNanosPerSec;
+    if (nsec < 0) {
+      nsec += kNanosPerSec;
+      sec--;
+    }
+    met->mutable_timestamp()->set_sec(sec);
+    met->mutable_timestamp()->set_nsec(nsec);
+    if (is_bytes(data_case)) {
+      size_t n = bits.read_varint();
+      str.clear();
+      for (size_t i = 0; i < n; i++) str.push_back(char(bits.read(8)));
+      if (data_case == rpc::Metric::kStringData) {
+        met->set_string_data(str);
+      } else {
+        met->set_bytes_data(str);
+      }
+    } else {
+      set_value_bits(met, data_case, value);
+    }
+    prev_ts = ts;
+    prev_value = value;
+    count++;
+    points_left--;
+  }
+
+  int64_t read_dod() {
+    if (!bits.read_bit()) return 0;
+    if (!bits.read_bit()) return int64_t(bits.read(7)) - 63;
+    if (!bits.read_bit()) return int64_t(bits.read(9)) - 255;
+    if (!bits.read_bit()) return int64_t(bits.read(12)) - 2047;
+    if (!bits.read_bit()) return int64_t(bits.read(32)) - 2147483647LL;
+    return int64_t(bits.read(64));
+  }
+
+  uint64_t read_xor() {
+    if (!bits.read_bit()) return 0;
+    if (!bits.read_bit()) {
+      if (leading < 0) {
+        throw PluginException("corrupt gorilla block: no previous window");
+      }
+      return bits.read(64 - leading - trailing) << trailing;
+    }
+    int lead = int(bits.read(5));
+    int meaningful = int(bits.read(6));
+    if (meaningful == 0) meaningful = 64;
+    if (lead + meaningful > 64) {
+      throw PluginException("corrupt gorilla block: bad float window");
+    }
+    leading = lead;
+    trailing = 64 - lead - meaningful;
+    return bits.read(meaningful) << trailing;
+  }
+};
+
+GorillaDecoder::GorillaDecoder(const char* data, size_t len) :
+                               data(data), len(len), pos(0),
+                               state(new State()) {}
+
+GorillaDecoder::~GorillaDecoder() {}
+
+bool GorillaDecoder::next(rpc::Metric* met) {
+  State& st = *state;
+  while (st.points_left == 0) {
+    if (st.series_left > 0) {
+      st.read_series();
+      st.series_left--;
+      continue;
+    }
+    if (pos == len) {
+      return false;
+    }
+    if (len - pos < 8 || std::memcmp(data + pos, kMagic, 4) != 0) {
+      throw PluginException("corrupt gorilla block: bad header");
+    }
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data + pos + 4);
+    size_t body_len = uint32_t(p[0]) | uint32_t(p[1]) << 8 |
+                      uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+    if (len - pos - 8 < body_len) {
+      throw PluginException("corrupt gorilla block: truncated");
+    }
+    st.block = ByteReader(data + pos + 8, body_len);
+    pos += 8 + body_len;
+    st.series_left = st.block.varint();
+  }
+  st.read_point(met);
+  return true;
+}
+
+GorillaPublisher::GorillaPublisher(FileSink* sink, const std::string& key) :
+                                   sink(sink), key(key) {}
+
+const ConfigPolicy GorillaPublisher::get_config_policy() {
+  ConfigPolicy policy(Plugin::StringRule{key, true});
+  return policy;
+}
+
+void GorillaPublisher::publish_metrics(std::vector<Metric> &metrics,
+                                       const Config& config) {
+  std::lock_guard<std::mutex> lk(mtx);
+  sink->write(config, key, [&](TextBuffer& out) {
+    encoder.add(metrics);
+    encoder.finish(out);
+  });
+}
+
+void GorillaPublisher::kill(const std::string& reason) {
+  sink->flush();
+}
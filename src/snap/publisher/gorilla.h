@@ -0,0 +1,156 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+#include "snap/publisher/file_sink.h"
+#include "snap/publisher/text_buffer.h"
+#include "snap/rpc/plugin.pb.h"
+
+namespace Plugin {
+
+/**
+ * GorillaEncoder packs metrics into compressed blocks, after Facebook's
+ * Gorilla paper ("Gorilla: A Fast, Scalable, In-Memory Time Series
+ * Database", VLDB 2015).
+ *
+ * Metrics are grouped into series by namespace, tags, unit, version and data
+ * type. Each series is written once per block, followed by its points:
+ * timestamps as delta-of-deltas, floats XORed with the previous value,
+ * integers as zigzag varint deltas, and strings verbatim. A series that
+ * reports on a steady interval with slowly changing values costs a few bits
+ * per point instead of a full rpc::Metric.
+ *
+ * Only the fields named above and the timestamp and data are kept; metric
+ * descriptions, namespace element descriptions, config and last advertised
+ * time are dropped.
+ *
+ * Block layout, integers as varints unless noted:
+ *   "SGB1" | body length (fixed32, little-endian) | series count |
+ *   per series: namespace (count, then value and name of each) |
+ *               tags (count, then key and value of each, sorted by key) |
+ *               unit | version (zigzag) | data case (1 byte) |
+ *               point count | payload length | payload bits
+ * with strings written as length and bytes.
+ */
+class GorillaEncoder final {
+ public:
+  GorillaEncoder();
+  ~GorillaEncoder();
+
+  GorillaEncoder(const GorillaEncoder&) = delete;
+  GorillaEncoder& operator=(const GorillaEncoder&) = delete;
+
+  void add(const rpc::Metric& met);
+  void add(const std::vector<Metric>& metrics);
+
+  /**
+   * points returns the number of metrics added since the last finish.
+   */
+  size_t points() const { return n_points; }
+
+  /**
+   * finish appends a block holding every metric added since the last
+   * finish to out, and starts a new one.
+   */
+  void finish(TextBuffer& out);
+
+ private:
+  struct Series;
+
+  std::unordered_map<std::string, std::unique_ptr<Series>> series;
+  // series in the order they were first seen in this block
+  std::vector<Series*> order;
+  size_t n_points;
+  // reused to build series keys and the block body
+  std::vector<std::pair<const std::string*, const std::string*>> tags;
+  std::string key;
+  std::string body;
+};
+
+/**
+ * GorillaDecoder reads the metrics back from a buffer of consecutive blocks,
+ * one at a time, series by series.
+ *
+ * Corrupt or truncated input is reported as PluginException.
+ */
+class GorillaDecoder final {
+ public:
+  /**
+   * The buffer is not copied and must outlive the decoder.
+   */
+  GorillaDecoder(const char* data, size_t len);
+  ~GorillaDecoder();
+
+  GorillaDecoder(const GorillaDecoder&) = delete;
+  GorillaDecoder& operator=(const GorillaDecoder&) = delete;
+
+  /**
+   * next fills met with the next metric, reusing its storage, and returns
+   * false at the end of the buffer.
+   */
+  bool next(rpc::Metric* met);
+
+ private:
+  struct State;
+
+  const char* data;
+  size_t len;
+  size_t pos;
+  std::unique_ptr<State> state;
+};
+
+/**
+ * GorillaPublisher writes each batch as one GorillaEncoder block to the file
+ * named by the string config value under key, through a FileSink.
+ *
+ * E.g.:
+ *   Plugin::FileSink sink(Plugin::FileSink::Options());
+ *   Plugin::GorillaPublisher plg(&sink);
+ *   Plugin::start_publisher(&plg, meta);
+ */
+class GorillaPublisher final : public PublisherInterface {
+ public:
+  /**
+   * The sink is not owned and must outlive the GorillaPublisher.
+   */
+  explicit GorillaPublisher(FileSink* sink, const std::string& key = "path");
+
+  const ConfigPolicy get_config_policy();
+
+  void publish_metrics(std::vector<Metric> &metrics, const Config& config);
+
+  /**
+   * kill flushes the FileSink.
+   */
+  void kill(const std::string& reason);
+
+ private:
+  FileSink* sink;
+  std::string key;
+  std::mutex mtx;
+  GorillaEncoder encoder;
+};
+
+}  // namespace Plugin
@@ -0,0 +1,481 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/publisher/spool.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/io/coded_stream.h>
+
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::uint8;
+
+using Plugin::Config;
+using Plugin::ConfigPolicy;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::Spool;
+using Plugin::SpoolingPublisher;
+
+namespace {
+
+/**
+ * Segment file layout:
+ *   [SegmentHeader][record]...[zeros]
+ * Record layout, 8-byte aligned:
+ *   [RecordHeader][serialized rpc::PubProcArg]
+ * A zero length marks the end of the written records.
+ */
+const char kSegmentMagic[8] = {'S', 'N', 'A', 'P', 'S', 'P', 'L', '1'};
+const size_t kSegmentHeaderBytes = 64;
+const uint32_t kRecordPending = 0;
+const uint32_t kRecordAcked = 1;
+const uint32_t kRecordFailed = 2;
+
+// wire tags of rpc::PubProcArg's Metrics (1) and Config (2) fields
+const uint8 kMetricsTag = (1 << 3) | 2;
+const uint8 kConfigTag = (2 << 3) | 2;
+
+struct SegmentHeader {
+  char magic[8];
+  uint64_t seq;
+};
+
+struct RecordHeader {
+  uint32_t length;
+  uint32_t crc;
+  uint32_t state;
+  // failed replays so far
+  uint32_t attempts;
+};
+
+size_t record_bytes(size_t payload) {
+  return (sizeof(RecordHeader) + payload + 7) & ~size_t(7);
+}
+
+const uint32_t* crc32c_table() {
+  static uint32_t table[256];
+  static bool ready = [] {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+      }
+      table[i] = c;
+    }
+    return true;
+  }();
+  (void)ready;
+  return table;
+}
+
+uint32_t crc32c(const char* data, size_t len) {
+  const uint32_t* table = crc32c_table();
+  uint32_t c = 0xffffffff;
+  for (size_t i = 0; i < len; i++) {
+    c = table[(c ^ uint8(data[i])) & 0xff] ^ (c >> 8);
+  }
+  return c ^ 0xffffffff;
+}
+
+void throw_errno(const std::string& what, const std::string& path) {
+  throw PluginException(what + " " + path + ": " + std::strerror(errno));
+}
+
+std::string segment_name(uint64_t seq) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%020llu.seg", (unsigned long long)seq);
+  return name;
+}
+
+bool parse_segment_name(const char* name, uint64_t* seq) {
+  char* end = nullptr;
+  unsigned long long v = std::strtoull(name, &end, 10);
+  if (end == name || std::strcmp(end, ".seg") != 0) {
+    return false;
+  }
+  *seq = v;
+  return true;
+}
+
+}  // namespace
+
+struct Spool::Segment {
+  uint64_t seq;
+  std::string path;
+  int fd;
+  char* base;
+  size_t size;
+  size_t write_off;
+  size_t read_off;
+  size_t pending;
+};
+
+Spool::Options::Options(const std::string& dir) :
+                          dir(dir),
+                          segment_bytes(64 << 20),
+                          max_segments(16),
+                          sync(false),
+                          max_attempts(10) {}
+
+Spool::Spool(const Options& opts) : opts(opts),
+                                    next_seq(0),
+                                    pending_count(0),
+                                    dropped_count(0),
+                                    failed_count(0) {
+  long page = sysconf(_SC_PAGESIZE);
+  this->opts.segment_bytes = std::max(this->opts.segment_bytes,
+                                      kSegmentHeaderBytes + 4096);
+  this->opts.segment_bytes = (this->opts.segment_bytes + page - 1) /
+                             page * page;
+  // record lengths are stored in 32 bits
+  this->opts.segment_bytes = std::min<size_t>(this->opts.segment_bytes,
+                                              UINT32_MAX / page * page);
+  this->opts.max_segments = std::max<size_t>(this->opts.max_segments, 1);
+  recover();
+}
+
+Spool::~Spool() {
+  for (auto& seg : segments) {
+    close_segment(seg.get(), false);
+  }
+}
+
+void Spool::append(const std::vector<Metric>& metrics, const Config& config) {
+  std::lock_guard<std::mutex> lk(mtx);
+
+  // ByteSize caches each message's size for SerializeWithCachedSizesToArray.
+  size_t payload = 0;
+  for (const Metric& met : metrics) {
+    uint32_t sz = met.get_rpc_metric_ptr()->ByteSize();
+    payload += 1 + CodedOutputStream::VarintSize32(sz) + sz;
+  }
+  const rpc::ConfigMap& cfg = config.get_rpc_config_map();
+  uint32_t cfg_sz = cfg.ByteSize();
+  payload += 1 + CodedOutputStream::VarintSize32(cfg_sz) + cfg_sz;
+
+  Segment* seg = writable_segment(record_bytes(payload));
+  char* rec = seg->base + seg->write_off;
+  RecordHeader* hdr = reinterpret_cast<RecordHeader*>(rec);
+  uint8* out = reinterpret_cast<uint8*>(rec + sizeof(RecordHeader));
+  for (const Metric& met : metrics) {
+    const rpc::Metric* rpc_met = met.get_rpc_metric_ptr();
+    *out++ = kMetricsTag;
+    out = CodedOutputStream::WriteVarint32ToArray(rpc_met->GetCachedSize(),
+                                                  out);
+    out = rpc_met->SerializeWithCachedSizesToArray(out);
+  }
+  *out++ = kConfigTag;
+  out = CodedOutputStream::WriteVarint32ToArray(cfg_sz, out);
+  cfg.SerializeWithCachedSizesToArray(out);
+
+  hdr->crc = crc32c(rec + sizeof(RecordHeader), payload);
+  hdr->state = kRecordPending;
+  hdr->attempts = 0;
+  // the length goes in last: a record without one was never written
+  hdr->length = uint32_t(payload);
+
+  if (opts.sync) {
+    long page = sysconf(_SC_PAGESIZE);
+    size_t start = seg->write_off / page * page;
+    size_t end = seg->write_off + record_bytes(payload);
+    if (msync(seg->base + start, end - start, MS_SYNC) != 0) {
+      throw_errno("cannot sync spool segment", seg->path);
+    }
+  }
+  seg->write_off += record_bytes(payload);
+  seg->pending++;
+  pending_count++;
+}
+
+size_t Spool::replay(const ReplayFunc& fn) {
+  std::lock_guard<std::mutex> lk(mtx);
+  size_t delivered = 0;
+
+  while (!segments.empty()) {
+    Segment* seg = segments.front().get();
+    while (seg->read_off < seg->write_off) {
+      RecordHeader* hdr = reinterpret_cast<RecordHeader*>(seg->base +
+                                                          seg->read_off);
+      size_t rec = record_bytes(hdr->length);
+      if (hdr->state != kRecordPending) {
+        seg->read_off += rec;
+        continue;
+      }
+
+      uint32_t state = kRecordAcked;
+      // Clear keeps the previously allocated metrics around for reuse.
+      scratch.Clear();
+      const char* payload = seg->base + seg->read_off + sizeof(RecordHeader);
+      if (scratch.ParseFromArray(payload, hdr->length)) {
+        std::vector<Metric> metrics;
+        metrics.reserve(scratch.metrics_size());
+        for (int i = 0; i < scratch.metrics_size(); i++) {
+          metrics.emplace_back(scratch.mutable_metrics(i));
+        }
+        Config config(scratch.config());
+        try {
+          fn(metrics, config);
+          delivered++;
+        } catch (...) {
+          if (++hdr->attempts < opts.max_attempts || opts.max_attempts == 0) {
+            throw;
+          }
+          state = kRecordFailed;
+          failed_count++;
+        }
+      } else {
+        dropped_count++;
+      }
+
+      hdr->state = state;
+      seg->read_off += rec;
+      seg->pending--;
+      pending_count--;
+    }
+
+    // the newest segment stays open for appends
+    if (segments.size() == 1) {
+      break;
+    }
+    close_segment(seg, true);
+    segments.pop_front();
+  }
+  return delivered;
+}
+
+size_t Spool::pending() const {
+  std::lock_guard<std::mutex> lk(mtx);
+  return pending_count;
+}
+
+uint64_t Spool::dropped() const {
+  std::lock_guard<std::mutex> lk(mtx);
+  return dropped_count;
+}
+
+uint64_t Spool::failed() const {
+  std::lock_guard<std::mutex> lk(mtx);
+  return failed_count;
+}
+
+void Spool::recover() {
+  DIR* dir = opendir(opts.dir.c_str());
+  if (dir == nullptr) {
+    throw_errno("cannot open spool directory", opts.dir);
+  }
+  std::vector<uint64_t> seqs;
+  while (struct dirent* ent = readdir(dir)) {
+    uint64_t seq;
+    if (parse_segment_name(ent->d_name, &seq)) {
+      seqs.push_back(seq);
+    }
+  }
+  closedir(dir);
+  std::sort(seqs.begin(), seqs.end());
+
+  for (uint64_t seq : seqs) {
+    next_seq = seq + 1;
+    Segment* seg = open_segment(seq, false);
+    if (seg == nullptr) {
+      continue;
+    }
+
+    size_t off = kSegmentHeaderBytes;
+    bool torn = false;
+    bool read_set = false;
+    while (off + sizeof(RecordHeader) <= seg->size) {
+      RecordHeader* hdr = reinterpret_cast<RecordHeader*>(seg->base + off);
+      if (hdr->length == 0) {
+        break;
+      }
+      size_t rec = record_bytes(hdr->length);
+      if (off + rec > seg->size ||
+          crc32c(seg->base + off + sizeof(RecordHeader), hdr->length) !=
+              hdr->crc) {
+        torn = true;
+        break;
+      }
+      if (hdr->state == kRecordPending) {
+        seg->pending++;
+        if (!read_set) {
+          seg->read_off = off;
+          read_set = true;
+        }
+      }
+      off += rec;
+    }
+    seg->write_off = off;
+    if (!read_set) {
+      seg->read_off = off;
+    }
+    if (torn) {
+      // appends land here next; clear the remains of the torn record so they
+      // can't be mistaken for a header later
+      std::memset(seg->base + off, 0, seg->size - off);
+    }
+    pending_count += seg->pending;
+  }
+
+  // fully replayed segments are no longer needed, except the newest one which
+  // keeps taking appends
+  while (segments.size() > 1 && segments.front()->pending == 0) {
+    close_segment(segments.front().get(), true);
+    segments.pop_front();
+  }
+}
+
+Spool::Segment* Spool::open_segment(uint64_t seq, bool create) {
+  std::unique_ptr<Segment> seg(new Segment());
+  seg->seq = seq;
+  seg->path = opts.dir + "/" + segment_name(seq);
+  seg->fd = open(seg->path.c_str(),
+                 O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0), 0644);
+  if (seg->fd < 0) {
+    throw_errno("cannot open spool segment", seg->path);
+  }
+
+  if (create) {
+    if (ftruncate(seg->fd, opts.segment_bytes) != 0) {
+      close(seg->fd);
+      throw_errno("cannot size spool segment", seg->path);
+    }
+    seg->size = opts.segment_bytes;
+  } else {
+    struct stat st;
+    if (fstat(seg->fd, &st) != 0) {
+      close(seg->fd);
+      throw_errno("cannot stat spool segment", seg->path);
+    }
+    seg->size = st.st_size;
+    if (seg->size < kSegmentHeaderBytes + sizeof(RecordHeader)) {
+      close(seg->fd);
+      return nullptr;
+    }
+  }
+
+  void* base = mmap(nullptr, seg->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    seg->fd, 0);
+  if (base == MAP_FAILED) {
+    close(seg->fd);
+    throw_errno("cannot map spool segment", seg->path);
+  }
+  seg->base = static_cast<char*>(base);
+
+  SegmentHeader* hdr = reinterpret_cast<SegmentHeader*>(seg->base);
+  if (create) {
+    std::memcpy(hdr->magic, kSegmentMagic, sizeof(kSegmentMagic));
+    hdr->seq = seq;
+  } else if (std::memcmp(hdr->magic, kSegmentMagic,
+                         sizeof(kSegmentMagic)) != 0) {
+    close_segment(seg.get(), false);
+    return nullptr;
+  }
+  seg->write_off = kSegmentHeaderBytes;
+  seg->read_off = kSegmentHeaderBytes;
+  seg->pending = 0;
+
+  segments.push_back(std::move(seg));
+  return segments.back().get();
+}
+
+void Spool::close_segment(Segment* seg, bool unlink) {
+  munmap(seg->base, seg->size);
+  close(seg->fd);
+  if (unlink) {
+    ::unlink(seg->path.c_str());
+  }
+}
+
+Spool::Segment* Spool::writable_segment(size_t rec) {
+  if (kSegmentHeaderBytes + rec > opts.segment_bytes) {
+    throw PluginException("batch of " + std::to_string(rec) +
+                          " bytes does not fit in a spool segment");
+  }
+  if (!segments.empty()) {
+    Segment* seg = segments.back().get();
+    // keep room for the zero length that terminates the segment
+    if (seg->write_off + rec + sizeof(RecordHeader) <= seg->size ||
+        seg->write_off + rec == seg->size) {
+      return seg;
+    }
+  }
+
+  Segment* seg = open_segment(next_seq++, true);
+  while (segments.size() > opts.max_segments) {
+    Segment* oldest = segments.front().get();
+    dropped_count += oldest->pending;
+    pending_count -= oldest->pending;
+    close_segment(oldest, true);
+    segments.pop_front();
+  }
+  return seg;
+}
+
+SpoolingPublisher::SpoolingPublisher(PublisherInterface* sink, Spool* spool) :
+                                       sink(sink),
+                                       spool(spool) {}
+
+const ConfigPolicy SpoolingPublisher::get_config_policy() {
+  return sink->get_config_policy();
+}
+
+void SpoolingPublisher::publish_metrics(std::vector<Metric> &metrics,
+                                        const Config& config) {
+  std::lock_guard<std::mutex> lk(mtx);
+  // new data may only go straight to the sink once the backlog is gone
+  if (!drain()) {
+    spool->append(metrics, config);
+    return;
+  }
+  try {
+    sink->publish_metrics(metrics, config);
+  } catch (PluginException &e) {
+    spool->append(metrics, config);
+  }
+}
+
+void SpoolingPublisher::kill(const std::string& reason) {
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    drain();
+  }
+  sink->kill(reason);
+}
+
+bool SpoolingPublisher::drain() {
+  if (spool->pending() == 0) {
+    return true;
+  }
+  try {
+    spool->replay([this](std::vector<Metric>& metrics, const Config& config) {
+      sink->publish_metrics(metrics, config);
+    });
+    return true;
+  } catch (PluginException &e) {
+    return false;
+  }
+}
@@ -0,0 +1,163 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "snap/rpc/plugin.pb.h"
+
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+
+namespace Plugin {
+
+/**
+ * Spool is a durable, append-only queue of metric batches kept in
+ * memory-mapped segment files under a directory.
+ *
+ * Each append stores one record: a serialized rpc::PubProcArg holding the
+ * batch's metrics and config, preceded by its length and a CRC32C. Records are
+ * replayed oldest first. Replay parses each record straight out of the mapping
+ * into a reused message, so draining a large backlog does not copy it through
+ * heap buffers. Records that were replayed successfully are marked in place,
+ * so a restarted plugin resumes where the previous one stopped. Unless
+ * Options::sync is set those marks may be lost in a crash, in which case the
+ * affected batches are delivered again.
+ *
+ * Disk use is capped at max_segments * segment_bytes; when a new segment is
+ * needed past the cap the oldest one is discarded and its unreplayed records
+ * are counted in dropped(). Torn or corrupted records (CRC mismatch) end the
+ * segment they are found in.
+ *
+ * A record rejected by max_attempts replays in a row is marked failed,
+ * skipped and counted in failed(), so one batch the sink never accepts
+ * can't hold back the ones behind it. Attempts are kept in the record, and
+ * a sink that is down altogether uses them up too, one per replay.
+ *
+ * Errors from the filesystem are thrown as PluginException.
+ */
+class Spool final {
+ public:
+  struct Options {
+    explicit Options(const std::string& dir);
+
+    /** directory holding the segment files; must exist */
+    std::string dir;
+    /**
+     * size of each segment file, rounded up to the page size and capped
+     * below 4 GiB
+     */
+    size_t segment_bytes;
+    /** number of segments kept before the oldest is discarded */
+    size_t max_segments;
+    /** msync each record after it is appended */
+    bool sync;
+    /** replays a record may fail before it is skipped; zero never skips */
+    uint32_t max_attempts;
+  };
+
+  typedef std::function<void(std::vector<Metric>& metrics,
+                              const Config& config)> ReplayFunc;
+
+  /**
+   * Opens the spool, recovering records left by a previous process.
+   */
+  explicit Spool(const Options& opts);
+
+  ~Spool();
+
+  Spool(const Spool&) = delete;
+  Spool& operator=(const Spool&) = delete;
+
+  /**
+   * append stores the batch. It throws PluginException when the batch does
+   * not fit in a single segment.
+   */
+  void append(const std::vector<Metric>& metrics, const Config& config);
+
+  /**
+   * replay hands pending batches to fn in the order they were appended and
+   * returns how many were delivered. If fn throws, the batch it was given
+   * stays pending and the exception is rethrown, unless that was the
+   * batch's last attempt: then it is marked failed and replay moves on.
+   */
+  size_t replay(const ReplayFunc& fn);
+
+  /** pending returns the number of batches not yet replayed. */
+  size_t pending() const;
+
+  /** dropped returns the number of batches discarded by the size cap. */
+  uint64_t dropped() const;
+
+  /** failed returns the number of batches skipped after max_attempts. */
+  uint64_t failed() const;
+
+ private:
+  struct Segment;
+
+  Options opts;
+  mutable std::mutex mtx;
+  std::deque<std::unique_ptr<Segment>> segments;
+  uint64_t next_seq;
+  size_t pending_count;
+  uint64_t dropped_count;
+  uint64_t failed_count;
+  rpc::PubProcArg scratch;
+
+  void recover();
+  Segment* open_segment(uint64_t seq, bool create);
+  void close_segment(Segment* seg, bool unlink);
+  Segment* writable_segment(size_t record_bytes);
+};
+
+/**
+ * SpoolingPublisher stores batches in a Spool while the wrapped publisher is
+ * failing, and replays them ahead of new data once it recovers.
+ *
+ * A batch that the wrapped publisher rejects with PluginException is spooled
+ * and the call reports success to snapteld, since the data is now safe on
+ * disk. Spooled batches are retried at the start of each publish_metrics and
+ * on kill, until the spool skips them after Options::max_attempts.
+ */
+class SpoolingPublisher final : public PublisherInterface {
+ public:
+  /**
+   * Neither the sink nor the spool are owned; both must outlive the
+   * SpoolingPublisher.
+   */
+  SpoolingPublisher(PublisherInterface* sink, Spool* spool);
+
+  const ConfigPolicy get_config_policy();
+
+  void publish_metrics(std::vector<Metric> &metrics, const Config& config);
+
+  void kill(const std::string& reason);
+
+ private:
+  PublisherInterface* sink;
+  Spool* spool;
+  // keeps spooled and fresh batches in order
+  std::mutex mtx;
+
+  bool drain();
+};
+
+}  // namespace Plugin
@@ -0,0 +1,228 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/publisher/text_buffer.h"
+
+#if defined(__has_include)
+#if __has_include(<version>)
+#include <version>
+#endif
+#endif
+
+#if defined(__cpp_lib_to_chars)
+#include <charconv>
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+using std::chrono::duration_cast;
+using std::chrono::seconds;
+using std::chrono::system_clock;
+
+using Plugin::TextBuffer;
+
+static const char kDigitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/**
+ * Writes value right-aligned so that it ends at end; returns the first digit.
+ */
+static char* format_uint(uint64_t value, char* end) {
+  char* p = end;
+  while (value >= 100) {
+    unsigned idx = unsigned(value % 100) * 2;
+    value /= 100;
+    *--p = kDigitPairs[idx + 1];
+    *--p = kDigitPairs[idx];
+  }
+  if (value >= 10) {
+    unsigned idx = unsigned(value) * 2;
+    *--p = kDigitPairs[idx + 1];
+    *--p = kDigitPairs[idx];
+  } else {
+    *--p = char('0' + value);
+  }
+  return p;
+}
+
+static void put_2digits(char* p, unsigned value) {
+  p[0] = kDigitPairs[value * 2];
+  p[1] = kDigitPairs[value * 2 + 1];
+}
+
+#if !defined(__cpp_lib_to_chars)
+static const double kPow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13,
+  1e14, 1e15, 1e16, 1e17
+};
+
+/**
+ * Without to_chars, snprintf plus a strtod round-trip check costs several
+ * hundred nanoseconds. Most metric values are short decimals, so first look
+ * for the fewest fraction digits k for which round(value * 10^k) / 10^k gives
+ * back value; both that division and strtod round correctly, so the decimal
+ * string reads back exactly. Returns the length written to out, or 0 if the
+ * value needs the general path.
+ */
+static int format_short_fixed(double value, bool is_float, char* out) {
+  double mag = std::fabs(value);
+  if (!(mag >= 1e-6 && mag < 1e15) && value != 0) {
+    return 0;
+  }
+  for (int k = 0; k <= 17; k++) {
+    double scaled = mag * kPow10[k];
+    if (scaled >= 9007199254740992.0) {  // 2^53
+      return 0;
+    }
+    double digits = std::floor(scaled + 0.5);
+    double back = digits / kPow10[k];
+    if (is_float ? float(back) != float(mag) : back != mag) {
+      continue;
+    }
+
+    char tmp[24];
+    char* end = tmp + sizeof(tmp);
+    char* p = format_uint(uint64_t(digits), end);
+    // left-pad with zeros so there is at least one digit before the point
+    while (end - p <= k) *--p = '0';
+    char* o = out;
+    if (std::signbit(value)) *o++ = '-';
+    size_t int_len = (end - p) - k;
+    std::memcpy(o, p, int_len);
+    o += int_len;
+    if (k > 0) {
+      *o++ = '.';
+      std::memcpy(o, p + int_len, k);
+      o += k;
+    }
+    return int(o - out);
+  }
+  return 0;
+}
+#endif
+
+TextBuffer::TextBuffer() : cached_sec(std::numeric_limits<int64_t>::min()) {}
+
+TextBuffer::TextBuffer(size_t capacity) :
+                         cached_sec(std::numeric_limits<int64_t>::min()) {
+  buf.reserve(capacity);
+}
+
+void TextBuffer::append_int(int64_t value) {
+  char tmp[24];
+  char* end = tmp + sizeof(tmp);
+  // negate in unsigned arithmetic so INT64_MIN doesn't overflow
+  uint64_t mag = value < 0 ? 0 - uint64_t(value) : uint64_t(value);
+  char* p = format_uint(mag, end);
+  if (value < 0) *--p = '-';
+  buf.append(p, end - p);
+}
+
+void TextBuffer::append_uint(uint64_t value) {
+  char tmp[24];
+  char* end = tmp + sizeof(tmp);
+  char* p = format_uint(value, end);
+  buf.append(p, end - p);
+}
+
+void TextBuffer::append_double(double value) {
+  char tmp[32];
+#if defined(__cpp_lib_to_chars)
+  std::to_chars_result res = std::to_chars(tmp, tmp + sizeof(tmp), value);
+  buf.append(tmp, res.ptr - tmp);
+#else
+  int len = format_short_fixed(value, false, tmp);
+  if (len == 0) {
+    len = std::snprintf(tmp, sizeof(tmp), "%.15g", value);
+    if (std::isfinite(value) && std::strtod(tmp, nullptr) != value) {
+      len = std::snprintf(tmp, sizeof(tmp), "%.17g", value);
+    }
+  }
+  buf.append(tmp, len);
+#endif
+}
+
+void TextBuffer::append_float(float value) {
+  char tmp[32];
+#if defined(__cpp_lib_to_chars)
+  std::to_chars_result res = std::to_chars(tmp, tmp + sizeof(tmp), value);
+  buf.append(tmp, res.ptr - tmp);
+#else
+  int len = format_short_fixed(value, true, tmp);
+  if (len == 0) {
+    len = std::snprintf(tmp, sizeof(tmp), "%.6g", value);
+    if (std::isfinite(value) && std::strtof(tmp, nullptr) != value) {
+      len = std::snprintf(tmp, sizeof(tmp), "%.9g", value);
+    }
+  }
+  buf.append(tmp, len);
+#endif
+}
+
+void TextBuffer::append_utc_time(system_clock::time_point tp) {
+  int64_t secs = duration_cast<seconds>(tp.time_since_epoch()).count();
+  if (tp.time_since_epoch() < system_clock::duration::zero() &&
+      system_clock::time_point(seconds(secs)) != tp) {
+    secs--;  // round toward the earlier second like gmtime does
+  }
+  if (secs != cached_sec) {
+    int64_t days = secs / 86400;
+    int64_t rem = secs % 86400;
+    if (rem < 0) {
+      rem += 86400;
+      days--;
+    }
+
+    // civil-from-days, see http://howardhinnant.github.io/date_algorithms.html
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned doe = unsigned(days - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t year = int64_t(yoe) + era * 400;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    unsigned day = doy - (153 * mp + 2) / 5 + 1;
+    unsigned month = mp < 10 ? mp + 3 : mp - 9;
+    if (month <= 2) year++;
+
+    unsigned y = unsigned(year < 0 ? 0 : year % 10000);
+    put_2digits(cached_time, y / 100);
+    put_2digits(cached_time + 2, y % 100);
+    cached_time[4] = '-';
+    put_2digits(cached_time + 5, month);
+    cached_time[7] = '-';
+    put_2digits(cached_time + 8, day);
+    cached_time[10] = ' ';
+    put_2digits(cached_time + 11, unsigned(rem / 3600));
+    cached_time[13] = ':';
+    put_2digits(cached_time + 14, unsigned(rem / 60 % 60));
+    cached_time[16] = ':';
+    put_2digits(cached_time + 17, unsigned(rem % 60));
+    cached_sec = secs;
+  }
+  buf.append(cached_time, sizeof(cached_time));
+}
@@ -0,0 +1,79 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace Plugin {
+
+/**
+ * TextBuffer is a growable, contiguous output buffer with fast number and
+ * time formatting, meant to replace std::ostream in publishers.
+ *
+ * clear() keeps the allocated capacity, so a buffer reused across publish
+ * calls stops allocating once it has grown to the usual batch size.
+ */
+class TextBuffer final {
+ public:
+  TextBuffer();
+  explicit TextBuffer(size_t capacity);
+
+  void append(const char* data, size_t len) { buf.append(data, len); }
+  void append(const std::string& str) { buf.append(str); }
+  void append(char c) { buf.push_back(c); }
+
+  void append_int(int64_t value);
+  void append_uint(uint64_t value);
+
+  /**
+   * append_double writes the shortest representation that reads back as the
+   * same double ("0.1", "1e+21", "nan", "inf").
+   */
+  void append_double(double value);
+
+  /**
+   * append_float is append_double for float32 data, so a float prints as
+   * "0.1" rather than as its exact double value.
+   */
+  void append_float(float value);
+
+  /**
+   * append_utc_time writes tp as "YYYY-MM-DD HH:MM:SS" in UTC, the format of
+   * strftime's "%F %T". The last formatted second is cached, since metrics in
+   * a batch tend to share it.
+   */
+  void append_utc_time(std::chrono::system_clock::time_point tp);
+
+  const char* data() const { return buf.data(); }
+  size_t size() const { return buf.size(); }
+  bool empty() const { return buf.empty(); }
+  void clear() { buf.clear(); }
+  void reserve(size_t capacity) { buf.reserve(capacity); }
+
+  /**
+   * consume drops the first len bytes, keeping the rest for later.
+   */
+  void consume(size_t len) { buf.erase(0, len); }
+
+  const std::string& str() const { return buf; }
+
+ private:
+  std::string buf;
+  int64_t cached_sec;
+  char cached_time[19];
+};
+
+}  // namespace Plugin
@@ -0,0 +1,376 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/stats.h"
+
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "snap/plugin.h"
+
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+using std::string;
+
+using Plugin::Counter;
+using Plugin::Gauge;
+using Plugin::Histogram;
+using Plugin::PluginException;
+using Plugin::RpcCall;
+using Plugin::Stats;
+using Plugin::TextBuffer;
+
+namespace {
+
+const char* const kMethodNames[Plugin::kRpcMethods] = {
+  "CollectMetrics", "GetMetricTypes", "Process", "Publish",
+  "GetConfigPolicy", "Kill",
+};
+
+std::atomic<unsigned> next_shard(0);
+
+// threads take shards round robin, the first time they touch any
+unsigned thread_shard() {
+  static thread_local unsigned shard =
+      next_shard.fetch_add(1, std::memory_order_relaxed);
+  return shard;
+}
+
+struct Series {
+  uint64_t id;
+  string name;
+  string help;
+  Stats::Type type;
+  Stats::Read read;
+  Stats::Labels labels;
+};
+
+struct Registry {
+  Registry() : next_id(1) {}
+
+  std::mutex mtx;
+  std::vector<Series> series;
+  uint64_t next_id;
+};
+
+Registry& registry() {
+  static Registry* r = new Registry();
+  return *r;
+}
+
+bool valid_name(const string& name) {
+  if (name.empty() || (name[0] >= '0' && name[0] <= '9')) return false;
+  for (char c : name) {
+    bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9') || c == '_' || c == ':';
+    if (!ok) return false;
+  }
+  return true;
+}
+
+void append_value(TextBuffer& out, double value) {
+  if (std::isnan(value)) {
+    out.append("NaN", 3);
+  } else if (std::isinf(value)) {
+    out.append(value > 0 ? "+Inf" : "-Inf", 4);
+  } else {
+    out.append_double(value);
+  }
+}
+
+void append_escaped(TextBuffer& out, const string& str, bool label) {
+  for (char c : str) {
+    if (c == '\\') {
+      out.append("\\\\", 2);
+    } else if (c == '\n') {
+      out.append("\\n", 2);
+    } else if (c == '"' && label) {
+      out.append("\\\"", 2);
+    } else {
+      out.append(c);
+    }
+  }
+}
+
+void append_header(TextBuffer& out, const string& name, const string& help,
+                   const char* type) {
+  out.append("# HELP ", 7);
+  out.append(name);
+  out.append(' ');
+  append_escaped(out, help, false);
+  out.append("\n# TYPE ", 8);
+  out.append(name);
+  out.append(' ');
+  out.append(type);
+  out.append('\n');
+}
+
+// name{method="...",extra} value
+void append_sample(TextBuffer& out, const string& name, const char* method,
+                   const char* extra, double value) {
+  out.append(name);
+  out.append("{method=\"", 9);
+  out.append(method);
+  out.append('"');
+  if (extra) out.append(extra);
+  out.append("} ", 2);
+  append_value(out, value);
+  out.append('\n');
+}
+
+double resident_bytes() {
+  FILE* f = std::fopen("/proc/self/statm", "r");
+  if (!f) return NAN;
+  unsigned long size = 0, resident = 0;
+  int n = std::fscanf(f, "%lu %lu", &size, &resident);
+  std::fclose(f);
+  if (n != 2) return NAN;
+  return double(resident) * sysconf(_SC_PAGESIZE);
+}
+
+}  // namespace
+
+const double Histogram::kBounds[Histogram::kBuckets] = {
+  0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1,
+  0.25, 0.5, 1, 2.5, 5, 10, INFINITY,
+};
+
+Counter::Counter() {
+  for (Shard& shard : shards) shard.n.store(0, std::memory_order_relaxed);
+}
+
+void Counter::add(uint64_t n) {
+  shards[thread_shard() % kShards].n.fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64_t Counter::value() const {
+  uint64_t sum = 0;
+  for (const Shard& shard : shards) {
+    sum += shard.n.load(std::memory_order_relaxed);
+  }
+  return sum;
+}
+
+Gauge::Gauge() {
+  for (Shard& shard : shards) shard.n.store(0, std::memory_order_relaxed);
+}
+
+void Gauge::add(int64_t n) {
+  shards[thread_shard() % kShards].n.fetch_add(n, std::memory_order_relaxed);
+}
+
+int64_t Gauge::value() const {
+  int64_t sum = 0;
+  for (const Shard& shard : shards) {
+    sum += shard.n.load(std::memory_order_relaxed);
+  }
+  return sum;
+}
+
+Histogram::Histogram() {
+  for (Shard& shard : shards) {
+    for (auto& bucket : shard.buckets) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    shard.sum_ns.store(0, std::memory_order_relaxed);
+  }
+}
+
+void Histogram::observe(nanoseconds took) {
+  double seconds = took.count() / 1e9;
+  int bucket = 0;
+  while (seconds > kBounds[bucket]) bucket++;
+  Shard& shard = shards[thread_shard() % kShards];
+  shard.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  shard.sum_ns.fetch_add(took.count() > 0 ? took.count() : 0,
+                         std::memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+  Snapshot snap = {{0}, 0, 0};
+  uint64_t sum_ns = 0;
+  for (const Shard& shard : shards) {
+    for (int i = 0; i < kBuckets; i++) {
+      uint64_t n = shard.buckets[i].load(std::memory_order_relaxed);
+      snap.buckets[i] += n;
+      snap.count += n;
+    }
+    sum_ns += shard.sum_ns.load(std::memory_order_relaxed);
+  }
+  snap.sum = sum_ns / 1e9;
+  return snap;
+}
+
+RpcCall::RpcCall(RpcMethod method) :
+    method(method), start(steady_clock::now()) {
+  Stats::rpc(method).in_flight.add(1);
+}
+
+RpcCall::~RpcCall() {
+  Stats::Rpc& rpc = Stats::rpc(method);
+  rpc.latency.observe(duration_cast<nanoseconds>(steady_clock::now() - start));
+  rpc.calls.add();
+  rpc.in_flight.add(-1);
+}
+
+void RpcCall::failed() {
+  Stats::rpc(method).errors.add();
+}
+
+Stats::Rpc& Stats::rpc(RpcMethod method) {
+  // never destroyed, so calls still finishing at exit have something to
+  // count in; placed in static storage, as new only honours the shards'
+  // alignment from C++17
+  alignas(Rpc) static char storage[sizeof(Rpc) * kRpcMethods];
+  static Rpc* rpcs = [] {
+    Rpc* p = reinterpret_cast<Rpc*>(storage);
+    for (int m = 0; m < kRpcMethods; m++) new (p + m) Rpc();
+    return p;
+  }();
+  return rpcs[method];
+}
+
+Stats::Registration Stats::add(const string& name, const string& help,
+                               Type type, Read read, const Labels& labels) {
+  if (!valid_name(name)) {
+    throw PluginException("invalid metric name: " + name);
+  }
+  for (const auto& label : labels) {
+    if (!valid_name(label.first)) {
+      throw PluginException("invalid label name: " + label.first);
+    }
+  }
+  Registry& r = registry();
+  std::lock_guard<std::mutex> lock(r.mtx);
+  Series series = {r.next_id++, name, help, type, std::move(read), labels};
+  r.series.push_back(std::move(series));
+  return Registration(r.series.back().id);
+}
+
+Stats::Registration& Stats::Registration::operator=(Registration&& other) {
+  if (this != &other) {
+    reset();
+    id = other.id;
+    other.id = 0;
+  }
+  return *this;
+}
+
+void Stats::Registration::reset() {
+  if (id == 0) return;
+  Registry& r = registry();
+  // scrapes read series under the lock, so none is reading this one after
+  std::lock_guard<std::mutex> lock(r.mtx);
+  for (auto it = r.series.begin(); it != r.series.end(); ++it) {
+    if (it->id == id) {
+      r.series.erase(it);
+      break;
+    }
+  }
+  id = 0;
+}
+
+void Stats::write(TextBuffer& out) {
+  static const struct {
+    const char* name;
+    const char* help;
+  } kFamilies[] = {
+    {"snap_plugin_rpc_calls_total", "RPC calls handled, by method."},
+    {"snap_plugin_rpc_errors_total", "RPC calls that failed, by method."},
+    {"snap_plugin_rpc_in_flight", "RPC calls being handled, by method."},
+  };
+
+  for (int f = 0; f < 3; f++) {
+    append_header(out, kFamilies[f].name, kFamilies[f].help,
+                  f == 2 ? "gauge" : "counter");
+    for (int m = 0; m < kRpcMethods; m++) {
+      Rpc& r = rpc(RpcMethod(m));
+      double value = f == 0 ? double(r.calls.value()) :
+                     f == 1 ? double(r.errors.value()) :
+                              double(r.in_flight.value());
+      append_sample(out, kFamilies[f].name, kMethodNames[m], nullptr, value);
+    }
+  }
+
+  string name = "snap_plugin_rpc_duration_seconds";
+  append_header(out, name, "Time spent handling RPC calls, by method.",
+                "histogram");
+  char le[32];
+  for (int m = 0; m < kRpcMethods; m++) {
+    Histogram::Snapshot snap = rpc(RpcMethod(m)).latency.snapshot();
+    uint64_t cumulative = 0;
+    for (int i = 0; i < Histogram::kBuckets; i++) {
+      cumulative += snap.buckets[i];
+      if (std::isinf(Histogram::kBounds[i])) {
+        std::snprintf(le, sizeof(le), ",le=\"+Inf\"");
+      } else {
+        std::snprintf(le, sizeof(le), ",le=\"%g\"", Histogram::kBounds[i]);
+      }
+      append_sample(out, name + "_bucket", kMethodNames[m], le,
+                    double(cumulative));
+    }
+    append_sample(out, name + "_sum", kMethodNames[m], nullptr, snap.sum);
+    append_sample(out, name + "_count", kMethodNames[m], nullptr,
+                  double(snap.count));
+  }
+
+  append_header(out, "process_resident_memory_bytes",
+                "Resident memory size in bytes.", "gauge");
+  out.append("process_resident_memory_bytes ", 30);
+  append_value(out, resident_bytes());
+  out.append('\n');
+
+  Registry& r = registry();
+  std::lock_guard<std::mutex> lock(r.mtx);
+  // families are written once, at the first series of each name
+  for (size_t i = 0; i < r.series.size(); i++) {
+    const Series& head = r.series[i];
+    bool seen = false;
+    for (size_t j = 0; j < i && !seen; j++) {
+      seen = r.series[j].name == head.name;
+    }
+    if (seen) continue;
+    append_header(out, head.name, head.help,
+                  head.type == CounterType ? "counter" : "gauge");
+    for (size_t j = i; j < r.series.size(); j++) {
+      const Series& s = r.series[j];
+      if (s.name != head.name) continue;
+      out.append(s.name);
+      for (size_t l = 0; l < s.labels.size(); l++) {
+        out.append(l == 0 ? '{' : ',');
+        out.append(s.labels[l].first);
+        out.append("=\"", 2);
+        append_escaped(out, s.labels[l].second, true);
+        out.append('"');
+      }
+      if (!s.labels.empty()) out.append('}');
+      out.append(' ');
+      double value;
+      try {
+        value = s.read();
+      } catch (...) {
+        value = NAN;
+      }
+      append_value(out, value);
+      out.append('\n');
+    }
+  }
+}
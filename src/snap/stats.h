@@ -0,0 +1,223 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "snap/publisher/text_buffer.h"
+
+namespace Plugin {
+
+/**
+ * Counter is a monotonic count that many threads can bump at once. Each
+ * thread adds to one of a few shards, each on cache lines of its own, so
+ * adds from different threads rarely share a cache line, and value sums
+ * the shards without stopping them. Before C++17 new doesn't honour that
+ * alignment, so the shards of instances on the heap may share lines.
+ */
+class Counter final {
+ public:
+  Counter();
+
+  Counter(const Counter&) = delete;
+  Counter& operator=(const Counter&) = delete;
+
+  void add(uint64_t n = 1);
+  uint64_t value() const;
+
+ private:
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> n;
+  };
+
+  static const int kShards = 16;
+  Shard shards[kShards];
+};
+
+/**
+ * Gauge is Counter for values that go down as well, such as calls in
+ * flight.
+ */
+class Gauge final {
+ public:
+  Gauge();
+
+  Gauge(const Gauge&) = delete;
+  Gauge& operator=(const Gauge&) = delete;
+
+  void add(int64_t n);
+  int64_t value() const;
+
+ private:
+  struct alignas(64) Shard {
+    std::atomic<int64_t> n;
+  };
+
+  static const int kShards = 16;
+  Shard shards[kShards];
+};
+
+/**
+ * Histogram counts durations in fixed buckets from 100us to 10s, sharded
+ * per thread like Counter.
+ */
+class Histogram final {
+ public:
+  static const int kBuckets = 17;
+  /** upper bounds of the buckets, in seconds; the last is +Inf */
+  static const double kBounds[kBuckets];
+
+  Histogram();
+
+  Histogram(const Histogram&) = delete;
+  Histogram& operator=(const Histogram&) = delete;
+
+  void observe(std::chrono::nanoseconds took);
+
+  struct Snapshot {
+    uint64_t buckets[kBuckets];  // not cumulative
+    uint64_t count;
+    double sum;  // seconds
+  };
+  Snapshot snapshot() const;
+
+ private:
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> buckets[kBuckets];
+    std::atomic<uint64_t> sum_ns;
+  };
+
+  static const int kShards = 8;
+  Shard shards[kShards];
+};
+
+/**
+ * The RPC methods counted in Stats.
+ */
+enum RpcMethod {
+  kCollectMetrics,
+  kGetMetricTypes,
+  kProcess,
+  kPublish,
+  kGetConfigPolicy,
+  kKill,
+  kRpcMethods
+};
+
+/**
+ * RpcCall counts one call of method in Stats: it is in flight from
+ * construction to destruction, and its latency is observed then.
+ */
+class RpcCall final {
+ public:
+  explicit RpcCall(RpcMethod method);
+  ~RpcCall();
+
+  RpcCall(const RpcCall&) = delete;
+  RpcCall& operator=(const RpcCall&) = delete;
+
+  /** failed counts the call as an error as well. */
+  void failed();
+
+ private:
+  RpcMethod method;
+  std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * Stats holds the process-wide counters served by AdminServer, in the
+ * Prometheus text exposition format: RPC calls, errors, calls in flight and
+ * latencies by method, the resident set size, and whatever the plugin
+ * registers.
+ *
+ * The RPC path only touches sharded atomics; the registry lock is taken
+ * when adding series and when scraping.
+ *
+ * E.g., to expose a publisher's queue depth for as long as the publisher
+ * lives, keep the registration next to it:
+ *   class Queued final : public Plugin::PublisherInterface {
+ *     ...
+ *     Plugin::CoalescingPublisher publisher;
+ *     Plugin::Stats::Registration depth = Plugin::Stats::add(
+ *         "snap_plugin_queue_depth", "Metrics not sent yet.",
+ *         Plugin::Stats::GaugeType,
+ *         [this] { return double(publisher.buffered()); });
+ *   };
+ */
+class Stats final {
+ public:
+  enum Type { CounterType, GaugeType };
+  typedef std::function<double()> Read;
+  typedef std::vector<std::pair<std::string, std::string>> Labels;
+
+  /**
+   * Registration keeps a series added with add until it is destroyed or
+   * reset. Once either returns, read is not running and won't be called
+   * again, so whatever it captures may go.
+   */
+  class Registration final {
+   public:
+    Registration() : id(0) {}
+    ~Registration() { reset(); }
+
+    Registration(Registration&& other) : id(other.id) { other.id = 0; }
+    Registration& operator=(Registration&& other);
+
+    Registration(const Registration&) = delete;
+    Registration& operator=(const Registration&) = delete;
+
+    /** reset removes the series; later calls do nothing. */
+    void reset();
+
+   private:
+    friend class Stats;
+    explicit Registration(uint64_t id) : id(id) {}
+
+    uint64_t id;
+  };
+
+  /**
+   * add registers a series read at each scrape, until the returned
+   * Registration goes. Series of the same name must differ by labels and
+   * share help and type. name and label keys must be valid Prometheus
+   * names; PluginException is thrown otherwise. read must not reset a
+   * Registration.
+   */
+  static Registration add(const std::string& name, const std::string& help,
+                          Type type, Read read,
+                          const Labels& labels = Labels());
+
+  /** write appends every series to out in the text exposition format. */
+  static void write(TextBuffer& out);
+
+ private:
+  friend class RpcCall;
+
+  struct Rpc {
+    Counter calls;
+    Counter errors;
+    Gauge in_flight;
+    Histogram latency;
+  };
+
+  static Rpc& rpc(RpcMethod method);
+};
+
+}  // namespace Plugin
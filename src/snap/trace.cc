@@ -0,0 +1,406 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/trace.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "snap/plugin.h"
+
+using std::string;
+
+using Plugin::PluginException;
+using Plugin::Trace;
+
+namespace {
+
+struct Event {
+  std::atomic<const char*> name;
+  std::atomic<const char*> category;
+  std::atomic<int64_t> begin;
+  std::atomic<int64_t> end;
+};
+
+/**
+ * A ring of events written by one thread. head counts the events ever
+ * written; the event with index i lives in slot i & mask until index
+ * i + capacity overwrites it.
+ *
+ * Once its thread exits the buffer is kept for dumps, and handed to a new
+ * thread after it has been dumped or cleared, or when too many exited
+ * threads' buffers are kept (see Trace::Options::exited_buffers).
+ */
+struct ThreadBuffer {
+  ThreadBuffer(size_t capacity, long tid, const string& thread_name) :
+      events(new Event[capacity]), mask(capacity - 1), head(0), first(0),
+      tid(tid), thread_name(thread_name), exited(0), dumped(false) {}
+
+  std::unique_ptr<Event[]> events;
+  size_t mask;
+  std::atomic<uint64_t> head;
+  // index of the first event kept since the last clear
+  std::atomic<uint64_t> first;
+  // the rest is guarded by State::mtx
+  long tid;
+  string thread_name;
+  // when the thread exited, counting exits from 1; 0 while it runs
+  uint64_t exited;
+  // whether a dump or clear has seen the buffer since its thread exited
+  bool dumped;
+};
+
+/**
+ * The buffer of the calling thread, given up for reuse when the thread
+ * exits.
+ */
+struct LocalBuffer {
+  LocalBuffer() : buf(nullptr) {}
+  ~LocalBuffer();
+
+  ThreadBuffer* buf;
+};
+
+struct CopiedEvent {
+  const char* name;
+  const char* category;
+  int64_t begin;
+  int64_t end;
+};
+
+struct State {
+  State() : signal_pipe{-1, -1}, at_exit(false), exits(0) {}
+
+  std::mutex mtx;
+  // buffers are reused rather than freed, so dumps needn't lock them
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+  Trace::Options opts;
+  std::mutex dump_mtx;
+  int signal_pipe[2];
+  bool at_exit;
+  uint64_t exits;
+};
+
+// leaked, so the exit handler and dump thread can use it during shutdown
+State& state() {
+  static State* s = new State();
+  return *s;
+}
+
+thread_local LocalBuffer local_buffer;
+volatile sig_atomic_t signal_fd = -1;
+
+size_t round_up_pow2(size_t n) {
+  size_t p = 16;
+  while (p < n) p <<= 1;
+  return p;
+}
+
+/**
+ * Picks a buffer for the calling thread: the one of an exited thread that
+ * has been dumped, else the one of the thread that exited first if
+ * exited_buffers are kept already, else a new one.
+ */
+ThreadBuffer* register_thread() {
+  char name[16] = {0};
+  pthread_getname_np(pthread_self(), name, sizeof(name));
+  State& s = state();
+  std::lock_guard<std::mutex> lock(s.mtx);
+  size_t capacity = round_up_pow2(s.opts.buffer_events);
+  ThreadBuffer* reuse = nullptr;
+  size_t kept = 0;
+  for (const auto& buf : s.buffers) {
+    // buffers of another size are left to dumps
+    if (!buf->exited || buf->mask + 1 != capacity) continue;
+    if (buf->dumped) {
+      reuse = buf.get();
+      break;
+    }
+    kept++;
+    if (!reuse || buf->exited < reuse->exited) reuse = buf.get();
+  }
+  if (reuse && (reuse->dumped || kept >= s.opts.exited_buffers)) {
+    // a dump racing with this may show the first spans of the new thread
+    // under the old one
+    reuse->first.store(reuse->head.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+    reuse->tid = syscall(SYS_gettid);
+    reuse->thread_name = name;
+    reuse->exited = 0;
+    reuse->dumped = false;
+    return reuse;
+  }
+  s.buffers.emplace_back(new ThreadBuffer(capacity, syscall(SYS_gettid),
+                                          name));
+  return s.buffers.back().get();
+}
+
+LocalBuffer::~LocalBuffer() {
+  if (!buf) return;
+  State& s = state();
+  std::lock_guard<std::mutex> lock(s.mtx);
+  buf->exited = ++s.exits;
+  buf = nullptr;
+}
+
+void on_signal(int) {
+  int saved = errno;
+  char c = 0;
+  ssize_t n = write(signal_fd, &c, 1);
+  (void)n;
+  errno = saved;
+}
+
+void dump_on_signal(int fd) {
+  for (;;) {
+    char c;
+    ssize_t n = read(fd, &c, 1);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return;
+    try {
+      Trace::dump();
+    } catch (PluginException&) {}
+  }
+}
+
+void dump_at_exit() {
+  try {
+    Trace::dump();
+  } catch (PluginException&) {}
+}
+
+/**
+ * Copies the events of buf still in its ring. The oldest slot may be
+ * being overwritten by the next event, so at most capacity - 1 events are
+ * copied, and events the writer laps while they are copied are dropped.
+ */
+void copy_events(const ThreadBuffer& buf, std::vector<CopiedEvent>* out) {
+  uint64_t capacity = buf.mask + 1;
+  uint64_t head = buf.head.load(std::memory_order_acquire);
+  uint64_t first = buf.first.load(std::memory_order_relaxed);
+  if (head >= capacity && head - capacity + 1 > first) {
+    first = head - capacity + 1;
+  }
+  size_t start = out->size();
+  for (uint64_t i = first; i < head; i++) {
+    const Event& e = buf.events[i & buf.mask];
+    CopiedEvent copy = {e.name.load(std::memory_order_relaxed),
+                        e.category.load(std::memory_order_relaxed),
+                        e.begin.load(std::memory_order_relaxed),
+                        e.end.load(std::memory_order_relaxed)};
+    out->push_back(copy);
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint64_t now = buf.head.load(std::memory_order_relaxed);
+  if (now > capacity && now - capacity >= first) {
+    // index now - capacity and older may be overwritten or half written
+    size_t torn = now - capacity - first + 1;
+    torn = std::min<size_t>(torn, out->size() - start);
+    out->erase(out->begin() + start, out->begin() + start + torn);
+  }
+}
+
+void write_escaped(std::ostream& out, const char* str) {
+  for (const char* p = str; *p; p++) {
+    unsigned char c = *p;
+    if (c == '"' || c == '\\') {
+      out << '\\' << char(c);
+    } else if (c < 0x20) {
+      char esc[8];
+      snprintf(esc, sizeof(esc), "\\u%04x", c);
+      out << esc;
+    } else {
+      out << char(c);
+    }
+  }
+}
+
+}  // namespace
+
+std::atomic<bool> Trace::on(false);
+
+Trace::Options::Options() : signal(SIGUSR2), buffer_events(65536),
+                            exited_buffers(16) {}
+
+void Trace::start(const Options& opts) {
+  State& s = state();
+  std::lock_guard<std::mutex> lock(s.mtx);
+  s.opts = opts;
+  if (!opts.path.empty() && !s.at_exit) {
+    std::atexit(dump_at_exit);
+    s.at_exit = true;
+  }
+  if (!opts.path.empty() && opts.signal != 0) {
+    if (s.signal_pipe[0] < 0) {
+      if (pipe2(s.signal_pipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+        throw PluginException(string("trace: pipe: ") + std::strerror(errno));
+      }
+      // only the write end is written from the signal handler
+      fcntl(s.signal_pipe[0], F_SETFL, 0);
+      signal_fd = s.signal_pipe[1];
+      std::thread(dump_on_signal, s.signal_pipe[0]).detach();
+    }
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(opts.signal, &sa, nullptr) != 0) {
+      throw PluginException(string("trace: sigaction: ") +
+                            std::strerror(errno));
+    }
+  }
+  on.store(true, std::memory_order_relaxed);
+}
+
+bool Trace::start_from_env() {
+  const char* path = std::getenv("SNAP_PLUGIN_TRACE");
+  if (enabled() || path == nullptr || *path == '\0') return enabled();
+  Options opts;
+  opts.path = path;
+  start(opts);
+  return true;
+}
+
+void Trace::stop() {
+  on.store(false, std::memory_order_relaxed);
+}
+
+int64_t Trace::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::record(const char* name, const char* category, int64_t begin,
+                   int64_t end) {
+  ThreadBuffer* buf = local_buffer.buf;
+  if (buf == nullptr) buf = local_buffer.buf = register_thread();
+  uint64_t i = buf->head.load(std::memory_order_relaxed);
+  // keeps the slot's stores after the previous head store, for copy_events
+  std::atomic_thread_fence(std::memory_order_release);
+  Event& e = buf->events[i & buf->mask];
+  e.name.store(name, std::memory_order_relaxed);
+  e.category.store(category, std::memory_order_relaxed);
+  e.begin.store(begin, std::memory_order_relaxed);
+  e.end.store(end, std::memory_order_relaxed);
+  buf->head.store(i + 1, std::memory_order_release);
+}
+
+void Trace::clear() {
+  State& s = state();
+  std::lock_guard<std::mutex> lock(s.mtx);
+  for (const auto& buf : s.buffers) {
+    buf->first.store(buf->head.load(std::memory_order_acquire),
+                     std::memory_order_relaxed);
+    if (buf->exited) buf->dumped = true;
+  }
+}
+
+void Trace::dump(std::ostream& out) {
+  State& s = state();
+  struct Dumped {
+    ThreadBuffer* buf;
+    long tid;
+    string thread_name;
+    uint64_t exited;
+  };
+  std::vector<Dumped> buffers;
+  {
+    std::lock_guard<std::mutex> lock(s.mtx);
+    for (const auto& buf : s.buffers) {
+      buffers.push_back({buf.get(), buf->tid, buf->thread_name, buf->exited});
+    }
+  }
+
+  long pid = getpid();
+  bool first = true;
+  std::vector<CopiedEvent> events;
+  char num[64];
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  for (const Dumped& d : buffers) {
+    if (!d.thread_name.empty()) {
+      out << (first ? "" : ",") << "\n{\"ph\":\"M\",\"name\":\"thread_name\","
+          << "\"pid\":" << pid << ",\"tid\":" << d.tid
+          << ",\"args\":{\"name\":\"";
+      write_escaped(out, d.thread_name.c_str());
+      out << "\"}}";
+      first = false;
+    }
+    events.clear();
+    copy_events(*d.buf, &events);
+    for (const CopiedEvent& e : events) {
+      out << (first ? "" : ",") << "\n{\"ph\":\"X\",\"name\":\"";
+      write_escaped(out, e.name);
+      out << "\",\"cat\":\"";
+      write_escaped(out, e.category);
+      // microseconds, to the nanosecond
+      snprintf(num, sizeof(num), "\",\"ts\":%lld.%03lld,\"dur\":%lld.%03lld",
+               (long long)(e.begin / 1000), (long long)(e.begin % 1000),
+               (long long)((e.end - e.begin) / 1000),
+               (long long)((e.end - e.begin) % 1000));
+      out << num << ",\"pid\":" << pid << ",\"tid\":" << d.tid << "}";
+      first = false;
+    }
+  }
+  out << "\n]}\n";
+
+  // the spans of threads that had exited are out, so their buffers can go
+  // to new threads
+  std::lock_guard<std::mutex> lock(s.mtx);
+  for (const Dumped& d : buffers) {
+    if (d.exited && d.buf->exited == d.exited) d.buf->dumped = true;
+  }
+}
+
+void Trace::dump() {
+  State& s = state();
+  string path;
+  {
+    std::lock_guard<std::mutex> lock(s.mtx);
+    path = s.opts.path;
+  }
+  if (path.empty()) {
+    throw PluginException("trace: no path to dump to");
+  }
+  // written aside and renamed, so a reader never sees a partial trace
+  std::lock_guard<std::mutex> lock(s.dump_mtx);
+  string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp.c_str(), std::ios::trunc);
+    dump(out);
+    out.flush();
+    if (!out) {
+      throw PluginException("trace: failed to write " + tmp);
+    }
+  }
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    throw PluginException("trace: failed to rename " + tmp + ": " +
+                          std::strerror(errno));
+  }
+}
@@ -0,0 +1,144 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace Plugin {
+
+/**
+ * Trace records spans of time into per-thread buffers and writes them out
+ * in the Chrome trace event format, which chrome://tracing and the Perfetto
+ * UI both open.
+ *
+ * Tracing is off until started, and a Span costs one relaxed load while it
+ * is. Once started, each thread writes its spans to a ring buffer of its
+ * own without locking; when the ring is full the oldest spans are
+ * overwritten, so a dump holds the latest buffer_events - 1 spans per
+ * thread. The buffer of a thread that exited is kept until a dump or clear
+ * has seen it, then reused by a new thread, so memory stays bounded by the
+ * threads alive plus exited_buffers.
+ *
+ * The proxies record a span per call, with nested spans for wrapping the
+ * request into Metrics, the plugin callback and building the reply; the
+ * exporter records its setup. Time spent by gRPC itself, receiving and
+ * parsing the request and sending the reply, falls outside them.
+ *
+ * Starting with a path dumps the trace there at exit, and whenever the
+ * process receives Options::signal. Plugins launched by snapteld can be
+ * traced without changes by setting SNAP_PLUGIN_TRACE to the path.
+ */
+class Trace final {
+ public:
+  struct Options {
+    Options();
+
+    /** path to dump to at exit and on signal; none by default */
+    std::string path;
+    /** signal that dumps the trace to path, SIGUSR2 by default; 0 for none */
+    int signal;
+    /** spans kept per thread, rounded up to a power of 2; 65536 by default */
+    size_t buffer_events;
+    /**
+     * buffers of exited threads kept until dumped, 16 by default; beyond
+     * that the oldest is handed to a new thread, dropping its spans
+     */
+    size_t exited_buffers;
+  };
+
+  /**
+   * start enables tracing. Failing to set up the signal handler is thrown
+   * as PluginException.
+   */
+  static void start(const Options& opts);
+
+  /**
+   * start_from_env starts tracing to the path in SNAP_PLUGIN_TRACE, if set
+   * and tracing isn't started yet. It returns whether tracing is on.
+   */
+  static bool start_from_env();
+
+  /** stop disables tracing; recorded spans are kept. */
+  static void stop();
+
+  static bool enabled() { return on.load(std::memory_order_relaxed); }
+
+  /** dump writes the spans recorded so far as Chrome trace JSON. */
+  static void dump(std::ostream& out);
+
+  /**
+   * dump writes the spans recorded so far to the path given to start.
+   * Failing to write is thrown as PluginException.
+   */
+  static void dump();
+
+  /** clear drops the spans recorded so far. */
+  static void clear();
+
+  /** now returns the time spans are measured in, in nanoseconds. */
+  static int64_t now();
+
+  /**
+   * record adds a span from begin to end to the calling thread's buffer.
+   * name and category must be string literals, or otherwise outlive the
+   * dump.
+   */
+  static void record(const char* name, const char* category, int64_t begin,
+                     int64_t end);
+
+ private:
+  static std::atomic<bool> on;
+};
+
+/**
+ * Span records the time from its construction to its destruction, or to
+ * end, while tracing is on. Spans opened inside others on the same thread
+ * show up nested.
+ *
+ * E.g.:
+ *   void collect_metrics(std::vector<Plugin::Metric>& metrics) {
+ *     Plugin::Span span("read_stats", "rando");
+ *     ...
+ *   }
+ *
+ * name and category must be string literals, or otherwise outlive the dump.
+ */
+class Span final {
+ public:
+  explicit Span(const char* name, const char* category = "plugin") :
+      name(name), category(category),
+      begin(Trace::enabled() ? Trace::now() : -1) {}
+
+  ~Span() { end(); }
+
+  Span(const Span&) = delete;
+  Span& operator=(const Span&) = delete;
+
+  /** end closes the span early; later calls do nothing. */
+  void end() {
+    if (begin < 0) return;
+    Trace::record(name, category, begin, Trace::now());
+    begin = -1;
+  }
+
+ private:
+  const char* name;
+  const char* category;
+  int64_t begin;
+};
+
+}  // namespace Plugin
@@ -0,0 +1,103 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/admin_server.h"
+#include "snap/plugin.h"
+#include "gtest/gtest.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+
+using Plugin::AdminServer;
+using Plugin::PluginException;
+
+namespace {
+
+std::string get(int fd, const std::string& path) {
+    std::string req = "GET " + path + " HTTP/1.1\r\nHost: x\r\n\r\n";
+    EXPECT_EQ(ssize_t(req.size()), write(fd, req.data(), req.size()));
+    std::string resp;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) resp.append(buf, n);
+    close(fd);
+    return resp;
+}
+
+std::string get_tcp(int port, const std::string& path) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    EXPECT_EQ(0, connect(fd, reinterpret_cast<sockaddr*>(&addr),
+                         sizeof(addr)));
+    return get(fd, path);
+}
+
+}  // namespace
+
+TEST(AdminServerTest, ServesMetricsOverTcp) {
+    AdminServer admin("127.0.0.1:0");
+    ASSERT_GT(admin.port(), 0);
+
+    std::string resp = get_tcp(admin.port(), "/metrics");
+    EXPECT_EQ(0u, resp.find("HTTP/1.1 200 OK\r\n"));
+    EXPECT_NE(std::string::npos,
+              resp.find("Content-Type: text/plain; version=0.0.4"));
+    EXPECT_NE(std::string::npos,
+              resp.find("\n# TYPE snap_plugin_rpc_calls_total counter\n"));
+    size_t body = resp.find("\r\n\r\n") + 4;
+    size_t len_pos = resp.find("Content-Length: ") + 16;
+    EXPECT_EQ(std::stoul(resp.substr(len_pos)), resp.size() - body);
+
+    EXPECT_EQ(0u, get_tcp(admin.port(), "/").find("HTTP/1.1 404"));
+}
+
+TEST(AdminServerTest, ServesMetricsOverUnixSocket) {
+    char dir[] = "/tmp/admin_test.XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(dir));
+    std::string path = std::string(dir) + "/admin.sock";
+    {
+        AdminServer admin("unix:" + path);
+        EXPECT_EQ(0, admin.port());
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, path.c_str());
+        ASSERT_EQ(0, connect(fd, reinterpret_cast<sockaddr*>(&addr),
+                             sizeof(addr)));
+        std::string resp = get(fd, "/metrics?x=1");
+        EXPECT_EQ(0u, resp.find("HTTP/1.1 200 OK\r\n"));
+    }
+    // the socket is removed on shutdown
+    EXPECT_NE(0, access(path.c_str(), F_OK));
+    rmdir(dir);
+}
+
+TEST(AdminServerTest, RejectsBadAddresses) {
+    EXPECT_THROW(AdminServer("localhost"), PluginException);
+    EXPECT_THROW(AdminServer("127.0.0.1:99999"), PluginException);
+    EXPECT_THROW(AdminServer("unix:"), PluginException);
+    EXPECT_THROW(AdminServer("unix:/nonexistent/dir/admin.sock"),
+                 PluginException);
+}
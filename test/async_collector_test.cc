@@ -0,0 +1,155 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/collector/async_collector.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+#include "snap/proxy/collector_proxy.h"
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+using std::chrono::system_clock;
+using Plugin::AsyncCollector;
+using Plugin::ConfigPolicy;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::Proxy::CollectorImpl;
+
+namespace {
+
+// Answers each requested metric from a group named by its first namespace
+// element: "ok" groups complete, "fail" groups throw, and "hang" groups
+// complete only when released.
+class Hosts final : public AsyncCollector {
+ public:
+    Hosts() : AsyncCollector(milliseconds(100), milliseconds(10)) {}
+
+    ~Hosts() {
+        release.set_value();
+    }
+
+    const ConfigPolicy get_config_policy() { return ConfigPolicy(); }
+
+    std::vector<Metric> get_metric_types(Plugin::Config cfg) { return {}; }
+
+    std::vector<Group> collect_async(const std::vector<Metric>& metrics) {
+        std::vector<Group> groups;
+        for (const Metric& met : metrics) {
+            std::string host = met.ns()[0].value;
+            Metric copy(met);
+            if (host == "hang") {
+                std::shared_future<void> wait = released;
+                groups.push_back({host, std::async(std::launch::async,
+                                                   [wait, copy]() {
+                    wait.wait();
+                    return std::vector<Metric>{copy};
+                })});
+            } else if (host == "fail") {
+                groups.push_back({host, std::async(std::launch::async,
+                                                   []() -> std::vector<Metric> {
+                    throw PluginException("unreachable");
+                })});
+            } else {
+                groups.push_back({host, std::async(std::launch::async,
+                                                   [copy]() mutable {
+                    copy.set_data(int64_t(1));
+                    return std::vector<Metric>{copy, copy};
+                })});
+            }
+        }
+        return groups;
+    }
+
+ private:
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+};
+
+std::vector<Metric> request(const std::vector<std::string>& hosts) {
+    std::vector<Metric> metrics;
+    for (const std::string& host : hosts) {
+        metrics.emplace_back(Metric({{host, "", ""}, {"power", "", ""}}, "W",
+                                    ""));
+    }
+    return metrics;
+}
+
+}  // namespace
+
+TEST(AsyncCollectorTest, CollectsGroups) {
+    Hosts plg;
+    std::vector<Metric> metrics = request({"ok", "ok"});
+    EXPECT_EQ("", plg.collect_metrics_by(metrics,
+                                         system_clock::time_point::max()));
+    ASSERT_EQ(4u, metrics.size());
+    EXPECT_EQ(1, metrics[3].get_int64_data());
+}
+
+TEST(AsyncCollectorTest, ReturnsPartialResultsByDeadline) {
+    Hosts plg;
+    std::vector<Metric> metrics = request({"ok", "hang", "fail"});
+    steady_clock::time_point start = steady_clock::now();
+    std::string incomplete = plg.collect_metrics_by(
+        metrics, system_clock::now() + milliseconds(50));
+    EXPECT_LT(steady_clock::now() - start, milliseconds(1000));
+    EXPECT_EQ("hang: timed out; fail: unreachable", incomplete);
+    EXPECT_EQ(2u, metrics.size());
+
+    // the timeout applies without a deadline
+    metrics = request({"hang"});
+    EXPECT_THROW(plg.collect_metrics(metrics), PluginException);
+    EXPECT_TRUE(metrics.empty());
+}
+
+TEST(AsyncCollectorTest, FailsWhenNoGroupCompletes) {
+    Hosts plg;
+    std::vector<Metric> metrics = request({"fail", "fail"});
+    try {
+        plg.collect_metrics_by(metrics, system_clock::time_point::max());
+        FAIL() << "no exception";
+    } catch (const PluginException& e) {
+        EXPECT_STREQ("fail: unreachable; fail: unreachable", e.what());
+    }
+}
+
+TEST(AsyncCollectorTest, ProxyRepliesWithPartialResults) {
+    Hosts plg;
+    CollectorImpl proxy(&plg);
+    rpc::MetricsArg args;
+    for (const Metric& met : request({"ok", "fail"})) {
+        *args.add_metrics() = *met.get_rpc_metric_ptr();
+    }
+    rpc::MetricsReply resp;
+    grpc::Status status = proxy.CollectMetrics(nullptr, &args, &resp);
+    EXPECT_TRUE(status.ok());
+    EXPECT_EQ("", resp.error());
+    ASSERT_EQ(3, resp.metrics_size());
+    const rpc::Metric& annotation = resp.metrics(2);
+    ASSERT_EQ(2, annotation.namespace__size());
+    EXPECT_EQ("collect", annotation.namespace_(0).value());
+    EXPECT_EQ("incomplete", annotation.namespace_(1).value());
+    EXPECT_EQ("fail: unreachable", annotation.string_data());
+
+    args.clear_metrics();
+    *args.add_metrics() = *request({"fail"})[0].get_rpc_metric_ptr();
+    resp.Clear();
+    status = proxy.CollectMetrics(nullptr, &args, &resp);
+    EXPECT_EQ(grpc::StatusCode::UNKNOWN, status.error_code());
+    EXPECT_EQ("fail: unreachable", resp.error());
+}
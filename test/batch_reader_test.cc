@@ -0,0 +1,117 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/collector/batch_reader.h"
+#include "gtest/gtest.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+using Plugin::BatchReader;
+
+namespace {
+
+class BatchReaderTest : public ::testing::TestWithParam<bool> {
+ protected:
+    BatchReaderTest() {
+        char tmpl[] = "/tmp/batch_reader_test.XXXXXX";
+        dir = mkdtemp(tmpl);
+    }
+
+    ~BatchReaderTest() {
+        for (const std::string& path : paths) unlink(path.c_str());
+        rmdir(dir.c_str());
+    }
+
+    std::string write(const std::string& name, const std::string& contents) {
+        std::string path = dir + "/" + name;
+        std::ofstream(path) << contents;
+        paths.push_back(path);
+        return path;
+    }
+
+    BatchReader::Options options() {
+        BatchReader::Options opts;
+        opts.use_io_uring = GetParam();
+        opts.queue_depth = 4;
+        opts.buffer_size = 16;
+        return opts;
+    }
+
+    std::string dir;
+    std::vector<std::string> paths;
+};
+
+}  // namespace
+
+TEST_P(BatchReaderTest, ReadsFilesAgain) {
+    BatchReader reader(options());
+    std::vector<std::string> want;
+    // more files than the queue holds, some larger than the buffer
+    for (int i = 0; i < 10; i++) {
+        want.push_back(std::string(i * 7, 'a' + i) + "\n");
+        reader.add(write("f" + std::to_string(i), want.back()));
+    }
+    size_t missing = reader.add(dir + "/missing");
+
+    EXPECT_EQ(10u, reader.read_all());
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(want[i], reader.contents(i).str());
+        EXPECT_EQ('\0', reader.contents(i).data[reader.contents(i).size]);
+    }
+    EXPECT_EQ(ENOENT, reader.error(missing));
+    EXPECT_TRUE(reader.contents(missing).empty());
+
+    // files are read from the start each time
+    std::ofstream(paths[3]) << "changed";
+    write("missing", "here now");
+    EXPECT_EQ(11u, reader.read_all());
+    EXPECT_EQ("changed", reader.contents(3).str());
+    EXPECT_EQ("here now", reader.contents(missing).str());
+}
+
+TEST_P(BatchReaderTest, BoundsOpenFiles) {
+    BatchReader::Options opts = options();
+    opts.max_open = 2;
+    BatchReader reader(opts);
+    for (int i = 0; i < 5; i++) {
+        reader.add(write("f" + std::to_string(i), std::to_string(i)));
+    }
+    int fd = open(paths[0].c_str(), O_RDONLY);
+    size_t own = reader.add_fd(fd);
+    EXPECT_EQ(6u, reader.read_all());
+    EXPECT_EQ(6u, reader.read_all());
+    EXPECT_EQ("4", reader.contents(4).str());
+    EXPECT_EQ("0", reader.contents(own).str());
+    close(fd);
+}
+
+TEST_P(BatchReaderTest, ReadsProcfs) {
+    BatchReader reader(options());
+    reader.add("/proc/self/stat");
+    reader.add("/proc/meminfo");
+    EXPECT_EQ(2u, reader.read_all());
+    EXPECT_EQ(std::to_string(getpid()) + " ",
+              reader.contents(0).str().substr(0, std::to_string(getpid())
+                                                     .size() + 1));
+    EXPECT_EQ("MemTotal:", reader.contents(1).str().substr(0, 9));
+}
+
+INSTANTIATE_TEST_CASE_P(IoUringAndPread, BatchReaderTest,
+                        ::testing::Values(true, false));
@@ -0,0 +1,192 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+#include "snap/processor/cardinality.h"
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::chrono::seconds;
+using std::chrono::system_clock;
+using Plugin::CardinalityGuardProcessor;
+using Plugin::Config;
+using Plugin::HyperLogLog;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::SlidingCardinality;
+
+namespace {
+
+const int64_t kSec = 1000000000;
+
+Metric request(const std::string& app, int sec, int id) {
+    Metric met({{"intel", "", ""}, {app, "", ""}, {"latency", "", ""}},
+               "ms", "");
+    met.add_tag({"host", "node" + std::to_string(id % 3)});
+    met.add_tag({"request_id", std::to_string(id)});
+    met.set_timestamp(system_clock::time_point(seconds(sec)));
+    met.set_data(1.0);
+    return met;
+}
+
+}  // namespace
+
+TEST(HyperLogLogTest, EstimatesWithinError) {
+    for (uint64_t n : {10ULL, 1000ULL, 100000ULL}) {
+        HyperLogLog hll(12);
+        for (uint64_t i = 0; i < n; i++) {
+            hll.add(i);
+            hll.add(i);
+        }
+        // 1.6% standard error; allow 4 of them
+        EXPECT_NEAR(double(n), hll.estimate(), n * 0.065 + 1) << n;
+    }
+    EXPECT_EQ(0, HyperLogLog(12).estimate());
+    EXPECT_THROW(HyperLogLog(3), PluginException);
+}
+
+TEST(HyperLogLogTest, MergesUnions) {
+    HyperLogLog a(10);
+    HyperLogLog b(10);
+    for (uint64_t i = 0; i < 5000; i++) a.add(i);
+    for (uint64_t i = 2500; i < 7500; i++) b.add(i);
+    a.merge(b);
+    EXPECT_NEAR(7500, a.estimate(), 7500 * 0.13);
+    EXPECT_THROW(a.merge(HyperLogLog(11)), PluginException);
+}
+
+TEST(SlidingCardinalityTest, ForgetsOldSlices) {
+    SlidingCardinality sc(12, seconds(40), 4);
+    for (uint64_t i = 0; i < 1000; i++) sc.add(i, 0);
+    for (uint64_t i = 1000; i < 1500; i++) sc.add(i, 15 * kSec);
+    EXPECT_NEAR(1500, sc.estimate(), 1500 * 0.065);
+
+    // 45s: the slice of 0-10s has left the window
+    for (uint64_t i = 1500; i < 1600; i++) sc.add(i, 45 * kSec);
+    EXPECT_NEAR(600, sc.estimate(), 600 * 0.065);
+    // too old to count
+    sc.add(5000, 0);
+    EXPECT_NEAR(600, sc.estimate(), 600 * 0.065);
+    EXPECT_EQ(5u * 4096, sc.memory());
+}
+
+TEST(CardinalityGuardTest, AggregatesAwayCulprit) {
+    rpc::ConfigMap map;
+    (*map.mutable_stringmap())["prefixes"] = "/intel/app; /intel/web";
+    (*map.mutable_intmap())["budget"] = 100;
+    (*map.mutable_intmap())["window"] = 60;
+    Config config(map);
+    CardinalityGuardProcessor plg;
+
+    // within budget: untouched
+    std::vector<Metric> batch;
+    for (int i = 0; i < 50; i++) batch.push_back(request("app", 0, i));
+    plg.process_metrics(batch, config);
+    ASSERT_EQ(50u, batch.size());
+    EXPECT_EQ(2u, batch[0].tags().size());
+
+    batch.clear();
+    for (int i = 50; i < 500; i++) batch.push_back(request("app", 1, i));
+    batch.push_back(request("web", 1, 7));
+    plg.process_metrics(batch, config);
+    // a series per host, the other prefix and one alert
+    ASSERT_EQ(5u, batch.size());
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(1u, batch[i].tags().size());
+        EXPECT_EQ(150, batch[i].get_float64_data());
+    }
+    EXPECT_EQ("node2", batch[0].tags().at("host"));
+    EXPECT_EQ("node0", batch[1].tags().at("host"));
+    // another prefix keeps its tags
+    EXPECT_EQ(2u, batch[3].tags().size());
+
+    const Metric& alert = batch[4];
+    ASSERT_EQ(3u, alert.ns().size());
+    EXPECT_EQ("cardinality", alert.ns()[2].value);
+    EXPECT_EQ("request_id", alert.tags().at("tag"));
+    EXPECT_EQ("aggregate", alert.tags().at("action"));
+    EXPECT_NEAR(500, alert.get_float64_data(), 500 * 0.065);
+
+    // no second alert in the same slice
+    batch.clear();
+    batch.push_back(request("app", 2, 1000));
+    plg.process_metrics(batch, config);
+    ASSERT_EQ(1u, batch.size());
+    EXPECT_EQ(0u, batch[0].tags().count("request_id"));
+}
+
+TEST(CardinalityGuardTest, DropsCulprit) {
+    rpc::ConfigMap map;
+    (*map.mutable_intmap())["budget"] = 100;
+    (*map.mutable_stringmap())["action"] = "drop";
+    Config config(map);
+    CardinalityGuardProcessor plg;
+
+    std::vector<Metric> batch;
+    for (int i = 0; i < 300; i++) batch.push_back(request("app", 0, i));
+    Metric quiet({{"intel", "", ""}, {"load", "", ""}}, "", "");
+    quiet.set_data(1.0);
+    batch.push_back(quiet);
+    plg.process_metrics(batch, config);
+
+    ASSERT_EQ(2u, batch.size());
+    EXPECT_EQ("load", batch[0].ns()[1].value);
+    EXPECT_EQ("cardinality", batch[1].ns()[0].value);
+    EXPECT_EQ("drop", batch[1].tags().at("action"));
+}
+
+TEST(CardinalityGuardTest, KeepsSketchesAcrossConfigs) {
+    rpc::ConfigMap map;
+    (*map.mutable_intmap())["budget"] = 100;
+    Config config(map);
+    CardinalityGuardProcessor plg;
+
+    std::vector<Metric> batch;
+    for (int i = 0; i < 80; i++) batch.push_back(request("app", 0, i));
+    plg.process_metrics(batch, config);
+    ASSERT_EQ(80u, batch.size());
+    // more configs than the prepared state cache holds
+    for (int i = 0; i < 100; i++) {
+        rpc::ConfigMap other;
+        (*other.mutable_intmap())["budget"] = 1000 + i;
+        std::vector<Metric> noise = {request("web", 0, i)};
+        plg.process_metrics(noise, Config(other));
+    }
+
+    // 80 more series only go over budget if the first 80 were kept
+    batch.clear();
+    for (int i = 80; i < 160; i++) batch.push_back(request("app", 1, i));
+    plg.process_metrics(batch, config);
+    ASSERT_EQ(4u, batch.size());
+    EXPECT_EQ("cardinality", batch[3].ns()[0].value);
+}
+
+TEST(CardinalityGuardTest, RejectsBadConfig) {
+    CardinalityGuardProcessor plg;
+    std::vector<Metric> batch;
+    rpc::ConfigMap map;
+    (*map.mutable_intmap())["precision"] = 20;
+    Config config(map);
+    EXPECT_THROW(plg.process_metrics(batch, config), PluginException);
+
+    rpc::ConfigMap bad_action;
+    (*bad_action.mutable_stringmap())["action"] = "sample";
+    Config config2(bad_action);
+    EXPECT_THROW(plg.process_metrics(batch, config2), PluginException);
+}
@@ -0,0 +1,304 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+#include "snap/publisher/coalescing_publisher.h"
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::chrono::milliseconds;
+using Plugin::CoalescingPublisher;
+using Plugin::Config;
+using Plugin::ConfigPolicy;
+using Plugin::Metric;
+
+namespace {
+
+class RecordingPublisher : public Plugin::PublisherInterface {
+public:
+  RecordingPublisher() : killed(false), fail(false), hold(false),
+                         attempts(0) {}
+
+  const ConfigPolicy get_config_policy() { return ConfigPolicy(); }
+
+  void publish_metrics(std::vector<Metric> &metrics, const Config& config) {
+    std::unique_lock<std::mutex> lk(mtx);
+    attempts++;
+    held.wait(lk, [this] { return !hold; });
+    if (fail || config.get_string("path") == fail_path) {
+      throw Plugin::PluginException("sink down");
+    }
+    batch_sizes.push_back(metrics.size());
+    paths.push_back(config.get_string("path"));
+  }
+
+  void kill(const std::string& reason) { killed = true; }
+
+  size_t calls() {
+    std::lock_guard<std::mutex> lk(mtx);
+    return batch_sizes.size();
+  }
+
+  int tries() {
+    std::lock_guard<std::mutex> lk(mtx);
+    return attempts;
+  }
+
+  void set_fail(bool value) {
+    std::lock_guard<std::mutex> lk(mtx);
+    fail = value;
+  }
+
+  void set_hold(bool value) {
+    std::lock_guard<std::mutex> lk(mtx);
+    hold = value;
+    held.notify_all();
+  }
+
+  std::mutex mtx;
+  std::condition_variable held;
+  std::vector<size_t> batch_sizes;
+  std::vector<std::string> paths;
+  bool killed;
+  bool fail;
+  // configs with this path are always rejected
+  std::string fail_path;
+  // blocks publish_metrics until cleared
+  bool hold;
+  int attempts;
+};
+
+rpc::ConfigMap path_config(const std::string& path) {
+  rpc::ConfigMap map;
+  (*map.mutable_stringmap())["path"] = path;
+  return map;
+}
+
+std::vector<Metric> make_metrics(int count) {
+  std::vector<Metric> metrics;
+  for (int i = 0; i < count; i++) {
+    metrics.emplace_back(Metric({{"foo", "", ""}, {"bar", "", ""}}, "", ""));
+    metrics.back().set_data(int64_t(i));
+  }
+  return metrics;
+}
+
+}  // namespace
+
+TEST(CoalescingPublisherTest, BuffersBelowLimits) {
+    RecordingPublisher sink;
+    CoalescingPublisher plg(&sink, {10, 0, milliseconds(0)});
+    rpc::ConfigMap map = path_config("/a");
+    std::vector<Metric> metrics = make_metrics(4);
+
+    plg.publish_metrics(metrics, Config(map));
+    plg.publish_metrics(metrics, Config(map));
+
+    EXPECT_EQ(0, sink.calls());
+    EXPECT_EQ(8, plg.buffered());
+}
+
+TEST(CoalescingPublisherTest, FlushesOnMetricCount) {
+    RecordingPublisher sink;
+    CoalescingPublisher plg(&sink, {10, 0, milliseconds(0)});
+    rpc::ConfigMap map = path_config("/a");
+    std::vector<Metric> metrics = make_metrics(4);
+
+    for (int i = 0; i < 3; i++) plg.publish_metrics(metrics, Config(map));
+
+    ASSERT_EQ(1, sink.calls());
+    EXPECT_EQ(12, sink.batch_sizes[0]);
+    EXPECT_EQ(0, plg.buffered());
+}
+
+TEST(CoalescingPublisherTest, FlushesOnByteSize) {
+    RecordingPublisher sink;
+    std::vector<Metric> metrics = make_metrics(5);
+    size_t one = metrics[0].get_rpc_metric_ptr()->ByteSize();
+    CoalescingPublisher plg(&sink, {0, one * 5, milliseconds(0)});
+    rpc::ConfigMap map = path_config("/a");
+
+    plg.publish_metrics(metrics, Config(map));
+
+    ASSERT_EQ(1, sink.calls());
+    EXPECT_EQ(5, sink.batch_sizes[0]);
+}
+
+TEST(CoalescingPublisherTest, GroupsByConfig) {
+    RecordingPublisher sink;
+    CoalescingPublisher plg(&sink, {0, 0, milliseconds(0)});
+    rpc::ConfigMap map_a = path_config("/a");
+    rpc::ConfigMap map_b = path_config("/b");
+    std::vector<Metric> metrics = make_metrics(2);
+
+    plg.publish_metrics(metrics, Config(map_a));
+    plg.publish_metrics(metrics, Config(map_b));
+    plg.publish_metrics(metrics, Config(map_a));
+    plg.flush();
+
+    ASSERT_EQ(2, sink.calls());
+    size_t a = sink.paths[0] == "/a" ? 0 : 1;
+    EXPECT_EQ("/a", sink.paths[a]);
+    EXPECT_EQ(4, sink.batch_sizes[a]);
+    EXPECT_EQ("/b", sink.paths[1 - a]);
+    EXPECT_EQ(2, sink.batch_sizes[1 - a]);
+}
+
+TEST(CoalescingPublisherTest, FlushesOnAge) {
+    RecordingPublisher sink;
+    CoalescingPublisher plg(&sink, {0, 0, milliseconds(20)});
+    rpc::ConfigMap map = path_config("/a");
+    std::vector<Metric> metrics = make_metrics(3);
+
+    plg.publish_metrics(metrics, Config(map));
+    for (int i = 0; i < 200 && sink.calls() == 0; i++) {
+        std::this_thread::sleep_for(milliseconds(10));
+    }
+
+    ASSERT_EQ(1, sink.calls());
+    EXPECT_EQ(3, sink.batch_sizes[0]);
+}
+
+TEST(CoalescingPublisherTest, KillFlushesAndForwards) {
+    RecordingPublisher sink;
+    CoalescingPublisher plg(&sink, {100, 0, milliseconds(0)});
+    rpc::ConfigMap map = path_config("/a");
+    std::vector<Metric> metrics = make_metrics(3);
+
+    plg.publish_metrics(metrics, Config(map));
+    plg.kill("task stopped");
+
+    ASSERT_EQ(1, sink.calls());
+    EXPECT_EQ(3, sink.batch_sizes[0]);
+    EXPECT_TRUE(sink.killed);
+}
+
+TEST(CoalescingPublisherTest, SizeFlushReportsSinkError) {
+    RecordingPublisher sink;
+    sink.fail = true;
+    CoalescingPublisher plg(&sink, {2, 0, milliseconds(0)});
+    rpc::ConfigMap map = path_config("/a");
+    std::vector<Metric> metrics = make_metrics(2);
+
+    EXPECT_THROW(plg.publish_metrics(metrics, Config(map)),
+                 Plugin::PluginException);
+    // the rejected batch is kept for the next flush
+    EXPECT_EQ(2, plg.buffered());
+
+    sink.set_fail(false);
+    plg.flush();
+    ASSERT_EQ(1, sink.calls());
+    EXPECT_EQ(2, sink.batch_sizes[0]);
+    EXPECT_EQ(0, plg.buffered());
+}
+
+TEST(CoalescingPublisherTest, AgeFlushErrorIsReportedOnNextCall) {
+    RecordingPublisher sink;
+    sink.fail = true;
+    CoalescingPublisher plg(&sink, {0, 0, milliseconds(10), 0});
+    rpc::ConfigMap map = path_config("/a");
+    std::vector<Metric> metrics = make_metrics(1);
+
+    plg.publish_metrics(metrics, Config(map));
+    for (int i = 0; i < 200 && sink.tries() == 0; i++) {
+        std::this_thread::sleep_for(milliseconds(10));
+    }
+    std::this_thread::sleep_for(milliseconds(10));
+
+    std::vector<Metric> next = make_metrics(2);
+    EXPECT_THROW(plg.publish_metrics(next, Config(map)),
+                 Plugin::PluginException);
+
+    // neither the failed batch nor the one that reported it is lost
+    sink.set_fail(false);
+    try {
+        plg.flush();
+    } catch (Plugin::PluginException&) {
+        // a timer retry failed again before the sink came back
+    }
+    size_t delivered = 0;
+    for (size_t n : sink.batch_sizes) delivered += n;
+    EXPECT_EQ(3, delivered);
+    EXPECT_EQ(0, plg.buffered());
+}
+
+TEST(CoalescingPublisherTest, SlowSinkDoesNotBlockPublishers) {
+    RecordingPublisher sink;
+    sink.hold = true;
+    CoalescingPublisher plg(&sink, {2, 0, milliseconds(0)});
+    rpc::ConfigMap map = path_config("/a");
+
+    std::thread first([&] {
+        std::vector<Metric> metrics = make_metrics(2);
+        plg.publish_metrics(metrics, Config(map));
+    });
+    for (int i = 0; i < 200 && sink.tries() == 0; i++) {
+        std::this_thread::sleep_for(milliseconds(10));
+    }
+    ASSERT_EQ(1, sink.tries());
+
+    // queued behind the stuck batch instead of waiting for it
+    std::vector<Metric> metrics = make_metrics(3);
+    plg.publish_metrics(metrics, Config(map));
+    EXPECT_EQ(5, plg.buffered());
+
+    sink.set_hold(false);
+    first.join();
+    ASSERT_EQ(2, sink.calls());
+    EXPECT_EQ(2, sink.batch_sizes[0]);
+    EXPECT_EQ(3, sink.batch_sizes[1]);
+    EXPECT_EQ(0, plg.buffered());
+}
+
+TEST(CoalescingPublisherTest, RejectedConfigDoesNotBlockOthers) {
+    RecordingPublisher sink;
+    sink.fail_path = "/bad";
+    CoalescingPublisher plg(&sink, {2, 0, std::chrono::hours(1), 3});
+    rpc::ConfigMap bad = path_config("/bad");
+    rpc::ConfigMap good = path_config("/good");
+    std::vector<Metric> metrics = make_metrics(2);
+
+    EXPECT_THROW(plg.publish_metrics(metrics, Config(bad)),
+                 Plugin::PluginException);
+    EXPECT_NO_THROW(plg.publish_metrics(metrics, Config(good)));
+    // waits behind the rejected group of its config, which waits for a retry
+    EXPECT_NO_THROW(plg.publish_metrics(metrics, Config(bad)));
+    EXPECT_NO_THROW(plg.publish_metrics(metrics, Config(good)));
+
+    ASSERT_EQ(2, sink.calls());
+    EXPECT_EQ("/good", sink.paths[0]);
+    EXPECT_EQ("/good", sink.paths[1]);
+    EXPECT_EQ(4, plg.buffered());
+    EXPECT_EQ(3, sink.tries());
+
+    EXPECT_THROW(plg.flush(), Plugin::PluginException);
+    try {
+        plg.flush();
+        FAIL() << "the last attempt should report the drop";
+    } catch (Plugin::PluginException& e) {
+        EXPECT_NE(std::string::npos,
+                  std::string(e.what()).find("dropped 4 metrics"));
+    }
+    EXPECT_EQ(5, sink.tries());
+    EXPECT_EQ(0, plg.buffered());
+    EXPECT_EQ(4, plg.dropped());
+    EXPECT_NO_THROW(plg.flush());
+}
@@ -16,6 +16,7 @@ limitations under the License.
 #include <snap/proxy/collector_proxy.h>
 #include "gmock/gmock.h"
 
+#include <chrono>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -98,6 +99,40 @@ TEST(CollectorProxySuccessTest, CollectMetricsWorks) {
     EXPECT_EQ("/foo/bar", ns_str);
 }
 
+namespace {
+
+// Collects nothing and reports the rest as missing.
+class PartialCollector : public MockCollector {
+ public:
+    std::string collect_metrics_by(vector<Metric> &metrics,
+                                   std::chrono::system_clock::time_point) {
+        metrics.resize(1);
+        return "rack2: timed out";
+    }
+};
+
+}  // namespace
+
+TEST(CollectorProxySuccessTest, CollectMetricsSendsIncompleteAsMetric) {
+    PartialCollector mockee;
+    CollectorImpl collector(&mockee);
+    rpc::MetricsArg args;
+    *args.add_metrics() = *mockee.fake_metric.get_rpc_metric_ptr();
+    Metric other({{"foo", "", ""}, {"*", "rack", ""}, {"baz", "", ""}},
+                 "", "");
+    *args.add_metrics() = *other.get_rpc_metric_ptr();
+    rpc::MetricsReply resp;
+    grpc::Status status = collector.CollectMetrics(nullptr, &args, &resp);
+
+    // snapteld would discard the whole reply over an error
+    EXPECT_EQ(grpc::StatusCode::OK, status.error_code());
+    EXPECT_EQ("", resp.error());
+    ASSERT_EQ(2, resp.metrics_size());
+    EXPECT_EQ("/foo/bar", extract_ns(resp.metrics(0)));
+    EXPECT_EQ("/foo/collect/incomplete", extract_ns(resp.metrics(1)));
+    EXPECT_EQ("rack2: timed out", resp.metrics(1).string_data());
+}
+
 TEST(CollectorProxySuccessTest, PingWorks) {
     MockCollector mockee;
     rpc::ErrReply resp;
@@ -0,0 +1,178 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/config.h"
+#include "snap/grpc_host.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+#include "snap/proxy/plugin_proxy.h"
+#include "snap/rpc/plugin.grpc.pb.h"
+#include "gtest/gtest.h"
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <grpc++/grpc++.h>
+
+using Plugin::Config;
+using Plugin::ConfigPolicy;
+using Plugin::GRPCHost;
+using Plugin::Meta;
+using Plugin::Metric;
+using Plugin::Proxy::ReplyCompression;
+
+namespace {
+
+Metric make_metric(int i) {
+    return Metric({{"intel", "", ""}, {"procfs", "", ""}, {"disk", "", ""},
+                   {"sda" + std::to_string(i), "", ""}, {"reads", "", ""}},
+                  "B", "");
+}
+
+class WideCollector : public Plugin::CollectorInterface {
+ public:
+    explicit WideCollector(int count) : count(count) {}
+
+    const ConfigPolicy get_config_policy() { return ConfigPolicy(); }
+
+    std::vector<Metric> get_metric_types(Config cfg) {
+        std::vector<Metric> metrics;
+        for (int i = 0; i < count; i++) metrics.push_back(make_metric(i));
+        return metrics;
+    }
+
+    void collect_metrics(std::vector<Metric>& metrics) {}
+
+    int count;
+};
+
+class EchoProcessor : public Plugin::ProcessorInterface {
+ public:
+    const ConfigPolicy get_config_policy() { return ConfigPolicy(); }
+
+    void process_metrics(std::vector<Metric>& metrics, const Config& config) {}
+};
+
+rpc::MetricsReply reply_of(int count) {
+    rpc::MetricsReply reply;
+    for (int i = 0; i < count; i++) {
+        *reply.add_metrics() = *make_metric(i).get_rpc_metric_ptr();
+    }
+    return reply;
+}
+
+std::shared_ptr<grpc::Channel> dial(const GRPCHost& host) {
+    return grpc::CreateChannel("127.0.0.1:" + std::to_string(host.port(0)),
+                               grpc::InsecureChannelCredentials());
+}
+
+grpc::Status metric_types(const GRPCHost& host, rpc::MetricsReply* reply) {
+    auto stub = rpc::Collector::NewStub(dial(host));
+    grpc::ClientContext ctx;
+    return stub->GetMetricTypes(&ctx, rpc::GetMetricTypesArg(), reply);
+}
+
+grpc::Status process(const GRPCHost& host, int count) {
+    auto stub = rpc::Processor::NewStub(dial(host));
+    grpc::ClientContext ctx;
+    rpc::PubProcArg arg;
+    *arg.mutable_metrics() = reply_of(count).metrics();
+    rpc::MetricsReply reply;
+    return stub->Process(&ctx, arg, &reply);
+}
+
+}  // namespace
+
+TEST(ReplyCompressionTest, LeavesRepliesAloneByDefault) {
+    grpc::ServerContext ctx;
+    ctx.set_compression_algorithm(GRPC_COMPRESS_DEFLATE);
+    ReplyCompression(Meta(Plugin::Collector, "wide", 1)).apply(&ctx,
+                                                                reply_of(50));
+    EXPECT_EQ(GRPC_COMPRESS_DEFLATE, ctx.compression_algorithm());
+    EXPECT_FALSE(ctx.compression_level_set());
+
+    ReplyCompression().apply(nullptr, reply_of(1));
+}
+
+TEST(ReplyCompressionTest, SkipsRepliesUnderThreshold) {
+    Meta meta(Plugin::Collector, "wide", 1);
+    meta.compression = Plugin::Gzip;
+    meta.compression_threshold = size_t(reply_of(10).ByteSize());
+    ReplyCompression compression(meta);
+
+    grpc::ServerContext small;
+    compression.apply(&small, reply_of(9));
+    EXPECT_EQ(GRPC_COMPRESS_NONE, small.compression_algorithm());
+
+    grpc::ServerContext large;
+    compression.apply(&large, reply_of(10));
+    EXPECT_EQ(GRPC_COMPRESS_GZIP, large.compression_algorithm());
+    EXPECT_FALSE(large.compression_level_set());
+}
+
+TEST(ReplyCompressionTest, LevelOverridesAlgorithm) {
+    Meta meta(Plugin::Collector, "wide", 1);
+    meta.compression = Plugin::Deflate;
+    meta.compression_level = Plugin::CompressHigh;
+    meta.compression_threshold = 0;
+
+    grpc::ServerContext ctx;
+    ReplyCompression(meta).apply(&ctx, reply_of(1));
+    EXPECT_TRUE(ctx.compression_level_set());
+    EXPECT_EQ(GRPC_COMPRESS_LEVEL_HIGH, ctx.compression_level());
+}
+
+TEST(ReplyCompressionTest, CompressedRepliesRoundTrip) {
+    WideCollector plg(500);
+    Meta meta(Plugin::Collector, "wide", 1);
+    meta.compression = Plugin::Gzip;
+    GRPCHost host((GRPCHost::Options()));
+    host.add(&plg, meta);
+    std::stringstream out;
+    host.start(out);
+
+    rpc::MetricsReply reply;
+    ASSERT_TRUE(metric_types(host, &reply).ok());
+    ASSERT_EQ(500, reply.metrics_size());
+    EXPECT_EQ("sda499", reply.metrics(499).namespace_(3).value());
+    host.shutdown();
+}
+
+TEST(MessageSizeTest, HostBoundsMessages) {
+    EchoProcessor proc;
+    GRPCHost::Options opts;
+    opts.max_receive_message_size = 4096;
+    GRPCHost host(opts);
+    host.add(&proc, Meta(Plugin::Processor, "echo", 1));
+    std::stringstream out;
+    host.start(out);
+
+    EXPECT_TRUE(process(host, 2).ok());
+    EXPECT_EQ(grpc::StatusCode::RESOURCE_EXHAUSTED,
+              process(host, 200).error_code());
+    host.shutdown();
+
+    WideCollector plg(200);
+    opts.max_receive_message_size = 0;
+    opts.max_send_message_size = 4096;
+    GRPCHost bounded(opts);
+    bounded.add(&plg, Meta(Plugin::Collector, "wide", 1));
+    bounded.start(out);
+
+    rpc::MetricsReply reply;
+    EXPECT_EQ(grpc::StatusCode::RESOURCE_EXHAUSTED,
+              metric_types(bounded, &reply).error_code());
+    bounded.shutdown();
+}
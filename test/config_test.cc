@@ -98,3 +98,31 @@ TEST(PluginConfigTest, GetIntValueWorks) {
 
     EXPECT_EQ(0xface, config.get_int("its"));
 }
+
+TEST(PluginConfigTest, FingerprintIgnoresInsertionOrder) {
+    rpc::ConfigMap firstMap;
+    (*firstMap.mutable_stringmap())["path"] = "/tmp/out";
+    (*firstMap.mutable_intmap())["port"] = 4505;
+    (*firstMap.mutable_boolmap())["sync"] = true;
+    rpc::ConfigMap secondMap;
+    (*secondMap.mutable_boolmap())["sync"] = true;
+    (*secondMap.mutable_intmap())["port"] = 4505;
+    (*secondMap.mutable_stringmap())["path"] = "/tmp/out";
+
+    EXPECT_EQ(Plugin::Config(firstMap).fingerprint(),
+              Plugin::Config(secondMap).fingerprint());
+}
+
+TEST(PluginConfigTest, FingerprintDiffersOnValue) {
+    rpc::ConfigMap firstMap;
+    (*firstMap.mutable_stringmap())["path"] = "/tmp/out";
+    rpc::ConfigMap secondMap;
+    (*secondMap.mutable_stringmap())["path"] = "/tmp/out2";
+    rpc::ConfigMap thirdMap;
+    (*thirdMap.mutable_stringmap())["pat"] = "h/tmp/out";
+
+    EXPECT_NE(Plugin::Config(firstMap).fingerprint(),
+              Plugin::Config(secondMap).fingerprint());
+    EXPECT_NE(Plugin::Config(firstMap).fingerprint(),
+              Plugin::Config(thirdMap).fingerprint());
+}
@@ -0,0 +1,163 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+#include "snap/processor/dedup.h"
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using std::chrono::seconds;
+using std::chrono::system_clock;
+using Plugin::ChangeFilter;
+using Plugin::Config;
+using Plugin::DedupProcessor;
+using Plugin::Metric;
+using Plugin::PluginException;
+
+namespace {
+
+template <typename T>
+Metric gauge(const std::string& name, int sec, T value) {
+    Metric met({{"intel", "", ""}, {"inventory", "", ""}, {name, "", ""}},
+               "", "");
+    met.set_timestamp(system_clock::time_point(seconds(sec)));
+    met.set_data(value);
+    return met;
+}
+
+template <typename T>
+bool pass(ChangeFilter& filter, const std::string& name, int sec, T value) {
+    return filter.pass(*gauge(name, sec, value).get_rpc_metric_ptr());
+}
+
+}  // namespace
+
+TEST(ChangeFilterTest, PassesChangesAndKeepalives) {
+    ChangeFilter::Options opts;
+    opts.keepalive = 3;
+    ChangeFilter filter(opts);
+
+    EXPECT_TRUE(pass(filter, "mtu", 0, int64_t(1500)));
+    EXPECT_FALSE(pass(filter, "mtu", 10, int64_t(1500)));
+    EXPECT_FALSE(pass(filter, "mtu", 20, int64_t(1500)));
+    // the third sample since the last one passed
+    EXPECT_TRUE(pass(filter, "mtu", 30, int64_t(1500)));
+    EXPECT_FALSE(pass(filter, "mtu", 40, int64_t(1500)));
+    EXPECT_TRUE(pass(filter, "mtu", 50, int64_t(9000)));
+    EXPECT_FALSE(pass(filter, "mtu", 60, int64_t(9000)));
+
+    EXPECT_TRUE(pass(filter, "state", 0, std::string("up")));
+    EXPECT_FALSE(pass(filter, "state", 10, std::string("up")));
+    EXPECT_TRUE(pass(filter, "state", 20, std::string("down")));
+    // same bits, different type
+    EXPECT_TRUE(pass(filter, "mtu", 70, uint64_t(9000)));
+}
+
+TEST(ChangeFilterTest, ToleranceBands) {
+    ChangeFilter::Options opts;
+    opts.keepalive = 0;
+    opts.tolerance = 0.5;
+    ChangeFilter filter(opts);
+
+    EXPECT_TRUE(pass(filter, "temp", 0, 20.0));
+    EXPECT_FALSE(pass(filter, "temp", 10, 20.4));
+    // compared to 20.0, the last passed, not 20.4
+    EXPECT_TRUE(pass(filter, "temp", 20, 20.6));
+    EXPECT_FALSE(pass(filter, "temp", 30, 20.2));
+
+    opts.tolerance = 0;
+    opts.relative_tolerance = 0.01;
+    ChangeFilter relative(opts);
+    EXPECT_TRUE(pass(relative, "size", 0, 1000.0));
+    EXPECT_FALSE(pass(relative, "size", 10, 1009.0));
+    EXPECT_TRUE(pass(relative, "size", 20, 1011.0));
+}
+
+TEST(ChangeFilterTest, EvictsStaleSeries) {
+    ChangeFilter::Options opts;
+    opts.stale_after = seconds(60);
+    ChangeFilter filter(opts);
+    pass(filter, "a", 0, 1.0);
+    pass(filter, "b", 50, 1.0);
+    EXPECT_EQ(1u, filter.evict(system_clock::time_point(seconds(100))));
+    EXPECT_EQ(1u, filter.series());
+    EXPECT_TRUE(pass(filter, "a", 101, 1.0));
+}
+
+TEST(DedupProcessorTest, DropsRepeatsInPlace) {
+    rpc::ConfigMap map;
+    (*map.mutable_stringmap())["match"] = "/intel/inventory";
+    (*map.mutable_intmap())["keepalive"] = 0;
+    Config config(map);
+    DedupProcessor plg;
+
+    for (int interval = 0; interval < 3; interval++) {
+        std::vector<Metric> batch;
+        batch.push_back(gauge("mtu", interval, int64_t(1500)));
+        Metric other({{"intel", "", ""}, {"load", "", ""}}, "", "");
+        other.set_data(1.0);
+        batch.push_back(other);
+        batch.push_back(gauge("links", interval, int64_t(interval / 2)));
+        plg.process_metrics(batch, config);
+
+        if (interval == 0) {
+            ASSERT_EQ(3u, batch.size());
+        } else if (interval == 1) {
+            ASSERT_EQ(1u, batch.size());
+            EXPECT_EQ("load", batch[0].ns()[1].value);
+        } else {
+            ASSERT_EQ(2u, batch.size());
+            EXPECT_EQ("load", batch[0].ns()[1].value);
+            EXPECT_EQ(1, batch[1].get_int64_data());
+        }
+    }
+}
+
+TEST(DedupProcessorTest, KeepsValuesAcrossConfigs) {
+    rpc::ConfigMap map;
+    (*map.mutable_stringmap())["match"] = "/intel/inventory";
+    (*map.mutable_intmap())["keepalive"] = 0;
+    Config config(map);
+    DedupProcessor plg;
+
+    std::vector<Metric> batch = {gauge("mtu", 0, int64_t(1500))};
+    plg.process_metrics(batch, config);
+    // more configs than the prepared state cache holds
+    for (int i = 0; i < 100; i++) {
+        rpc::ConfigMap other;
+        (*other.mutable_intmap())["stale_after"] = 600 + i;
+        std::vector<Metric> noise = {gauge("links", 0, int64_t(1))};
+        plg.process_metrics(noise, Config(other));
+    }
+
+    std::vector<Metric> next = {gauge("mtu", 1, int64_t(1500))};
+    plg.process_metrics(next, config);
+    EXPECT_EQ(0u, next.size());
+}
+
+TEST(DedupProcessorTest, RejectsBadConfig) {
+    for (const char* tolerance : {"-1", "0.5x", ""}) {
+        rpc::ConfigMap map;
+        (*map.mutable_stringmap())["tolerance"] = tolerance;
+        Config config(map);
+        DedupProcessor plg;
+        std::vector<Metric> batch;
+        EXPECT_THROW(plg.process_metrics(batch, config), PluginException)
+            << tolerance;
+    }
+}
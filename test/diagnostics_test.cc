@@ -0,0 +1,189 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/config.h"
+#include "snap/diagnostics.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+#include "gtest/gtest.h"
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using Plugin::Config;
+using Plugin::ConfigPolicy;
+using Plugin::Diagnostics;
+using Plugin::Meta;
+using Plugin::Metric;
+using Plugin::PluginException;
+
+namespace {
+
+class GreetCollector : public Plugin::CollectorInterface {
+ public:
+    const ConfigPolicy get_config_policy() {
+        ConfigPolicy policy;
+        policy.add_rule({"intel", "greet"},
+                        Plugin::StringRule{"greeting", {"hello", false}});
+        return policy;
+    }
+
+    std::vector<Metric> get_metric_types(Config cfg) {
+        return {Metric({{"intel", "", ""}, {"greet", "", ""}}, "", "")};
+    }
+
+    void collect_metrics(std::vector<Metric>& metrics) {
+        for (Metric& met : metrics) {
+            // 100 allocations per collect, kept so they aren't elided
+            for (int i = 0; i < 100; i++) kept.emplace_back(new int(i));
+            met.set_data(met.get_config().get_string("greeting") + " " +
+                         met.get_config().get_string("name"));
+        }
+    }
+
+    std::vector<std::unique_ptr<int>> kept;
+};
+
+class FailingProcessor : public Plugin::ProcessorInterface {
+ public:
+    const ConfigPolicy get_config_policy() { return ConfigPolicy(); }
+
+    void process_metrics(std::vector<Metric>& metrics, const Config& config) {
+        throw PluginException("no can do");
+    }
+};
+
+class CountingPublisher : public Plugin::PublisherInterface {
+ public:
+    CountingPublisher() : published(0) {}
+
+    const ConfigPolicy get_config_policy() { return ConfigPolicy(); }
+
+    void publish_metrics(std::vector<Metric>& metrics, const Config& config) {
+        published += metrics.size();
+    }
+
+    size_t published;
+};
+
+Diagnostics::Options parse(std::vector<std::string> args) {
+    std::vector<char*> argv;
+    for (std::string& arg : args) argv.push_back(&arg[0]);
+    return Diagnostics::parse(int(argv.size()), argv.data());
+}
+
+}  // namespace
+
+TEST(DiagnosticsTest, ParsesFlags) {
+    Diagnostics::Options opts = parse({"plugin", "{\"a\": 1}"});
+    EXPECT_FALSE(opts.enabled);
+
+    opts = parse({"plugin", "--rounds", "3", "--diagnose", "--config", "{}",
+                  "--batch", "7"});
+    EXPECT_TRUE(opts.enabled);
+    EXPECT_EQ(3, opts.rounds);
+    EXPECT_EQ(7, opts.batch);
+    EXPECT_EQ("{}", opts.config);
+
+    EXPECT_THROW(parse({"plugin", "--diagnose", "--rounds", "0"}),
+                 PluginException);
+    EXPECT_THROW(parse({"plugin", "--diagnose", "--rounds"}), PluginException);
+    EXPECT_THROW(parse({"plugin", "--diagnose", "--bogus"}), PluginException);
+}
+
+TEST(DiagnosticsTest, RunsCollector) {
+    GreetCollector plg;
+    Diagnostics::Options opts;
+    opts.config = "{\"name\": \"world\"}";
+    opts.rounds = 5;
+    std::stringstream out;
+    EXPECT_TRUE(Diagnostics(opts, out).run(
+        &plg, Meta(Plugin::Collector, "greet", 3)));
+    std::string report = out.str();
+
+    EXPECT_NE(std::string::npos,
+              report.find("Plugin: greet (collector), version 3"));
+    EXPECT_NE(std::string::npos,
+              report.find("string  intel.greet greeting default \"hello\""));
+    EXPECT_NE(std::string::npos,
+              report.find("Metric types (1):\n  intel/greet\n"));
+    // the policy default is merged with the config given
+    EXPECT_NE(std::string::npos, report.find("value=\"hello world\""));
+
+    std::string line;
+    std::stringstream lines(report);
+    while (std::getline(lines, line) &&
+           line.compare(0, 15, "collect_metrics") != 0) {}
+    std::stringstream row(line);
+    std::string name;
+    int rounds;
+    double avg_ms, max_ms, allocs;
+    size_t bytes;
+    ASSERT_TRUE(bool(row >> name >> rounds >> avg_ms >> max_ms >> allocs >>
+                     bytes));
+    EXPECT_EQ(5, rounds);
+    EXPECT_LE(avg_ms, max_ms);
+    EXPECT_GE(allocs, 100.0);
+    EXPECT_GT(bytes, 0u);
+}
+
+TEST(DiagnosticsTest, ReportsAllocsAsUnknownWithoutCounter) {
+    // as if libsnap_allocs weren't linked
+    Diagnostics::AllocCounter* counter = Diagnostics::set_alloc_counter(
+        nullptr);
+    GreetCollector plg;
+    Diagnostics::Options opts;
+    opts.config = "{\"name\": \"world\"}";
+    std::stringstream out;
+    bool ok = Diagnostics(opts, out).run(&plg,
+                                         Meta(Plugin::Collector, "greet", 3));
+    Diagnostics::set_alloc_counter(counter);
+    EXPECT_TRUE(ok);
+
+    std::string line;
+    std::stringstream lines(out.str());
+    while (std::getline(lines, line) &&
+           line.compare(0, 15, "collect_metrics") != 0) {}
+    EXPECT_NE(std::string::npos, line.find(" n/a ")) << line;
+}
+
+TEST(DiagnosticsTest, ReportsFailure) {
+    FailingProcessor plg;
+    std::stringstream out;
+    EXPECT_FALSE(Diagnostics(Diagnostics::Options(), out).run(
+        &plg, Meta(Plugin::Processor, "failing", 1)));
+    EXPECT_NE(std::string::npos,
+              out.str().find("process_metrics failed: no can do"));
+
+    Diagnostics::Options opts;
+    opts.config = "[1, 2]";
+    out.str("");
+    EXPECT_FALSE(Diagnostics(opts, out).run(
+        &plg, Meta(Plugin::Processor, "failing", 1)));
+    EXPECT_NE(std::string::npos, out.str().find("--config failed"));
+}
+
+TEST(DiagnosticsTest, FeedsSyntheticBatch) {
+    CountingPublisher plg;
+    Diagnostics::Options opts;
+    opts.batch = 4;
+    opts.rounds = 3;
+    std::stringstream out;
+    EXPECT_TRUE(Diagnostics(opts, out).run(
+        &plg, Meta(Plugin::Publisher, "counting", 1)));
+    EXPECT_EQ(12u, plg.published);
+    EXPECT_NE(std::string::npos, out.str().find("Published metrics (4):"));
+    EXPECT_NE(std::string::npos, out.str().find("publish_metrics"));
+}
@@ -0,0 +1,237 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/event_loop.h"
+#include "gtest/gtest.h"
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using std::chrono::milliseconds;
+using Plugin::EventLoop;
+
+namespace {
+
+// Counts down completions, for the test to wait on.
+class Latch {
+ public:
+    explicit Latch(int count) : count(count) {}
+
+    void done() {
+        std::lock_guard<std::mutex> lk(mtx);
+        if (--count == 0) cv.notify_all();
+    }
+
+    bool wait() {
+        std::unique_lock<std::mutex> lk(mtx);
+        return cv.wait_for(lk, std::chrono::seconds(10),
+                           [this] { return count <= 0; });
+    }
+
+ private:
+    int count;
+    std::mutex mtx;
+    std::condition_variable cv;
+};
+
+void nonblocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+}  // namespace
+
+TEST(EventLoopTest, RunsPostedTasksAndTimers) {
+    EventLoop loop((EventLoop::Options()));
+    std::mutex mtx;
+    std::vector<int> order;
+    Latch latch(4);
+    auto record = [&](int i) {
+        return [&, i] {
+            {
+                std::lock_guard<std::mutex> lk(mtx);
+                order.push_back(i);
+            }
+            latch.done();
+        };
+    };
+    loop.after(milliseconds(60), record(3));
+    uint64_t cancelled = loop.after(milliseconds(40), record(99));
+    loop.after(milliseconds(20), record(2));
+    loop.post(record(1));
+    EXPECT_TRUE(loop.cancel(cancelled));
+    EXPECT_FALSE(loop.cancel(cancelled));
+    loop.after(milliseconds(80), [&] { latch.done(); });
+
+    ASSERT_TRUE(latch.wait());
+    EXPECT_EQ(std::vector<int>({1, 2, 3}), order);
+}
+
+TEST(EventLoopTest, KeepsThousandsOfReadsInFlight) {
+    EventLoop::Options opts;
+    opts.threads = 2;
+    EventLoop loop(opts);
+    const int kPipes = 1000;
+    std::vector<int> fds(2 * kPipes);
+    std::vector<char> bufs(kPipes * 8);
+    std::atomic<int> good(0);
+    Latch latch(kPipes);
+    for (int i = 0; i < kPipes; i++) {
+        ASSERT_EQ(0, pipe(&fds[2 * i]));
+        nonblocking(fds[2 * i]);
+        loop.read(fds[2 * i], &bufs[i * 8], 8, [&, i](size_t n, int err) {
+            if (err == 0 && n == 4 &&
+                std::string(&bufs[i * 8], 4) == std::to_string(1000 + i)) {
+                good++;
+            }
+            latch.done();
+        });
+    }
+    // every read is pending before any data arrives
+    for (int i = kPipes - 1; i >= 0; i--) {
+        std::string data = std::to_string(1000 + i);
+        ASSERT_EQ(4, ::write(fds[2 * i + 1], data.data(), 4));
+    }
+    ASSERT_TRUE(latch.wait());
+    EXPECT_EQ(kPipes, good.load());
+    for (int fd : fds) close(fd);
+}
+
+TEST(EventLoopTest, ConnectsWritesAndReads) {
+    EventLoop loop((EventLoop::Options()));
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    ASSERT_EQ(0, bind(server, reinterpret_cast<sockaddr*>(&addr), len));
+    ASSERT_EQ(0, listen(server, 1));
+    getsockname(server, reinterpret_cast<sockaddr*>(&addr), &len);
+
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    nonblocking(client);
+    // large enough to need several writes
+    std::string payload(4 << 20, 'x');
+    std::atomic<int> result(-1);
+    Latch latch(1);
+    loop.connect(client, reinterpret_cast<sockaddr*>(&addr), len,
+                 [&](int err) {
+        if (err) {
+            result = err;
+            return latch.done();
+        }
+        loop.write(client, payload.data(), payload.size(), [&](int err) {
+            result = err;
+            latch.done();
+        });
+    });
+
+    int conn = accept(server, nullptr, nullptr);
+    ASSERT_GE(conn, 0);
+    size_t got = 0;
+    char buf[65536];
+    ssize_t n;
+    while (got < payload.size() && (n = ::read(conn, buf, sizeof(buf))) > 0) {
+        got += n;
+    }
+    ASSERT_TRUE(latch.wait());
+    EXPECT_EQ(0, result.load());
+    EXPECT_EQ(payload.size(), got);
+
+    // the peer closing ends a pending read
+    close(conn);
+    char rbuf[16];
+    Latch eof(1);
+    size_t read_n = 1;
+    loop.read(client, rbuf, sizeof(rbuf), [&](size_t n, int err) {
+        read_n = n;
+        eof.done();
+    });
+    ASSERT_TRUE(eof.wait());
+    EXPECT_EQ(0u, read_n);
+    loop.forget(client);
+    close(client);
+    close(server);
+}
+
+TEST(EventLoopTest, WatchesReusedFdNumbers) {
+    EventLoop loop((EventLoop::Options()));
+    char buf[8];
+    // bytes read from fd, or -1 if the read never completes
+    auto read_once = [&](int fd) -> ssize_t {
+        Latch latch(1);
+        size_t got = 0;
+        loop.read(fd, buf, sizeof(buf), [&](size_t n, int err) {
+            got = n;
+            latch.done();
+        });
+        return latch.wait() ? ssize_t(got) : -1;
+    };
+
+    int first[2];
+    ASSERT_EQ(0, pipe(first));
+    nonblocking(first[0]);
+    ASSERT_EQ(1, ::write(first[1], "x", 1));
+    EXPECT_EQ(1, read_once(first[0]));
+
+    // closed without forget once its read completed, and the number taken
+    // by another pipe
+    int second[2];
+    ASSERT_EQ(0, pipe(second));
+    ASSERT_EQ(first[0], dup2(second[0], first[0]));
+    close(second[0]);
+    nonblocking(first[0]);
+    ASSERT_EQ(1, ::write(second[1], "y", 1));
+    EXPECT_EQ(1, read_once(first[0]));
+
+    loop.forget(first[0]);
+    close(first[0]);
+    close(first[1]);
+    close(second[1]);
+}
+
+TEST(EventLoopTest, ReadsFiles) {
+    char tmpl[] = "/tmp/event_loop_test.XXXXXX";
+    close(mkstemp(tmpl));
+    std::ofstream(tmpl) << "cpu 1 2 3\n";
+    EventLoop loop((EventLoop::Options()));
+    std::string contents;
+    int result = -1;
+    int missing = 0;
+    Latch latch(2);
+    loop.read_file(tmpl, [&](std::string got, int err) {
+        contents = got;
+        result = err;
+        latch.done();
+    });
+    loop.read_file("/nonexistent/file", [&](std::string got, int err) {
+        missing = err;
+        latch.done();
+    });
+    ASSERT_TRUE(latch.wait());
+    unlink(tmpl);
+    EXPECT_EQ(0, result);
+    EXPECT_EQ("cpu 1 2 3\n", contents);
+    EXPECT_EQ(ENOENT, missing);
+}
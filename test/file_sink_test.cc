@@ -0,0 +1,129 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/config.h"
+#include "snap/plugin.h"
+#include "snap/publisher/file_sink.h"
+#include "snap/publisher/text_buffer.h"
+#include "gtest/gtest.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using std::chrono::milliseconds;
+using Plugin::Config;
+using Plugin::FileSink;
+using Plugin::TextBuffer;
+
+namespace {
+
+class FileSinkTest : public ::testing::Test {
+protected:
+  std::string path;
+
+  virtual void SetUp() {
+    char tmpl[] = "/tmp/file_sink_test.XXXXXX";
+    int fd = mkstemp(tmpl);
+    close(fd);
+    path = tmpl;
+  }
+
+  virtual void TearDown() {
+    unlink(path.c_str());
+  }
+
+  std::string contents() {
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+  }
+};
+
+}  // namespace
+
+TEST_F(FileSinkTest, BuffersUntilFlush) {
+    FileSink::Options opts;
+    opts.sync_interval = milliseconds(0);
+    FileSink sink(opts);
+
+    sink.write(path, [](TextBuffer& out) { out.append("one\n", 4); });
+    EXPECT_EQ("", contents());
+
+    sink.flush();
+    EXPECT_EQ("one\n", contents());
+}
+
+TEST_F(FileSinkTest, WritesOutFullBuffer) {
+    FileSink::Options opts;
+    opts.sync_interval = milliseconds(0);
+    opts.buffer_bytes = 8;
+    FileSink sink(opts);
+
+    sink.write(path, [](TextBuffer& out) { out.append("0123456789\n", 11); });
+
+    EXPECT_EQ("0123456789\n", contents());
+}
+
+TEST_F(FileSinkTest, LooksUpFileByConfig) {
+    FileSink::Options opts;
+    opts.sync_interval = milliseconds(0);
+    FileSink sink(opts);
+    rpc::ConfigMap map;
+    (*map.mutable_stringmap())["path"] = path;
+
+    sink.write(Config(map), "path", [](TextBuffer& out) { out.append('a'); });
+    sink.write(Config(map), "path", [](TextBuffer& out) { out.append('b'); });
+    sink.flush();
+
+    EXPECT_EQ("ab", contents());
+}
+
+TEST_F(FileSinkTest, BackgroundRoundWritesOut) {
+    FileSink::Options opts;
+    opts.sync_interval = milliseconds(10);
+    FileSink sink(opts);
+
+    sink.write(path, [](TextBuffer& out) { out.append("tick\n", 5); });
+    for (int i = 0; i < 200 && contents().empty(); i++) {
+        std::this_thread::sleep_for(milliseconds(10));
+    }
+
+    EXPECT_EQ("tick\n", contents());
+}
+
+TEST_F(FileSinkTest, DestructorWritesOut) {
+    {
+        FileSink::Options opts;
+        opts.sync_interval = milliseconds(0);
+        FileSink sink(opts);
+        sink.write(path, [](TextBuffer& out) { out.append("last\n", 5); });
+    }
+
+    EXPECT_EQ("last\n", contents());
+}
+
+TEST_F(FileSinkTest, UnopenablePathThrows) {
+    FileSink::Options opts;
+    opts.sync_interval = milliseconds(0);
+    FileSink sink(opts);
+
+    EXPECT_THROW(sink.write("/nonexistent/dir/file", [](TextBuffer& out) {}),
+                 Plugin::PluginException);
+}
@@ -0,0 +1,135 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+#include "snap/processor/filter.h"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+using Plugin::Config;
+using Plugin::FilterProcessor;
+using Plugin::Metric;
+using Plugin::MetricFilter;
+using Plugin::PluginException;
+
+namespace {
+
+Metric make_metric(const std::string& path,
+                   std::vector<std::pair<std::string, std::string>> tags = {}) {
+    std::vector<Metric::NamespaceElement> ns;
+    size_t begin = 1;
+    while (begin <= path.size()) {
+        size_t end = path.find('/', begin);
+        if (end == std::string::npos) end = path.size();
+        ns.push_back({path.substr(begin, end - begin), "", ""});
+        begin = end + 1;
+    }
+    Metric met(ns, "", "");
+    for (const auto& tag : tags) met.add_tag(tag);
+    return met;
+}
+
+bool keeps(const MetricFilter& filter, const Metric& met) {
+    return filter.keep(*met.get_rpc_metric_ptr());
+}
+
+}  // namespace
+
+TEST(MetricFilterTest, MatchesGlobs) {
+    MetricFilter filter("/intel/procfs/cpu/*/utilization; /intel/net/**", "");
+
+    EXPECT_TRUE(keeps(filter, make_metric("/intel/procfs/cpu/0/utilization")));
+    EXPECT_TRUE(keeps(filter, make_metric("/intel/procfs/cpu/1/utilization")));
+    EXPECT_FALSE(keeps(filter, make_metric("/intel/procfs/cpu/0/idle")));
+    EXPECT_FALSE(keeps(filter, make_metric("/intel/procfs/cpu/utilization")));
+    EXPECT_TRUE(keeps(filter, make_metric("/intel/net")));
+    EXPECT_TRUE(keeps(filter, make_metric("/intel/net/eth0/bytes_recv")));
+    EXPECT_FALSE(keeps(filter, make_metric("/intel/disk/sda")));
+}
+
+TEST(MetricFilterTest, OverlappingRules) {
+    // "**" in the middle, and a literal rule overlapping a wildcard one
+    MetricFilter filter("/intel/**/bytes\n/intel/disk/*/ops", "/**/sda/*");
+
+    EXPECT_TRUE(keeps(filter, make_metric("/intel/bytes")));
+    EXPECT_TRUE(keeps(filter, make_metric("/intel/net/eth0/bytes")));
+    EXPECT_TRUE(keeps(filter, make_metric("/intel/bytes/bytes")));
+    EXPECT_TRUE(keeps(filter, make_metric("/intel/disk/sdb/ops")));
+    EXPECT_FALSE(keeps(filter, make_metric("/intel/disk/sda/bytes")));
+    EXPECT_FALSE(keeps(filter, make_metric("/intel/disk/sda/ops")));
+    EXPECT_FALSE(keeps(filter, make_metric("/intel/net/eth0/bytes/rate")));
+}
+
+TEST(MetricFilterTest, ExcludeOnly) {
+    MetricFilter filter("", "/intel/debug/**");
+
+    EXPECT_TRUE(keeps(filter, make_metric("/intel/net/eth0")));
+    EXPECT_TRUE(keeps(filter, make_metric("/other")));
+    EXPECT_FALSE(keeps(filter, make_metric("/intel/debug/x")));
+
+    MetricFilter all("", "");
+    EXPECT_TRUE(keeps(all, make_metric("/intel/net/eth0")));
+}
+
+TEST(MetricFilterTest, TagPredicates) {
+    MetricFilter filter("/intel/**{host=node1,rack!=r2}; /intel/cpu{env}",
+                        "/intel/**{!owner}");
+
+    EXPECT_TRUE(keeps(filter, make_metric(
+        "/intel/net", {{"host", "node1"}, {"owner", "ops"}})));
+    EXPECT_FALSE(keeps(filter, make_metric(
+        "/intel/net", {{"host", "node1"}, {"rack", "r2"}, {"owner", "ops"}})));
+    EXPECT_FALSE(keeps(filter, make_metric(
+        "/intel/net", {{"host", "node2"}, {"owner", "ops"}})));
+    // excluded for lacking an owner
+    EXPECT_FALSE(keeps(filter, make_metric("/intel/net", {{"host", "node1"}})));
+    EXPECT_TRUE(keeps(filter, make_metric(
+        "/intel/cpu", {{"env", ""}, {"owner", "ops"}})));
+}
+
+TEST(MetricFilterTest, RejectsBadRules) {
+    EXPECT_THROW(MetricFilter("/intel/{host=a", ""), PluginException);
+    EXPECT_THROW(MetricFilter("/intel//cpu", ""), PluginException);
+    EXPECT_THROW(MetricFilter("", "{host=a}"), PluginException);
+    EXPECT_THROW(MetricFilter("/intel{=a}", ""), PluginException);
+}
+
+TEST(FilterProcessorTest, CompactsInPlace) {
+    rpc::ConfigMap map;
+    (*map.mutable_stringmap())["include"] = "/intel/**";
+    (*map.mutable_stringmap())["exclude"] = "/intel/*/drop";
+    Config config(map);
+    FilterProcessor plg;
+
+    std::vector<Metric> batch;
+    batch.reserve(8);
+    batch.push_back(make_metric("/intel/a/drop"));
+    batch.push_back(make_metric("/intel/a/keep"));
+    batch.push_back(make_metric("/other/x"));
+    batch.push_back(make_metric("/intel/b/keep"));
+    batch.push_back(make_metric("/intel/b/drop"));
+    // memoize the namespace, which must move with the metric
+    EXPECT_EQ("a", batch[1].ns()[1].value);
+    const Metric* data = batch.data();
+
+    plg.process_metrics(batch, config);
+    ASSERT_EQ(2u, batch.size());
+    EXPECT_EQ(data, batch.data());
+    EXPECT_EQ(8u, batch.capacity());
+    EXPECT_EQ("a", batch[0].ns()[1].value);
+    EXPECT_EQ("b", batch[1].ns()[1].value);
+}
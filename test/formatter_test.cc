@@ -0,0 +1,153 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/publisher/formatter.h"
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+using std::chrono::milliseconds;
+using std::chrono::system_clock;
+using Plugin::Formatter;
+using Plugin::Metric;
+using Plugin::TextBuffer;
+
+namespace {
+class FormatterTest : public ::testing::Test {
+ protected:
+    FormatterTest() {
+        // 2016-11-22 10:00:00.250 UTC
+        ts = system_clock::time_point(milliseconds(1479808800250LL));
+    }
+
+    Metric& add(std::vector<Metric::NamespaceElement> ns) {
+        metrics.emplace_back(Metric(ns, "", ""));
+        metrics.back().set_timestamp(ts);
+        return metrics.back();
+    }
+
+    std::string format(Formatter::Format fmt) {
+        Formatter formatter(fmt);
+        TextBuffer out;
+        formatter.format(metrics, out);
+        return out.str();
+    }
+
+    system_clock::time_point ts;
+    std::vector<Metric> metrics;
+};
+}  // namespace
+
+TEST_F(FormatterTest, Influx) {
+    Metric& load = add({{"intel", "", ""}, {"cpu load", "", ""}});
+    load.add_tag({"rack", "r1"});
+    load.add_tag({"host", "node,1"});
+    load.set_data(0.5);
+    add({{"intel", "", ""}, {"count", "", ""}}).set_data(int64_t(-3));
+    add({{"intel", "", ""}, {"bytes", "", ""}}).set_data(uint64_t(7));
+    add({{"intel", "", ""}, {"up", "", ""}}).set_data(true);
+    add({{"intel", "", ""}, {"state", "", ""}}).set_data(
+        std::string("say \"hi\""));
+
+    EXPECT_EQ(
+        "intel/cpu\\ load,host=node\\,1,rack=r1 value=0.5 1479808800250000000\n"
+        "intel/count value=-3i 1479808800250000000\n"
+        "intel/bytes value=7u 1479808800250000000\n"
+        "intel/up value=true 1479808800250000000\n"
+        "intel/state value=\"say \\\"hi\\\"\" 1479808800250000000\n",
+        format(Formatter::Influx));
+}
+
+TEST_F(FormatterTest, Graphite) {
+    Metric& load = add({{"intel", "", ""}, {"cpu.0", "", ""}, {"load", "", ""}});
+    load.add_tag({"host", "node 1"});
+    load.set_data(1.25f);
+    add({{"intel", "", ""}, {"state", "", ""}}).set_data(std::string("up"));
+
+    EXPECT_EQ("intel.cpu_0.load;host=node_1 1.25 1479808800\n",
+              format(Formatter::Graphite));
+}
+
+TEST_F(FormatterTest, OpenTSDB) {
+    Metric& load = add({{"intel", "", ""}, {"load", "", ""}});
+    load.add_tag({"host", "node\"1"});
+    load.set_data(int32_t(3));
+    Metric& nan = add({{"intel", "", ""}, {"nan", "", ""}});
+    nan.add_tag({"host", "node1"});
+    nan.set_data(std::numeric_limits<double>::quiet_NaN());
+    Metric& up = add({{"intel", "", ""}, {"up", "", ""}});
+    up.add_tag({"host", "node1"});
+    up.set_data(false);
+
+    EXPECT_EQ(
+        "[{\"metric\":\"intel.load\",\"timestamp\":1479808800250,\"value\":3,"
+        "\"tags\":{\"host\":\"node_1\"}},"
+        "{\"metric\":\"intel.up\",\"timestamp\":1479808800250,\"value\":0,"
+        "\"tags\":{\"host\":\"node1\"}}]",
+        format(Formatter::OpenTSDB));
+}
+
+TEST_F(FormatterTest, OpenTSDBSkipsUntagged) {
+    add({{"intel", "", ""}, {"bare", "", ""}}).set_data(1.5);
+    Metric& empty = add({{"intel", "", ""}, {"empty", "", ""}});
+    empty.add_tag({"host", ""});
+    empty.set_data(2.5);
+    Metric& load = add({{"intel", "", ""}, {"load", "", ""}});
+    load.add_tag({"host", "node1"});
+    load.set_data(3.5);
+
+    Formatter formatter(Formatter::OpenTSDB);
+    TextBuffer out;
+    EXPECT_EQ(1u, formatter.format(metrics, out));
+    EXPECT_EQ(
+        "[{\"metric\":\"intel.load\",\"timestamp\":1479808800250,"
+        "\"value\":3.5,\"tags\":{\"host\":\"node1\"}}]",
+        out.str());
+}
+
+TEST_F(FormatterTest, OpenTSDBEmptyBatch) {
+    EXPECT_EQ("[]", format(Formatter::OpenTSDB));
+}
+
+TEST_F(FormatterTest, Prometheus) {
+    Metric& load = add({{"intel", "", ""}, {"cpu-load", "", ""}});
+    load.add_tag({"rack", "a\\b"});
+    load.add_tag({"host", "line\n\"two\""});
+    load.set_data(uint32_t(12));
+    add({{"9p", "", ""}, {"inf", "", ""}}).set_data(
+        -std::numeric_limits<double>::infinity());
+
+    EXPECT_EQ(
+        "intel_cpu_load{host=\"line\\n\\\"two\\\"\",rack=\"a\\\\b\"} 12 "
+        "1479808800250\n"
+        "_9p_inf -Inf 1479808800250\n",
+        format(Formatter::Prometheus));
+}
+
+TEST_F(FormatterTest, FormatsBatchView) {
+    add({{"intel", "", ""}, {"a", "", ""}}).set_data(1.5);
+    add({{"intel", "", ""}, {"b", "", ""}}).set_data(std::string("skipped"));
+    google::protobuf::RepeatedPtrField<rpc::Metric> batch;
+    for (const Metric& met : metrics) {
+        *batch.Add() = *met.get_rpc_metric_ptr();
+    }
+
+    Formatter formatter(Formatter::Graphite);
+    TextBuffer out;
+    EXPECT_EQ(1u, formatter.format(batch, out));
+    EXPECT_EQ("intel.a 1.5 1479808800\n", out.str());
+}
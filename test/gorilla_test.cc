@@ -0,0 +1,273 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+#include "snap/publisher/file_sink.h"
+#include "snap/publisher/gorilla.h"
+#include "snap/publisher/text_buffer.h"
+#include "gtest/gtest.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using std::chrono::system_clock;
+using Plugin::Config;
+using Plugin::FileSink;
+using Plugin::GorillaDecoder;
+using Plugin::GorillaEncoder;
+using Plugin::GorillaPublisher;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::TextBuffer;
+
+namespace {
+
+Metric make_metric(const std::string& name, int64_t ts_nanos) {
+    Metric met({{"intel", "", ""}, {"mock", "", ""}, {name, "", ""}}, "B", "");
+    met.add_tag({"host", "node1"});
+    met.set_timestamp(system_clock::time_point(
+        std::chrono::duration_cast<system_clock::duration>(
+            nanoseconds(ts_nanos))));
+    return met;
+}
+
+void expect_same(const rpc::Metric& want, const rpc::Metric& got) {
+    ASSERT_EQ(want.namespace__size(), got.namespace__size());
+    for (int i = 0; i < want.namespace__size(); i++) {
+        EXPECT_EQ(want.namespace_(i).value(), got.namespace_(i).value());
+        EXPECT_EQ(want.namespace_(i).name(), got.namespace_(i).name());
+    }
+    EXPECT_EQ(want.tags().size(), got.tags().size());
+    for (const auto& tag : want.tags()) {
+        EXPECT_EQ(tag.second, got.tags().at(tag.first));
+    }
+    EXPECT_EQ(want.unit(), got.unit());
+    EXPECT_EQ(want.timestamp().sec(), got.timestamp().sec());
+    EXPECT_EQ(want.timestamp().nsec(), got.timestamp().nsec());
+    ASSERT_EQ(want.data_case(), got.data_case());
+    switch (want.data_case()) {
+        case rpc::Metric::kFloat64Data:
+            EXPECT_EQ(want.float64_data(), got.float64_data());
+            break;
+        case rpc::Metric::kFloat32Data:
+            EXPECT_EQ(want.float32_data(), got.float32_data());
+            break;
+        case rpc::Metric::kInt32Data:
+            EXPECT_EQ(want.int32_data(), got.int32_data());
+            break;
+        case rpc::Metric::kInt64Data:
+            EXPECT_EQ(want.int64_data(), got.int64_data());
+            break;
+        case rpc::Metric::kUint32Data:
+            EXPECT_EQ(want.uint32_data(), got.uint32_data());
+            break;
+        case rpc::Metric::kUint64Data:
+            EXPECT_EQ(want.uint64_data(), got.uint64_data());
+            break;
+        case rpc::Metric::kBoolData:
+            EXPECT_EQ(want.bool_data(), got.bool_data());
+            break;
+        case rpc::Metric::kStringData:
+            EXPECT_EQ(want.string_data(), got.string_data());
+            break;
+        default:
+            break;
+    }
+}
+
+// Decodes buf and checks it holds the metrics of want, grouped by series
+// in first-seen order.
+void expect_decodes(const std::string& buf, const std::vector<Metric>& want) {
+    GorillaDecoder dec(buf.data(), buf.size());
+    rpc::Metric got;
+    size_t n = 0;
+    while (dec.next(&got)) {
+        ASSERT_LT(n, want.size());
+        expect_same(*want[n].get_rpc_metric_ptr(), got);
+        n++;
+    }
+    EXPECT_EQ(want.size(), n);
+}
+
+}  // namespace
+
+TEST(GorillaTest, RoundTripsEveryType) {
+    const int64_t base = 1479808800123456789LL;
+    std::vector<Metric> metrics;
+    // one series per type, points added series by series so the decoded
+    // order matches
+    for (int i = 0; i < 5; i++) {
+        metrics.push_back(make_metric("f64", base + i * 1000000000LL));
+        metrics.back().set_data(i == 3 ? std::nan("") : 20.5 + i * 0.1);
+    }
+    for (int i = 0; i < 5; i++) {
+        metrics.push_back(make_metric("f32", base + i * 999999937LL));
+        metrics.back().set_data(float(-i * 1.5f));
+    }
+    for (int i = 0; i < 5; i++) {
+        metrics.push_back(make_metric("i32", base - i * 12345LL));
+        metrics.back().set_data(int32_t(i % 2 ? -2147483647 - 1 : 2147483647));
+    }
+    for (int i = 0; i < 5; i++) {
+        metrics.push_back(make_metric("i64", base + (int64_t(i) << 40)));
+        metrics.back().set_data(int64_t(-i * 1000));
+    }
+    for (int i = 0; i < 5; i++) {
+        metrics.push_back(make_metric("u32", base + i));
+        metrics.back().set_data(uint32_t(4000000000u + i));
+    }
+    for (int i = 0; i < 5; i++) {
+        metrics.push_back(make_metric("u64", base));
+        metrics.back().set_data(i % 2 ? std::numeric_limits<uint64_t>::max() :
+                                uint64_t(i));
+    }
+    for (int i = 0; i < 5; i++) {
+        metrics.push_back(make_metric("bool", i * 10));
+        metrics.back().set_data(i % 3 == 0);
+    }
+    for (int i = 0; i < 5; i++) {
+        metrics.push_back(make_metric("str", base + i * 10));
+        metrics.back().set_data(std::string(i, 'x'));
+    }
+
+    GorillaEncoder enc;
+    enc.add(metrics);
+    EXPECT_EQ(metrics.size(), enc.points());
+    TextBuffer out;
+    enc.finish(out);
+    EXPECT_EQ(0u, enc.points());
+
+    GorillaDecoder dec(out.data(), out.size());
+    rpc::Metric got;
+    for (const Metric& met : metrics) {
+        ASSERT_TRUE(dec.next(&got));
+        if (met.get_rpc_metric_ptr()->data_case() == rpc::Metric::kFloat64Data &&
+            std::isnan(met.get_float64_data())) {
+            EXPECT_TRUE(std::isnan(got.float64_data()));
+            continue;
+        }
+        expect_same(*met.get_rpc_metric_ptr(), got);
+    }
+    EXPECT_FALSE(dec.next(&got));
+}
+
+TEST(GorillaTest, GroupsSeriesAndReadsConsecutiveBlocks) {
+    const int64_t base = 1479808800000000000LL;
+    std::vector<Metric> first;
+    std::vector<Metric> second;
+    for (int i = 0; i < 10; i++) {
+        first.push_back(make_metric(i % 2 ? "a" : "b", base + i));
+        first.back().set_data(double(i));
+        second.push_back(make_metric("c", base + i));
+        second.back().set_data(int64_t(i));
+    }
+
+    GorillaEncoder enc;
+    TextBuffer out;
+    enc.add(first);
+    enc.finish(out);
+    enc.add(second);
+    enc.finish(out);
+
+    // "b" was seen first
+    std::vector<Metric> want;
+    for (int i = 0; i < 10; i += 2) want.push_back(first[i]);
+    for (int i = 1; i < 10; i += 2) want.push_back(first[i]);
+    for (const Metric& met : second) want.push_back(met);
+    expect_decodes(out.str(), want);
+}
+
+TEST(GorillaTest, CompressesRegularSeries) {
+    const int64_t base = 1479808800000000000LL;
+    std::vector<Metric> metrics;
+    size_t raw = 0;
+    for (int i = 0; i < 1000; i++) {
+        for (int s = 0; s < 10; s++) {
+            metrics.push_back(make_metric("load" + std::to_string(s),
+                                          base + i * 10000000000LL));
+            metrics.back().set_data(double(s + i % 4));
+            raw += metrics.back().get_rpc_metric_ptr()->ByteSize();
+        }
+    }
+
+    GorillaEncoder enc;
+    enc.add(metrics);
+    TextBuffer out;
+    enc.finish(out);
+
+    EXPECT_GE(raw / out.size(), 10u);
+}
+
+TEST(GorillaTest, RejectsTruncatedBlock) {
+    std::vector<Metric> metrics;
+    for (int i = 0; i < 10; i++) {
+        metrics.push_back(make_metric("a", i * 1000));
+        metrics.back().set_data(i * 0.5);
+    }
+    GorillaEncoder enc;
+    enc.add(metrics);
+    TextBuffer out;
+    enc.finish(out);
+
+    rpc::Metric got;
+    GorillaDecoder truncated(out.data(), out.size() - 1);
+    EXPECT_THROW(truncated.next(&got), PluginException);
+
+    std::string bad = out.str();
+    bad[0] = 'X';
+    GorillaDecoder bad_magic(bad.data(), bad.size());
+    EXPECT_THROW(bad_magic.next(&got), PluginException);
+}
+
+TEST(GorillaTest, PublisherWritesBlocks) {
+    char tmpl[] = "/tmp/gorilla_test.XXXXXX";
+    close(mkstemp(tmpl));
+    rpc::ConfigMap map;
+    (*map.mutable_stringmap())["path"] = tmpl;
+    Config config(map);
+
+    FileSink::Options opts;
+    opts.sync_interval = milliseconds(0);
+    FileSink sink(opts);
+    GorillaPublisher plg(&sink);
+
+    std::vector<Metric> batch;
+    for (int i = 0; i < 3; i++) {
+        batch.push_back(make_metric("a", i * 1000));
+        batch.back().set_data(uint64_t(i));
+    }
+    plg.publish_metrics(batch, config);
+    plg.publish_metrics(batch, config);
+    plg.kill("done");
+
+    std::ifstream in(tmpl);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    unlink(tmpl);
+
+    std::vector<Metric> want(batch);
+    for (const Metric& met : batch) want.push_back(met);
+    expect_decodes(ss.str(), want);
+}
@@ -0,0 +1,142 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/config.h"
+#include "snap/grpc_host.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+#include "snap/rpc/plugin.grpc.pb.h"
+#include "gtest/gtest.h"
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <grpc++/grpc++.h>
+
+using Plugin::Config;
+using Plugin::ConfigPolicy;
+using Plugin::GRPCHost;
+using Plugin::Meta;
+using Plugin::Metric;
+using Plugin::PluginException;
+
+namespace {
+
+class NamedCollector : public Plugin::CollectorInterface {
+ public:
+    explicit NamedCollector(const std::string& name) : name(name) {}
+
+    const ConfigPolicy get_config_policy() { return ConfigPolicy(); }
+
+    std::vector<Metric> get_metric_types(Config cfg) {
+        return {Metric({{"intel", "", ""}, {name, "", ""}}, "", "")};
+    }
+
+    void collect_metrics(std::vector<Metric>& metrics) {}
+
+    std::string name;
+};
+
+class TagProcessor : public Plugin::ProcessorInterface {
+ public:
+    const ConfigPolicy get_config_policy() { return ConfigPolicy(); }
+
+    void process_metrics(std::vector<Metric>& metrics, const Config& config) {
+        for (Metric& met : metrics) met.add_tag({"processed", "yes"});
+    }
+};
+
+std::shared_ptr<grpc::Channel> dial(const GRPCHost& host, size_t i) {
+    return grpc::CreateChannel("127.0.0.1:" + std::to_string(host.port(i)),
+                               grpc::InsecureChannelCredentials());
+}
+
+std::string metric_type(const GRPCHost& host, size_t i, grpc::Status* status) {
+    auto stub = rpc::Collector::NewStub(dial(host, i));
+    grpc::ClientContext ctx;
+    rpc::GetMetricTypesArg arg;
+    rpc::MetricsReply reply;
+    *status = stub->GetMetricTypes(&ctx, arg, &reply);
+    if (!status->ok() || reply.metrics_size() != 1) return "";
+    return reply.metrics(0).namespace_(1).value();
+}
+
+}  // namespace
+
+TEST(GRPCHostTest, RoutesCallsToEachPlugin) {
+    NamedCollector cpu("cpu");
+    NamedCollector disk("disk");
+    TagProcessor tagger;
+    GRPCHost host((GRPCHost::Options()));
+    host.add(&cpu, Meta(Plugin::Collector, "cpu", 1));
+    host.add(&disk, Meta(Plugin::Collector, "disk", 2));
+    host.add(&tagger, Meta(Plugin::Processor, "tagger", 3));
+    std::stringstream out;
+    host.start(out);
+    ASSERT_EQ(3u, host.size());
+    EXPECT_NE(host.port(0), host.port(1));
+    EXPECT_NE(host.port(1), host.port(2));
+
+    grpc::Status status;
+    EXPECT_EQ("cpu", metric_type(host, 0, &status));
+    EXPECT_TRUE(status.ok());
+    EXPECT_EQ("disk", metric_type(host, 1, &status));
+    EXPECT_TRUE(status.ok());
+    // the processor's port doesn't answer for the collectors
+    EXPECT_EQ("", metric_type(host, 2, &status));
+    EXPECT_EQ(grpc::StatusCode::UNIMPLEMENTED, status.error_code());
+
+    auto stub = rpc::Processor::NewStub(dial(host, 2));
+    grpc::ClientContext ctx;
+    rpc::PubProcArg arg;
+    *arg.add_metrics() = *cpu.get_metric_types(Config(rpc::ConfigMap()))[0]
+                             .get_rpc_metric_ptr();
+    rpc::MetricsReply reply;
+    status = stub->Process(&ctx, arg, &reply);
+    ASSERT_TRUE(status.ok()) << status.error_message();
+    ASSERT_EQ(1, reply.metrics_size());
+    EXPECT_EQ("yes", reply.metrics(0).tags().at("processed"));
+
+    // one advertisement per plugin, in order
+    std::string line;
+    for (size_t i = 0; i < host.size(); i++) {
+        ASSERT_TRUE(std::getline(out, line).good());
+        EXPECT_NE(std::string::npos, line.find(
+            "\"ListenAddress\":\"127.0.0.1:" + std::to_string(host.port(i)) +
+            "\""));
+    }
+    EXPECT_NE(std::string::npos, line.find("\"Name\":\"tagger\""));
+
+    host.shutdown();
+    host.wait();
+}
+
+TEST(GRPCHostTest, RejectsMisuse) {
+    NamedCollector cpu("cpu");
+    GRPCHost host((GRPCHost::Options()));
+    std::stringstream out;
+    EXPECT_THROW(host.start(out), PluginException);
+    host.add(&cpu, Meta(Plugin::Collector, "cpu", 1));
+    host.start(out);
+    EXPECT_THROW(host.add(&cpu, Meta(Plugin::Collector, "cpu", 1)),
+                 PluginException);
+    EXPECT_THROW(host.start(out), PluginException);
+
+    GRPCHost::Options opts;
+    opts.address = "not-an-address";
+    GRPCHost bad(opts);
+    bad.add(&cpu, Meta(Plugin::Collector, "cpu", 1));
+    EXPECT_THROW(bad.start(out), PluginException);
+}
@@ -106,6 +106,35 @@ TEST(MetricTest, SetTagsWorks) {
     EXPECT_EQ("1hr", fake_metric.tags().at("period"));
 }
 
+TEST(MetricTest, TagEditsInvalidateMemo) {
+    Metric fake_metric;
+    fake_metric.add_tag(make_pair("host", "zero"));
+    EXPECT_EQ(1u, fake_metric.tags().size());
+    fake_metric.add_tag(make_pair("period", "1hr"));
+    EXPECT_EQ(2u, fake_metric.tags().size());
+    fake_metric.mutable_tags()->erase("host");
+    EXPECT_EQ(0u, fake_metric.tags().count("host"));
+}
+
+TEST(MetricTest, SwapWorks) {
+    Metric owned({{"foo", "", ""}}, "atoms", "");
+    owned.add_tag(make_pair("host", "zero"));
+    rpc::Metric source_metric(*owned.get_rpc_metric_ptr());
+    source_metric.mutable_namespace_(0)->set_value("bar");
+    (*source_metric.mutable_config()->mutable_stringmap())["key"] = "bar";
+    Metric wrapped(&source_metric);
+    // memoize both, so the caches have to move too
+    EXPECT_EQ("/foo", extract_ns(owned));
+    EXPECT_EQ("/bar", extract_ns(wrapped));
+
+    owned.swap(wrapped);
+    EXPECT_EQ("/bar", extract_ns(owned));
+    EXPECT_EQ(&source_metric, owned.get_rpc_metric_ptr());
+    EXPECT_EQ("bar", owned.get_config().get_string("key"));
+    EXPECT_EQ("/foo", extract_ns(wrapped));
+    EXPECT_EQ("zero", wrapped.tags().at("host"));
+}
+
 TEST(MetricTest, SetTimestampWorks) {
     Metric fake_metric;
     std::tm source_time{56,10,8,2,5,92,6,122,1}; // 02 May 1992, 08:10:56
@@ -0,0 +1,179 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+#include "snap/processor/prepared_processor.h"
+#include "snap/proxy/processor_proxy.h"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Plugin::Config;
+using Plugin::ConfigPolicy;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::PreparedProcessor;
+using Plugin::Proxy::ProcessorImpl;
+
+namespace {
+
+struct Suffix {
+  std::string value;
+};
+
+/**
+ * Appends the "suffix" config value to the last namespace element.
+ */
+class SuffixProcessor final : public PreparedProcessor<Suffix> {
+ public:
+  explicit SuffixProcessor(size_t max_states = 64) :
+                           PreparedProcessor<Suffix>(max_states),
+                           prepared(0) {}
+
+  const ConfigPolicy get_config_policy() {
+    return ConfigPolicy(Plugin::StringRule{"suffix", true});
+  }
+
+  std::unique_ptr<Suffix> prepare(const Config& config) {
+    prepared++;
+    std::string value = config.get_string("suffix");
+    if (value == "bad") {
+      throw PluginException("bad suffix");
+    }
+    return std::unique_ptr<Suffix>(new Suffix{value});
+  }
+
+  void process_metrics(std::vector<Metric> &metrics, const Suffix& suffix) {
+    for (Metric& met : metrics) {
+      std::vector<Metric::NamespaceElement> ns = met.ns();
+      ns.back().value += suffix.value;
+      met.set_ns(ns);
+    }
+  }
+
+  std::atomic<int> prepared;
+};
+
+rpc::ConfigMap suffix_config(const std::string& suffix) {
+  rpc::ConfigMap map;
+  (*map.mutable_stringmap())["suffix"] = suffix;
+  return map;
+}
+
+std::string process(Plugin::ProcessorInterface* plg,
+                    const rpc::ConfigMap& map) {
+  std::vector<Metric> metrics;
+  metrics.emplace_back(Metric({{"intel", "", ""}, {"load", "", ""}}, "", ""));
+  Config config(map);
+  plg->process_metrics(metrics, config);
+  return metrics[0].ns().back().value;
+}
+
+}  // namespace
+
+TEST(PreparedProcessorTest, PreparesOncePerConfig) {
+    SuffixProcessor plg;
+    rpc::ConfigMap a = suffix_config("_a");
+    rpc::ConfigMap b = suffix_config("_b");
+
+    EXPECT_EQ("load_a", process(&plg, a));
+    EXPECT_EQ("load_a", process(&plg, a));
+    EXPECT_EQ("load_b", process(&plg, b));
+    EXPECT_EQ("load_a", process(&plg, suffix_config("_a")));
+    EXPECT_EQ(2, plg.prepared);
+}
+
+TEST(PreparedProcessorTest, DoesNotCacheFailures) {
+    SuffixProcessor plg;
+    rpc::ConfigMap bad = suffix_config("bad");
+
+    EXPECT_THROW(process(&plg, bad), PluginException);
+    EXPECT_THROW(process(&plg, bad), PluginException);
+    EXPECT_EQ(2, plg.prepared);
+}
+
+TEST(PreparedProcessorTest, EvictsOldestState) {
+    SuffixProcessor plg(2);
+
+    process(&plg, suffix_config("_a"));
+    process(&plg, suffix_config("_b"));
+    process(&plg, suffix_config("_c"));
+    EXPECT_EQ(3, plg.prepared);
+
+    process(&plg, suffix_config("_c"));
+    EXPECT_EQ(3, plg.prepared);
+    process(&plg, suffix_config("_a"));
+    EXPECT_EQ(4, plg.prepared);
+}
+
+TEST(PreparedProcessorTest, SharesStateAcrossThreads) {
+    SuffixProcessor plg;
+    rpc::ConfigMap a = suffix_config("_a");
+    std::vector<std::thread> threads;
+    std::atomic<int> wrong(0);
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([&]() {
+            for (int j = 0; j < 100; j++) {
+                if (process(&plg, a) != "load_a") wrong++;
+            }
+        });
+    }
+    for (std::thread& t : threads) t.join();
+
+    EXPECT_EQ(0, wrong);
+    // racing first batches may each prepare, but only one state is kept
+    EXPECT_LE(plg.prepared, 4);
+}
+
+TEST(PreparedProcessorTest, ProxyReportsPrepareError) {
+    SuffixProcessor plg;
+    ProcessorImpl processor(&plg);
+    rpc::PubProcArg req;
+    *req.mutable_config() = suffix_config("bad");
+    rpc::Metric* met = req.add_metrics();
+    met->add_namespace_()->set_value("load");
+    rpc::MetricsReply resp;
+
+    grpc::Status status = processor.Process(nullptr, &req, &resp);
+    EXPECT_EQ(grpc::StatusCode::UNKNOWN, status.error_code());
+    EXPECT_EQ("bad suffix", resp.error());
+}
+
+TEST(TaskStoreTest, KeepsStatePerKeyUntilIdle) {
+    Plugin::TaskStore<int> store(std::chrono::milliseconds(20));
+    auto zero = []() { return std::unique_ptr<int>(new int(0)); };
+    auto bump = [](int& n) { n++; };
+
+    store.with(1, zero, bump);
+    store.with(1, zero, bump);
+    store.with(2, zero, bump);
+    int seen = 0;
+    store.with(1, zero, [&](int& n) { seen = n; });
+    EXPECT_EQ(2, seen);
+    EXPECT_EQ(2u, store.size());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    store.with(2, zero, [&](int& n) { seen = n; });
+    EXPECT_EQ(0, seen);
+    EXPECT_EQ(1u, store.size());
+
+    store.clear();
+    EXPECT_EQ(0u, store.size());
+}
@@ -0,0 +1,175 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/collector/procfs.h"
+#include "gtest/gtest.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using Plugin::FileReader;
+using Plugin::KeyValueParser;
+using Plugin::PidStat;
+using Plugin::ProcessTable;
+using Plugin::TableParser;
+using Plugin::Token;
+
+namespace {
+
+Token token(const std::string& str) {
+    return Token(str.data(), str.size());
+}
+
+}  // namespace
+
+TEST(TokenTest, ParsesNumbers) {
+    uint64_t u;
+    int64_t i;
+    double d;
+    EXPECT_TRUE(token("18446744073709551615").to_uint64(&u));
+    EXPECT_EQ(18446744073709551615ULL, u);
+    EXPECT_FALSE(token("12a").to_uint64(&u));
+    EXPECT_FALSE(token("").to_uint64(&u));
+    EXPECT_TRUE(token("-20").to_int64(&i));
+    EXPECT_EQ(-20, i);
+    EXPECT_FALSE(token("-").to_int64(&i));
+    EXPECT_TRUE(token("0.25").to_double(&d));
+    EXPECT_EQ(0.25, d);
+    EXPECT_FALSE(token("0.25x").to_double(&d));
+    EXPECT_TRUE(token("abc") == "abc");
+    EXPECT_TRUE(token("abc") != "ab");
+}
+
+TEST(FileReaderTest, RereadsKeptOpenFile) {
+    char tmpl[] = "/tmp/procfs_test.XXXXXX";
+    close(mkstemp(tmpl));
+    {
+        std::ofstream out(tmpl);
+        out << "first";
+    }
+    FileReader reader(tmpl);
+    ASSERT_TRUE(reader.read());
+    EXPECT_EQ("first", reader.contents().str());
+
+    // rewritten in place, and larger than the initial buffer
+    std::string big(10000, 'x');
+    {
+        std::ofstream out(tmpl, std::ios::trunc);
+        out << big;
+    }
+    ASSERT_TRUE(reader.read());
+    EXPECT_EQ(big, reader.contents().str());
+    EXPECT_EQ('\0', reader.contents().data[big.size()]);
+
+    unlink(tmpl);
+    FileReader missing(tmpl, false);
+    EXPECT_FALSE(missing.read());
+    EXPECT_TRUE(missing.contents().empty());
+}
+
+TEST(FileReaderTest, ReadsProcfsFilesPastOnePage) {
+    std::ifstream in("/proc/self/smaps");
+    std::string full((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    ASSERT_GT(full.size(), size_t(2 * getpagesize()));
+
+    FileReader reader("/proc/self/smaps");
+    ASSERT_TRUE(reader.read());
+    // mappings may come and go between the two reads, but not by half
+    EXPECT_GT(reader.contents().size, full.size() / 2);
+    EXPECT_EQ('\n', reader.contents().data[reader.contents().size - 1]);
+}
+
+TEST(KeyValueParserTest, MeminfoAndVmstat) {
+    std::string meminfo = "MemTotal:       16318672 kB\n"
+                          "no separator\n"
+                          "HugePages_Total:       0\n";
+    KeyValueParser kv(token(meminfo));
+    Token key, value;
+    ASSERT_TRUE(kv.next(&key, &value));
+    EXPECT_EQ("MemTotal", key.str());
+    EXPECT_EQ("16318672", value.str());
+    ASSERT_TRUE(kv.next(&key, &value));
+    EXPECT_EQ("HugePages_Total", key.str());
+    EXPECT_EQ("0", value.str());
+    EXPECT_FALSE(kv.next(&key, &value));
+
+    std::string vmstat = "nr_free_pages 123\nnr_zone_inactive_anon 7";
+    KeyValueParser vm(token(vmstat), ' ');
+    ASSERT_TRUE(vm.next(&key, &value));
+    ASSERT_TRUE(vm.next(&key, &value));
+    EXPECT_EQ("nr_zone_inactive_anon", key.str());
+    EXPECT_EQ("7", value.str());
+    EXPECT_FALSE(vm.next(&key, &value));
+}
+
+TEST(TableParserTest, SplitsRowsAndFields) {
+    std::string diskstats = "   8       0 sda 100 5\n"
+                            "\n"
+                            "   8       1 sda1\t42 0\n";
+    TableParser table(token(diskstats));
+    Token fields[8];
+    ASSERT_TRUE(table.next_row());
+    ASSERT_EQ(5u, table.fields(fields, 8));
+    EXPECT_EQ("sda", fields[2].str());
+    ASSERT_TRUE(table.next_row());
+    EXPECT_EQ(0u, table.fields(fields, 8));
+    ASSERT_TRUE(table.next_row());
+    Token field;
+    ASSERT_TRUE(table.next_field(&field));
+    EXPECT_EQ("8", field.str());
+    ASSERT_EQ(2u, table.fields(fields, 2));
+    EXPECT_EQ("sda1", fields[1].str());
+    ASSERT_TRUE(table.next_field(&field));
+    EXPECT_EQ("42", field.str());
+    EXPECT_FALSE(table.next_row());
+}
+
+TEST(PidStatTest, ParsesStatLine) {
+    std::string line = "4242 (my (odd) cmd) S 1 4242 4242 0 -1 4194560 500 0 "
+                       "0 0 123 45 0 0 20 -5 3 0 98765 104857600 2560\n";
+    PidStat stat;
+    ASSERT_TRUE(stat.parse(token(line)));
+    EXPECT_EQ(4242, stat.pid());
+    EXPECT_EQ("my (odd) cmd", stat.comm.str());
+    EXPECT_EQ('S', stat.state);
+    EXPECT_EQ(1, stat.field(4));
+    EXPECT_EQ(123, stat.field(14));
+    EXPECT_EQ(45, stat.field(15));
+    EXPECT_EQ(-5, stat.field(19));
+    EXPECT_EQ(2560, stat.field(24));
+    EXPECT_EQ(0, stat.field(25));
+
+    EXPECT_FALSE(stat.parse(token("4242 cmd S 1")));
+    EXPECT_FALSE(stat.parse(token("x (cmd) S 1")));
+}
+
+TEST(ProcessTableTest, FindsSelf) {
+    ProcessTable table((ProcessTable::Options()));
+    for (int round = 0; round < 2; round++) {
+        const std::vector<PidStat>& stats = table.scan();
+        bool found = false;
+        for (const PidStat& stat : stats) {
+            if (stat.pid() == getpid()) {
+                found = true;
+                EXPECT_GE(stat.field(20), 1);  // num_threads
+            }
+        }
+        EXPECT_TRUE(found);
+    }
+}
@@ -0,0 +1,196 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+#include "snap/processor/rate.h"
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+using std::chrono::system_clock;
+using Plugin::Config;
+using Plugin::CounterRate;
+using Plugin::CounterTable;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::RateProcessor;
+
+namespace {
+
+template <typename T>
+Metric counter_metric(const std::string& name, int64_t ms, T value) {
+    Metric met({{"intel", "", ""}, {"net", "", ""}, {name, "", ""}}, "B", "");
+    met.set_timestamp(system_clock::time_point(milliseconds(ms)));
+    met.set_data(value);
+    return met;
+}
+
+template <typename T>
+rpc::Metric counter(const std::string& name, int64_t ms, T value) {
+    return *counter_metric(name, ms, value).get_rpc_metric_ptr();
+}
+
+}  // namespace
+
+TEST(CounterTableTest, InsertsFindsAndEvicts) {
+    CounterTable table(100000);
+    bool added;
+    for (uint64_t k = 0; k < 50000; k++) {
+        CounterTable::Entry* e = table.insert(k * 7919, &added);
+        ASSERT_NE(nullptr, e);
+        ASSERT_TRUE(added);
+        e->ts = int64_t(k % 2);
+        e->value = k;
+    }
+    EXPECT_EQ(50000u, table.size());
+    table.insert(7919, &added);
+    EXPECT_FALSE(added);
+
+    // drop the even keys; the odd ones must still be found after the
+    // backward shifts
+    EXPECT_EQ(25000u, table.evict(1));
+    EXPECT_EQ(25000u, table.size());
+    for (uint64_t k = 0; k < 50000; k++) {
+        CounterTable::Entry* e = table.find(k * 7919);
+        if (k % 2) {
+            ASSERT_NE(nullptr, e);
+            EXPECT_EQ(k, e->value);
+        } else {
+            EXPECT_EQ(nullptr, e);
+        }
+    }
+}
+
+TEST(CounterTableTest, BoundsSeries) {
+    CounterTable table(3000);
+    bool added;
+    for (uint64_t k = 1; k <= 3000; k++) {
+        ASSERT_NE(nullptr, table.insert(k, &added));
+    }
+    EXPECT_EQ(nullptr, table.insert(3001, &added));
+    // existing keys are still updated
+    EXPECT_NE(nullptr, table.insert(3000, &added));
+    EXPECT_LE(table.memory(), 4096 * sizeof(CounterTable::Entry));
+}
+
+TEST(CounterRateTest, PerSecondRates) {
+    CounterRate rate((CounterRate::Options()));
+    double r;
+    EXPECT_FALSE(rate.update(counter("rx", 1000, uint64_t(100)), &r));
+    ASSERT_TRUE(rate.update(counter("rx", 3000, uint64_t(300)), &r));
+    EXPECT_DOUBLE_EQ(100, r);
+    ASSERT_TRUE(rate.update(counter("rx", 3500, uint64_t(400)), &r));
+    EXPECT_DOUBLE_EQ(200, r);
+    // not newer than the last sample
+    EXPECT_FALSE(rate.update(counter("rx", 3500, uint64_t(500)), &r));
+
+    EXPECT_FALSE(rate.update(counter("f", 0, 1.5), &r));
+    ASSERT_TRUE(rate.update(counter("f", 4000, 3.5), &r));
+    EXPECT_DOUBLE_EQ(0.5, r);
+}
+
+TEST(CounterRateTest, WrapsAndResets) {
+    CounterRate rate((CounterRate::Options()));
+    double r;
+    rate.update(counter("u32", 0, uint32_t(4294967290u)), &r);
+    ASSERT_TRUE(rate.update(counter("u32", 1000, uint32_t(4)), &r));
+    EXPECT_DOUBLE_EQ(10, r);
+
+    rate.update(counter("u64", 0, uint64_t(18446744073709551606ULL)), &r);
+    ASSERT_TRUE(rate.update(counter("u64", 1000, uint64_t(5)), &r));
+    EXPECT_DOUBLE_EQ(15, r);
+
+    // a restarted counter counts from zero
+    rate.update(counter("reset", 0, uint64_t(1000)), &r);
+    ASSERT_TRUE(rate.update(counter("reset", 2000, uint64_t(40)), &r));
+    EXPECT_DOUBLE_EQ(20, r);
+    rate.update(counter("i64", 0, int64_t(1000)), &r);
+    ASSERT_TRUE(rate.update(counter("i64", 1000, int64_t(7)), &r));
+    EXPECT_DOUBLE_EQ(7, r);
+}
+
+TEST(CounterRateTest, EvictsStaleSeries) {
+    CounterRate::Options opts;
+    opts.stale_after = seconds(60);
+    CounterRate rate(opts);
+    double r;
+    rate.update(counter("a", 0, uint64_t(1)), &r);
+    rate.update(counter("b", 50000, uint64_t(1)), &r);
+    EXPECT_EQ(1u, rate.evict(system_clock::time_point(seconds(100))));
+    EXPECT_EQ(1u, rate.table().size());
+    // "a" starts over
+    EXPECT_FALSE(rate.update(counter("a", 101000, uint64_t(5)), &r));
+}
+
+TEST(RateProcessorTest, ReplacesMatchingCounters) {
+    rpc::ConfigMap map;
+    (*map.mutable_stringmap())["match"] = "/intel/net";
+    Config config(map);
+    RateProcessor plg;
+
+    std::vector<Metric> batch;
+    batch.push_back(counter_metric("rx", 0, uint64_t(10)));
+    Metric other({{"intel", "", ""}, {"os", "", ""}, {"load", "", ""}}, "", "");
+    other.set_data(1.0);
+    batch.push_back(other);
+    plg.process_metrics(batch, config);
+    ASSERT_EQ(1u, batch.size());
+    EXPECT_EQ("os", batch[0].ns()[1].value);
+
+    std::vector<Metric> next;
+    next.push_back(counter_metric("rx", 2000, uint64_t(30)));
+    plg.process_metrics(next, config);
+    ASSERT_EQ(1u, next.size());
+    EXPECT_EQ("rate", next[0].ns().back().value);
+    EXPECT_EQ("rx", next[0].ns()[2].value);
+    EXPECT_EQ("B/s", next[0].get_rpc_metric_ptr()->unit());
+    EXPECT_DOUBLE_EQ(10, next[0].get_float64_data());
+}
+
+TEST(RateProcessorTest, KeepsCountersAcrossConfigs) {
+    rpc::ConfigMap map;
+    (*map.mutable_stringmap())["match"] = "/intel/net";
+    Config config(map);
+    RateProcessor plg;
+
+    std::vector<Metric> batch = {counter_metric("rx", 0, uint64_t(10))};
+    plg.process_metrics(batch, config);
+    // more configs than the prepared state cache holds
+    for (int i = 0; i < 100; i++) {
+        rpc::ConfigMap other;
+        (*other.mutable_intmap())["stale_after"] = 600 + i;
+        std::vector<Metric> noise = {counter_metric("tx", 0, uint64_t(1))};
+        plg.process_metrics(noise, Config(other));
+    }
+
+    std::vector<Metric> next = {counter_metric("rx", 2000, uint64_t(30))};
+    plg.process_metrics(next, config);
+    ASSERT_EQ(1u, next.size());
+    EXPECT_DOUBLE_EQ(10, next[0].get_float64_data());
+}
+
+TEST(RateProcessorTest, RejectsBadConfig) {
+    rpc::ConfigMap map;
+    (*map.mutable_intmap())["max_series"] = 0;
+    Config config(map);
+    RateProcessor plg;
+    std::vector<Metric> batch;
+    EXPECT_THROW(plg.process_metrics(batch, config), PluginException);
+}
@@ -0,0 +1,90 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+#include "snap/processor/rewrite.h"
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+using Plugin::Config;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::RewriteProcessor;
+using Plugin::TagRewriter;
+
+namespace {
+
+Metric vm_metric() {
+    Metric met({{"intel", "", ""}, {"libvirt", "", ""},
+                {"vm-42", "vm_id", "the VM"}, {"cpu", "", ""}}, "", "");
+    met.add_tag({"hostname", "node1"});
+    met.add_tag({"request_id", "abc"});
+    met.add_tag({"env", "prod"});
+    return met;
+}
+
+}  // namespace
+
+TEST(TagRewriterTest, AppliesRulesInOrder) {
+    TagRewriter rewriter(
+        "set dc=east; default env=dev; default tier=web\n"
+        "rename hostname=host; drop request_id\n"
+        "copy vm=[vm_id]; copy plugin=ns[1]; copy leaf=ns[-1]");
+    EXPECT_EQ(8u, rewriter.size());
+
+    Metric met = vm_metric();
+    // memoize the tags, which the rewrite must invalidate
+    EXPECT_EQ(3u, met.tags().size());
+    rewriter.apply(met);
+
+    std::map<std::string, std::string> want = {
+        {"dc", "east"}, {"env", "prod"}, {"tier", "web"}, {"host", "node1"},
+        {"vm", "vm-42"}, {"plugin", "libvirt"}, {"leaf", "cpu"}};
+    EXPECT_EQ(want, met.tags());
+}
+
+TEST(TagRewriterTest, MissingSourcesAreNoOps) {
+    TagRewriter rewriter("rename nope=x; copy a=[nope]; copy b=ns[9];"
+                         "copy c=ns[-9]; drop nope");
+    Metric met = vm_metric();
+    rewriter.apply(met);
+    EXPECT_EQ(3u, met.tags().size());
+    EXPECT_EQ("node1", met.tags().at("hostname"));
+}
+
+TEST(TagRewriterTest, RejectsBadRules) {
+    EXPECT_THROW(TagRewriter("set host"), PluginException);
+    EXPECT_THROW(TagRewriter("move a=b"), PluginException);
+    EXPECT_THROW(TagRewriter("copy a=ns[x]"), PluginException);
+    EXPECT_THROW(TagRewriter("copy a=cpu"), PluginException);
+    EXPECT_THROW(TagRewriter("rename a="), PluginException);
+    EXPECT_THROW(TagRewriter("drop"), PluginException);
+}
+
+TEST(RewriteProcessorTest, RewritesBatch) {
+    rpc::ConfigMap map;
+    (*map.mutable_stringmap())["rules"] = "copy vm=[vm_id]; drop request_id";
+    Config config(map);
+    RewriteProcessor plg;
+
+    std::vector<Metric> batch = {vm_metric(), vm_metric()};
+    plg.process_metrics(batch, config);
+    for (const Metric& met : batch) {
+        EXPECT_EQ("vm-42", met.tags().at("vm"));
+        EXPECT_EQ(0u, met.tags().count("request_id"));
+    }
+}
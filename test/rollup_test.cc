@@ -0,0 +1,250 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+#include "snap/processor/rollup.h"
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::chrono::seconds;
+using std::chrono::system_clock;
+using Plugin::ColumnStats;
+using Plugin::Config;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::Rollup;
+using Plugin::RollupProcessor;
+
+namespace {
+
+Metric point(const std::string& name, int sec) {
+    Metric met({{"intel", "", ""}, {name, "", ""}}, "ms", "");
+    met.add_tag({"host", "node1"});
+    met.set_timestamp(system_clock::time_point(seconds(sec)));
+    return met;
+}
+
+// Rollups by "<series>/<aggregate>".
+std::map<std::string, const Metric*> by_name(const std::vector<Metric>& out) {
+    std::map<std::string, const Metric*> m;
+    for (const Metric& met : out) {
+        const auto& ns = met.ns();
+        m[ns[1].value + "/" + ns.back().value] = &met;
+    }
+    return m;
+}
+
+}  // namespace
+
+TEST(RollupTest, AggregatesFloatColumns) {
+    std::vector<double> values = {3, -1.5, 7, NAN, 2, 0.5, 4};
+    ColumnStats<double> stats = Plugin::aggregate(values.data(), values.size());
+    EXPECT_EQ(-1.5, stats.min);
+    EXPECT_EQ(7, stats.max);
+    EXPECT_TRUE(std::isnan(stats.sum));
+
+    values[3] = 1;
+    stats = Plugin::aggregate(values.data(), values.size());
+    EXPECT_EQ(16, stats.sum);
+}
+
+TEST(RollupTest, AggregatesIntColumns) {
+    std::vector<int64_t> values = {5, -9, 12, 0, 3};
+    ColumnStats<int64_t> stats = Plugin::aggregate(values.data(),
+                                                   values.size());
+    EXPECT_EQ(-9, stats.min);
+    EXPECT_EQ(12, stats.max);
+    EXPECT_EQ(11, stats.sum);
+}
+
+TEST(RollupTest, ClosesWindowOnLaterPoint) {
+    Rollup::Options opts;
+    opts.window = seconds(10);
+    opts.aggregates = Rollup::Min | Rollup::Max | Rollup::Avg |
+                      Rollup::Count | Rollup::Sum;
+    Rollup rollup(opts);
+    std::vector<Metric> out;
+
+    int values[] = {4, 1, 7};
+    for (int i = 0; i < 3; i++) {
+        Metric met = point("load", 100 + i * 3);
+        met.set_data(double(values[i]));
+        EXPECT_TRUE(rollup.add(*met.get_rpc_metric_ptr(), &out));
+    }
+    EXPECT_TRUE(out.empty());
+
+    Metric next = point("load", 110);
+    next.set_data(2.0);
+    rollup.add(*next.get_rpc_metric_ptr(), &out);
+
+    ASSERT_EQ(5u, out.size());
+    auto m = by_name(out);
+    EXPECT_EQ(1, m["load/min"]->get_float64_data());
+    EXPECT_EQ(7, m["load/max"]->get_float64_data());
+    EXPECT_EQ(12, m["load/sum"]->get_float64_data());
+    EXPECT_EQ(4, m["load/avg"]->get_float64_data());
+    EXPECT_EQ(3u, m["load/count"]->get_uint64_data());
+    EXPECT_EQ(system_clock::time_point(seconds(100)),
+              m["load/min"]->timestamp());
+    EXPECT_EQ("node1", m["load/min"]->tags().at("host"));
+    EXPECT_EQ("ms", m["load/min"]->get_rpc_metric_ptr()->unit());
+}
+
+TEST(RollupTest, KeepsIntegerSeriesIntegral) {
+    Rollup::Options opts;
+    opts.window = seconds(10);
+    opts.aggregates = Rollup::Max | Rollup::Avg;
+    Rollup rollup(opts);
+    std::vector<Metric> out;
+
+    int32_t values[] = {-3, 4};
+    for (int i = 0; i < 2; i++) {
+        Metric met = point("errors", i);
+        met.set_data(values[i]);
+        rollup.add(*met.get_rpc_metric_ptr(), &out);
+    }
+    rollup.flush(system_clock::time_point(seconds(10)), &out);
+
+    auto m = by_name(out);
+    ASSERT_EQ(2u, m.size());
+    EXPECT_EQ(4, m["errors/max"]->get_int64_data());
+    EXPECT_EQ(0.5, m["errors/avg"]->get_float64_data());
+    EXPECT_EQ(0u, rollup.series());
+}
+
+TEST(RollupTest, FlushesQuietSeriesAndDropsLatePoints) {
+    Rollup::Options opts;
+    opts.window = seconds(10);
+    opts.aggregates = Rollup::Count;
+    Rollup rollup(opts);
+    std::vector<Metric> out;
+
+    Metric a = point("a", 1);
+    a.set_data(1.0);
+    Metric b = point("b", 12);
+    b.set_data(1.0);
+    rollup.add(*a.get_rpc_metric_ptr(), &out);
+    rollup.add(*b.get_rpc_metric_ptr(), &out);
+    EXPECT_EQ(2u, rollup.series());
+
+    rollup.flush(system_clock::time_point(seconds(9)), &out);
+    EXPECT_TRUE(out.empty());
+    rollup.flush(system_clock::time_point(seconds(10)), &out);
+    ASSERT_EQ(1u, out.size());
+    EXPECT_EQ("a", out[0].ns()[1].value);
+    EXPECT_EQ(1u, rollup.series());
+
+    Metric late = point("a", 5);
+    late.set_data(1.0);
+    EXPECT_TRUE(rollup.add(*late.get_rpc_metric_ptr(), &out));
+    EXPECT_EQ(1u, rollup.late());
+    EXPECT_EQ(1u, out.size());
+}
+
+TEST(RollupTest, IgnoresNonNumericData) {
+    Rollup rollup((Rollup::Options()));
+    std::vector<Metric> out;
+    Metric met = point("state", 0);
+    met.set_data(std::string("up"));
+    EXPECT_FALSE(rollup.add(*met.get_rpc_metric_ptr(), &out));
+    EXPECT_EQ(0u, rollup.series());
+}
+
+TEST(RollupTest, ParsesAggregates) {
+    EXPECT_EQ(Rollup::Min | Rollup::Count,
+              Rollup::parse_aggregates("min,,count"));
+    EXPECT_THROW(Rollup::parse_aggregates("min,p99"), PluginException);
+}
+
+TEST(RollupProcessorTest, ReplacesNumericMetrics) {
+    rpc::ConfigMap map;
+    (*map.mutable_intmap())["window"] = 10;
+    (*map.mutable_stringmap())["aggregates"] = "max";
+    Config config(map);
+    RollupProcessor plg;
+
+    std::vector<Metric> batch;
+    for (int i = 0; i < 3; i++) {
+        batch.push_back(point("load", i * 4));
+        batch.back().set_data(double(i));
+    }
+    batch.push_back(point("state", 0));
+    batch.back().set_data(std::string("up"));
+    plg.process_metrics(batch, config);
+    ASSERT_EQ(1u, batch.size());
+    EXPECT_EQ("state", batch[0].ns()[1].value);
+
+    std::vector<Metric> next;
+    next.push_back(point("load", 12));
+    next.back().set_data(9.0);
+    plg.process_metrics(next, config);
+    auto m = by_name(next);
+    ASSERT_EQ(1u, m.size());
+    EXPECT_EQ(2, m["load/max"]->get_float64_data());
+}
+
+TEST(RollupProcessorTest, KeepsWindowsAcrossConfigs) {
+    rpc::ConfigMap map;
+    (*map.mutable_intmap())["window"] = 10;
+    (*map.mutable_stringmap())["aggregates"] = "count";
+    Config config(map);
+    RollupProcessor plg;
+
+    std::vector<Metric> batch = {point("load", 1)};
+    batch.back().set_data(1.0);
+    plg.process_metrics(batch, config);
+
+    // more configs than the prepared state cache holds
+    for (int i = 0; i < 100; i++) {
+        rpc::ConfigMap other;
+        (*other.mutable_intmap())["window"] = 10 + i;
+        std::vector<Metric> noise = {point("other", 1)};
+        noise.back().set_data(1.0);
+        plg.process_metrics(noise, Config(other));
+    }
+
+    std::vector<Metric> next = {point("load", 5), point("load", 12)};
+    next[0].set_data(2.0);
+    next[1].set_data(3.0);
+    plg.process_metrics(next, config);
+    auto m = by_name(next);
+    ASSERT_EQ(1u, m.count("load/count"));
+    EXPECT_EQ(2u, m["load/count"]->get_uint64_data());
+}
+
+TEST(RollupProcessorTest, DropsIdleTasks) {
+    rpc::ConfigMap map;
+    (*map.mutable_intmap())["window"] = 10;
+    RollupProcessor plg(std::chrono::milliseconds(20));
+
+    std::vector<Metric> batch = {point("load", 1)};
+    batch.back().set_data(1.0);
+    plg.process_metrics(batch, Config(map));
+    EXPECT_EQ(1u, plg.tasks());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    rpc::ConfigMap other;
+    (*other.mutable_intmap())["window"] = 20;
+    batch = {point("load", 1)};
+    batch.back().set_data(1.0);
+    plg.process_metrics(batch, Config(other));
+    EXPECT_EQ(1u, plg.tasks());
+}
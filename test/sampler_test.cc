@@ -0,0 +1,152 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/collector/sampler.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::chrono::milliseconds;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::Sampler;
+
+namespace {
+
+std::vector<Metric::NamespaceElement> depth_ns() {
+    return {{"intel", "", ""}, {"queue", "", ""}, {"depth", "", ""}};
+}
+
+std::vector<Metric> request(const std::vector<std::string>& stats) {
+    std::vector<Metric> metrics;
+    for (const std::string& stat : stats) {
+        std::vector<Metric::NamespaceElement> ns = depth_ns();
+        ns.push_back({stat, "", ""});
+        metrics.emplace_back(Metric(ns, "", ""));
+    }
+    return metrics;
+}
+
+Sampler::Options options(size_t capacity) {
+    Sampler::Options opts;
+    opts.interval = milliseconds(1);
+    opts.capacity = capacity;
+    return opts;
+}
+
+}  // namespace
+
+TEST(SamplerTest, ListsMetricTypes) {
+    Sampler sampler(options(8));
+    sampler.add(depth_ns(), [](double* v) { *v = 1; return true; }, "items");
+    std::vector<Metric> types = sampler.metric_types();
+    ASSERT_EQ(5u, types.size());
+    EXPECT_EQ(4u, types[0].ns().size());
+    EXPECT_EQ("last", types[0].ns()[3].value);
+    EXPECT_EQ("count", types[4].ns()[3].value);
+    EXPECT_EQ("items", types[0].get_rpc_metric_ptr()->unit());
+}
+
+TEST(SamplerTest, SummarizesSinceLastCollect) {
+    Sampler sampler(options(8));
+    double next = 0;
+    sampler.add(depth_ns(), [&](double* v) { *v = next; return true; });
+
+    for (double v : {3.0, 1.0, 8.0}) {
+        next = v;
+        sampler.sample();
+    }
+    std::vector<Metric> metrics = request({"last", "min", "max", "avg",
+                                           "count"});
+    sampler.collect(metrics);
+    EXPECT_EQ(8, metrics[0].get_float64_data());
+    EXPECT_EQ(1, metrics[1].get_float64_data());
+    EXPECT_EQ(8, metrics[2].get_float64_data());
+    EXPECT_EQ(4, metrics[3].get_float64_data());
+    EXPECT_EQ(3u, metrics[4].get_uint64_data());
+
+    // nothing new: the last sample stands in
+    metrics = request({"min", "avg", "count"});
+    sampler.collect(metrics);
+    EXPECT_EQ(8, metrics[0].get_float64_data());
+    EXPECT_EQ(8, metrics[1].get_float64_data());
+    EXPECT_EQ(0u, metrics[2].get_uint64_data());
+}
+
+TEST(SamplerTest, KeepsOnlyCapacitySamples) {
+    Sampler sampler(options(4));
+    double next = 0;
+    sampler.add(depth_ns(), [&](double* v) { *v = next; return true; });
+    for (int i = 1; i <= 10; i++) {
+        next = i;
+        sampler.sample();
+    }
+    std::vector<Metric> metrics = request({"min", "count"});
+    sampler.collect(metrics);
+    EXPECT_EQ(7, metrics[0].get_float64_data());
+    EXPECT_EQ(4u, metrics[1].get_uint64_data());
+}
+
+TEST(SamplerTest, SkipsFailedProbesAndUnknownMetrics) {
+    Sampler sampler(options(8));
+    int calls = 0;
+    sampler.add(depth_ns(), [&](double* v) {
+        calls++;
+        if (calls == 2) throw PluginException("gone");
+        *v = calls;
+        return calls != 3;
+    });
+    for (int i = 0; i < 4; i++) sampler.sample();
+
+    std::vector<Metric> metrics = request({"count", "max", "median"});
+    metrics.emplace_back(Metric({{"intel", "", ""}, {"other", "", ""}}, "",
+                                ""));
+    sampler.collect(metrics);
+    EXPECT_EQ(2u, metrics[0].get_uint64_data());
+    EXPECT_EQ(4, metrics[1].get_float64_data());
+    EXPECT_EQ(rpc::Metric::DATA_NOT_SET,
+              metrics[2].get_rpc_metric_ptr()->data_case());
+    EXPECT_EQ(rpc::Metric::DATA_NOT_SET,
+              metrics[3].get_rpc_metric_ptr()->data_case());
+}
+
+TEST(SamplerTest, SamplesInBackground) {
+    Sampler sampler(options(1024));
+    std::atomic<int> n(0);
+    sampler.add(depth_ns(), [&](double* v) { *v = ++n; return true; });
+    sampler.start();
+    EXPECT_THROW(sampler.add(depth_ns(), [](double*) { return false; }),
+                 PluginException);
+
+    uint64_t total = 0;
+    double last = 0;
+    for (int i = 0; i < 50 && total < 20; i++) {
+        std::this_thread::sleep_for(milliseconds(5));
+        std::vector<Metric> metrics = request({"count", "last", "min"});
+        sampler.collect(metrics);
+        if (metrics[0].get_uint64_data() == 0) continue;
+        // samples are read in order and never twice
+        EXPECT_GT(metrics[2].get_float64_data(), last);
+        last = metrics[1].get_float64_data();
+        total += metrics[0].get_uint64_data();
+    }
+    sampler.stop();
+    EXPECT_GE(total, 20u);
+    EXPECT_LE(total, uint64_t(n));
+}
@@ -0,0 +1,263 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/collector/shm_ring.h"
+#include "snap/collector/shm_ring_collector.h"
+#include "snap/metric.h"
+#include "gtest/gtest.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using Plugin::Metric;
+using Plugin::ShmRing;
+using Plugin::ShmRingCollector;
+using Plugin::ShmRingHeader;
+using Plugin::ShmRingSlot;
+using Plugin::ShmRingWriter;
+
+namespace {
+
+class ShmRingTest : public ::testing::Test {
+ protected:
+    ShmRingTest() : name("/snap_shm_ring_test." + std::to_string(getpid())) {}
+
+    ~ShmRingTest() {
+        for (const auto& m : mapped) munmap(m.first, m.second);
+        shm_unlink(name.c_str());
+    }
+
+    ShmRingCollector::Options options(uint64_t capacity) {
+        ShmRingCollector::Options opts;
+        opts.name = name;
+        opts.capacity = capacity;
+        opts.prefix = {{"app", "", ""}};
+        return opts;
+    }
+
+    // claim claims the next slot as a producer would, returning it unwritten
+    ShmRingSlot* claim(uint64_t* pos) {
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        EXPECT_LE(0, fd);
+        struct stat st;
+        fstat(fd, &st);
+        void* addr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fd, 0);
+        close(fd);
+        mapped.push_back({addr, st.st_size});
+        ShmRingHeader* hdr = static_cast<ShmRingHeader*>(addr);
+        *pos = hdr->head.fetch_add(1);
+        return reinterpret_cast<ShmRingSlot*>(hdr + 1) +
+               (*pos & (hdr->capacity - 1));
+    }
+
+    Metric request(const std::vector<std::string>& ns) {
+        std::vector<Metric::NamespaceElement> elems;
+        for (const std::string& e : ns) elems.push_back({e, "", ""});
+        return Metric(elems, "", "");
+    }
+
+    std::string name;
+    std::vector<std::pair<void*, size_t>> mapped;
+};
+
+}  // namespace
+
+TEST_F(ShmRingTest, WriterNeedsRing) {
+    ShmRingWriter writer;
+    EXPECT_FALSE(writer.open(name));
+    EXPECT_FALSE(writer.gauge("a", 1));
+}
+
+TEST_F(ShmRingTest, DrainsInOrderAndDropsWhenFull) {
+    ShmRing ring(name, 3);
+    EXPECT_EQ(4u, ring.capacity());
+    ShmRingWriter writer;
+    ASSERT_TRUE(writer.open(name));
+
+    for (int i = 0; i < 6; i++) {
+        EXPECT_EQ(i < 4, writer.gauge("g", i));
+    }
+    EXPECT_FALSE(writer.counter(std::string(47, 'x').c_str(), 1));
+    EXPECT_EQ(3u, ring.dropped());
+
+    std::vector<double> got;
+    auto read = [&](const ShmRingSlot& slot) {
+        EXPECT_EQ("g", std::string(slot.name, slot.name_len));
+        got.push_back(slot.value);
+    };
+    EXPECT_EQ(3u, ring.drain(read, 3));
+    EXPECT_TRUE(writer.gauge("g", 10));
+    EXPECT_EQ(2u, ring.drain(read, 10));
+    EXPECT_EQ(0u, ring.drain(read, 10));
+    EXPECT_EQ(std::vector<double>({0, 1, 2, 3, 10}), got);
+}
+
+TEST_F(ShmRingTest, ConcurrentWriters) {
+    ShmRing ring(name, 1024);
+    const int kThreads = 4;
+    const int kWrites = 100000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&, t] {
+            ShmRingWriter writer;
+            ASSERT_TRUE(writer.open(name));
+            std::string key = "t" + std::to_string(t);
+            for (int i = 0; i < kWrites; i++) {
+                writer.gauge(key.c_str(), i);
+            }
+        });
+    }
+
+    // values from each writer must arrive in order, and each one written
+    // must be read or counted as dropped
+    std::map<std::string, double> last;
+    size_t read = 0;
+    auto check = [&](const ShmRingSlot& slot) {
+        std::string key(slot.name, slot.name_len);
+        auto it = last.find(key);
+        if (it != last.end()) {
+            EXPECT_LT(it->second, slot.value);
+        }
+        last[key] = slot.value;
+        read++;
+    };
+    while (read + ring.dropped() < size_t(kThreads) * kWrites) {
+        ring.drain(check, 256);
+    }
+    for (std::thread& t : threads) t.join();
+    ring.drain(check, 1024);
+    EXPECT_EQ(size_t(kThreads) * kWrites, read + ring.dropped());
+}
+
+TEST_F(ShmRingTest, ReusesCompatibleRing) {
+    ShmRingWriter writer;
+    {
+        ShmRing ring(name, 16);
+        ASSERT_TRUE(writer.open(name));
+        writer.counter("c", 1);
+    }
+    {
+        ShmRing ring(name, 16);
+        writer.counter("c", 2);
+        double sum = 0;
+        ring.drain([&](const ShmRingSlot& slot) { sum += slot.value; }, 16);
+        EXPECT_EQ(3, sum);
+    }
+    // a different capacity replaces it
+    ShmRing ring(name, 32);
+    writer.counter("c", 4);
+    size_t n = ring.drain([](const ShmRingSlot&) {}, 32);
+    EXPECT_EQ(0u, n);
+    ShmRingWriter fresh;
+    EXPECT_TRUE(fresh.open(name));
+}
+
+TEST_F(ShmRingTest, SkipsSlotOfDeadProducer) {
+    ShmRing ring(name, 4, 2);
+    ShmRingWriter writer;
+    ASSERT_TRUE(writer.open(name));
+    // claimed by a producer that never finishes
+    uint64_t pos;
+    claim(&pos);
+    EXPECT_TRUE(writer.gauge("g", 1));
+
+    std::vector<double> got;
+    auto read = [&](const ShmRingSlot& slot) { got.push_back(slot.value); };
+    EXPECT_EQ(0u, ring.drain(read, 10));
+    EXPECT_EQ(0u, ring.drain(read, 10));
+    EXPECT_EQ(0u, ring.abandoned());
+    EXPECT_EQ(1u, ring.drain(read, 10));
+    EXPECT_EQ(1u, ring.abandoned());
+
+    // the skipped slot is usable again on the next lap
+    for (int i = 2; i < 6; i++) EXPECT_TRUE(writer.gauge("g", i));
+    EXPECT_EQ(4u, ring.drain(read, 10));
+    EXPECT_EQ(std::vector<double>({1, 2, 3, 4, 5}), got);
+    EXPECT_EQ(0u, ring.dropped());
+}
+
+TEST_F(ShmRingTest, ClampsNameLength) {
+    ShmRingCollector plg(options(4));
+    uint64_t pos;
+    ShmRingSlot* slot = claim(&pos);
+    slot->value = 1;
+    slot->kind = Plugin::kShmGauge;
+    slot->name_len = 255;
+    std::memset(slot->name, 'x', sizeof(slot->name));
+    slot->seq.store(pos + 1);
+
+    std::vector<Metric> metrics;
+    metrics.push_back(request({"app", "*"}));
+    plg.collect_metrics(metrics);
+    ASSERT_EQ(1u, metrics.size());
+    EXPECT_EQ(std::string(Plugin::kShmRingNameMax, 'x'),
+              metrics[0].ns()[1].value);
+}
+
+TEST_F(ShmRingTest, CollectorAggregatesAndExpands) {
+    ShmRingCollector::Options opts = options(64);
+    opts.max_series = 3;
+    ShmRingCollector plg(opts);
+    ASSERT_EQ(3u, plg.get_metric_types(Plugin::Config(rpc::ConfigMap()))
+                      .size());
+
+    ShmRingWriter writer;
+    ASSERT_TRUE(writer.open(name));
+    writer.counter("requests", 2);
+    writer.gauge("depth", 7);
+    writer.counter("requests", 3);
+    writer.gauge("depth", 5);
+    writer.gauge("errors", 0);
+    writer.gauge("overflow", 1);
+
+    std::vector<Metric> metrics;
+    metrics.push_back(request({"app", "requests"}));
+    metrics.push_back(request({"app", "unknown"}));
+    metrics.push_back(request({"app", "*"}));
+    metrics.push_back(request({"app", "ring", "dropped"}));
+    plg.collect_metrics(metrics);
+
+    std::map<std::string, double> got;
+    ASSERT_EQ(5u, metrics.size());
+    for (const Metric& met : metrics) {
+        std::string key;
+        for (const Metric::NamespaceElement& e : met.ns()) key += "/" + e.value;
+        if (key == "/app/ring/dropped") {
+            EXPECT_EQ(1u, met.get_uint64_data());
+            continue;
+        }
+        got[key] += met.get_float64_data();
+    }
+    EXPECT_EQ(3u, got.size());
+    EXPECT_EQ(10, got["/app/requests"]);
+    EXPECT_EQ(5, got["/app/depth"]);
+    EXPECT_EQ(0, got["/app/errors"]);
+
+    // counters keep their total across collects
+    writer.counter("requests", 1);
+    metrics.clear();
+    metrics.push_back(request({"app", "requests"}));
+    plg.collect_metrics(metrics);
+    ASSERT_EQ(1u, metrics.size());
+    EXPECT_EQ(6, metrics[0].get_float64_data());
+}
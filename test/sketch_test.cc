@@ -0,0 +1,187 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/plugin.h"
+#include "snap/processor/sketch.h"
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+using std::chrono::seconds;
+using std::chrono::system_clock;
+using Plugin::Config;
+using Plugin::DDSketch;
+using Plugin::Metric;
+using Plugin::PluginException;
+using Plugin::QuantileProcessor;
+
+namespace {
+
+Metric latency(const std::string& name, int sec, double value) {
+    Metric met({{"intel", "", ""}, {"app", "", ""}, {name, "", ""}}, "ms", "");
+    met.set_timestamp(system_clock::time_point(seconds(sec)));
+    met.set_data(value);
+    return met;
+}
+
+}  // namespace
+
+TEST(DDSketchTest, QuantilesWithinRelativeAccuracy) {
+    DDSketch sketch((DDSketch::Options()));
+    for (int i = 1; i <= 10000; i++) sketch.add(i);
+
+    EXPECT_EQ(10000u, sketch.count());
+    EXPECT_NEAR(5000, sketch.quantile(0.5), 5000 * 0.01);
+    EXPECT_NEAR(9900, sketch.quantile(0.99), 9900 * 0.01);
+    EXPECT_EQ(1, sketch.quantile(0));
+    EXPECT_EQ(10000, sketch.quantile(1));
+    EXPECT_TRUE(std::isnan(DDSketch(DDSketch::Options()).quantile(0.5)));
+}
+
+TEST(DDSketchTest, HandlesNegativesAndZero) {
+    DDSketch sketch((DDSketch::Options()));
+    for (int i = -100; i <= 100; i++) sketch.add(i);
+
+    EXPECT_EQ(0, sketch.quantile(0.5));
+    EXPECT_NEAR(-90, sketch.quantile(0.05), 90 * 0.01);
+    EXPECT_NEAR(90, sketch.quantile(0.95), 90 * 0.01);
+    EXPECT_EQ(-100, sketch.min());
+}
+
+TEST(DDSketchTest, MergesExactly) {
+    DDSketch all((DDSketch::Options()));
+    DDSketch a((DDSketch::Options()));
+    DDSketch b((DDSketch::Options()));
+    for (int i = 1; i <= 1000; i++) {
+        double v = std::exp(i % 97 * 0.1);
+        all.add(v);
+        (i % 2 ? a : b).add(v);
+    }
+    a.merge(b);
+
+    EXPECT_EQ(all.count(), a.count());
+    for (double q : {0.1, 0.5, 0.9, 0.999}) {
+        EXPECT_EQ(all.quantile(q), a.quantile(q));
+    }
+
+    DDSketch::Options coarse;
+    coarse.relative_accuracy = 0.05;
+    DDSketch c(coarse);
+    EXPECT_THROW(a.merge(c), PluginException);
+}
+
+TEST(DDSketchTest, BoundsBins) {
+    DDSketch::Options opts;
+    opts.max_bins = 64;
+    DDSketch sketch(opts);
+    for (int i = 0; i < 100000; i++) {
+        sketch.add(std::pow(10.0, (i % 1200) / 100.0 - 6));
+    }
+
+    EXPECT_LE(sketch.memory(), 2 * 64 * sizeof(uint64_t));
+    // the collapsed bins are the smallest values; high quantiles hold
+    EXPECT_NEAR(954993, sketch.quantile(0.999), 954993 * 0.01);
+}
+
+TEST(DDSketchTest, SerializesRoundTrip) {
+    DDSketch sketch((DDSketch::Options()));
+    for (int i = -50; i < 500; i++) sketch.add(i * 1.5);
+    std::string data;
+    sketch.serialize(&data);
+
+    DDSketch parsed = DDSketch::parse(data);
+    EXPECT_EQ(sketch.count(), parsed.count());
+    EXPECT_EQ(sketch.sum(), parsed.sum());
+    for (double q : {0.0, 0.25, 0.5, 0.99, 1.0}) {
+        EXPECT_EQ(sketch.quantile(q), parsed.quantile(q));
+    }
+    EXPECT_THROW(DDSketch::parse(data.substr(0, data.size() / 2)),
+                 PluginException);
+}
+
+TEST(QuantileProcessorTest, EmitsQuantilesPerWindow) {
+    rpc::ConfigMap map;
+    (*map.mutable_stringmap())["match"] = "/intel/app";
+    (*map.mutable_stringmap())["quantiles"] = "0.5,0.999";
+    (*map.mutable_intmap())["window"] = 10;
+    Config config(map);
+    QuantileProcessor plg;
+
+    std::vector<Metric> batch;
+    for (int i = 1; i <= 100; i++) {
+        batch.push_back(latency("latency", i % 10, i));
+    }
+    Metric other({{"intel", "", ""}, {"os", "", ""}, {"load", "", ""}}, "", "");
+    other.set_data(1.0);
+    batch.push_back(other);
+    plg.process_metrics(batch, config);
+    ASSERT_EQ(1u, batch.size());
+    EXPECT_EQ("os", batch[0].ns()[1].value);
+
+    std::vector<Metric> next;
+    next.push_back(latency("latency", 10, 1));
+    plg.process_metrics(next, config);
+    ASSERT_EQ(2u, next.size());
+    std::map<std::string, double> got;
+    for (const Metric& met : next) {
+        EXPECT_EQ(system_clock::time_point(seconds(0)), met.timestamp());
+        got[met.ns().back().value] = met.get_float64_data();
+    }
+    EXPECT_NEAR(50, got["p50"], 50 * 0.01);
+    EXPECT_NEAR(99, got["p999"], 99 * 0.01);
+}
+
+TEST(QuantileProcessorTest, EmitsSerializedSketch) {
+    rpc::ConfigMap map;
+    (*map.mutable_stringmap())["output"] = "sketch";
+    (*map.mutable_intmap())["window"] = 10;
+    Config config(map);
+    QuantileProcessor plg;
+
+    std::vector<Metric> batch;
+    for (int i = 0; i < 5; i++) batch.push_back(latency("latency", i, i));
+    // 20s later, the quiet window is closed after the batch
+    batch.push_back(latency("other", 25, 1));
+    plg.process_metrics(batch, config);
+
+    ASSERT_EQ(1u, batch.size());
+    EXPECT_EQ("sketch", batch[0].ns().back().value);
+    DDSketch sketch = DDSketch::parse(
+        batch[0].get_rpc_metric_ptr()->bytes_data());
+    EXPECT_EQ(5u, sketch.count());
+}
+
+TEST(QuantileProcessorTest, RejectsBadConfig) {
+    QuantileProcessor plg;
+    std::vector<Metric> batch;
+    rpc::ConfigMap map;
+    (*map.mutable_stringmap())["quantiles"] = "0.5,1.5";
+    Config config(map);
+    EXPECT_THROW(plg.process_metrics(batch, config), PluginException);
+
+    rpc::ConfigMap bad_output;
+    (*bad_output.mutable_stringmap())["output"] = "histogram";
+    Config config2(bad_output);
+    EXPECT_THROW(plg.process_metrics(batch, config2), PluginException);
+
+    rpc::ConfigMap bad_accuracy;
+    (*bad_accuracy.mutable_stringmap())["accuracy"] = "0.01abc";
+    Config config3(bad_accuracy);
+    EXPECT_THROW(plg.process_metrics(batch, config3), PluginException);
+}
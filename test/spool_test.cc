@@ -0,0 +1,253 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/config.h"
+#include "snap/metric.h"
+#include "snap/publisher/spool.h"
+#include "gtest/gtest.h"
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using Plugin::Config;
+using Plugin::ConfigPolicy;
+using Plugin::Metric;
+using Plugin::Spool;
+using Plugin::SpoolingPublisher;
+
+namespace {
+
+class SpoolTest : public ::testing::Test {
+protected:
+  std::string dir;
+
+  virtual void SetUp() {
+    char tmpl[] = "/tmp/spool_test.XXXXXX";
+    dir = mkdtemp(tmpl);
+  }
+
+  virtual void TearDown() {
+    for (const std::string& name : files()) {
+      unlink((dir + "/" + name).c_str());
+    }
+    rmdir(dir.c_str());
+  }
+
+  std::vector<std::string> files() {
+    std::vector<std::string> names;
+    DIR* d = opendir(dir.c_str());
+    while (struct dirent* ent = readdir(d)) {
+      if (ent->d_name[0] != '.') names.push_back(ent->d_name);
+    }
+    closedir(d);
+    return names;
+  }
+
+  Spool::Options options() {
+    Spool::Options opts(dir);
+    opts.segment_bytes = 8192;
+    opts.max_segments = 4;
+    return opts;
+  }
+};
+
+std::vector<Metric> make_batch(int64_t first, int count) {
+  std::vector<Metric> metrics;
+  for (int i = 0; i < count; i++) {
+    metrics.emplace_back(Metric({{"foo", "", ""}, {"bar", "", ""}}, "", ""));
+    metrics.back().set_data(first + i);
+  }
+  return metrics;
+}
+
+std::vector<int64_t> replay_all(Spool& spool, std::vector<std::string>* paths) {
+  std::vector<int64_t> values;
+  spool.replay([&](std::vector<Metric>& metrics, const Config& config) {
+    for (const Metric& met : metrics) values.push_back(met.get_int64_data());
+    if (paths) paths->push_back(config.get_string("path"));
+  });
+  return values;
+}
+
+class FlakyPublisher : public Plugin::PublisherInterface {
+public:
+  FlakyPublisher() : down(false) {}
+
+  const ConfigPolicy get_config_policy() { return ConfigPolicy(); }
+
+  void publish_metrics(std::vector<Metric> &metrics, const Config& config) {
+    if (down) throw Plugin::PluginException("sink down");
+    for (const Metric& met : metrics) values.push_back(met.get_int64_data());
+  }
+
+  bool down;
+  std::vector<int64_t> values;
+};
+
+}  // namespace
+
+TEST_F(SpoolTest, ReplaysInOrderWithConfig) {
+    Spool spool(options());
+    rpc::ConfigMap map;
+    (*map.mutable_stringmap())["path"] = "/out";
+
+    spool.append(make_batch(0, 3), Config(map));
+    spool.append(make_batch(3, 2), Config(map));
+    EXPECT_EQ(2, spool.pending());
+
+    std::vector<std::string> paths;
+    std::vector<int64_t> values = replay_all(spool, &paths);
+
+    EXPECT_EQ(std::vector<int64_t>({0, 1, 2, 3, 4}), values);
+    EXPECT_EQ(std::vector<std::string>({"/out", "/out"}), paths);
+    EXPECT_EQ(0, spool.pending());
+    EXPECT_EQ(0, replay_all(spool, nullptr).size());
+}
+
+TEST_F(SpoolTest, SurvivesReopen) {
+    rpc::ConfigMap map;
+    (*map.mutable_stringmap())["path"] = "/out";
+    {
+        Spool spool(options());
+        spool.append(make_batch(0, 2), Config(map));
+        spool.append(make_batch(2, 2), Config(map));
+        int calls = 0;
+        EXPECT_THROW(spool.replay([&](std::vector<Metric>& metrics, const Config& config) {
+            if (++calls == 2) throw Plugin::PluginException("sink down");
+        }), Plugin::PluginException);
+    }
+    Spool spool(options());
+
+    EXPECT_EQ(1, spool.pending());
+    EXPECT_EQ(std::vector<int64_t>({2, 3}), replay_all(spool, nullptr));
+}
+
+TEST_F(SpoolTest, RollsSegmentsAndDropsOldest) {
+    Spool spool(options());
+    rpc::ConfigMap map;
+    for (int i = 0; i < 1000; i++) {
+        spool.append(make_batch(i, 1), Config(map));
+    }
+
+    EXPECT_EQ(4, files().size());
+    EXPECT_LT(0, spool.dropped());
+    EXPECT_EQ(1000, spool.pending() + spool.dropped());
+    std::vector<int64_t> values = replay_all(spool, nullptr);
+    ASSERT_FALSE(values.empty());
+    EXPECT_EQ(999, values.back());
+    EXPECT_EQ(1, files().size());
+}
+
+TEST_F(SpoolTest, RejectsOversizedBatch) {
+    Spool spool(options());
+    rpc::ConfigMap map;
+
+    EXPECT_THROW(spool.append(make_batch(0, 1000), Config(map)),
+                 Plugin::PluginException);
+    EXPECT_EQ(0, spool.pending());
+}
+
+TEST_F(SpoolTest, CorruptRecordEndsSegment) {
+    rpc::ConfigMap map;
+    {
+        Spool spool(options());
+        spool.append(make_batch(0, 1), Config(map));
+        spool.append(make_batch(1, 1), Config(map));
+    }
+    // flip a payload byte in the second record
+    std::string path = dir + "/" + files()[0];
+    std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekg(64);
+    uint32_t len = 0;
+    f.read(reinterpret_cast<char*>(&len), sizeof(len));
+    size_t second = 64 + ((16 + len + 7) & ~size_t(7));
+    f.seekp(second + 20);
+    f.put('\x7f');
+    f.close();
+
+    Spool spool(options());
+
+    EXPECT_EQ(1, spool.pending());
+    EXPECT_EQ(std::vector<int64_t>({0}), replay_all(spool, nullptr));
+}
+
+TEST_F(SpoolTest, SkipsRecordAfterMaxAttempts) {
+    Spool::Options opts = options();
+    opts.max_attempts = 3;
+    rpc::ConfigMap map;
+    auto reject_two = [](std::vector<Metric>& metrics, const Config&) {
+        if (metrics[0].get_int64_data() == 2) {
+            throw Plugin::PluginException("poison");
+        }
+    };
+    {
+        Spool spool(opts);
+        spool.append(make_batch(0, 2), Config(map));
+        spool.append(make_batch(2, 1), Config(map));
+        spool.append(make_batch(3, 1), Config(map));
+
+        EXPECT_THROW(spool.replay(reject_two), Plugin::PluginException);
+        EXPECT_EQ(2, spool.pending());
+    }
+    // attempts are kept across a restart
+    Spool spool(opts);
+    EXPECT_THROW(spool.replay(reject_two), Plugin::PluginException);
+    EXPECT_EQ(1, spool.replay(reject_two));
+    EXPECT_EQ(0, spool.pending());
+    EXPECT_EQ(1, spool.failed());
+    EXPECT_EQ(0, spool.dropped());
+}
+
+TEST_F(SpoolTest, CapsSegmentSize) {
+    Spool::Options opts = options();
+    opts.segment_bytes = size_t(8) << 30;
+    Spool spool(opts);
+    rpc::ConfigMap map;
+    spool.append(make_batch(0, 1), Config(map));
+
+    // record lengths are 32-bit, so segments stay below 4 GiB
+    struct stat st;
+    ASSERT_EQ(0, stat((dir + "/" + files()[0]).c_str(), &st));
+    EXPECT_GT(uint64_t(st.st_size), uint64_t(1) << 31);
+    EXPECT_LE(uint64_t(st.st_size), uint64_t(UINT32_MAX));
+}
+
+TEST_F(SpoolTest, PublisherSpoolsWhileSinkIsDown) {
+    Spool spool(options());
+    FlakyPublisher sink;
+    SpoolingPublisher plg(&sink, &spool);
+    rpc::ConfigMap map;
+
+    std::vector<Metric> first = make_batch(0, 2);
+    plg.publish_metrics(first, Config(map));
+    sink.down = true;
+    std::vector<Metric> second = make_batch(2, 2);
+    plg.publish_metrics(second, Config(map));
+    std::vector<Metric> third = make_batch(4, 1);
+    plg.publish_metrics(third, Config(map));
+    EXPECT_EQ(2, spool.pending());
+
+    sink.down = false;
+    std::vector<Metric> fourth = make_batch(5, 1);
+    plg.publish_metrics(fourth, Config(map));
+
+    EXPECT_EQ(std::vector<int64_t>({0, 1, 2, 3, 4, 5}), sink.values);
+    EXPECT_EQ(0, spool.pending());
+}
@@ -0,0 +1,169 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/plugin.h"
+#include "snap/proxy/processor_proxy.h"
+#include "snap/publisher/text_buffer.h"
+#include "snap/stats.h"
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "mocks.h"
+
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using Plugin::Counter;
+using Plugin::Gauge;
+using Plugin::Histogram;
+using Plugin::PluginException;
+using Plugin::Stats;
+using Plugin::TextBuffer;
+using ::testing::_;
+using ::testing::Throw;
+
+namespace {
+
+std::string scrape() {
+    TextBuffer out;
+    Stats::write(out);
+    return out.str();
+}
+
+// value of the sample line starting with prefix, or -1
+double sample(const std::string& text, const std::string& prefix) {
+    size_t pos = text.find("\n" + prefix + " ");
+    if (pos == std::string::npos) return -1;
+    return std::stod(text.substr(pos + prefix.size() + 2));
+}
+
+}  // namespace
+
+TEST(StatsTest, CountsAcrossThreads) {
+    Counter counter;
+    Gauge gauge;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 10000; i++) {
+                counter.add();
+                gauge.add(i % 2 ? -1 : 2);
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    EXPECT_EQ(80000u, counter.value());
+    EXPECT_EQ(40000, gauge.value());
+    // a shard per cache line
+    EXPECT_EQ(16u * 64, sizeof(Counter));
+    EXPECT_EQ(8u * 192, sizeof(Histogram));
+}
+
+TEST(StatsTest, BucketsDurations) {
+    Histogram hist;
+    hist.observe(microseconds(50));
+    hist.observe(microseconds(100));
+    hist.observe(milliseconds(3));
+    hist.observe(std::chrono::seconds(60));
+    Histogram::Snapshot snap = hist.snapshot();
+    EXPECT_EQ(4u, snap.count);
+    EXPECT_EQ(2u, snap.buckets[0]);
+    EXPECT_EQ(1u, snap.buckets[5]);  // <= 5ms
+    EXPECT_EQ(1u, snap.buckets[Histogram::kBuckets - 1]);
+    EXPECT_NEAR(60.00315, snap.sum, 1e-9);
+}
+
+TEST(StatsTest, WritesRegisteredSeries) {
+    double depth = 7;
+    Stats::Registration a = Stats::add(
+        "test_queue_depth", "Queued\nthings.", Stats::GaugeType,
+        [&] { return depth; }, {{"queue", "a\"b"}});
+    Stats::Registration c = Stats::add(
+        "test_queue_depth", "Queued\nthings.", Stats::GaugeType,
+        [] { return 1.5; }, {{"queue", "c"}});
+    Stats::Registration broken = Stats::add(
+        "test_broken_total", "Throws.", Stats::CounterType,
+        []() -> double { throw PluginException("nope"); });
+    EXPECT_THROW(Stats::add("1bad", "", Stats::GaugeType, [] { return 0.0; }),
+                 PluginException);
+    EXPECT_THROW(Stats::add("ok", "", Stats::GaugeType, [] { return 0.0; },
+                            {{"bad-label", ""}}),
+                 PluginException);
+
+    depth = 9;
+    std::string text = scrape();
+    EXPECT_NE(std::string::npos, text.find(
+        "# HELP test_queue_depth Queued\\nthings.\n"
+        "# TYPE test_queue_depth gauge\n"
+        "test_queue_depth{queue=\"a\\\"b\"} 9\n"
+        "test_queue_depth{queue=\"c\"} 1.5\n"));
+    EXPECT_NE(std::string::npos, text.find("test_broken_total NaN\n"));
+    EXPECT_GT(sample(text, "process_resident_memory_bytes"), 0);
+}
+
+TEST(StatsTest, DropsSeriesWithTheirRegistration) {
+    std::string text;
+    {
+        Stats::Registration kept;
+        {
+            Stats::Registration moved = Stats::add(
+                "test_scoped", "Scoped.", Stats::GaugeType,
+                [] { return 1.0; });
+            kept = std::move(moved);
+        }
+        text = scrape();
+        EXPECT_EQ(1, sample(text, "test_scoped"));
+    }
+    text = scrape();
+    EXPECT_EQ(std::string::npos, text.find("test_scoped"));
+
+    Stats::Registration reset = Stats::add(
+        "test_reset", "Reset.", Stats::GaugeType, [] { return 2.0; });
+    reset.reset();
+    reset.reset();
+    EXPECT_EQ(std::string::npos, scrape().find("test_reset"));
+}
+
+TEST(StatsTest, CountsProxyCalls) {
+    std::string before = scrape();
+    MockProcessor mockee;
+    EXPECT_CALL(mockee, process_metrics(_, _))
+        .WillOnce(Throw(PluginException("broken")))
+        .WillOnce(::testing::Return());
+    Plugin::Proxy::ProcessorImpl proxy(&mockee);
+    rpc::PubProcArg arg;
+    rpc::MetricsReply reply;
+    proxy.Process(nullptr, &arg, &reply);
+    proxy.Process(nullptr, &arg, &reply);
+
+    std::string after = scrape();
+    const std::string calls =
+        "snap_plugin_rpc_calls_total{method=\"Process\"}";
+    const std::string errors =
+        "snap_plugin_rpc_errors_total{method=\"Process\"}";
+    const std::string count =
+        "snap_plugin_rpc_duration_seconds_count{method=\"Process\"}";
+    const std::string inf =
+        "snap_plugin_rpc_duration_seconds_bucket{method=\"Process\","
+        "le=\"+Inf\"}";
+    EXPECT_EQ(2, sample(after, calls) - sample(before, calls));
+    EXPECT_EQ(1, sample(after, errors) - sample(before, errors));
+    EXPECT_EQ(2, sample(after, count) - sample(before, count));
+    EXPECT_EQ(sample(after, count), sample(after, inf));
+    EXPECT_EQ(0, sample(after,
+        "snap_plugin_rpc_in_flight{method=\"Process\"}"));
+}
@@ -0,0 +1,200 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/collector/statsd.h"
+#include "snap/metric.h"
+#include "gtest/gtest.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Plugin::Metric;
+using Plugin::StatsdCollector;
+using Plugin::StatsdLine;
+using Plugin::StatsdParser;
+
+namespace {
+
+StatsdCollector::Options options() {
+    StatsdCollector::Options opts;
+    opts.address = "127.0.0.1";
+    opts.port = 0;
+    opts.threads = 2;
+    opts.prefix = {{"statsd", "", ""}};
+    return opts;
+}
+
+void add(StatsdCollector& plg, const std::string& packet) {
+    plg.add_packet(packet.data(), packet.size());
+}
+
+// Collects the metrics requested as namespaces, keyed by namespace and tags.
+std::map<std::string, double> collect(StatsdCollector& plg,
+                                      const std::vector<std::string>& ns) {
+    std::vector<Metric> metrics;
+    for (const std::string& req : ns) {
+        std::vector<Metric::NamespaceElement> elems;
+        size_t pos = 0;
+        while (pos <= req.size()) {
+            size_t slash = req.find('/', pos);
+            if (slash == std::string::npos) slash = req.size();
+            elems.push_back({req.substr(pos, slash - pos), "", ""});
+            pos = slash + 1;
+        }
+        metrics.emplace_back(Metric(elems, "", ""));
+    }
+    plg.collect_metrics(metrics);
+
+    std::map<std::string, double> got;
+    for (const Metric& met : metrics) {
+        const rpc::Metric& m = *met.get_rpc_metric_ptr();
+        std::string key;
+        for (const auto& e : m.namespace_()) key += "/" + e.value();
+        std::map<std::string, std::string> tags(m.tags().begin(),
+                                                m.tags().end());
+        for (const auto& tag : tags) key += ";" + tag.first + "=" + tag.second;
+        got[key] = m.data_case() == rpc::Metric::kUint64Data ?
+                   double(m.uint64_data()) : m.float64_data();
+    }
+    return got;
+}
+
+}  // namespace
+
+TEST(StatsdParserTest, ParsesLines) {
+    std::string packet =
+        "hits:1|c\n"
+        "load:-2.5|g|#host:a,ssd\r\n"
+        "\n"
+        "latency:12|ms|@0.5\n"
+        "users:alice|s\n"
+        "broken|c\n"
+        "nan:x|c\n"
+        "rate:1|c|@2\n"
+        "size:3|h|c:abc";
+    StatsdParser parser(packet.data(), packet.size());
+    StatsdLine line;
+
+    ASSERT_TRUE(parser.next(&line));
+    EXPECT_EQ("hits", line.name.str());
+    EXPECT_EQ(StatsdLine::Counter, line.type);
+    EXPECT_EQ(1, line.value);
+    EXPECT_EQ(1, line.rate);
+
+    ASSERT_TRUE(parser.next(&line));
+    EXPECT_EQ(StatsdLine::Gauge, line.type);
+    EXPECT_EQ(-2.5, line.value);
+    EXPECT_TRUE(line.relative);
+    EXPECT_EQ("host:a,ssd", line.tags.str());
+
+    ASSERT_TRUE(parser.next(&line));
+    EXPECT_EQ(StatsdLine::Timer, line.type);
+    EXPECT_EQ(0.5, line.rate);
+    EXPECT_TRUE(line.tags.empty());
+
+    ASSERT_TRUE(parser.next(&line));
+    EXPECT_EQ("size", line.name.str());
+    EXPECT_EQ(StatsdLine::Timer, line.type);
+    EXPECT_FALSE(parser.next(&line));
+    EXPECT_EQ(4u, parser.errors());
+}
+
+TEST(StatsdParserTest, RejectsBarInName) {
+    std::string packet = "a|b:1|c\nok:1|c";
+    StatsdParser parser(packet.data(), packet.size());
+    StatsdLine line;
+
+    ASSERT_TRUE(parser.next(&line));
+    EXPECT_EQ("ok", line.name.str());
+    EXPECT_FALSE(parser.next(&line));
+    EXPECT_EQ(1u, parser.errors());
+}
+
+TEST(StatsdCollectorTest, Aggregates) {
+    StatsdCollector plg(options());
+    EXPECT_EQ(6u, plg.get_metric_types(Plugin::Config(rpc::ConfigMap()))
+                      .size());
+    add(plg, "hits:1|c\nhits:2|c|@0.5\nhits:1|c|#code:500\n"
+             "depth:10|g\ndepth:+5|g\ndepth:-3|g\n"
+             "lat:10|ms\nlat:30|ms\nlat:20|ms|@0.5\n");
+
+    std::map<std::string, double> got = collect(plg, {
+        "statsd/counter/*", "statsd/gauge/depth", "statsd/timer/*/count",
+        "statsd/timer/lat/min", "statsd/timer/lat/max", "statsd/timer/*/avg",
+        "statsd/gauge/missing", "other/counter/*"});
+    std::map<std::string, double> want = {
+        {"/statsd/counter/hits", 5},
+        {"/statsd/counter/hits;code=500", 1},
+        {"/statsd/gauge/depth", 12},
+        {"/statsd/timer/lat/count", 4},
+        {"/statsd/timer/lat/min", 10},
+        {"/statsd/timer/lat/max", 30},
+        {"/statsd/timer/lat/avg", 20},
+    };
+    EXPECT_EQ(want, got);
+
+    // counters and timers start over, gauges stay
+    add(plg, "depth:+1|g\n");
+    got = collect(plg, {"statsd/counter/hits", "statsd/gauge/*",
+                        "statsd/timer/lat/count", "statsd/timer/lat/avg"});
+    want = {
+        {"/statsd/counter/hits", 0},
+        {"/statsd/counter/hits;code=500", 0},
+        {"/statsd/gauge/depth", 13},
+        {"/statsd/timer/lat/count", 0},
+    };
+    EXPECT_EQ(want, got);
+}
+
+TEST(StatsdCollectorTest, LimitsSeries) {
+    StatsdCollector::Options opts = options();
+    opts.max_series = 2;
+    StatsdCollector plg(opts);
+    add(plg, "a:1|c\nb:1|c\nc:1|c\na:1|c\nbad\n");
+    EXPECT_EQ(2u, plg.errors());
+    EXPECT_EQ(2u, collect(plg, {"statsd/counter/*"}).size());
+}
+
+TEST(StatsdCollectorTest, ReceivesDatagrams) {
+    StatsdCollector plg(options());
+    ASSERT_NE(0, plg.port());
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_GE(fd, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(plg.port());
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    const int kPackets = 200;
+    std::string packet = "hits:1|c\nhits:1|c";
+    for (int i = 0; i < kPackets; i++) {
+        sendto(fd, packet.data(), packet.size(), 0,
+               reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    }
+    close(fd);
+
+    for (int i = 0; i < 200 && plg.packets() < kPackets; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(uint64_t(kPackets), plg.packets());
+    std::map<std::string, double> got = collect(plg, {"statsd/counter/hits"});
+    EXPECT_EQ(2 * kPackets, got["/statsd/counter/hits"]);
+}
@@ -0,0 +1,79 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/publisher/text_buffer.h"
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <string>
+
+using std::chrono::seconds;
+using std::chrono::system_clock;
+using Plugin::TextBuffer;
+
+TEST(TextBufferTest, FormatsIntegers) {
+    TextBuffer out;
+    out.append_int(0);
+    out.append(' ');
+    out.append_int(-42);
+    out.append(' ');
+    out.append_int(std::numeric_limits<int64_t>::min());
+    out.append(' ');
+    out.append_uint(std::numeric_limits<uint64_t>::max());
+
+    EXPECT_EQ("0 -42 -9223372036854775808 18446744073709551615", out.str());
+}
+
+TEST(TextBufferTest, FormatsShortestDoubles) {
+    TextBuffer out;
+    out.append_double(0.1);
+    out.append(' ');
+    out.append_double(100);
+    out.append(' ');
+    out.append_double(-2.5);
+    out.append(' ');
+    out.append_float(0.1f);
+
+    EXPECT_EQ("0.1 100 -2.5 0.1", out.str());
+}
+
+TEST(TextBufferTest, DoublesRoundTrip) {
+    TextBuffer out;
+    out.append_double(1.0 / 3);
+
+    EXPECT_EQ(1.0 / 3, std::stod(out.str()));
+}
+
+TEST(TextBufferTest, FormatsTimeLikeStrftime) {
+    const std::time_t stamps[] = {0, 951782400, 1488412799, 4102444800};
+    for (std::time_t ts : stamps) {
+        char expected[32];
+        std::strftime(expected, sizeof(expected), "%F %T", std::gmtime(&ts));
+        TextBuffer out;
+        out.append_utc_time(system_clock::time_point(seconds(ts)));
+        EXPECT_EQ(expected, out.str());
+    }
+}
+
+TEST(TextBufferTest, ClearKeepsCapacity) {
+    TextBuffer out(64);
+    out.append("some text", 9);
+    size_t capacity = out.str().capacity();
+    out.clear();
+
+    EXPECT_TRUE(out.empty());
+    EXPECT_EQ(capacity, out.str().capacity());
+}
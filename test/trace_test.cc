@@ -0,0 +1,204 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/metric.h"
+#include "snap/plugin.h"
+#include "snap/proxy/collector_proxy.h"
+#include "snap/trace.h"
+#include "gtest/gtest.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mocks.h"
+
+using Plugin::Span;
+using Plugin::Trace;
+using ::testing::_;
+using ::testing::Return;
+
+namespace {
+
+class TraceTest : public ::testing::Test {
+ protected:
+    TraceTest() {
+        Trace::start(Trace::Options());
+        Trace::clear();
+    }
+
+    ~TraceTest() {
+        Trace::stop();
+        Trace::clear();
+    }
+
+    static std::string dump() {
+        std::stringstream out;
+        Trace::dump(out);
+        return out.str();
+    }
+
+    static size_t count(const std::string& str, const std::string& what) {
+        size_t n = 0;
+        for (size_t pos = str.find(what); pos != std::string::npos;
+             pos = str.find(what, pos + 1)) {
+            n++;
+        }
+        return n;
+    }
+
+    // begin and end of the first span called name, in microseconds
+    static void span_times(const std::string& trace, const std::string& name,
+                           double* begin, double* end) {
+        size_t pos = trace.find("\"name\":\"" + name + "\"");
+        ASSERT_NE(std::string::npos, pos);
+        double dur;
+        ASSERT_EQ(1, sscanf(trace.c_str() + trace.find("\"ts\":", pos) + 5,
+                            "%lf", begin));
+        ASSERT_EQ(1, sscanf(trace.c_str() + trace.find("\"dur\":", pos) + 6,
+                            "%lf", &dur));
+        *end = *begin + dur;
+    }
+};
+
+}  // namespace
+
+TEST_F(TraceTest, RecordsNestedSpans) {
+    {
+        Span outer("outer", "test");
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        Span inner("inner", "test");
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::string trace = dump();
+    EXPECT_EQ(0u, trace.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["));
+    EXPECT_EQ(2u, count(trace, "\"ph\":\"X\""));
+    EXPECT_EQ(2u, count(trace, "\"cat\":\"test\""));
+
+    double outer_begin, outer_end, inner_begin, inner_end;
+    span_times(trace, "outer", &outer_begin, &outer_end);
+    span_times(trace, "inner", &inner_begin, &inner_end);
+    EXPECT_LT(outer_begin, inner_begin);
+    EXPECT_LE(inner_end, outer_end);
+    EXPECT_GE(outer_end - outer_begin, 2000.0);
+}
+
+TEST_F(TraceTest, SkipsSpansWhileStopped) {
+    Trace::stop();
+    { Span span("dropped"); }
+    Trace::start(Trace::Options());
+    Span ended("ended");
+    ended.end();
+    ended.end();
+    std::string trace = dump();
+    EXPECT_EQ(std::string::npos, trace.find("dropped"));
+    EXPECT_EQ(1u, count(trace, "\"name\":\"ended\""));
+}
+
+TEST_F(TraceTest, KeepsLatestSpansPerThread) {
+    Trace::Options opts;
+    opts.buffer_events = 16;
+    Trace::start(opts);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([t] {
+            for (int i = 0; i < (t == 0 ? 100 : 10); i++) {
+                Span span(t == 0 ? "busy" : "quiet");
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+
+    std::string trace = dump();
+    // one slot is always left for the span being written
+    EXPECT_EQ(15u, count(trace, "\"name\":\"busy\""));
+    EXPECT_EQ(30u, count(trace, "\"name\":\"quiet\""));
+}
+
+TEST_F(TraceTest, ReusesBuffersOfExitedThreads) {
+    Trace::Options opts;
+    opts.buffer_events = 16;
+    opts.exited_buffers = 2;
+    Trace::start(opts);
+    // a dump lets every buffer of an exited thread be reused
+    size_t before = count(dump(), "thread_name");
+
+    for (int t = 0; t < 10; t++) {
+        std::thread([] { Span span("dumped"); }).join();
+        EXPECT_NE(std::string::npos, dump().find("\"name\":\"dumped\""));
+    }
+    EXPECT_LE(count(dump(), "thread_name"), before + 1);
+
+    // without dumps, at most exited_buffers are kept
+    for (int t = 0; t < 10; t++) {
+        std::thread([] { Span span("undumped"); }).join();
+    }
+    std::string trace = dump();
+    EXPECT_LE(count(trace, "thread_name"), before + 3);
+    EXPECT_LE(2u, count(trace, "\"name\":\"undumped\""));
+}
+
+TEST_F(TraceTest, TracesProxyPhases) {
+    ::testing::NiceMock<MockCollector> mockee;
+    std::vector<Metric> types{mockee.fake_metric};
+    ON_CALL(mockee, get_metric_types(_)).WillByDefault(Return(types));
+    Plugin::Proxy::CollectorImpl proxy(&mockee);
+
+    rpc::MetricsArg arg;
+    *arg.add_metrics() = *mockee.fake_metric.get_rpc_metric_ptr();
+    rpc::MetricsReply reply;
+    ASSERT_TRUE(proxy.CollectMetrics(nullptr, &arg, &reply).ok());
+
+    std::string trace = dump();
+    double call_begin, call_end, begin, end;
+    span_times(trace, "CollectMetrics", &call_begin, &call_end);
+    for (const char* phase : {"wrap", "collect_metrics", "marshal"}) {
+        span_times(trace, phase, &begin, &end);
+        EXPECT_LE(call_begin, begin) << phase;
+        EXPECT_LE(end, call_end) << phase;
+    }
+    EXPECT_NE(std::string::npos, trace.find("\"cat\":\"plugin\""));
+}
+
+TEST_F(TraceTest, DumpsOnSignal) {
+    char tmpl[] = "/tmp/trace_test.XXXXXX";
+    close(mkstemp(tmpl));
+    unlink(tmpl);
+    Trace::Options opts;
+    opts.path = tmpl;
+    Trace::start(opts);
+    { Span span("before_signal"); }
+
+    raise(SIGUSR2);
+    std::string trace;
+    for (int i = 0; i < 200 && trace.empty(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::ifstream in(tmpl);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        trace = ss.str();
+    }
+    unlink(tmpl);
+    EXPECT_NE(std::string::npos, trace.find("before_signal"));
+
+    // nothing left to dump at exit
+    Trace::start(Trace::Options());
+}
@@ -0,0 +1,87 @@
+/*
+http://www.apache.org/licenses/LICENSE-2.0.txt
+Copyright 2016 Intel Corporation
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+#include "snap/metric.h"
+#include "snap/processor/windows.h"
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+using std::chrono::seconds;
+using std::chrono::system_clock;
+using Plugin::Metric;
+using Plugin::Windows;
+
+namespace {
+
+const int64_t kWindow = 10 * 1000000000LL;
+
+// Sums the points of a window.
+struct Sum {
+    double total;
+    void clear() { total = 0; }
+};
+
+Metric point(const std::string& name, int sec) {
+    Metric met({{"intel", "", ""}, {name, "", ""}}, "", "");
+    met.set_timestamp(system_clock::time_point(seconds(sec)));
+    return met;
+}
+
+}  // namespace
+
+TEST(WindowsTest, ClosesOnLaterPointAndDropsLatePoints) {
+    Windows<Sum> windows(kWindow, Sum{0});
+    std::vector<std::pair<int64_t, double>> closed;
+    auto close = [&](const Windows<Sum>::Window& w) {
+        closed.emplace_back(w.start, w.acc.total);
+    };
+
+    for (int sec : {1, 4, -3, 12, 8}) {
+        Metric met = point("load", sec);
+        Sum* sum = windows.add(1, *met.get_rpc_metric_ptr(), close);
+        if (sum != nullptr) sum->total += sec;
+    }
+
+    // -3 and 8 belong to windows before the series' current one
+    ASSERT_EQ(1u, closed.size());
+    EXPECT_EQ(0, closed[0].first);
+    EXPECT_EQ(5, closed[0].second);
+    EXPECT_EQ(2u, windows.late());
+    EXPECT_EQ(1u, windows.size());
+}
+
+TEST(WindowsTest, CloseUntilForgetsQuietSeries) {
+    Windows<Sum> windows(kWindow, Sum{0});
+    std::vector<std::string> closed;
+    auto close = [&](const Windows<Sum>::Window& w) {
+        closed.push_back(w.tmpl.namespace_(1).value());
+    };
+
+    Metric a = point("a", 1);
+    Metric b = point("b", 15);
+    windows.add(1, *a.get_rpc_metric_ptr(), close)->total = 1;
+    windows.add(2, *b.get_rpc_metric_ptr(), close)->total = 1;
+
+    windows.close_until(kWindow, close);
+    ASSERT_EQ(1u, closed.size());
+    EXPECT_EQ("a", closed[0]);
+    EXPECT_EQ(1u, windows.size());
+
+    // a's window is closed, so its points are late now
+    EXPECT_EQ(nullptr, windows.add(1, *a.get_rpc_metric_ptr(), close));
+    EXPECT_EQ(1u, windows.late());
+}